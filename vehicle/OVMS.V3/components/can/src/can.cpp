@@ -48,6 +48,9 @@ static const char *TAG = "can";
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "metrics_standard.h"
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+#include <esp_timer.h>
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
 
 can MyCan __attribute__ ((init_priority (4510)));
 
@@ -267,13 +270,16 @@ void can_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
     writer->printf("Wdg Timer: %20d sec(s)\n",monotonictime-sbus->m_watchdog_timer);
     }
   writer->printf("Err flags: 0x%08x\n",sbus->m_status.error_flags);
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  MyCan.LatencyStatus(writer);
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
   }
 
 void can_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
-  for (int k=1;k<5;k++)
+  for (int k=1;k<=CAN_MAXBUSES;k++)
     {
-    static const char* name[4] = {"can1", "can2", "can3", "can4"};
+    static const char* name[CAN_MAXBUSES] = {"can1", "can2", "can3", "can4", "can5"};
     canbus* sbus = (canbus*)MyPcpApp.FindDeviceByName(name[k-1]);
     if (sbus != NULL)
       {
@@ -298,6 +304,9 @@ void can_clearstatus(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int ar
     }
 
   sbus->ClearStatus();
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  MyCan.LatencyReset();
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
   writer->puts("Status cleared");
   }
 
@@ -645,6 +654,7 @@ uint32_t can::AddPlayer(canplay* player, int filterc, const char* const* filterv
   OvmsMutexLock lock(&m_playermap_mutex);
   uint32_t id = m_player_id++;
   m_playermap[id] = player;
+  player->Start();
 
   return id;
   }
@@ -709,6 +719,12 @@ static void CAN_rxtask(void *pvParameters)
     {
     if (xQueueReceive(me->m_rxqueue,&msg, (portTickType)portMAX_DELAY)==pdTRUE)
       {
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      uint32_t qlen = uxQueueMessagesWaiting(me->m_rxqueue) + 1;
+      if (qlen > me->m_rxqueue_hwm)
+        me->m_rxqueue_hwm = qlen;
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      OVMS_QUEUE_RECEIVED(me->m_rxstats, me->m_rxqueue);
       switch(msg.type)
         {
         case CAN_frame:
@@ -753,6 +769,8 @@ can::can()
 
   m_logger_id = 1;
   m_player_id = 1;
+  m_loggermap_mutex.SetName("can.loggermap");
+  m_playermap_mutex.SetName("can.playermap");
 
   MyConfig.RegisterParam("can", "CAN Configuration", true, true);
 
@@ -760,9 +778,9 @@ can::can()
 
   for (int k=0;k<CAN_MAXBUSES;k++) m_buslist[k] = NULL;
 
-  for (int k=1;k<5;k++)
+  for (int k=1;k<=CAN_MAXBUSES;k++)
     {
-    static const char* name[4] = {"can1", "can2", "can3", "can4"};
+    static const char* name[CAN_MAXBUSES] = {"can1", "can2", "can3", "can4", "can5"};
     OvmsCommand* cmd_canx = cmd_can->RegisterCommand(name[k-1],"CANx framework");
     OvmsCommand* cmd_canstart = cmd_canx->RegisterCommand("start","CAN start framework");
     cmd_canstart->RegisterCommand("listen","Start CAN bus in listen mode",can_start,"<baud> [<dbc>]", 1, 2);
@@ -786,7 +804,15 @@ can::can()
   cmd_can->RegisterCommand("list", "List CAN buses", can_list);
 
   m_rxqueue = xQueueCreate(CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE,sizeof(CAN_queue_msg_t));
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_rxstats = OvmsContention::RegisterQueue(m_rxqueue, "can.rx");
+#endif
   xTaskCreatePinnedToCore(CAN_rxtask, "OVMS CanRx", 2*2048, (void*)this, 23, &m_rxtask, CORE(0));
+
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  LatencyReset();
+  MyEvents.RegisterEvent(TAG, "ticker.10", std::bind(&can::LatencyTicker, this, std::placeholders::_1, std::placeholders::_2));
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
   }
 
 can::~can()
@@ -814,35 +840,131 @@ canbus* can::GetBus(int busnumber)
 
 void can::IncomingFrame(CAN_frame_t* p_frame)
   {
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  LatencyRecord(CAN_Latency_RxQueue, p_frame);
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+
   p_frame->origin->m_status.packets_rx++;
   p_frame->origin->m_watchdog_timer = monotonictime;
 
   ExecuteCallbacks(p_frame, false, true /*ignored*/);
   p_frame->origin->LogFrame(CAN_LogFrame_RX, p_frame);
   NotifyListeners(p_frame, false);
+
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  LatencyRecord(CAN_Latency_CanTask, p_frame);
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
   }
 
-void can::RegisterListener(QueueHandle_t queue, bool txfeedback)
+void can::RegisterListener(QueueHandle_t queue, bool txfeedback, const char* name)
   {
-  m_listeners[queue] = txfeedback;
+  CanListener_t& listener = m_listeners[queue];
+  listener.txfeedback = txfeedback;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  if (!listener.stats)
+    listener.stats = OvmsContention::RegisterQueue(queue, name ? name : "can.listener");
+#endif
   }
 
 void can::DeregisterListener(QueueHandle_t queue)
   {
   auto it = m_listeners.find(queue);
   if (it != m_listeners.end())
+    {
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContention::DeregisterQueue(it->second.stats);
+#endif
     m_listeners.erase(it);
+    }
   }
 
 void can::NotifyListeners(const CAN_frame_t* frame, bool tx)
   {
   for (CanListenerMap_t::iterator it = m_listeners.begin(); it != m_listeners.end(); ++it)
     {
-    if (!tx || (tx && it->second))
-      xQueueSend(it->first,frame,0);
+    if (!tx || (tx && it->second.txfeedback))
+      {
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      uint32_t qlen = uxQueueMessagesWaiting(it->first) + 1;
+      if (qlen > m_listener_hwm)
+        m_listener_hwm = qlen;
+      if (OVMS_QUEUE_SEND(it->second.stats,it->first,frame,0) != pdTRUE)
+        m_listener_drops++;
+#else
+      OVMS_QUEUE_SEND(it->second.stats,it->first,frame,0);
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      }
     }
   }
 
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+
+/**
+ * LatencyRecord: add frame latency at pipeline stage
+ *  Each stage is recorded by a single task, so we don't need to lock here.
+ */
+void can::LatencyRecord(CAN_latency_stage_t stage, const CAN_frame_t* frame)
+  {
+  if (frame->rxtime == 0)
+    return;
+  uint32_t latency = (uint32_t)esp_timer_get_time() - frame->rxtime;
+  CAN_latency_stat_t* stat = &m_latency[stage];
+  stat->count++;
+  stat->sum += latency;
+  if (latency > stat->max)
+    stat->max = latency;
+  int bucket = 0;
+  for (uint32_t limit = 16; bucket < CAN_LATENCY_BUCKETS-1 && latency >= limit; limit <<= 2)
+    bucket++;
+  stat->hist[bucket]++;
+  }
+
+void can::LatencyReset()
+  {
+  memset(m_latency, 0, sizeof(m_latency));
+  m_rxqueue_hwm = 0;
+  m_listener_hwm = 0;
+  m_listener_drops = 0;
+  }
+
+void can::LatencyStatus(OvmsWriter* writer)
+  {
+  static const char* stagename[CAN_Latency_Stages] = { "RX queue", "CAN task", "Veh queue", "Vehicle" };
+  writer->printf("\nRX pipeline latency (all buses, us from driver reception):\n"
+    "  %-10s %9s %7s %7s %7s %7s %7s %7s %7s %7s %7s %7s\n",
+    "Stage", "Count", "Avg", "Max", "<16u", "<64u", "<256u", "<1m", "<4m", "<16m", "<65m", ">65m");
+  for (int i = 0; i < CAN_Latency_Stages; i++)
+    {
+    CAN_latency_stat_t* stat = &m_latency[i];
+    writer->printf("  %-10s %9u %7u %7u", stagename[i], stat->count,
+      stat->count ? (uint32_t)(stat->sum / stat->count) : 0, stat->max);
+    for (int b = 0; b < CAN_LATENCY_BUCKETS; b++)
+      writer->printf(" %7u", stat->hist[b]);
+    writer->puts("");
+    }
+  writer->printf("RX queue max: %u/%u, listener queues max: %u, listener drops: %u\n",
+    m_rxqueue_hwm, CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE, m_listener_hwm, m_listener_drops);
+  }
+
+void can::LatencyTicker(std::string event, void* data)
+  {
+  static OvmsMetricInt* m_lat_avg = MyMetrics.InitInt("m.can.rx.lat.avg", SM_STALE_MID, 0);
+  static OvmsMetricInt* m_lat_max = MyMetrics.InitInt("m.can.rx.lat.max", SM_STALE_MID, 0);
+  static OvmsMetricInt* m_queue_hwm = MyMetrics.InitInt("m.can.rx.queue.hwm", SM_STALE_MID, 0);
+  static OvmsMetricInt* m_drops = MyMetrics.InitInt("m.can.rx.drops", SM_STALE_MID, 0);
+
+  // end to end latency = vehicle stage, or CAN task stage if no vehicle is loaded:
+  CAN_latency_stat_t* stat = &m_latency[CAN_Latency_Vehicle];
+  if (stat->count == 0)
+    stat = &m_latency[CAN_Latency_CanTask];
+  m_lat_avg->SetValue(stat->count ? (int)(stat->sum / stat->count) : 0);
+  m_lat_max->SetValue(stat->max);
+  m_queue_hwm->SetValue(m_rxqueue_hwm);
+  m_drops->SetValue(m_listener_drops);
+  }
+
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+
 void can::RegisterCallback(const char* caller, CanFrameCallback callback, bool txfeedback)
   {
   if (txfeedback)
@@ -888,6 +1010,9 @@ canbus::canbus(const char* name)
   m_mode = CAN_MODE_OFF;
   m_speed = CAN_SPEED_1000KBPS;
   m_dbcfile = NULL;
+#ifdef CONFIG_OVMS_DEV_TRACER
+  m_trace_isr = MyTracer.Intern((std::string("isr.") + name).c_str());
+#endif
   ClearStatus();
 
   using std::placeholders::_1;
@@ -45,6 +45,7 @@
 #include "pcp.h"
 #include <esp_err.h>
 #include "ovms_events.h"
+#include "ovms_tracer.h"
 
 ////////////////////////////////////////////////////////////////////////
 // Constant ESP_QUEUED to indicate a 'queued' response
@@ -134,6 +135,9 @@ struct CAN_frame_t
     uint32_t  u32[2];                   // Payload u32 access (Att: little endian!)
     uint64_t  u64;                      // Payload u64 access (Att: little endian!)
     } data;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  uint32_t    rxtime;                   // Driver reception time [us, esp_timer], 0 = unknown
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
 
   esp_err_t Write(canbus* bus=NULL, TickType_t maxqueuewait=0);  // bus: NULL=origin
   };
@@ -263,6 +267,7 @@ extern const char* GetCanLogTypeName(CAN_log_type_t type);
 ////////////////////////////////////////////////////////////////////////
 
 class canlog;
+class OvmsWriter;
 class canplay;
 class dbcfile;
 
@@ -312,6 +317,9 @@ class canbus : public pcp, public InternalRamAllocated
     uint32_t m_watchdog_timer;
     QueueHandle_t m_txqueue;
     int m_busnumber;
+#ifdef CONFIG_OVMS_DEV_TRACER
+    uint16_t m_trace_isr;           // tracer name id "isr.<bus>"
+#endif
 
   protected:
     dbcfile *m_dbcfile;
@@ -321,7 +329,14 @@ class canbus : public pcp, public InternalRamAllocated
 // can - the CAN system controller
 ////////////////////////////////////////////////////////////////////////
 
-typedef std::map<QueueHandle_t, bool> CanListenerMap_t;
+typedef struct
+  {
+  bool txfeedback;                    // also send transmitted frames
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  OvmsContentionStats* stats;
+#endif
+  } CanListener_t;
+typedef std::map<QueueHandle_t, CanListener_t> CanListenerMap_t;
 
 
 class CanFrameCallbackEntry
@@ -339,6 +354,28 @@ class CanFrameCallbackEntry
   };
 typedef std::list<CanFrameCallbackEntry*> CanFrameCallbackList_t;
 
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+// RX pipeline stages, latency is measured from the driver reception time:
+typedef enum
+  {
+  CAN_Latency_RxQueue = 0,    // CAN task got frame from driver (via m_rxqueue)
+  CAN_Latency_CanTask,        // CAN task done (callbacks, logging, listener queues)
+  CAN_Latency_VehQueue,       // vehicle task got frame from listener queue
+  CAN_Latency_Vehicle,        // vehicle task done (poller, IncomingFrameCanN)
+  CAN_Latency_Stages
+  } CAN_latency_stage_t;
+
+#define CAN_LATENCY_BUCKETS 8 // <16us, <64us, <256us, <1ms, <4ms, <16ms, <65ms, >=65ms
+
+typedef struct
+  {
+  uint32_t count;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t hist[CAN_LATENCY_BUCKETS];
+  } CAN_latency_stat_t;
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+
 class can : public InternalRamAllocated
   {
   public:
@@ -350,9 +387,12 @@ class can : public InternalRamAllocated
 
   public:
     QueueHandle_t m_rxqueue;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats* m_rxstats;   // receiver side (senders are ISRs)
+#endif
 
   public:
-    void RegisterListener(QueueHandle_t queue, bool txfeedback=false);
+    void RegisterListener(QueueHandle_t queue, bool txfeedback=false, const char* name=NULL);
     void DeregisterListener(QueueHandle_t queue);
     void NotifyListeners(const CAN_frame_t* frame, bool tx);
 
@@ -383,6 +423,20 @@ class can : public InternalRamAllocated
   public:
     canbus* GetBus(int busnumber);
 
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  public:
+    void LatencyRecord(CAN_latency_stage_t stage, const CAN_frame_t* frame);
+    void LatencyReset();
+    void LatencyStatus(OvmsWriter* writer);
+    void LatencyTicker(std::string event, void* data);
+
+  public:
+    CAN_latency_stat_t m_latency[CAN_Latency_Stages];
+    uint32_t m_rxqueue_hwm;           // driver → CAN task queue high water mark
+    uint32_t m_listener_hwm;          // listener queues high water mark
+    uint32_t m_listener_drops;        // frames dropped on full listener queues
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+
   public:
     typedef std::map<uint32_t, canlog*> canlog_map_t;
     canlog_map_t m_loggermap;
@@ -159,6 +159,11 @@ size_t canformat::Stuff(uint8_t *buffer, size_t len)
   return consumed;
   }
 
+size_t canformat::GetPutBufferUsed()
+  {
+  return m_buf.UsedSpace();
+  }
+
 canformat::canformat_serve_mode_t canformat::GetServeMode()
   {
   return m_servemode;
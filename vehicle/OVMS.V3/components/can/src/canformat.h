@@ -72,6 +72,7 @@ class canformat
     void SetPutCallback(canformat_put_write_fn callback);
     virtual size_t Serve(uint8_t *buffer, size_t len, void* userdata=NULL);
     virtual size_t Stuff(uint8_t *buffer, size_t len);
+    size_t GetPutBufferUsed();
 
   protected:
     canformat_put_write_fn m_putcallback_fn;
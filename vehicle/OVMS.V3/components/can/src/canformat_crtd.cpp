@@ -173,6 +173,20 @@ size_t canformat_crtd::put(CAN_log_message_t* message, uint8_t *buffer, size_t l
     // We look for something like
     // 1524311386.811100 1R11 100 01 02 03
     if (!isdigit(b[0])) return consumed;    // Discard invalid line
+    message->timestamp.tv_sec = strtol(b,NULL,10);
+    for (;((*b != 0)&&(*b != ' ')&&(*b != '.'));b++) {}
+    if (*b == '.')
+      {
+      // Fractional part, scaled to microseconds:
+      long usec = 0;
+      int digits = 0;
+      for (b++;isdigit(*b);b++)
+        {
+        if (digits++ < 6) usec = usec*10 + (*b - '0');
+        }
+      for (;digits<6;digits++) usec *= 10;
+      message->timestamp.tv_usec = usec;
+      }
     for (;((*b != 0)&&(*b != ' '));b++) {}
     if (*b == 0) return consumed;           // Discard invalid line
     b++;
@@ -29,6 +29,7 @@ static const char *TAG = "canformat-gvret";
 
 #include <errno.h>
 #include <endian.h>
+#include <sys/param.h>
 #include "pcp.h"
 #include "canformat_gvret.h"
 
@@ -125,7 +126,7 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
   else
     {
     std::string line = m_buf.ReadLine();
-    char *b = strdup(line.c_str());
+    char *b = (char*)line.c_str();
 
     // We look for something like
     // 1000 - 100 S 0 4 01 02 03 04
@@ -133,9 +134,9 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
 
     message->type = CAN_LogFrame_RX;
 
-    uint32_t timestamp = strtol(b,&b,10);
-    message->timestamp.tv_sec = timestamp % 1000000;
-    message->timestamp.tv_usec = timestamp / 1000000;
+    uint32_t timestamp = strtoul(b,&b,10);
+    message->timestamp.tv_sec = timestamp / 1000000;
+    message->timestamp.tv_usec = timestamp % 1000000;
 
     b += 2; // Skip the '-'
 
@@ -151,7 +152,6 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
     else
       {
       // Bad frame type - discard
-      free(b);
       return consumed;
       }
 
@@ -163,7 +163,6 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
     if (message->frame.FIR.B.DLC > 8)
       {
       // Bad frame length - discard
-      free(b);
       return consumed;
       }
 
@@ -172,9 +171,8 @@ size_t canformat_gvret_ascii::put(CAN_log_message_t* message, uint8_t *buffer, s
       message->frame.data.u8[x] = strtol(b,&b,16);
       }
 
-    message->origin = MyCan.GetBus(busnumber-'0');
+    message->origin = MyCan.GetBus(busnumber);
 
-    free(b);
     return consumed;
     }
   }
@@ -203,7 +201,7 @@ std::string canformat_gvret_binary::get(CAN_log_message_t* message)
 
   frame.startbyte = GVRET_START_BYTE;
   frame.command = BUILD_CAN_FRAME;
-  frame.microseconds = (uint32_t)((message->timestamp.tv_sec * 1000000) + message->timestamp.tv_usec);
+  frame.microseconds = (uint32_t)message->timestamp.tv_sec * 1000000 + (uint32_t)message->timestamp.tv_usec;
   frame.id = (uint32_t)message->frame.MsgID |
               ((message->frame.FIR.B.FF == CAN_frame_std)? 0 : 0x80000000);
   frame.lenbus = message->frame.FIR.B.DLC + (busnumber<<4);
@@ -241,39 +239,62 @@ size_t canformat_gvret_binary::put(CAN_log_message_t* message, uint8_t *buffer,
     switch (m.command)
       {
       case BUILD_CAN_FRAME:
-        if (m_buf.UsedSpace() >= 8)
+        if (m_putcallback_fn == NULL)
           {
+          // No host to answer, so this is a GVRET device stream or a recorded
+          // file: frames have the gvret_binary_frame_t layout written by get(),
+          // the data is followed by a (zero) checksum byte
+          gvret_binary_frame_t f;
+          if (m_buf.UsedSpace() >= 11)
+            {
+            m_buf.Peek(11,(uint8_t*)&f);
+            size_t flen = 12 + MIN(f.lenbus & 0x0f, 8);
+            if (m_buf.UsedSpace() >= flen)
+              {
+              m_buf.Pop(flen,(uint8_t*)&f);
+              CAN_frame_t* msg = &message->frame;
+              message->type = CAN_LogFrame_RX;
+              message->timestamp.tv_sec = f.microseconds / 1000000;
+              message->timestamp.tv_usec = f.microseconds % 1000000;
+              message->origin = msg->origin = MyCan.GetBus(f.lenbus >> 4);
+              if (f.id & 0x80000000)
+                {
+                msg->MsgID = f.id & 0x7fffffff;
+                msg->FIR.B.FF = CAN_frame_ext;
+                }
+              else
+                {
+                msg->MsgID = f.id;
+                msg->FIR.B.FF = CAN_frame_std;
+                }
+              msg->FIR.B.DLC = flen - 12;
+              memcpy(&msg->data, f.data, msg->FIR.B.DLC);
+              }
+            }
+          }
+        else if (m_buf.UsedSpace() >= 8)
+          {
+          // Host command to transmit / simulate a frame (TCP server)
           m_buf.Peek(8,(uint8_t*)&m);
           if (m_buf.UsedSpace() >= 8 + m.body.build_can_frame.length)
             {
             m_buf.Pop(8 + m.body.build_can_frame.length,(uint8_t*)&m);
-            CAN_frame_t msg;
-            memset(&msg,0,sizeof(msg));
-            msg.origin = MyCan.GetBus(m.body.build_can_frame.bus);
-            if (m.body.build_can_frame.id & 0x8000000)
+            // We have a frame to be transmitted / simulated by Serve() or a player
+            CAN_frame_t* msg = &message->frame;
+            message->type = CAN_LogFrame_RX;
+            msg->origin = MyCan.GetBus(m.body.build_can_frame.bus);
+            if (m.body.build_can_frame.id & 0x80000000)
               {
-              msg.MsgID = m.body.build_can_frame.id & 0x7fffffff;
-              msg.FIR.B.FF = CAN_frame_ext;
+              msg->MsgID = m.body.build_can_frame.id & 0x7fffffff;
+              msg->FIR.B.FF = CAN_frame_ext;
               }
             else
               {
-              msg.MsgID = m.body.build_can_frame.id;
-              msg.FIR.B.FF = CAN_frame_std;
-              }
-            msg.FIR.B.DLC = m.body.build_can_frame.length;
-            memcpy(&msg.data, &m.body.build_can_frame.data, m.body.build_can_frame.length);
-            // We have a frame to be transmitted / simulated
-            switch (m_servemode)
-              {
-              case Transmit:
-                if (msg.origin) msg.origin->Write(&msg);
-                break;
-              case Simulate:
-                if (msg.origin) MyCan.IncomingFrame(&msg);
-                break;
-              default:
-                break;
+              msg->MsgID = m.body.build_can_frame.id;
+              msg->FIR.B.FF = CAN_frame_std;
               }
+            msg->FIR.B.DLC = MIN(m.body.build_can_frame.length, 8);
+            memcpy(&msg->data, &m.body.build_can_frame.data, msg->FIR.B.DLC);
             }
           }
         break;
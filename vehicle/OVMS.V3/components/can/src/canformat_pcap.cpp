@@ -29,6 +29,7 @@ static const char *TAG = "canformat-pcap";
 
 #include <errno.h>
 #include <endian.h>
+#include <sys/param.h>
 #include "pcp.h"
 #include "canformat_pcap.h"
 
@@ -150,12 +151,14 @@ size_t canformat_pcap::put(CAN_log_message_t* message, uint8_t *buffer, size_t l
     return consumed;
     }
   message->type = CAN_LogFrame_RX;
+  message->timestamp.tv_sec = be32toh(m.record.hdr.ts_sec);
+  message->timestamp.tv_usec = be32toh(m.record.hdr.ts_usec);
   message->frame.FIR.B.RTR = (idf & CANFORMAT_PCAP_FL_RTR)?CAN_RTR:CAN_no_RTR;
   message->frame.FIR.B.FF = (idf & CANFORMAT_PCAP_FL_EXT)?CAN_frame_ext:CAN_frame_std;
   message->frame.MsgID = idf & CANFORMAT_PCAP_FL_MASK;
   message->origin = MyCan.GetBus(0);
-  message->frame.FIR.B.DLC = m.record.phdr.len;
-  memcpy(message->frame.data.u8, m.record.data, m.record.phdr.len);
+  message->frame.FIR.B.DLC = MIN(m.record.phdr.len, 8);
+  memcpy(message->frame.data.u8, m.record.data, message->frame.FIR.B.DLC);
 
   return consumed;
   }
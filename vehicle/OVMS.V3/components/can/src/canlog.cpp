@@ -173,6 +173,9 @@ canlog::canlog(const char* type, std::string format, canformat::canformat_serve_
 
   int queuesize = MyConfig.GetParamValueInt("can", "log.queuesize",100);
   m_queue = xQueueCreate(queuesize, sizeof(CAN_log_message_t));
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_queue_stats = OvmsContention::RegisterQueue(m_queue, "canlog");
+#endif
   xTaskCreatePinnedToCore(RxTask, "OVMS CanLog", 4096, (void*)this, 10, &m_task, CORE(1));
   }
 
@@ -186,6 +189,9 @@ canlog::~canlog()
 
   if (m_queue)
     {
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContention::DeregisterQueue(m_queue_stats);
+#endif
     CAN_log_message_t msg;
     while (xQueueReceive(m_queue, &msg, 0) == pdTRUE)
       {
@@ -332,7 +338,7 @@ void canlog::LogFrame(canbus* bus, CAN_log_type_t type, const CAN_frame_t* frame
     memcpy(&msg.frame,frame,sizeof(CAN_frame_t));
     msg.frame.origin = bus;
     m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
+    if (OVMS_QUEUE_SEND(m_queue_stats, m_queue, &msg, 0) != pdTRUE) m_dropcount++;
     }
   else
     {
@@ -352,7 +358,7 @@ void canlog::LogStatus(canbus* bus, CAN_log_type_t type, const CAN_status_t* sta
     msg.origin = bus;
     memcpy(&msg.status,status,sizeof(CAN_status_t));
     m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
+    if (OVMS_QUEUE_SEND(m_queue_stats, m_queue, &msg, 0) != pdTRUE) m_dropcount++;
     }
   else
     {
@@ -372,7 +378,7 @@ void canlog::LogInfo(canbus* bus, CAN_log_type_t type, const char* text)
     msg.origin = bus;
     msg.text = strdup(text);
     m_msgcount++;
-    if (xQueueSend(m_queue, &msg, 0) != pdTRUE) m_dropcount++;
+    if (OVMS_QUEUE_SEND(m_queue_stats, m_queue, &msg, 0) != pdTRUE) m_dropcount++;
     }
   else
     {
@@ -93,6 +93,9 @@ class canlog : public InternalRamAllocated
   public:
     TaskHandle_t        m_task;
     QueueHandle_t       m_queue;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats* m_queue_stats;
+#endif
     uint32_t            m_msgcount;
     uint32_t            m_dropcount;
     uint32_t            m_filtercount;
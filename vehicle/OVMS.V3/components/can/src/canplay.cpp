@@ -35,6 +35,7 @@ static const char *TAG = "canplay";
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <esp_timer.h>
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "ovms_events.h"
@@ -160,6 +161,43 @@ void can_play_speed(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
     }
   }
 
+void can_play_loop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyCan.HasPlayer())
+    {
+    writer->puts("CAN playing inactive");
+    return;
+    }
+
+  bool loop = (strcmp(cmd->GetName(), "on") == 0);
+  OvmsMutexLock lock(&MyCan.m_playermap_mutex);
+  for (can::canplay_map_t::iterator it=MyCan.m_playermap.begin(); it!=MyCan.m_playermap.end(); ++it)
+    {
+    if (argc>0 && it->first != (uint32_t)atoi(argv[0]))
+      continue;
+    it->second->SetLoop(loop);
+    writer->printf("CAN player #%d: loop %s\n", it->first, loop ? "on" : "off");
+    }
+  }
+
+void can_play_seek(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyCan.HasPlayer())
+    {
+    writer->puts("CAN playing inactive");
+    return;
+    }
+
+  OvmsMutexLock lock(&MyCan.m_playermap_mutex);
+  for (can::canplay_map_t::iterator it=MyCan.m_playermap.begin(); it!=MyCan.m_playermap.end(); ++it)
+    {
+    if (argc>1 && it->first != (uint32_t)atoi(argv[1]))
+      continue;
+    it->second->Seek(atoi(argv[0]));
+    writer->printf("CAN player #%d: seeking to %ds\n", it->first, atoi(argv[0]));
+    }
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // CAN Play System initialisation
 ////////////////////////////////////////////////////////////////////////
@@ -182,7 +220,13 @@ OvmsCanPlayInit::OvmsCanPlayInit()
 
   OvmsCommand* cmd_canplay = cmd_can->RegisterCommand("play", "CAN play framework");
   cmd_canplay->RegisterCommand("stop", "Stop playing", can_play_stop,"[<id>]",0,1);
-  cmd_canplay->RegisterCommand("speed", "Set playback speed", can_play_speed,"<speed> [<id>]",1,2);
+  cmd_canplay->RegisterCommand("speed", "Set playback speed", can_play_speed,
+    "<speed> [<id>]\n"
+    "<speed>: 1 = real time, n = n times faster, 0 = maximum rate",1,2);
+  OvmsCommand* cmd_loop = cmd_canplay->RegisterCommand("loop", "Restart playing at end of trace");
+  cmd_loop->RegisterCommand("on", "Loop playing", can_play_loop,"[<id>]",0,1);
+  cmd_loop->RegisterCommand("off", "Stop playing at end of trace", can_play_loop,"[<id>]",0,1);
+  cmd_canplay->RegisterCommand("seek", "Seek to trace position", can_play_seek,"<seconds> [<id>]",1,2);
   cmd_canplay->RegisterCommand("status", "Playing status", can_play_status,"[<id>]",0,1);
   cmd_canplay->RegisterCommand("list", "Playing list", can_play_list);
   cmd_canplay->RegisterCommand("start", "CAN play start framework");
@@ -199,19 +243,24 @@ canplay::canplay(const char* type, std::string format, canformat::canformat_serv
   m_formatter = MyCanFormatFactory.NewFormat(format.c_str());
   m_formatter->SetServeMode(mode);
   m_filter = NULL;
+  m_target = NULL;
   m_speed = 1;
+  m_loop = false;
 
+  m_task = NULL;
+  m_stop = false;
+  m_seek = -1;
+  m_position = 0;
   m_msgcount = 0;
-  xTaskCreatePinnedToCore(PlayTask, "OVMS CanPlay", 4096, (void*)this, 10, &m_task, CORE(1));
+  m_skipcount = 0;
+  m_loopcount = 0;
+  m_rate = 0;
+  m_avgrate = 0;
   }
 
 canplay::~canplay()
   {
-  if (m_task)
-    {
-    vTaskDelete(m_task);
-    m_task = NULL;
-    }
+  Stop();
 
   if (m_formatter)
     {
@@ -226,23 +275,190 @@ canplay::~canplay()
     }
   }
 
+void canplay::Start()
+  {
+  if (m_task) return;
+  m_stop = false;
+  xTaskCreatePinnedToCore(PlayTask, "OVMS CanPlay", 4096, (void*)this, 10, &m_task, CORE(1));
+  }
+
+void canplay::Stop()
+  {
+  // Note: sub classes need to Stop() in their destructor, as the task uses their InputMsg()
+  m_stop = true;
+  while (m_task)
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+
 void canplay::PlayTask(void *context)
   {
   canplay* me = (canplay*) context;
+  me->Play();
+  me->m_task = NULL;
+  vTaskDelete(NULL);
+  }
+
+void canplay::Play()
+  {
+  CAN_log_message_t msg;
+  int64_t tracebase = -1;       // timestamp of first trace frame [us]
+  int64_t anchor_pos = 0;       // trace position at anchor time [us]
+  int64_t anchor_time = 0;      // system time of anchor [us]
+  uint32_t anchor_speed = 0;
+  int64_t starttime = esp_timer_get_time();
+  int64_t ratetime = starttime;
+  uint32_t ratecount = 0, startcount = m_msgcount;
+
+  while (!m_stop)
+    {
+    // seek backwards => restart trace:
+    int32_t seek = m_seek;
+    if (seek >= 0 && (int64_t)seek * 1000000LL < m_position)
+      {
+      OvmsRecMutexLock lock(&m_inputmutex);
+      Rewind();
+      tracebase = -1;
+      m_position = 0;
+      }
 
-//  CAN_log_message_t msg;
-//  while (me->InputMsg(&msg))
-//    {
-//    vTaskDelay(pdMS_TO_TICKS(1000));
-//    }
+    m_inputmutex.Lock();
+    bool got = IsOpen() && InputMsg(&msg);
+    m_inputmutex.Unlock();
+    if (!got)
+      {
+      if (!IsOpen())
+        {
+        // i.e. SD card unmounted, wait for remount:
+        vTaskDelay(pdMS_TO_TICKS(100));
+        continue;
+        }
+      if (seek >= 0 && m_seek.compare_exchange_strong(seek, -1))
+        {
+        ESP_LOGW(TAG, "Play task: seek position beyond end of trace");
+        }
+      if (!m_loop)
+        break;
+      OvmsRecMutexLock lock(&m_inputmutex);
+      if (!Rewind())
+        break;
+      m_loopcount++;
+      tracebase = -1;
+      m_position = 0;
+      continue;
+      }
+
+    if (msg.type != CAN_LogFrame_RX || (m_filter && !m_filter->IsFiltered(&msg.frame)))
+      {
+      m_skipcount++;
+      continue;
+      }
 
-//  me->Close();
-  while(1)
+    // trace timing; frames without timestamp are played back to back:
+    int64_t ts = (int64_t)msg.timestamp.tv_sec * 1000000LL + msg.timestamp.tv_usec;
+    if (ts != 0)
+      {
+      if (tracebase < 0 || ts < tracebase)
+        {
+        tracebase = ts - m_position;
+        anchor_speed = 0;
+        }
+      m_position = ts - tracebase;
+      }
+
+    seek = m_seek;
+    if (seek >= 0)
+      {
+      if (m_position < (int64_t)seek * 1000000LL)
+        continue;
+      // a concurrent Seek() keeps its new position:
+      m_seek.compare_exchange_strong(seek, -1);
+      anchor_speed = 0;
+      }
+
+    // wait for frame time:
+    while (!m_stop)
+      {
+      uint32_t speed = m_speed;
+      int64_t now = esp_timer_get_time();
+      if (speed == 0 || speed != anchor_speed || now - anchor_time > 1000000LL + (m_position - anchor_pos) / speed)
+        {
+        // (re)start timing, also if we fell behind by more than a second:
+        anchor_pos = m_position;
+        anchor_time = now;
+        anchor_speed = speed;
+        break;
+        }
+      int64_t wait = anchor_time + (m_position - anchor_pos) / speed - now;
+      if (wait < portTICK_PERIOD_MS * 1000)
+        break;
+      vTaskDelay(pdMS_TO_TICKS(MIN(wait / 1000, 100)));
+      }
+
+    if (m_stop || !PlayFrame(&msg.frame))
+      continue;
+    m_msgcount++;
+
+    // rate statistics:
+    ratecount++;
+    int64_t now = esp_timer_get_time();
+    if (now - ratetime >= 1000000LL)
+      {
+      m_rate = ratecount * 1e6f / (now - ratetime);
+      m_avgrate = (m_msgcount - startcount) * 1e6f / (now - starttime);
+      ratecount = 0;
+      ratetime = now;
+      }
+    }
+
+  int64_t now = esp_timer_get_time();
+  if (now > starttime)
+    m_avgrate = (m_msgcount - startcount) * 1e6f / (now - starttime);
+  m_rate = 0;
+  ESP_LOGI(TAG, "Play task finished: %s", GetStats().c_str());
+  }
+
+bool canplay::PlayFrame(CAN_frame_t* frame)
+  {
+  if (m_target)
+    frame->origin = m_target;
+  if (frame->origin == NULL)
     {
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    m_skipcount++;
+    return false;
+    }
+
+  switch (m_formatter->GetServeMode())
+    {
+    case canformat::Simulate:
+      {
+      // feed the RX queue, so frames take the same path as from the CAN drivers:
+      CAN_queue_msg_t qmsg;
+      qmsg.type = CAN_frame;
+      qmsg.body.frame = *frame;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      qmsg.body.frame.rxtime = esp_timer_get_time();
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      while (xQueueSend(MyCan.m_rxqueue, &qmsg, pdMS_TO_TICKS(100)) != pdTRUE)
+        {
+        if (m_stop) return false;
+        }
+      return true;
+      }
+    case canformat::Transmit:
+      return (frame->origin->Write(frame, pdMS_TO_TICKS(100)) == ESP_OK);
+    default:
+      return false;
     }
   }
 
+void canplay::ResetFormatter()
+  {
+  canformat::canformat_serve_mode_t mode = m_formatter->GetServeMode();
+  delete m_formatter;
+  m_formatter = MyCanFormatFactory.NewFormat(m_format.c_str());
+  m_formatter->SetServeMode(mode);
+  }
+
 const char* canplay::GetType()
   {
   return m_type;
@@ -258,11 +474,39 @@ void canplay::SetSpeed(uint32_t speed)
   m_speed = speed;
   }
 
+void canplay::SetLoop(bool loop)
+  {
+  m_loop = loop;
+  }
+
+void canplay::Seek(uint32_t seconds)
+  {
+  m_seek = (int32_t)MIN(seconds, (uint32_t)INT32_MAX);
+  if (!m_task)
+    {
+    // finished, restart:
+    Start();
+    }
+  }
+
+void canplay::SetTarget(canbus* bus)
+  {
+  m_target = bus;
+  }
+
 bool canplay::InputMsg(CAN_log_message_t* msg)
   {
   return false;
   }
 
+bool canplay::Rewind()
+  {
+  OvmsRecMutexLock lock(&m_inputmutex);
+  Close();
+  ResetFormatter();
+  return Open();
+  }
+
 std::string canplay::GetInfo()
   {
   std::ostringstream buf;
@@ -273,7 +517,12 @@ std::string canplay::GetInfo()
     buf << "(" << m_formatter->GetServeModeName() << ")";
     }
 
-  buf << " Speed:" << m_speed << "x";
+  if (m_speed)
+    buf << " Speed:" << m_speed << "x";
+  else
+    buf << " Speed:max";
+  if (m_loop)
+    buf << " Loop:on";
 
   if (m_filter)
     {
@@ -291,7 +540,16 @@ std::string canplay::GetStats()
   {
   std::ostringstream buf;
 
-  buf << "total messages: " << m_msgcount;
+  buf << "total messages: " << m_msgcount
+      << ", skipped: " << m_skipcount
+      << ", loops: " << m_loopcount
+      << std::fixed << std::setprecision(1)
+      << ", position: " << (m_position / 1e6) << "s"
+      << ", rate: " << (m_task ? m_rate : m_avgrate) << " fps";
+  if (m_task)
+    buf << " (avg " << m_avgrate << ")";
+  else
+    buf << " (finished)";
 
   return buf.str();
   }
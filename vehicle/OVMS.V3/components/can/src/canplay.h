@@ -27,12 +27,19 @@
 #ifndef __CANPLAY_H__
 #define __CANPLAY_H__
 
+#include <atomic>
 #include "freertos/semphr.h"
 #include "can.h"
 #include "canformat.h"
+#include "ovms_mutex.h"
 
 /**
  * canplay is the general interface and base implementation for all can players.
+ *
+ * The play task reads frames via InputMsg() and injects them into the CAN RX
+ * queue (serve mode Simulate) or transmits them (Transmit), keeping the original
+ * inter-frame timing scaled by m_speed. Speed 0 plays as fast as the RX pipeline
+ * can take the frames, the rate is reported by GetStats().
  */
 class canplay : public InternalRamAllocated
   {
@@ -42,12 +49,22 @@ class canplay : public InternalRamAllocated
 
   public:
     static void PlayTask(void* context);
+    void Start();
+    void Stop();
+
+  protected:
+    void Play();
+    bool PlayFrame(CAN_frame_t* frame);
+    void ResetFormatter();
 
   public:
     const char* GetType();
     const char* GetFormat();
     virtual std::string GetStats();
     void SetSpeed(uint32_t speed);
+    void SetLoop(bool loop);
+    void Seek(uint32_t seconds);
+    void SetTarget(canbus* bus);
 
   public:
     // Methods expected to be implemented by sub-classes
@@ -56,6 +73,7 @@ class canplay : public InternalRamAllocated
     virtual bool IsOpen() = 0;
     virtual std::string GetInfo();
     virtual bool InputMsg(CAN_log_message_t* msg);
+    virtual bool Rewind();
 
   public:
     virtual void SetFilter(canfilter* filter);
@@ -64,13 +82,23 @@ class canplay : public InternalRamAllocated
   public:
     const char*         m_type;
     std::string         m_format;
-    uint32_t            m_speed;
+    volatile uint32_t   m_speed;            // 1 = real time, n = n times faster, 0 = max rate
+    volatile bool       m_loop;
     canformat*          m_formatter;
     canfilter*          m_filter;
+    canbus*             m_target;           // play all frames to this bus, NULL = logged origin
+    OvmsRecMutex        m_inputmutex;       // serializes InputMsg() with Open/Close/Rewind
 
   public:
     TaskHandle_t        m_task;
+    volatile bool       m_stop;
+    std::atomic<int32_t> m_seek;            // trace position to seek to [s], -1 = none
+    int64_t             m_position;         // current trace position [us]
     uint32_t            m_msgcount;
+    uint32_t            m_skipcount;
+    uint32_t            m_loopcount;
+    float               m_rate;             // frames per second, last second
+    float               m_avgrate;          // frames per second, since start
   };
 
 #endif // __CANPLAY_H__
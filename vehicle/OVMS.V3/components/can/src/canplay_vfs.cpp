@@ -85,11 +85,13 @@ OvmsCanPlayVFSInit::OvmsCanPlayVFSInit()
     }
   }
 
-canplay_vfs::canplay_vfs(std::string path, std::string format)
-  : canplay("vfs", format)
+canplay_vfs::canplay_vfs(std::string path, std::string format, canformat::canformat_serve_mode_t mode)
+  : canplay("vfs", format, mode)
   {
-  m_file = NULL;
   m_path = path;
+  m_data = NULL;
+  m_datalen = 0;
+  m_datapos = 0;
   using std::placeholders::_1;
   using std::placeholders::_2;
   MyEvents.RegisterEvent(TAG, "sd.mounted", std::bind(&canplay_vfs::MountListener, this, _1, _2));
@@ -99,20 +101,15 @@ canplay_vfs::canplay_vfs(std::string path, std::string format)
 canplay_vfs::~canplay_vfs()
   {
   MyEvents.DeregisterEvent(TAG);
-
-  if (m_file != NULL)
-    {
-    Close();
-    }
+  Stop();
+  Close();
   }
 
 bool canplay_vfs::Open()
   {
-  if (m_file)
-    {
-    fclose(m_file);
-    m_file = NULL;
-    }
+  OvmsRecMutexLock lock(&m_inputmutex);
+  if (m_reader.IsOpen())
+    Close();
 
   if (MyConfig.ProtectedPath(m_path))
     {
@@ -128,8 +125,7 @@ bool canplay_vfs::Open()
     }
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
 
-  m_file = fopen(m_path.c_str(), "r");
-  if (!m_file)
+  if (!m_reader.Open(m_path.c_str()))
     {
     ESP_LOGE(TAG, "Error: Can't read from '%s'", m_path.c_str());
     return false;
@@ -142,10 +138,12 @@ bool canplay_vfs::Open()
 
 void canplay_vfs::Close()
   {
-  if (m_file)
+  OvmsRecMutexLock lock(&m_inputmutex);
+  if (m_reader.IsOpen())
     {
-    fclose(m_file);
-    m_file = NULL;
+    m_reader.Close();
+    m_data = NULL;
+    m_datalen = m_datapos = 0;
     ESP_LOGI(TAG, "Closed vfs playback '%s': %s",
       m_path.c_str(), GetStats().c_str());
     }
@@ -153,7 +151,7 @@ void canplay_vfs::Close()
 
 bool canplay_vfs::IsOpen()
   {
-  return (m_file != NULL);
+  return m_reader.IsOpen();
   }
 
 std::string canplay_vfs::GetInfo()
@@ -174,8 +172,30 @@ void canplay_vfs::MountListener(std::string event, void* data)
 
 bool canplay_vfs::InputMsg(CAN_log_message_t* msg)
   {
-  if (m_file == NULL) return false;
+  if (!m_reader.IsOpen()) return false;
   if (m_formatter == NULL) return false;
 
-  return false;
+  while (true)
+    {
+    // Let the formatter parse the next message from the current block,
+    // it keeps partial input in its put buffer:
+    memset(msg, 0, sizeof(*msg));
+    size_t buffered = m_formatter->GetPutBufferUsed();
+    size_t used = m_formatter->put(msg, (uint8_t*)m_data + m_datapos, m_datalen - m_datapos);
+    m_datapos += used;
+    if (msg->origin != NULL)
+      return true;
+    if (used > 0 || m_formatter->GetPutBufferUsed() != buffered)
+      continue;
+
+    // No progress, fetch next block:
+    m_datalen = m_datapos = 0;
+    ssize_t len = m_reader.Read(&m_data);
+    if (len <= 0)
+      {
+      m_data = NULL;
+      return false;
+      }
+    m_datalen = len;
+    }
   }
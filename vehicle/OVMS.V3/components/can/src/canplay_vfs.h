@@ -29,11 +29,12 @@
 #define __CANPLAY_VFS_H__
 
 #include "canplay.h"
+#include "ovms_vfs.h"
 
 class canplay_vfs : public canplay
   {
   public:
-    canplay_vfs(std::string path, std::string format);
+    canplay_vfs(std::string path, std::string format, canformat::canformat_serve_mode_t mode=canformat::Simulate);
     virtual ~canplay_vfs();
 
   public:
@@ -50,7 +51,10 @@ class canplay_vfs : public canplay
 
   public:
     std::string         m_path;
-    FILE*               m_file;
+    VfsStreamReader     m_reader;
+    const uint8_t*      m_data;             // current reader block
+    size_t              m_datalen;
+    size_t              m_datapos;
   };
 
 #endif // __CANPLAY_VFS_H__
@@ -0,0 +1,684 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "cansim";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <climits>
+#include "cansim.h"
+#include "canformat.h"
+
+#define CANSIM_FRAME_TIME     250           // min frame distance on the bus [us]
+
+/**
+ * parse_hex: append hex byte tokens ("0a 1b2c") to <out>
+ */
+static bool parse_hex(const char* s, std::string& out)
+  {
+  while (*s)
+    {
+    if (!isxdigit((unsigned char)s[0]) || !isxdigit((unsigned char)s[1]))
+      return false;
+    char b[3] = { s[0], s[1], 0 };
+    out.push_back((char)strtoul(b, NULL, 16));
+    s += 2;
+    }
+  return true;
+  }
+
+cansim::cansim()
+  {
+  Clear();
+  }
+
+cansim::~cansim()
+  {
+  }
+
+void cansim::Clear()
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  m_name.clear();
+  m_dir.clear();
+  m_error.clear();
+  m_ecus.clear();
+  m_learn_req.clear();
+  m_learn_rx.clear();
+  m_learn_len.clear();
+  m_latency = 5000;
+  m_jitter = 2000;
+  m_separation = 1000;
+  m_cycle = 0;
+  m_learned = 0;
+  Start(0);
+  }
+
+/**
+ * Start: restart the scenario time at <time_us>, reset statistics
+ */
+void cansim::Start(int64_t time_us)
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  m_start = time_us;
+  m_seed = 1;
+  m_requests = m_responses = m_negative = m_ignored = m_frames = 0;
+  for (ecu_t& ecu : m_ecus)
+    {
+    ecu.tx.clear();
+    ecu.txwait = false;
+    ecu.txtime = 0;
+    }
+  }
+
+int64_t cansim::ScenarioTime(int64_t time_us)
+  {
+  int64_t t = time_us - m_start;
+  if (t < 0) return 0;
+  return (m_cycle > 0) ? t % m_cycle : t;
+  }
+
+bool cansim::Load(const char* path)
+  {
+  FILE* f = fopen(path, "r");
+  if (!f)
+    {
+    m_error = std::string("cannot open ") + path;
+    ESP_LOGE(TAG, "Load: %s", m_error.c_str());
+    return false;
+    }
+
+  OvmsRecMutexLock lock(&m_mutex);
+  Clear();
+  m_name = path;
+  const char* sep = strrchr(path, '/');
+  if (sep) m_dir = std::string(path, sep - path + 1);
+
+  char line[1024];
+  int lineno = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f))
+    ok = ParseLine(line, ++lineno);
+  fclose(f);
+  return ok;
+  }
+
+bool cansim::LoadString(const char* name, const char* text, size_t len)
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  Clear();
+  m_name = name;
+
+  std::string line;
+  int lineno = 0;
+  size_t pos = 0;
+  while (pos < len)
+    {
+    const char* eol = (const char*)memchr(text + pos, '\n', len - pos);
+    size_t end = eol ? eol - text : len;
+    line.assign(text + pos, end - pos);
+    pos = end + 1;
+    if (!ParseLine(&line[0], ++lineno))
+      return false;
+    }
+  return true;
+  }
+
+bool cansim::ParseLine(char* line, int lineno)
+  {
+  char* hash = strchr(line, '#');
+  if (hash) *hash = 0;
+
+  char* save;
+  std::vector<char*> tok;
+  for (char* t = strtok_r(line, " \t\r\n", &save); t; t = strtok_r(NULL, " \t\r\n", &save))
+    tok.push_back(t);
+  if (tok.empty()) return true;
+
+  std::string cmd = tok[0];
+  const char* err = NULL;
+  ecu_t* ecu = m_ecus.empty() ? NULL : &m_ecus.back();
+
+  if (cmd == "latency" && tok.size() >= 2)
+    {
+    m_latency = atof(tok[1]) * 1000;
+    if (tok.size() >= 3) m_jitter = atof(tok[2]) * 1000;
+    }
+  else if (cmd == "separation" && tok.size() >= 2)
+    {
+    m_separation = atof(tok[1]) * 1000;
+    }
+  else if (cmd == "cycle" && tok.size() >= 2)
+    {
+    m_cycle = atof(tok[1]) * 1000000;
+    }
+  else if (cmd == "ecu" && tok.size() >= 3)
+    {
+    ecu_t e;
+    e.txid = strtoul(tok[1], NULL, 16);
+    e.rxid = strtoul(tok[2], NULL, 16);
+    e.latency = (tok.size() >= 4) ? atof(tok[3]) * 1000 : m_latency;
+    e.jitter = (tok.size() >= 5) ? atof(tok[4]) * 1000 : m_jitter;
+    e.origin = NULL;
+    e.txpos = 0;
+    e.txseq = 0;
+    e.txwait = false;
+    e.txtime = 0;
+    if (FindECU(e.txid))
+      err = "duplicate ECU";
+    else
+      m_ecus.push_back(e);
+    }
+  else if (cmd == "pid" && tok.size() >= 3)
+    {
+    simpid_t p;
+    p.type = strtoul(tok[1], NULL, 16);
+    p.pid = strtoul(tok[2], NULL, 16);
+    memset(p.poll, 0, sizeof(p.poll));
+    size_t size = 0;
+    std::string pattern;
+    for (size_t i = 3; i < tok.size() && !err; i++)
+      {
+      if (strcmp(tok[i], "poll") == 0 && i+1 < tok.size())
+        {
+        char* s = tok[++i];
+        for (int k = 0; k < 4 && *s; k++)
+          {
+          p.poll[k] = strtoul(s, &s, 10);
+          if (*s == ',') s++;
+          }
+        }
+      else if (strcmp(tok[i], "size") == 0 && i+1 < tok.size())
+        size = strtoul(tok[++i], NULL, 10);
+      else if (!parse_hex(tok[i], pattern))
+        err = "invalid hex data";
+      }
+    if (!ecu)
+      err = "pid without ecu";
+    else if (FindPID(ecu, p.type, p.pid))
+      err = "duplicate pid";
+    if (!err)
+      {
+      if (size == 0) size = pattern.size();
+      if (pattern.empty()) pattern.push_back(0);
+      while (p.data.size() < size)
+        p.data.append(pattern, 0, std::min(pattern.size(), size - p.data.size()));
+      ecu->pids.push_back(p);
+      }
+    }
+  else if (cmd == "ramp" && tok.size() >= 9)
+    {
+    simpid_t* p = ecu ? FindPID(ecu, strtoul(tok[1], NULL, 16), strtoul(tok[2], NULL, 16)) : NULL;
+    ramp_t r;
+    r.offset = atoi(tok[3]);
+    r.bytes = atoi(tok[4]);
+    r.from = strtoll(tok[5], NULL, 0);
+    r.to = strtoll(tok[6], NULL, 0);
+    r.t0 = atof(tok[7]) * 1000000;
+    r.t1 = atof(tok[8]) * 1000000;
+    if (!p)
+      err = "unknown pid";
+    else if (r.bytes < 1 || r.bytes > 4 || r.offset + r.bytes > p->data.size())
+      err = "ramp exceeds payload";
+    else
+      p->ramps.push_back(r);
+    }
+  else if (cmd == "set" && tok.size() >= 6)
+    {
+    simpid_t* p = ecu ? FindPID(ecu, strtoul(tok[2], NULL, 16), strtoul(tok[3], NULL, 16)) : NULL;
+    patch_t s;
+    s.time = atof(tok[1]) * 1000000;
+    s.offset = atoi(tok[4]);
+    for (size_t i = 5; i < tok.size() && !err; i++)
+      {
+      if (!parse_hex(tok[i], s.data))
+        err = "invalid hex data";
+      }
+    if (!p)
+      err = "unknown pid";
+    else if (!err && s.offset + s.data.size() > p->data.size())
+      err = "patch exceeds payload";
+    if (!err)
+      {
+      // keep patches sorted by time, in file order for equal times:
+      auto it = p->patches.begin();
+      while (it != p->patches.end() && it->time <= s.time) ++it;
+      p->patches.insert(it, s);
+      }
+    }
+  else if (cmd == "trace" && tok.size() >= 2)
+    {
+    std::string path = tok[1];
+    if (path[0] != '/') path = m_dir + path;
+    if (!LoadTrace(path, (tok.size() >= 3) ? tok[2] : "crtd"))
+      err = "trace load failed";
+    }
+  else
+    {
+    err = "invalid directive";
+    }
+
+  if (err)
+    {
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%s:%d: %s '%s'", m_name.c_str(), lineno, err, cmd.c_str());
+    m_error = buf;
+    ESP_LOGE(TAG, "Load: %s", buf);
+    return false;
+    }
+  return true;
+  }
+
+/**
+ * LoadTrace: learn the responses of a recorded polling session
+ */
+bool cansim::LoadTrace(const std::string& path, const char* format)
+  {
+  canformat* fmt = MyCanFormatFactory.NewFormat(format);
+  if (!fmt)
+    {
+    ESP_LOGE(TAG, "LoadTrace: unknown format '%s'", format);
+    return false;
+    }
+  fmt->SetServeMode(canformat::Simulate);
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f)
+    {
+    ESP_LOGE(TAG, "LoadTrace: cannot open %s", path.c_str());
+    delete fmt;
+    return false;
+    }
+
+  uint8_t buf[512];
+  size_t len, pos;
+  CAN_log_message_t msg;
+  uint32_t learned = m_learned;
+  while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+    pos = 0;
+    while (true)
+      {
+      memset(&msg, 0, sizeof(msg));
+      size_t buffered = fmt->GetPutBufferUsed();
+      size_t used = fmt->put(&msg, buf + pos, len - pos);
+      pos += used;
+      if (msg.frame.MsgID != 0 && (msg.type == CAN_LogFrame_RX || msg.type == CAN_LogFrame_TX))
+        Learn(&msg.frame);
+      else if (used == 0 && fmt->GetPutBufferUsed() == buffered)
+        break;
+      }
+    }
+  fclose(f);
+  delete fmt;
+  ESP_LOGI(TAG, "LoadTrace: %s: learned %u responses", path.c_str(), m_learned - learned);
+  return true;
+  }
+
+/**
+ * Learn: track requests & responses (single or ISO-TP multi frame), add
+ *  complete responses to the scenario, creating ECUs & PIDs as needed.
+ */
+void cansim::Learn(const CAN_frame_t* frame)
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  const uint8_t* d = frame->data.u8;
+  uint32_t id = frame->MsgID;
+  switch (d[0] >> 4)
+    {
+    case 0:
+      {
+      int len = d[0] & 0x0f;
+      if (len < 1 || len > 7) return;
+      if (d[1] < 0x40)
+        {
+        uint16_t pid = (d[1] == 0x22 && len >= 3) ? (d[2] << 8 | d[3]) : (len >= 2) ? d[2] : 0;
+        m_learn_req[id] = (uint32_t)d[1] << 16 | pid;
+        }
+      else
+        LearnResponse(id, std::string((const char*)d+1, len));
+      break;
+      }
+    case 1:
+      m_learn_len[id] = (d[0] & 0x0f) << 8 | d[1];
+      m_learn_rx[id].assign((const char*)d+2, 6);
+      break;
+    case 2:
+      {
+      auto it = m_learn_rx.find(id);
+      if (it == m_learn_rx.end()) return;
+      size_t need = m_learn_len[id];
+      it->second.append((const char*)d+1, std::min((size_t)7, need - it->second.size()));
+      if (it->second.size() >= need)
+        {
+        std::string resp = it->second;
+        m_learn_rx.erase(it);
+        m_learn_len.erase(id);
+        LearnResponse(id, resp);
+        }
+      break;
+      }
+    default:
+      break;
+    }
+  }
+
+void cansim::LearnResponse(uint32_t rxid, const std::string& resp)
+  {
+  uint8_t svc = resp[0];
+  if (svc == 0x7f || resp.size() < 2) return;
+  uint8_t type = svc - 0x40;
+  size_t hdr = (type == 0x22) ? 3 : 2;
+  if (resp.size() < hdr) return;
+  uint16_t pid = (type == 0x22) ? ((uint8_t)resp[1] << 8 | (uint8_t)resp[2]) : (uint8_t)resp[1];
+  uint32_t key = (uint32_t)type << 16 | pid;
+
+  // find the request, prefer the standard ID scheme (response = request + 8):
+  auto req = m_learn_req.find(rxid - 8);
+  if (req == m_learn_req.end() || req->second != key)
+    {
+    for (req = m_learn_req.begin(); req != m_learn_req.end(); ++req)
+      if (req->second == key) break;
+    if (req == m_learn_req.end()) return;
+    }
+  uint32_t txid = req->first;
+  m_learn_req.erase(req);
+
+  ecu_t* ecu = FindECU(txid);
+  if (!ecu)
+    {
+    ecu_t e;
+    e.txid = txid;
+    e.rxid = rxid;
+    e.latency = m_latency;
+    e.jitter = m_jitter;
+    e.origin = NULL;
+    e.txpos = 0;
+    e.txseq = 0;
+    e.txwait = false;
+    e.txtime = 0;
+    m_ecus.push_back(e);
+    ecu = &m_ecus.back();
+    }
+  simpid_t* p = FindPID(ecu, type, pid);
+  if (!p)
+    {
+    simpid_t n;
+    n.type = type;
+    n.pid = pid;
+    memset(n.poll, 0, sizeof(n.poll));
+    ecu->pids.push_back(n);
+    p = &ecu->pids.back();
+    }
+  p->data = resp.substr(hdr);
+  m_learned++;
+  }
+
+cansim::ecu_t* cansim::FindECU(uint32_t txid)
+  {
+  for (ecu_t& ecu : m_ecus)
+    {
+    if (ecu.txid == txid) return &ecu;
+    }
+  return NULL;
+  }
+
+cansim::simpid_t* cansim::FindPID(ecu_t* ecu, uint8_t type, uint16_t pid)
+  {
+  for (simpid_t& p : ecu->pids)
+    {
+    if (p.type == type && p.pid == pid) return &p;
+    }
+  return NULL;
+  }
+
+int64_t cansim::Jitter(int64_t range)
+  {
+  if (range <= 0) return 0;
+  m_seed = m_seed * 1103515245 + 12345;
+  return (m_seed >> 8) % (range + 1);
+  }
+
+/**
+ * Payload: current response data of <p> at bus time <time_us>
+ */
+void cansim::Payload(simpid_t* p, int64_t time_us, std::string& out)
+  {
+  int64_t t = ScenarioTime(time_us);
+  out = p->data;
+  for (const patch_t& s : p->patches)
+    {
+    if (s.time > t) break;
+    out.replace(s.offset, s.data.size(), s.data);
+    }
+  for (const ramp_t& r : p->ramps)
+    {
+    int64_t v;
+    if (t <= r.t0 || r.t1 <= r.t0)
+      v = (t < r.t1) ? r.from : r.to;
+    else if (t >= r.t1)
+      v = r.to;
+    else
+      v = r.from + (r.to - r.from) * (t - r.t0) / (r.t1 - r.t0);
+    for (int k = r.bytes - 1, o = r.offset; k >= 0; k--, o++)
+      out[o] = (char)(v >> (8*k));
+    }
+  }
+
+/**
+ * Process: handle a frame sent to the ECUs, emit the response frames
+ */
+void cansim::Process(const CAN_frame_t* frame, int64_t time_us, emit_fn emit)
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  const uint8_t* d = frame->data.u8;
+
+  if (frame->FIR.B.DLC < 1)
+    {
+    m_ignored++;
+    return;
+    }
+
+  if ((d[0] >> 4) == 3)
+    {
+    // Flow control:
+    ecu_t* ecu = FindECU(frame->MsgID);
+    if (!ecu || !ecu->txwait || frame->FIR.B.DLC < 3)
+      {
+      m_ignored++;
+      return;
+      }
+    switch (d[0] & 0x0f)
+      {
+      case 0:
+        {
+        // clear to send, decode STmin (ms, 0xF1-0xF9 = 100-900 us):
+        int64_t sep;
+        if (d[2] <= 0x7f)
+          sep = d[2] * 1000;
+        else if (d[2] >= 0xf1 && d[2] <= 0xf9)
+          sep = (d[2] - 0xf0) * 100;
+        else
+          sep = 127000;
+        if (sep < m_separation) sep = m_separation;
+        if (ecu->txtime < time_us) ecu->txtime = time_us;
+        ecu->txwait = false;
+        SendFrames(ecu, d[1] ? d[1] : INT_MAX, sep, emit);
+        break;
+        }
+      case 1:
+        // wait:
+        break;
+      default:
+        // overflow / abort:
+        ecu->tx.clear();
+        ecu->txwait = false;
+        break;
+      }
+    return;
+    }
+
+  int len = d[0] & 0x0f;
+  if ((d[0] >> 4) != 0 || len < 2 || len > 7)
+    {
+    m_ignored++;
+    return;
+    }
+  uint8_t type = d[1];
+  uint16_t pid = (type == 0x22 && len >= 3) ? (d[2] << 8 | d[3]) : d[2];
+
+  if (frame->MsgID == 0x7df)
+    {
+    // OBD broadcast: answered by all standard ECUs knowing the PID
+    m_requests++;
+    for (ecu_t& ecu : m_ecus)
+      {
+      if (ecu.rxid >= 0x7e8 && ecu.rxid <= 0x7ef && FindPID(&ecu, type, pid))
+        {
+        ecu.origin = frame->origin;
+        Respond(&ecu, type, pid, true, time_us, emit);
+        }
+      }
+    return;
+    }
+
+  ecu_t* ecu = FindECU(frame->MsgID);
+  if (!ecu)
+    {
+    m_ignored++;
+    return;
+    }
+  m_requests++;
+  ecu->origin = frame->origin;
+  Respond(ecu, type, pid, false, time_us, emit);
+  }
+
+void cansim::Respond(ecu_t* ecu, uint8_t type, uint16_t pid, bool broadcast, int64_t time_us, emit_fn& emit)
+  {
+  std::string resp;
+  simpid_t* p = FindPID(ecu, type, pid);
+  if (p)
+    {
+    std::string data;
+    Payload(p, time_us, data);
+    resp.push_back(0x40 + type);
+    if (type == 0x22) resp.push_back(pid >> 8);
+    resp.push_back(pid & 0xff);
+    resp.append(data);
+    m_responses++;
+    }
+  else if (!broadcast)
+    {
+    // negative response: request out of range
+    resp.push_back(0x7f);
+    resp.push_back(type);
+    resp.push_back(0x31);
+    m_negative++;
+    }
+  else
+    return;
+
+  // a new request aborts a running transmission:
+  ecu->tx.clear();
+  ecu->txwait = false;
+  int64_t t = time_us + ecu->latency + Jitter(ecu->jitter);
+  if (t < ecu->txtime + CANSIM_FRAME_TIME) t = ecu->txtime + CANSIM_FRAME_TIME;
+  ecu->txtime = t;
+
+  CAN_frame_t f;
+  memset(&f, 0, sizeof(f));
+  f.origin = ecu->origin;
+  f.FIR.B.FF = (ecu->rxid > 0x7ff) ? CAN_frame_ext : CAN_frame_std;
+  f.FIR.B.DLC = 8;
+  f.MsgID = ecu->rxid;
+  if (resp.size() <= 7)
+    {
+    f.data.u8[0] = resp.size();
+    memcpy(&f.data.u8[1], resp.data(), resp.size());
+    }
+  else
+    {
+    f.data.u8[0] = 0x10 | ((resp.size() >> 8) & 0x0f);
+    f.data.u8[1] = resp.size() & 0xff;
+    memcpy(&f.data.u8[2], resp.data(), 6);
+    ecu->tx = resp;
+    ecu->txpos = 6;
+    ecu->txseq = 1;
+    ecu->txwait = true;
+    }
+  m_frames++;
+  emit(f, t);
+  }
+
+void cansim::SendFrames(ecu_t* ecu, int count, int64_t separation, emit_fn& emit)
+  {
+  if (separation < CANSIM_FRAME_TIME) separation = CANSIM_FRAME_TIME;
+  CAN_frame_t f;
+  while (count-- > 0 && ecu->txpos < ecu->tx.size())
+    {
+    memset(&f, 0, sizeof(f));
+    f.origin = ecu->origin;
+    f.FIR.B.FF = (ecu->rxid > 0x7ff) ? CAN_frame_ext : CAN_frame_std;
+    f.FIR.B.DLC = 8;
+    f.MsgID = ecu->rxid;
+    size_t n = std::min((size_t)7, ecu->tx.size() - ecu->txpos);
+    f.data.u8[0] = 0x20 | (ecu->txseq++ & 0x0f);
+    memcpy(&f.data.u8[1], ecu->tx.data() + ecu->txpos, n);
+    ecu->txpos += n;
+    ecu->txtime += separation;
+    m_frames++;
+    emit(f, ecu->txtime);
+    }
+  if (ecu->txpos >= ecu->tx.size())
+    ecu->tx.clear();
+  else
+    ecu->txwait = true;   // block complete, wait for next flow control
+  }
+
+std::string cansim::GetInfo()
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  int pids = 0;
+  for (ecu_t& ecu : m_ecus) pids += ecu.pids.size();
+  char buf[200];
+  snprintf(buf, sizeof(buf), "%s: %d ECUs, %d PIDs, latency %d+%d ms",
+    m_name.c_str(), (int)m_ecus.size(), pids, (int)(m_latency/1000), (int)(m_jitter/1000));
+  return std::string(buf);
+  }
+
+std::string cansim::GetStats()
+  {
+  char buf[200];
+  snprintf(buf, sizeof(buf), "requests=%u responses=%u negative=%u ignored=%u frames=%u learned=%u",
+    m_requests, m_responses, m_negative, m_ignored, m_frames, m_learned);
+  return std::string(buf);
+  }
@@ -0,0 +1,172 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __CANSIM_H__
+#define __CANSIM_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include "can.h"
+#include "ovms_mutex.h"
+
+/**
+ * cansim: ECU simulator for OBD-II / UDS style request/response polling
+ *
+ * Emulates the ECUs polled by a vehicle module: requests (single frames,
+ * ISO-TP flow control) are passed in by Process(), response frames are
+ * returned through the emit callback with their (simulated) bus time, so
+ * the caller decides how to deliver them (host harness event queue, virtual
+ * CAN bus). Responses are sent as single frames or ISO-TP multi frames
+ * honouring the flow control block size & separation time.
+ *
+ * Scenarios are text files, one directive per line, '#' starts a comment:
+ *
+ *   latency <ms> [<jitter ms>]     default ECU response latency (5 ms, 2 ms)
+ *   separation <ms>                min consecutive frame separation (1 ms)
+ *   cycle <s>                      scenario time wraps after <s> (0 = off)
+ *   ecu <txid> <rxid> [<ms> [<jitter ms>]]
+ *                                  ECU listening on <txid>, replying on <rxid>
+ *   pid <type> <pid> [poll <t0>,<t1>,<t2>,<t3>] [size <n>] [<hex>...]
+ *                                  response payload for the last ECU, the
+ *                                  hex pattern is repeated to fill <size>
+ *   ramp <type> <pid> <offset> <bytes> <from> <to> <t0 s> <t1 s>
+ *                                  linear big endian value over scenario time
+ *   set <t s> <type> <pid> <offset> <hex>...
+ *                                  patch the payload from scenario time <t>
+ *   trace <path> [<format>]        learn request/response pairs from a CAN
+ *                                  log (default format crtd)
+ *
+ * Types, PIDs and IDs are hexadecimal, "poll" gives the poll intervals for
+ * vehicle states 0-3 (used by harnesses to build a poll list).
+ */
+class cansim : public InternalRamAllocated
+  {
+  public:
+    typedef std::function<void(const CAN_frame_t& frame, int64_t time_us)> emit_fn;
+
+    struct ramp_t
+      {
+      uint16_t offset;
+      uint8_t bytes;
+      int64_t from, to;
+      int64_t t0, t1;                       // scenario time [us]
+      };
+    struct patch_t
+      {
+      int64_t time;                         // scenario time [us]
+      uint16_t offset;
+      std::string data;
+      };
+    struct simpid_t
+      {
+      uint8_t type;
+      uint16_t pid;
+      uint16_t poll[4];                     // poll intervals by state [s]
+      std::string data;                     // response payload
+      std::vector<ramp_t> ramps;
+      std::vector<patch_t> patches;
+      };
+    struct ecu_t
+      {
+      uint32_t txid;                        // request ID
+      uint32_t rxid;                        // response ID
+      int64_t latency, jitter;              // [us]
+      std::vector<simpid_t> pids;
+      // ISO-TP transmission state:
+      canbus* origin;                       // bus of the current exchange
+      std::string tx;                       // response being sent
+      size_t txpos;
+      uint8_t txseq;
+      bool txwait;                          // waiting for flow control
+      int64_t txtime;                       // bus time of last frame sent
+      };
+
+  public:
+    cansim();
+    ~cansim();
+
+  public:
+    bool Load(const char* path);
+    bool LoadString(const char* name, const char* text, size_t len);
+    void Clear();
+    void Start(int64_t time_us);
+    void Process(const CAN_frame_t* frame, int64_t time_us, emit_fn emit);
+    void Learn(const CAN_frame_t* frame);
+
+  public:
+    const std::string& GetName() { return m_name; }
+    const std::string& GetError() { return m_error; }
+    std::string GetInfo();
+    std::string GetStats();
+    const std::vector<ecu_t>& GetECUs() { return m_ecus; }
+    int64_t ScenarioTime(int64_t time_us);
+
+  protected:
+    bool ParseLine(char* line, int lineno);
+    bool LoadTrace(const std::string& path, const char* format);
+    ecu_t* FindECU(uint32_t txid);
+    simpid_t* FindPID(ecu_t* ecu, uint8_t type, uint16_t pid);
+    void LearnResponse(uint32_t rxid, const std::string& resp);
+    void Respond(ecu_t* ecu, uint8_t type, uint16_t pid, bool broadcast, int64_t time_us, emit_fn& emit);
+    void SendFrames(ecu_t* ecu, int count, int64_t separation, emit_fn& emit);
+    void Payload(simpid_t* p, int64_t time_us, std::string& out);
+    int64_t Jitter(int64_t range);
+
+  protected:
+    OvmsRecMutex        m_mutex;
+    std::string         m_name;
+    std::string         m_dir;              // scenario directory (relative traces)
+    std::string         m_error;
+    std::vector<ecu_t>  m_ecus;
+    int64_t             m_latency;          // default latency [us]
+    int64_t             m_jitter;           // default jitter [us]
+    int64_t             m_separation;       // min CF separation [us]
+    int64_t             m_cycle;            // scenario cycle [us], 0 = off
+    int64_t             m_start;            // scenario start time [us]
+    uint32_t            m_seed;             // jitter LCG state
+
+    // Trace learning state: pending requests & responses by CAN ID
+    std::map<uint32_t, uint32_t> m_learn_req;     // txid → type<<16 | pid
+    std::map<uint32_t, std::string> m_learn_rx;   // rxid → partial response
+    std::map<uint32_t, size_t> m_learn_len;       // rxid → expected length
+
+  public:
+    uint32_t            m_requests;         // requests received
+    uint32_t            m_responses;        // positive responses started
+    uint32_t            m_negative;         // negative responses sent
+    uint32_t            m_ignored;          // unknown / unexpected frames
+    uint32_t            m_frames;           // frames emitted
+    uint32_t            m_learned;          // responses learned from traces
+  };
+
+#endif // __CANSIM_H__
@@ -0,0 +1,391 @@
+/**
+ * Project:      Open Vehicle Monitor System
+ * Module:       CANopen SDO monitor
+ * 
+ * (c) 2018  Michael Balzer <dexter@dexters-web.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "ovms_log.h"
+static const char *TAG = "canopen";
+
+#include <math.h>
+#include "canopen_monitor.h"
+
+// Average bit count of a CAN frame (11 bit ID, 8 data bytes, stuffing):
+#define FRAME_BITS    125
+
+
+CANopenMonitor::CANopenMonitor(CANopenAsyncClient* client, uint8_t nodeid)
+  {
+  m_client = client;
+  m_nodeid = nodeid;
+  m_callback = NULL;
+  m_pending = 0;
+  m_divider = 1;
+  m_divcnt = 0;
+  m_maxdivider = 8;
+  m_load_low = 40;
+  m_load_high = 70;
+  m_load = 0;
+  m_load_time = 0;
+  m_load_frames = 0;
+  m_load_overruns = 0;
+  m_stuckcnt = 0;
+  ResetStats();
+  }
+
+CANopenMonitor::~CANopenMonitor()
+  {
+  for (auto obj : m_objects)
+    delete obj;
+  for (auto map : m_maps)
+    delete map;
+  }
+
+
+/**
+ * AddObject: add SDO to sample
+ *  - value = raw * scale + offset
+ *  - metric: optional metric to update on each read
+ *  - interval: sampling interval in poll cycles
+ */
+CANopenMonitorObject* CANopenMonitor::AddObject(uint16_t index, uint8_t subindex, CANopenMonitorValue_t type,
+    float scale, OvmsMetricFloat* metric /*=NULL*/, int interval /*=1*/, float offset /*=0*/)
+  {
+  CANopenMonitorObject* obj = new CANopenMonitorObject();
+  obj->index = index;
+  obj->subindex = subindex;
+  obj->type = type;
+  obj->scale = scale;
+  obj->offset = offset;
+  obj->metric = metric;
+  obj->interval = (interval < 1) ? 1 : (interval > 255) ? 255 : interval;
+  obj->countdown = 1;
+  m_objects.push_back(obj);
+  m_objectmap[(uint32_t)index << 8 | subindex] = obj;
+  return obj;
+  }
+
+
+/**
+ * AddMap: add aggregation map
+ *  - key: bin selector, bin = (key - keymin) / binsize
+ *  - value: sample source, return NAN to skip the sample
+ *  - maps are updated after each complete sampling cycle
+ */
+CANopenMonitorMap* CANopenMonitor::AddMap(OvmsMetricVector<float>* metric, CANopenMonitorSource key, CANopenMonitorSource value,
+    int bincnt, float binsize /*=1*/, float keymin /*=0*/, CANopenMonitorAggr_t mode /*=COMA_Max*/)
+  {
+  CANopenMonitorMap* map = new CANopenMonitorMap();
+  map->metric = metric;
+  map->key = key;
+  map->value = value;
+  map->keymin = keymin;
+  map->binsize = (binsize > 0) ? binsize : 1;
+  map->bincnt = bincnt;
+  map->mode = mode;
+  map->bins.resize(bincnt, 0);
+  map->counts.resize(bincnt, 0);
+  m_maps.push_back(map);
+  return map;
+  }
+
+
+void CANopenMonitor::SetCycleCallback(CANopenMonitorCallback callback)
+  {
+  m_callback = callback;
+  }
+
+
+/**
+ * SetLoadLimits: configure bus load adaption
+ *  - the poll rate is reduced if the load exceeds high_prc
+ *  - …and raised again when the load falls below low_prc
+ */
+void CANopenMonitor::SetLoadLimits(int low_prc, int high_prc, int max_divider /*=8*/)
+  {
+  m_load_low = low_prc;
+  m_load_high = high_prc;
+  m_maxdivider = (max_divider < 1) ? 1 : max_divider;
+  if (m_divider > m_maxdivider)
+    m_divider = m_maxdivider;
+  }
+
+
+void CANopenMonitor::ResetMaps()
+  {
+  for (auto map : m_maps)
+    {
+    std::fill(map->bins.begin(), map->bins.end(), 0);
+    std::fill(map->counts.begin(), map->counts.end(), 0);
+    if (map->metric)
+      map->metric->ClearValue();
+    }
+  }
+
+
+void CANopenMonitor::ResetStats()
+  {
+  for (auto obj : m_objects)
+    {
+    obj->rxcnt = 0;
+    obj->errcnt = 0;
+    }
+  m_pollcnt = 0;
+  m_cyclecnt = 0;
+  m_overruns = 0;
+  m_requests = 0;
+  m_starttime = esp_log_timestamp();
+  }
+
+
+/**
+ * UpdateLoad: measure bus load & adapt poll rate (once per second)
+ */
+void CANopenMonitor::UpdateLoad()
+  {
+  canbus* bus = m_client->m_worker->m_bus;
+  uint32_t now = esp_log_timestamp();
+  uint32_t frames = bus->m_status.packets_rx + bus->m_status.packets_tx;
+  
+  if (m_load_time == 0)
+    {
+    m_load_time = now;
+    m_load_frames = frames;
+    return;
+    }
+  
+  uint32_t elapsed = now - m_load_time;
+  if (elapsed < 1000)
+    return;
+  
+  uint64_t bitrate = MAP_CAN_SPEED(bus->m_speed);
+  uint64_t bits = (uint64_t)(frames - m_load_frames) * FRAME_BITS;
+  m_load = (bitrate > 0) ? (bits * 100 * 1000) / (bitrate * elapsed) : 0;
+  m_load_time = now;
+  m_load_frames = frames;
+  
+  if ((m_load > m_load_high || m_load_overruns > 0) && m_divider < m_maxdivider)
+    {
+    m_divider++;
+    ESP_LOGD(TAG, "Monitor node %d: bus load %d%%, %u overruns => rate divider %d",
+      m_nodeid, m_load, m_load_overruns, m_divider);
+    }
+  else if (m_load < m_load_low && m_load_overruns == 0 && m_divider > 1)
+    {
+    m_divider--;
+    ESP_LOGD(TAG, "Monitor node %d: bus load %d%% => rate divider %d",
+      m_nodeid, m_load, m_divider);
+    }
+  m_load_overruns = 0;
+  }
+
+
+/**
+ * Poll: start next sampling cycle
+ *  - call periodically, the call rate defines the base sampling rate
+ *  - sends read requests for all objects due in this cycle
+ */
+void CANopenMonitor::Poll()
+  {
+  m_pollcnt++;
+  UpdateLoad();
+  
+  if (m_pending > 0)
+    {
+    // previous cycle still running:
+    m_overruns++;
+    m_load_overruns++;
+    if (++m_stuckcnt > 10 * m_maxdivider)
+      {
+      // results lost (i.e. done queue overflow), restart:
+      ESP_LOGW(TAG, "Monitor node %d: %d results lost, restarting cycle", m_nodeid, (int)m_pending);
+      for (auto obj : m_objects)
+        obj->pending = false;
+      m_pending = 0;
+      m_stuckcnt = 0;
+      }
+    return;
+    }
+  m_stuckcnt = 0;
+  
+  if (++m_divcnt < m_divider)
+    return;
+  m_divcnt = 0;
+  
+  // collect objects due:
+  m_due.clear();
+  for (auto obj : m_objects)
+    {
+    if (obj->countdown > 1)
+      {
+      obj->countdown--;
+      continue;
+      }
+    obj->countdown = obj->interval;
+    obj->pending = true;
+    m_due.push_back(obj);
+    }
+  if (m_due.empty())
+    return;
+  
+  // set pending count before sending, results may arrive immediately:
+  m_pending = m_due.size();
+  for (auto obj : m_due)
+    {
+    CANopenResult_t res = m_client->ReadSDO(m_nodeid, obj->index, obj->subindex,
+      (uint8_t*)&obj->raw, sizeof(obj->raw));
+    if (res == COR_WAIT)
+      m_requests++;
+    else
+      ObjectDone(obj, false);
+    }
+  }
+
+
+/**
+ * ProcessResult: process async job result
+ *  - returns false if the job does not belong to the monitor
+ */
+bool CANopenMonitor::ProcessResult(CANopenJob& job)
+  {
+  if (job.type != COJT_ReadSDO || job.sdo.nodeid != m_nodeid)
+    return false;
+  
+  auto it = m_objectmap.find((uint32_t)job.sdo.index << 8 | job.sdo.subindex);
+  if (it == m_objectmap.end())
+    return false;
+  CANopenMonitorObject* obj = it->second;
+  if (job.sdo.buf != (uint8_t*)&obj->raw || !obj->pending)
+    return false;
+  
+  if (job.result != COR_OK)
+    {
+    ObjectDone(obj, false);
+    return true;
+    }
+  
+  float raw;
+  switch (obj->type)
+    {
+    case COMV_Int8:   raw = (int8_t) obj->raw;   break;
+    case COMV_UInt8:  raw = (uint8_t) obj->raw;  break;
+    case COMV_Int16:  raw = (int16_t) obj->raw;  break;
+    case COMV_UInt16: raw = (uint16_t) obj->raw; break;
+    case COMV_Int32:  raw = (int32_t) obj->raw;  break;
+    default:          raw = obj->raw;            break;
+    }
+  obj->value = raw * obj->scale + obj->offset;
+  obj->valid = true;
+  if (obj->metric)
+    obj->metric->SetValue(obj->value);
+  
+  ObjectDone(obj, true);
+  return true;
+  }
+
+
+void CANopenMonitor::ObjectDone(CANopenMonitorObject* obj, bool success)
+  {
+  if (success)
+    obj->rxcnt++;
+  else
+    obj->errcnt++;
+  obj->pending = false;
+  if (m_pending.fetch_sub(1) == 1)
+    CycleDone();
+  }
+
+
+/**
+ * CycleDone: all reads of the cycle done, update maps & call back
+ */
+void CANopenMonitor::CycleDone()
+  {
+  m_cyclecnt++;
+  
+  for (auto map : m_maps)
+    {
+    float value = map->value();
+    if (isnan(value))
+      continue;
+    int bin = floorf((map->key() - map->keymin) / map->binsize);
+    if (bin < 0 || bin >= map->bincnt)
+      continue;
+    
+    float& binval = map->bins[bin];
+    uint32_t& cnt = map->counts[bin];
+    float oldval = binval;
+    switch (map->mode)
+      {
+      case COMA_Max:
+        if (cnt == 0 || value > binval)
+          binval = value;
+        break;
+      case COMA_Min:
+        if (cnt == 0 || value < binval)
+          binval = value;
+        break;
+      case COMA_Avg:
+        binval = (binval * cnt + value) / (cnt + 1);
+        break;
+      case COMA_Count:
+        binval += 1;
+        break;
+      }
+    cnt++;
+    
+    if (map->metric && (binval != oldval || cnt == 1))
+      map->metric->SetElemValue(bin, binval);
+    }
+  
+  if (m_callback)
+    m_callback();
+  }
+
+
+void CANopenMonitor::StatusReport(int verbosity, OvmsWriter* writer)
+  {
+  float secs = (esp_log_timestamp() - m_starttime) / 1000.0f;
+  if (secs < 1)
+    secs = 1;
+  
+  writer->printf(
+    "Node %d: %d objects, %d maps\n"
+    "  Polls   : %u, overruns: %u\n"
+    "  Cycles  : %u = %.1f/s\n"
+    "  Requests: %u = %.1f/s\n"
+    "  Bus load: %d%% (adaption %d..%d%%), rate divider: %d/%d\n",
+    m_nodeid, (int)m_objects.size(), (int)m_maps.size(),
+    m_pollcnt, m_overruns,
+    m_cyclecnt, m_cyclecnt / secs,
+    m_requests, m_requests / secs,
+    m_load, m_load_low, m_load_high, m_divider, m_maxdivider);
+  
+  writer->puts("  Object   Intv   Rate/s    Reads  Errors       Value");
+  for (auto obj : m_objects)
+    {
+    writer->printf("  %04x.%02x  %4d  %7.1f  %7u  %6u  %10.2f%s\n",
+      obj->index, obj->subindex, obj->interval,
+      obj->rxcnt / secs, obj->rxcnt, obj->errcnt,
+      obj->value, obj->valid ? "" : " (n/a)");
+    }
+  }
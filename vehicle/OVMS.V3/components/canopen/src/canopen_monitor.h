@@ -0,0 +1,172 @@
+/**
+ * Project:      Open Vehicle Monitor System
+ * Module:       CANopen SDO monitor
+ * 
+ * (c) 2018  Michael Balzer <dexter@dexters-web.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __CANOPEN_MONITOR_H__
+#define __CANOPEN_MONITOR_H__
+
+#include <map>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#include "canopen.h"
+
+
+/**
+ * CANopenMonitor: table driven SDO sampling
+ * 
+ * A monitor samples a set of SDO objects of a single node via a
+ *   CANopenAsyncClient, scales the raw values into metrics and aggregates
+ *   samples into bin maps (e.g. values by speed, histograms).
+ * 
+ * Sampling is driven by the application calling Poll() periodically
+ *   (e.g. on a status PDO). Each object has its own sampling interval
+ *   in poll cycles, so fast changing values can be read on every cycle
+ *   while slow values only add requests every n cycles.
+ * 
+ * The monitor adapts to the bus load: if the CAN bus load exceeds the
+ *   configured high level, or a sampling cycle is still running when the
+ *   next poll occurs, the effective poll rate is reduced (divided) until
+ *   the load drops below the low level.
+ * 
+ * The application needs to pass all async job results to ProcessResult(),
+ *   results not belonging to the monitor are ignored. When all reads of a
+ *   cycle are done, the maps are updated and the cycle callback is executed
+ *   (in the context of the task calling ProcessResult()).
+ * 
+ * Objects & maps need to be defined before the first Poll().
+ */
+
+typedef enum __attribute__ ((__packed__))
+  {
+  COMV_Int8 = 0,
+  COMV_UInt8,
+  COMV_Int16,
+  COMV_UInt16,
+  COMV_Int32,
+  COMV_UInt32
+  } CANopenMonitorValue_t;
+
+typedef enum __attribute__ ((__packed__))
+  {
+  COMA_Max = 0,                         // keep maximum value per bin
+  COMA_Min,                             // keep minimum value per bin
+  COMA_Avg,                             // average of values per bin
+  COMA_Count                            // count samples per bin (histogram)
+  } CANopenMonitorAggr_t;
+
+typedef std::function<float()> CANopenMonitorSource;
+typedef std::function<void()> CANopenMonitorCallback;
+
+struct CANopenMonitorObject
+  {
+  uint16_t              index;          // SDO register address
+  uint8_t               subindex;       // SDO subregister address
+  CANopenMonitorValue_t type;           // raw value type
+  float                 scale;          // value = raw * scale + offset
+  float                 offset;
+  OvmsMetricFloat*      metric;         // optional metric binding
+  uint8_t               interval;       // sampling interval [poll cycles]
+  
+  uint32_t              raw;            // SDO read buffer
+  float                 value;          // last scaled value
+  bool                  valid;          // value has been read
+  bool                  pending;        // read request running
+  uint8_t               countdown;      // cycles until next read
+  uint32_t              rxcnt;          // reads done
+  uint32_t              errcnt;         // reads failed
+  };
+
+struct CANopenMonitorMap
+  {
+  OvmsMetricVector<float>* metric;      // bin values
+  CANopenMonitorSource  key;            // bin key, e.g. speed
+  CANopenMonitorSource  value;          // sample value, NAN = skip sample
+  float                 keymin;         // key of first bin
+  float                 binsize;        // key range per bin
+  int                   bincnt;
+  CANopenMonitorAggr_t  mode;
+  
+  std::vector<float>    bins;
+  std::vector<uint32_t> counts;
+  };
+
+class CANopenMonitor
+  {
+  public:
+    CANopenMonitor(CANopenAsyncClient* client, uint8_t nodeid);
+    ~CANopenMonitor();
+  
+  public:
+    // Definition:
+    CANopenMonitorObject* AddObject(uint16_t index, uint8_t subindex, CANopenMonitorValue_t type,
+      float scale, OvmsMetricFloat* metric=NULL, int interval=1, float offset=0);
+    CANopenMonitorMap* AddMap(OvmsMetricVector<float>* metric, CANopenMonitorSource key, CANopenMonitorSource value,
+      int bincnt, float binsize=1, float keymin=0, CANopenMonitorAggr_t mode=COMA_Max);
+    void SetCycleCallback(CANopenMonitorCallback callback);
+    void SetLoadLimits(int low_prc, int high_prc, int max_divider=8);
+  
+  public:
+    // Operation:
+    void Poll();
+    bool ProcessResult(CANopenJob& job);
+    void ResetMaps();
+    void ResetStats();
+    void StatusReport(int verbosity, OvmsWriter* writer);
+  
+  protected:
+    void ObjectDone(CANopenMonitorObject* obj, bool success);
+    void CycleDone();
+    void UpdateLoad();
+  
+  protected:
+    CANopenAsyncClient*   m_client;
+    uint8_t               m_nodeid;
+    std::vector<CANopenMonitorObject*> m_objects;
+    std::map<uint32_t, CANopenMonitorObject*> m_objectmap;   // index<<8|subindex → object
+    std::vector<CANopenMonitorMap*> m_maps;
+    CANopenMonitorCallback m_callback;
+    
+    std::atomic_int       m_pending;      // reads pending in current cycle
+    int                   m_divider;      // effective poll rate divider
+    int                   m_divcnt;
+    int                   m_maxdivider;
+    int                   m_load_low;     // bus load limits [%]
+    int                   m_load_high;
+    int                   m_load;         // last bus load measured [%]
+    uint32_t              m_load_time;    // last load measurement [ms]
+    uint32_t              m_load_frames;
+    uint32_t              m_load_overruns;
+    int                   m_stuckcnt;
+    
+    uint32_t              m_pollcnt;      // Poll() calls
+    uint32_t              m_cyclecnt;     // sampling cycles completed
+    uint32_t              m_overruns;     // polls skipped due to running cycle
+    uint32_t              m_requests;     // read requests sent
+    uint32_t              m_starttime;    // stats start [ms]
+    std::vector<CANopenMonitorObject*> m_due;  // Poll() working list
+  };
+
+#endif // __CANOPEN_MONITOR_H__
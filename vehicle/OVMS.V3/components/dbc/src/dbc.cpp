@@ -38,6 +38,7 @@ static const char *TAG = "dbc";
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <sys/param.h>
 #include "dbc.h"
 #include "dbc_tokeniser.hpp"
 #include "dbc_parser.hpp"
@@ -831,7 +832,12 @@ dbcNumber dbcSignal::Decode(CAN_frame_t* msg)
   if (m_value_type == DBC_VALUETYPE_UNSIGNED)
     result.Cast((uint32_t)val, DBC_NUMBER_INTEGER_UNSIGNED);
   else
+    {
+    // Sign extend signals shorter than the 32 bit container:
+    if ((m_signal_size > 0) && (m_signal_size < 32) && (val & (1ULL << (m_signal_size-1))))
+      val |= ~((1ULL << m_signal_size) - 1);
     result.Cast((uint32_t)val, DBC_NUMBER_INTEGER_SIGNED);
+    }
 
   // Apply factor and offset
   if (!(m_factor == 1))
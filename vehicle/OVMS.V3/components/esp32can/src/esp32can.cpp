@@ -39,6 +39,7 @@ static const char *TAG = "esp32can";
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
 #include <string.h>
+#include <esp_timer.h>
 #include "esp32can.h"
 #include "esp32can_regdef.h"
 #include "ovms_peripherals.h"
@@ -119,6 +120,9 @@ static inline uint32_t ESP32CAN_rxframe(esp32can *me, BaseType_t* task_woken)
       memset(&msg,0,sizeof(msg));
       msg.type = CAN_frame;
       msg.body.frame.origin = me;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      msg.body.frame.rxtime = esp_timer_get_time();
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
 
       // get FIR
       msg.body.frame.FIR.U = MODULE_ESP32CAN->MBX_CTRL.FCTRL.FIR.U;
@@ -159,6 +163,7 @@ static IRAM_ATTR void ESP32CAN_isr(void *pvParameters)
   BaseType_t task_woken = pdFALSE;
   uint32_t interrupt;
 
+  OVMS_TRACE_ISR(me->m_trace_isr, 0);
   ESP32CAN_ENTER_CRITICAL_ISR();
 
   // Read interrupt status and clear flags
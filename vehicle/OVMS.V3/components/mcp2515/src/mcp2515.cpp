@@ -37,13 +37,18 @@ static const char *TAG = "mcp2515";
 #include "driver/gpio.h"
 #include "esp_intr.h"
 #include "soc/dport_reg.h"
+#include "esp_timer.h"
 
 static IRAM_ATTR void MCP2515_isr(void *pvParameters)
   {
   mcp2515 *me = (mcp2515*)pvParameters;
   BaseType_t task_woken = pdFALSE;
 
+  OVMS_TRACE_ISR(me->m_trace_isr, 0);
   me->m_status.interrupts++;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  me->m_isrtime = esp_timer_get_time();
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
 
   // we don't know the IRQ source and querying by SPI is too slow for an ISR,
   // so we let AsynchronousInterruptHandler() figure out what to do. 
@@ -410,6 +415,9 @@ bool mcp2515::AsynchronousInterruptHandler(CAN_frame_t* frame, bool * frameRecei
     // The indicated RX buffer has a message to be read
     memset(frame,0,sizeof(*frame));
     frame->origin = this;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+    frame->rxtime = m_isrtime;
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
 
     // read RX buffer and clear interrupt flag:
     uint8_t *p = m_spibus->spi_cmd(m_spi, buf, 13, 1, CMD_READ_RXBUF + ((intflag==1) ? 0 : 4));
@@ -100,6 +100,9 @@ class mcp2515 : public canbus
   public:
     spi* m_spibus;
     spi_nodma_device_handle_t m_spi;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+    volatile uint32_t m_isrtime;      // last interrupt time, frames are read later by the CAN task
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
 
   protected:
     spi_nodma_device_interface_config_t m_devcfg;
@@ -47,6 +47,7 @@ obd2pid::obd2pid(int pid, pid_t type, OvmsMetric* metric)
   m_pid = pid;
   m_type = type;
   m_script = NULL;
+  m_expr = NULL;
   m_metric = metric;
   }
 
@@ -57,6 +58,11 @@ obd2pid::~obd2pid()
     free(m_script);
     m_script = NULL;
     }
+  if (m_expr)
+    {
+    delete m_expr;
+    m_expr = NULL;
+    }
   }
 
 int obd2pid::GetPid()
@@ -77,6 +83,7 @@ const char* obd2pid::GetTypeString()
     case Internal:       return "internal";
     case Metric:         return "metric";
     case Script:         return "script";
+    case Expression:     return "expression";
     default:             return "unknown";
     }
   }
@@ -115,6 +122,41 @@ void obd2pid::LoadScript(std::string path)
   m_script[fsz] = 0;
 
   fclose(f);
+
+  // Compile if possible, other scripts are evaluated by Duktape:
+  std::string error;
+  if (!SetExpression(m_script, error))
+    ESP_LOGI(TAG, "Script %s not compiled (%s), using Javascript", path.c_str(), error.c_str());
+  }
+
+bool obd2pid::SetExpression(std::string source, std::string& error)
+  {
+  if (m_expr)
+    {
+    delete m_expr;
+    m_expr = NULL;
+    }
+  obd2expr* expr = new obd2expr();
+  if (!expr->Compile(source.c_str(), error))
+    {
+    delete expr;
+    return false;
+    }
+  m_expr = expr;
+  if (m_type != Script)
+    {
+    // keep the expression source for the PID list:
+    if (m_script)
+      free(m_script);
+    m_script = (char*)ExternalRamMalloc(source.size()+1);
+    memcpy(m_script, source.c_str(), source.size()+1);
+    }
+  return true;
+  }
+
+const char* obd2pid::GetSource()
+  {
+  return m_script ? m_script : "";
   }
 
 float obd2pid::Execute()
@@ -129,14 +171,19 @@ float obd2pid::Execute()
         return m_metric->AsFloat();
       else
         return 0.0;
+    case Expression:      // PIDs defined by an expression in the map
+      if (m_expr)
+        return m_expr->Evaluate();
+      else
+        return 0.0;
     case Script:
+      if (m_expr)
+        return m_expr->Evaluate();
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
-      {
-      return MyScripts.DuktapeEvalFloatResult(m_script);
-      }
-#else // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
-      return 0;
+      if (m_script)
+        return MyScripts.DuktapeEvalFloatResult(m_script);
 #endif // #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+      return 0;
     default:
       return 0;
     }
@@ -172,7 +219,7 @@ obd2ecu::obd2ecu(const char* name, canbus* can)
 
   xTaskCreatePinnedToCore(OBD2ECU_task, "OVMS OBDII ECU", 6144, (void*)this, 5, &m_task, CORE(1));
 
-  MyCan.RegisterListener(m_rxqueue);
+  MyCan.RegisterListener(m_rxqueue, false, "obd2ecu.rx");
   }
 
 obd2ecu::~obd2ecu()
@@ -180,8 +227,8 @@ obd2ecu::~obd2ecu()
   m_can->SetPowerMode(Off);
   MyCan.DeregisterListener(m_rxqueue);
 
-  vQueueDelete(m_rxqueue);
   vTaskDelete(m_task);
+  vQueueDelete(m_rxqueue);
 
   ClearMap();
   }
@@ -240,7 +287,11 @@ void obd2ecu_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     if ((argc==0)||(it->second->GetPid() == atoi(argv[0])))
       {
       const char *ms;
-      if (it->second->GetMetric() && (it->second->GetType() != obd2pid::Script))
+      if (it->second->GetType() == obd2pid::Expression)
+        ms = it->second->GetSource();
+      else if (it->second->GetType() == obd2pid::Script)
+        ms = it->second->IsCompiled() ? "(compiled)" : "";
+      else if (it->second->GetMetric())
         ms = it->second->GetMetric()->m_name;
       else
         ms = "";
@@ -468,6 +519,8 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
   uint32_t reply;
   int jitter;
   uint8_t mapped_pid;
+  PidMap::iterator it;
+  obd2pid* pid = NULL;
   float metric;
   char rtn_string[21];
 
@@ -500,8 +553,10 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
     case 1:  /* Mode 1 (main real-time PIDs are here */
 
       mapped_pid = p_d[2];
-      if (m_pidmap.find(mapped_pid) != m_pidmap.end()) // m_pidmap[pid] contains the obd2pid object to work with
-      { metric = m_pidmap[mapped_pid]->Execute();
+      it = m_pidmap.find(mapped_pid);
+      if (it != m_pidmap.end()) // it->second contains the obd2pid object to work with
+      { pid = it->second;
+        metric = pid->Execute();
       }
       else
       { if (MyConfig.GetParamValueBool("obd2ecu","autocreate"))
@@ -553,7 +608,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           /* Also a Minimum "idle" RPM, but only if not moving, for HUD device */
 
           // Test if metric is from a script; if so, don't do the dongle workarounds (script will do this if needed)
-          if(m_pidmap[mapped_pid]->GetType() != obd2pid::Script)
+          if(!pid || pid->GetType() != obd2pid::Script)
           { metric = metric+jitter;
             if(StandardMetrics.ms_v_pos_speed->AsFloat() < 1.0) metric = 500+jitter;
           }
@@ -568,7 +623,7 @@ void obd2ecu::IncomingFrame(CAN_frame_t* p_frame)
           /* Scaling provides a 1:1 metric pass-through, so be aware of limmits of the display device */
           /* Use with display set to L/hr (not L/km).  Note: scripting this metric is not pre-scaled. */
 
-          if(m_pidmap[mapped_pid]->GetType() != obd2pid::Script) metric = metric*3.0;
+          if(!pid || pid->GetType() != obd2pid::Script) metric = metric*3.0;
           FillFrame(&r_frame,reply,mapped_pid,metric,pid_format[mapped_pid]);
           m_can->Write(&r_frame);
           break;
@@ -771,11 +826,27 @@ void obd2ecu::LoadMap()
           m_pidmap[pid]->SetMetric(m);
         }
       }
-      else if(pid) ESP_LOGI(TAG, "Metric '%s' not found; ignored.",it->second.c_str());
+    else if (pid>0)
+      {
+      // not a metric name, try as an expression:
+      obd2pid* p = new obd2pid(pid,obd2pid::Expression);
+      std::string error;
+      if (p->SetExpression(it->second, error))
+        {
+        ESP_LOGI(TAG, "Using custom expression for pid #%d (0x%02x)",pid,pid);
+        if (m_pidmap.find(pid) != m_pidmap.end())
+          delete m_pidmap[pid];
+        m_pidmap[pid] = p;
+        }
+      else
+        {
+        ESP_LOGI(TAG, "Metric or expression '%s' invalid (%s); ignored.",it->second.c_str(),error.c_str());
+        delete p;
+        }
+      }
     }
 
-  // Look for scripts (if javascript enabled)...
-  #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+  // Look for scripts (compiled if possible, else javascript if enabled)...
   DIR *dir;
   struct dirent *dp;
   if ((dir = opendir ("/store/obd2ecu")) != NULL)
@@ -797,7 +868,6 @@ void obd2ecu::LoadMap()
       }
     closedir(dir);
     }
-  #endif //#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   }
 
 void obd2ecu::ClearMap()
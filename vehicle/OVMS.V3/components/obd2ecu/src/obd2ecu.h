@@ -37,6 +37,7 @@
 #include "pcp.h"
 #include "can.h"
 #include "ovms_metrics.h"
+#include "obd2expr.h"
 
 class obd2pid
   {
@@ -46,7 +47,8 @@ class obd2pid
       Unimplemented,
       Internal,
       Metric,
-      Script
+      Script,
+      Expression
       } pid_t;
 
   public:
@@ -61,6 +63,9 @@ class obd2pid
     void SetType(pid_t type);
     void SetMetric(OvmsMetric* metric);
     void LoadScript(std::string path);
+    bool SetExpression(std::string source, std::string& error);
+    const char* GetSource();
+    bool IsCompiled() { return m_expr != NULL; }
     float Execute();
 
   public:
@@ -70,6 +75,7 @@ class obd2pid
     int m_pid;
     pid_t m_type;
     char* m_script;
+    obd2expr* m_expr;       // compiled expression / script
     OvmsMetric* m_metric;
   };
 
@@ -0,0 +1,505 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "obd2expr";
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <math.h>
+#include "obd2expr.h"
+
+static const struct
+  {
+  const char*     name;
+  metric_unit_t   unit;
+  } obd2expr_units[] =
+  {
+  { "km", Kilometers },     { "miles", Miles },       { "mi", Miles },
+  { "m", Meters },          { "meters", Meters },
+  { "c", Celcius },         { "celcius", Celcius },   { "celsius", Celcius },
+  { "f", Fahrenheit },      { "fahrenheit", Fahrenheit },
+  { "kpa", kPa },           { "pa", Pa },             { "psi", PSI },
+  { "v", Volts },           { "a", Amps },            { "ah", AmpHours },
+  { "kw", kW },             { "kwh", kWh },           { "w", Watts },           { "wh", WattHours },
+  { "s", Seconds },         { "sec", Seconds },       { "min", Minutes },       { "h", Hours },
+  { "kph", Kph },           { "km/h", Kph },          { "mph", Mph },
+  { "%", Percentage },      { "wh/km", WattHoursPK }, { "wh/mi", WattHoursPM },
+  { "nm", Nm },
+  };
+
+obd2expr::obd2expr()
+  {
+  m_src = m_err = m_errpos = NULL;
+  m_depth = m_maxdepth = 0;
+  m_deletes = 0;
+  }
+
+obd2expr::~obd2expr()
+  {
+  }
+
+bool obd2expr::Compile(const char* source, std::string& error)
+  {
+  m_code.clear();
+  m_refs.clear();
+  m_src = source;
+  m_err = m_errpos = NULL;
+  m_depth = m_maxdepth = 0;
+
+  ParseCond();
+  Accept(";");
+  Skip();
+  if (*m_src)
+    Fail("unexpected input");
+
+  if (m_err)
+    {
+    char pos[20];
+    snprintf(pos, sizeof(pos), " at position %d", (int)(m_errpos - source));
+    error = m_err;
+    error += pos;
+    m_code.clear();
+    m_refs.clear();
+    return false;
+    }
+  ESP_LOGD(TAG, "Compiled '%s': %d ops, %d refs, stack %d", source,
+    (int)m_code.size(), (int)m_refs.size(), m_maxdepth);
+  return true;
+  }
+
+float obd2expr::Evaluate()
+  {
+  float stack[OBD2EXPR_MAXSTACK];
+  int sp = 0;
+  if (m_deletes != MyMetrics.m_deletecount)
+    {
+    // metrics deleted (i.e. vehicle change): drop cached pointers
+    m_deletes = MyMetrics.m_deletecount;
+    for (ref_t& ref : m_refs)
+      ref.metric = NULL;
+    }
+  for (const op_t& op : m_code)
+    {
+    switch (op.code)
+      {
+      case Const:
+        stack[sp++] = op.value;
+        break;
+      case Load:
+        {
+        ref_t& ref = m_refs[op.index];
+        if (!ref.metric)
+          ref.metric = MyMetrics.Find(ref.name.c_str());
+        stack[sp++] = ref.metric ? ref.metric->AsFloat(0, op.unit) : 0;
+        break;
+        }
+      default:
+        switch (Arity(op.code))
+          {
+          case 1:
+            stack[sp-1] = Apply(op.code, stack[sp-1]);
+            break;
+          case 2:
+            sp -= 1;
+            stack[sp-1] = Apply(op.code, stack[sp-1], stack[sp]);
+            break;
+          default:
+            sp -= 2;
+            stack[sp-1] = Apply(op.code, stack[sp-1], stack[sp], stack[sp+1]);
+            break;
+          }
+        break;
+      }
+    }
+  return sp ? stack[0] : 0;
+  }
+
+int obd2expr::Arity(opcode_t code)
+  {
+  if (code <= Load) return 0;
+  if (code <= Sqrt) return 1;
+  if (code <= Max)  return 2;
+  return 3;
+  }
+
+static inline bool truthy(float a)
+  {
+  return a != 0 && !isnan(a);
+  }
+
+float obd2expr::Apply(opcode_t code, float a, float b, float c)
+  {
+  switch (code)
+    {
+    case Neg:     return -a;
+    case Not:     return truthy(a) ? 0 : 1;
+    case Abs:     return fabsf(a);
+    case Round:   return floorf(a + 0.5f);    // Javascript rounding
+    case Floor:   return floorf(a);
+    case Ceil:    return ceilf(a);
+    case Sqrt:    return sqrtf(a);
+    case Add:     return a + b;
+    case Sub:     return a - b;
+    case Mul:     return a * b;
+    // Note: division by zero yields 0 (PID values need to stay finite)
+    case Div:     return (b != 0) ? a / b : 0;
+    case Mod:     return (b != 0) ? fmodf(a, b) : 0;
+    case Lt:      return a < b;
+    case Le:      return a <= b;
+    case Gt:      return a > b;
+    case Ge:      return a >= b;
+    case Eq:      return a == b;
+    case Ne:      return a != b;
+    case And:     return truthy(a) ? b : a;
+    case Or:      return truthy(a) ? a : b;
+    case Min:     return fminf(a, b);
+    case Max:     return fmaxf(a, b);
+    case Select:  return truthy(a) ? b : c;
+    default:      return 0;
+    }
+  }
+
+void obd2expr::Emit(opcode_t code, float value)
+  {
+  if (m_err) return;
+  int arity = Arity(code);
+
+  // fold constant operations:
+  if (arity > 0 && (int)m_code.size() >= arity)
+    {
+    bool folded = true;
+    for (int i = 1; i <= arity && folded; i++)
+      folded = (m_code[m_code.size()-i].code == Const);
+    if (folded)
+      {
+      float arg[3] = { 0, 0, 0 };
+      for (int i = 0; i < arity; i++)
+        arg[i] = m_code[m_code.size()-arity+i].value;
+      m_code.resize(m_code.size()-arity+1);
+      m_code.back().value = Apply(code, arg[0], arg[1], arg[2]);
+      m_depth -= arity - 1;
+      return;
+      }
+    }
+
+  m_code.push_back({ code, Other, 0, value });
+  m_depth += 1 - arity;
+  if (m_depth > m_maxdepth)
+    m_maxdepth = m_depth;
+  if (m_maxdepth > OBD2EXPR_MAXSTACK)
+    Fail("expression too complex");
+  }
+
+void obd2expr::Fail(const char* message)
+  {
+  if (m_err) return;
+  m_err = message;
+  m_errpos = m_src;
+  }
+
+void obd2expr::Skip()
+  {
+  while (*m_src)
+    {
+    if (isspace((unsigned char)*m_src))
+      m_src++;
+    else if (m_src[0] == '/' && m_src[1] == '/')
+      {
+      while (*m_src && *m_src != '\n') m_src++;
+      }
+    else if (m_src[0] == '/' && m_src[1] == '*')
+      {
+      const char* end = strstr(m_src+2, "*/");
+      m_src = end ? end+2 : m_src+strlen(m_src);
+      }
+    else
+      break;
+    }
+  }
+
+bool obd2expr::Accept(const char* token)
+  {
+  if (m_err) return false;
+  Skip();
+  size_t len = strlen(token);
+  if (strncmp(m_src, token, len) != 0)
+    return false;
+  m_src += len;
+  return true;
+  }
+
+void obd2expr::Expect(const char* token)
+  {
+  if (!Accept(token))
+    Fail("syntax error");
+  }
+
+void obd2expr::ParseCond()
+  {
+  ParseBinary(0);
+  if (Accept("?"))
+    {
+    ParseCond();
+    Expect(":");
+    ParseCond();
+    Emit(Select);
+    }
+  }
+
+void obd2expr::ParseBinary(int level)
+  {
+  // operators by precedence, longest tokens first:
+  static const struct { const char* token; opcode_t code; } ops[][4] =
+    {
+    { { "||", Or } },
+    { { "&&", And } },
+    { { "===", Eq }, { "!==", Ne }, { "==", Eq }, { "!=", Ne } },
+    { { "<=", Le }, { ">=", Ge }, { "<", Lt }, { ">", Gt } },
+    { { "+", Add }, { "-", Sub } },
+    { { "*", Mul }, { "/", Div }, { "%", Mod } },
+    };
+  static const int levels = sizeof(ops) / sizeof(ops[0]);
+
+  if (level >= levels)
+    {
+    ParseUnary();
+    return;
+    }
+  ParseBinary(level+1);
+  while (!m_err)
+    {
+    int i;
+    for (i = 0; i < 4 && ops[level][i].token; i++)
+      {
+      if (Accept(ops[level][i].token))
+        break;
+      }
+    if (i == 4 || !ops[level][i].token)
+      break;
+    ParseBinary(level+1);
+    Emit(ops[level][i].code);
+    }
+  }
+
+void obd2expr::ParseUnary()
+  {
+  if (Accept("-"))
+    {
+    ParseUnary();
+    Emit(Neg);
+    }
+  else if (Accept("+"))
+    {
+    ParseUnary();
+    }
+  else if (Accept("!"))
+    {
+    ParseUnary();
+    Emit(Not);
+    }
+  else
+    {
+    ParsePrimary();
+    }
+  }
+
+void obd2expr::ParsePrimary()
+  {
+  if (m_err) return;
+  Skip();
+  if (Accept("("))
+    {
+    ParseCond();
+    Expect(")");
+    }
+  else if (isdigit((unsigned char)*m_src) || *m_src == '.')
+    {
+    char* end;
+    float value = strtof(m_src, &end);
+    if (end == m_src)
+      Fail("invalid number");
+    else
+      {
+      m_src = end;
+      Emit(Const, value);
+      }
+    }
+  else
+    {
+    const char* start = m_src;
+    std::string name = ParseName();
+    if (name.empty())
+      Fail("syntax error");
+    else if (Accept("("))
+      ParseCall(name);
+    else if (name == "true")
+      Emit(Const, 1);
+    else if (name == "false")
+      Emit(Const, 0);
+    else if (name == "Math.PI")
+      Emit(Const, M_PI);
+    else if (name.find('.') == std::string::npos)
+      {
+      m_src = start;                // report the identifier position
+      Fail("unknown identifier");   // i.e. a script variable
+      }
+    else
+      {
+      metric_unit_t unit = Other;
+      if (Accept("["))
+        {
+        const char* start = m_src;
+        const char* end = strchr(m_src, ']');
+        if (!end)
+          {
+          Fail("syntax error");
+          return;
+          }
+        std::string label(start, end - start);
+        m_src = end + 1;
+        size_t i;
+        for (i = 0; i < sizeof(obd2expr_units)/sizeof(obd2expr_units[0]); i++)
+          {
+          if (strcasecmp(label.c_str(), obd2expr_units[i].name) == 0)
+            break;
+          }
+        if (i == sizeof(obd2expr_units)/sizeof(obd2expr_units[0]))
+          {
+          m_src = start;
+          Fail("unknown unit");
+          return;
+          }
+        unit = obd2expr_units[i].unit;
+        }
+      ParseMetric(name, unit);
+      }
+    }
+  }
+
+void obd2expr::ParseCall(const std::string& name)
+  {
+  static const struct { const char* name; opcode_t code; } functions[] =
+    {
+    { "abs", Abs }, { "round", Round }, { "floor", Floor }, { "ceil", Ceil },
+    { "sqrt", Sqrt }, { "min", Min }, { "max", Max },
+    };
+
+  if (name == "OvmsMetrics.AsFloat" || name == "OvmsMetrics.Value" || name == "OvmsMetricFloat")
+    {
+    std::string metric = ParseString();
+    Expect(")");
+    if (!m_err)
+      ParseMetric(metric, Other);
+    return;
+    }
+
+  const char* fn = name.c_str();
+  if (strncmp(fn, "Math.", 5) == 0)
+    fn += 5;
+  for (size_t i = 0; i < sizeof(functions)/sizeof(functions[0]); i++)
+    {
+    if (strcmp(fn, functions[i].name) != 0)
+      continue;
+    opcode_t code = functions[i].code;
+    ParseCond();
+    if (Arity(code) == 1)
+      Emit(code);
+    else
+      {
+      // min & max: two or more arguments
+      Expect(",");
+      ParseCond();
+      Emit(code);
+      while (Accept(","))
+        {
+        ParseCond();
+        Emit(code);
+        }
+      }
+    Expect(")");
+    return;
+    }
+
+  Fail("unknown function");
+  }
+
+void obd2expr::ParseMetric(const std::string& name, metric_unit_t unit)
+  {
+  if (m_err) return;
+  size_t index;
+  for (index = 0; index < m_refs.size(); index++)
+    {
+    if (m_refs[index].name == name)
+      break;
+    }
+  if (index == m_refs.size())
+    m_refs.push_back({ name, MyMetrics.Find(name.c_str()) });
+  Emit(Load);
+  if (!m_err)
+    {
+    m_code.back().index = index;
+    m_code.back().unit = unit;
+    }
+  }
+
+std::string obd2expr::ParseName()
+  {
+  Skip();
+  const char* start = m_src;
+  if (isalpha((unsigned char)*m_src) || *m_src == '_' || *m_src == '$')
+    {
+    while (isalnum((unsigned char)*m_src) || *m_src == '_' || *m_src == '$' || *m_src == '.')
+      m_src++;
+    }
+  return std::string(start, m_src - start);
+  }
+
+std::string obd2expr::ParseString()
+  {
+  Skip();
+  char quote = *m_src;
+  if (quote != '"' && quote != '\'')
+    {
+    Fail("string expected");
+    return "";
+    }
+  const char* start = ++m_src;
+  const char* end = strchr(start, quote);
+  if (!end)
+    {
+    Fail("unterminated string");
+    return "";
+    }
+  m_src = end + 1;
+  return std::string(start, end - start);
+  }
@@ -0,0 +1,118 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __OBD2EXPR_H__
+#define __OBD2EXPR_H__
+
+#include <string>
+#include <vector>
+#include "ovms_metrics.h"
+
+#define OBD2EXPR_MAXSTACK   16      // evaluation stack depth limit
+
+/**
+ * obd2expr: compiled PID value expression
+ *
+ * PID expressions are compiled into a small stack machine program, so PID
+ * requests are answered inline, without a Duktape evaluation. The syntax is
+ * a subset of Javascript expressions, so simple PID scripts compile as well:
+ *  - numbers, true/false, + - * / %, unary - + !, parentheses
+ *  - comparisons < <= > >= == != (=== !==), && ||, cond ? a : b
+ *  - metrics by name, optionally converted to a unit: v.p.speed[mph]
+ *  - OvmsMetrics.AsFloat("<name>"), OvmsMetrics.Value("<name>"),
+ *    OvmsMetricFloat("<name>")
+ *  - abs min max round floor ceil sqrt (also as Math.<function>)
+ *  - a trailing ";"
+ *
+ * Metrics not found at compile time are looked up on evaluation (i.e. if
+ * created later by the vehicle module), undefined metrics read as 0.
+ */
+class obd2expr
+  {
+  public:
+    obd2expr();
+    ~obd2expr();
+
+  public:
+    bool Compile(const char* source, std::string& error);
+    float Evaluate();
+    size_t GetSize() { return m_code.size(); }
+
+  protected:
+    typedef enum : uint8_t
+      {
+      Const, Load,
+      Neg, Not, Abs, Round, Floor, Ceil, Sqrt,
+      Add, Sub, Mul, Div, Mod, Lt, Le, Gt, Ge, Eq, Ne, And, Or, Min, Max,
+      Select
+      } opcode_t;
+    typedef struct
+      {
+      opcode_t        code;
+      metric_unit_t   unit;           // Load: unit conversion
+      uint16_t        index;          // Load: metric reference
+      float           value;          // Const: value
+      } op_t;
+    typedef struct
+      {
+      std::string     name;
+      OvmsMetric*     metric;         // cached lookup, valid while m_deletes is current
+      } ref_t;
+
+  protected:
+    // Parser:
+    void ParseCond();
+    void ParseBinary(int level);
+    void ParseUnary();
+    void ParsePrimary();
+    void ParseCall(const std::string& name);
+    void ParseMetric(const std::string& name, metric_unit_t unit);
+    std::string ParseName();
+    std::string ParseString();
+    void Skip();
+    bool Accept(const char* token);
+    void Expect(const char* token);
+    void Fail(const char* message);
+    void Emit(opcode_t code, float value=0);
+    static int Arity(opcode_t code);
+    static float Apply(opcode_t code, float a, float b=0, float c=0);
+
+  protected:
+    std::vector<op_t>   m_code;
+    std::vector<ref_t>  m_refs;
+    uint32_t            m_deletes;      // MyMetrics.m_deletecount at last lookup
+    const char*         m_src;          // compiler: source position
+    const char*         m_err;          // compiler: error message
+    const char*         m_errpos;       // compiler: error position
+    int                 m_depth;        // compiler: stack depth
+    int                 m_maxdepth;     // compiler: max stack depth
+  };
+
+#endif //#ifndef __OBD2EXPR_H__
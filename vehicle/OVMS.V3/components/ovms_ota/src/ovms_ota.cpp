@@ -53,6 +53,8 @@ static const char *TAG = "ota";
 #include "ovms_netmanager.h"
 #include "ovms_version.h"
 #include "crypt_md5.h"
+#include "ovms_vfs.h"
+#include "ovms_tracer.h"
 
 OvmsOTA MyOTA __attribute__ ((init_priority (4400)));
 
@@ -165,8 +167,8 @@ void ota_flash_vfs(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
     }
   writer->printf("Source image is %d bytes in size\n",ds.st_size);
 
-  FILE* f = fopen(argv[0], "r");
-  if (f == NULL)
+  VfsStreamReader reader;
+  if (!reader.Open(argv[0]))
     {
     writer->printf("Error: Cannot open %s\n",argv[0]);
     return;
@@ -178,24 +180,26 @@ void ota_flash_vfs(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
   if (err != ESP_OK)
     {
     writer->printf("Error: ESP32 error #%d when starting OTA operation\n",err);
-    fclose(f);
     return;
     }
 
   writer->puts("Flashing image partition...");
-  char buf[512];
-  while(size_t n = fread(buf, sizeof(char), sizeof(buf), f))
+  ssize_t res = reader.Process([&err,otah](const uint8_t* data, size_t len) -> bool
+    {
+    OVMS_TRACE_SPAN("ota.write");
+    err = esp_ota_write(otah, data, len);
+    return (err == ESP_OK);
+    });
+  reader.Close();
+  if (res < 0)
     {
-    err = esp_ota_write(otah, buf, n);
     if (err != ESP_OK)
-      {
       writer->printf("Error: ESP32 error #%d when writing to flash - state is inconsistent\n",err);
-      esp_ota_end(otah);
-      fclose(f);
-      return;
-      }
+    else
+      writer->printf("Error: Cannot read %s - state is inconsistent\n",argv[0]);
+    esp_ota_end(otah);
+    return;
     }
-  fclose(f);
 
   err = esp_ota_end(otah);
   if (err != ESP_OK)
@@ -204,8 +208,6 @@ void ota_flash_vfs(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
     return;
     }
 
-  fclose(f);
-
   writer->puts("Setting boot partition...");
   err = esp_ota_set_boot_partition(target);
   if (err != ESP_OK)
@@ -325,7 +327,10 @@ void ota_flash_http(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
       http.Disconnect();
       return;
       }
+    {
+    OVMS_TRACE_SPAN("ota.write");
     err = esp_ota_write(otah, rbuf, k);
+    }
     if (err != ESP_OK)
       {
       writer->printf("Error: ESP32 error #%d when writing to flash - state is inconsistent\n",err);
@@ -427,8 +432,8 @@ void ota_boot(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, con
 #ifdef CONFIG_OVMS_COMP_SDCARD
 void OvmsOTA::AutoFlashSD(std::string event, void* data)
   {
-  FILE* f = fopen("/sd/ovms3.bin", "r");
-  if (f == NULL) return;
+  VfsStreamReader reader;
+  if (!reader.Open("/sd/ovms3.bin")) return;
 
   const esp_partition_t *running = esp_ota_get_running_partition();
   const esp_partition_t *target = esp_ota_get_next_update_partition(running);
@@ -437,14 +442,12 @@ void OvmsOTA::AutoFlashSD(std::string event, void* data)
   if (!m_lock.IsLocked())
     {
     ESP_LOGW(TAG, "AutoFlashSD: Flash operation already in progress - cannot auto flash");
-    fclose(f);
     return;
     }
 
   if (running==NULL)
     {
     ESP_LOGE(TAG, "AutoFlashSD Error: Current running image cannot be determined - aborting");
-    fclose(f);
     return;
     }
   ESP_LOGW(TAG, "AutoFlashSD Current running partition is: %s",running->label);
@@ -452,7 +455,6 @@ void OvmsOTA::AutoFlashSD(std::string event, void* data)
   if (target==NULL)
     {
     ESP_LOGE(TAG, "AutoFlashSD Error: Target partition cannot be determined - aborting");
-    fclose(f);
     return;
     }
   ESP_LOGW(TAG, "AutoFlashSD Target partition is: %s",target->label);
@@ -460,7 +462,6 @@ void OvmsOTA::AutoFlashSD(std::string event, void* data)
   if (running == target)
     {
     ESP_LOGE(TAG, "AutoFlashSD Error: Cannot flash to running image partition");
-    fclose(f);
     return;
     }
 
@@ -468,7 +469,6 @@ void OvmsOTA::AutoFlashSD(std::string event, void* data)
   if (stat("/sd/ovms3.bin", &ds) != 0)
     {
     ESP_LOGE(TAG, "AutoFlashSD Error: Cannot stat file");
-    fclose(f);
     return;
     }
   ESP_LOGW(TAG, "AutoFlashSD Source image is %d bytes in size",(int)ds.st_size);
@@ -479,26 +479,27 @@ void OvmsOTA::AutoFlashSD(std::string event, void* data)
   if (err != ESP_OK)
     {
     ESP_LOGE(TAG, "AutoFlashSD Error: ESP32 error #%d when starting OTA operation",err);
-    fclose(f);
     return;
     }
 
   ESP_LOGW(TAG, "AutoFlashSD Flashing image partition...");
-  char buf[512];
-  while(size_t n = fread(buf, sizeof(char), sizeof(buf), f))
+  ssize_t res = reader.Process([&err,otah](const uint8_t* data, size_t len) -> bool
+    {
+    OVMS_TRACE_SPAN("ota.write");
+    err = esp_ota_write(otah, data, len);
+    return (err == ESP_OK);
+    });
+  reader.Close();
+  if (res < 0)
     {
-    err = esp_ota_write(otah, buf, n);
     if (err != ESP_OK)
-      {
       ESP_LOGE(TAG, "AutoFlashSD Error: ESP32 error #%d when writing to flash - state is inconsistent",err);
-      esp_ota_end(otah);
-      fclose(f);
-      return;
-      }
+    else
+      ESP_LOGE(TAG, "AutoFlashSD Error: Cannot read image - state is inconsistent");
+    esp_ota_end(otah);
+    return;
     }
 
-  fclose(f);
-
   err = esp_ota_end(otah);
   if (err != ESP_OK)
     {
@@ -790,7 +791,10 @@ bool OvmsOTA::AutoFlash(bool force)
       http.Disconnect();
       return false;
       }
+    {
+    OVMS_TRACE_SPAN("ota.write");
     err = esp_ota_write(otah, rbuf, k);
+    }
     if (err != ESP_OK)
       {
       ESP_LOGE(TAG, "AutoFlash: ESP32 error #%d when writing to flash - state is inconsistent", err);
@@ -42,7 +42,6 @@ static const char *TAG = "script";
 #include "ovms_config.h"
 #include "ovms_command.h"
 #include "ovms_events.h"
-#include "console_async.h"
 #include "buffered_shell.h"
 
 OvmsScripts MyScripts __attribute__ ((init_priority (1600)));
@@ -1022,7 +1021,7 @@ static void script_compact(int verbosity, OvmsWriter* writer, OvmsCommand* cmd,
 static void script_ovms(bool print, int verbosity, OvmsWriter* writer,
   const char* spath, FILE* sf, bool secure=false)
   {
-  char *ext = rindex(spath, '.');
+  const char *ext = strrchr(spath, '.');
   if ((ext != NULL)&&(strcmp(ext,".js")==0))
     {
     // Javascript script
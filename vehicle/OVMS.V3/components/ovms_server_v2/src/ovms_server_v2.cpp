@@ -1745,7 +1745,7 @@ OvmsServerV2::OvmsServerV2(const char* name)
   #undef bind  // Kludgy, but works
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyMetrics.RegisterListener(TAG, "*", std::bind(&OvmsServerV2::MetricModified, this, _1));
+  MyMetrics.RegisterListener(TAG, "*", std::bind(&OvmsServerV2::MetricModified, this, _1), true);
 
   if (MyOvmsServerV2Reader == 0)
     {
@@ -33,14 +33,18 @@ static const char *TAG = "ovms-server-v3";
 
 #include <string.h>
 #include <stdint.h>
+#include <esp_timer.h>
 #include "ovms_server_v3.h"
 #include "buffered_shell.h"
+#include "command_pool.h"
 #include "ovms_command.h"
 #include "ovms_metrics.h"
 #include "metrics_standard.h"
 
 OvmsServerV3 *MyOvmsServerV3 = NULL;
+OvmsMutex MyOvmsServerV3Lock;   // held while deleting MyOvmsServerV3 (command workers)
 size_t MyOvmsServerV3Modifier = 0;
+size_t MyOvmsServerV3JournalModifier = 0;
 size_t MyOvmsServerV3Reader = 0;
 
 bool OvmsServerV3ReaderCallback(OvmsNotifyType* type, OvmsNotifyEntry* entry)
@@ -164,6 +168,12 @@ static void OvmsServerV3MongooseCallback(struct mg_connection *nc, int ev, void
     case MG_EV_MQTT_PUBCOMP:
       ESP_LOGV(TAG, "OvmsServerV3MongooseCallback(MG_EV_MQTT_PUBCOMP)");
       break;
+    case MG_EV_SEND:
+      if (MyOvmsServerV3 && MyOvmsServerV3->m_sync.pending && nc->send_mbuf.len == 0)
+        {
+        MyOvmsServerV3->SyncSent();
+        }
+      break;
     case MG_EV_CLOSE:
       ESP_LOGV(TAG, "OvmsServerV3MongooseCallback(MG_EV_CLOSE)");
       if (MyOvmsServerV3)
@@ -184,6 +194,7 @@ OvmsServerV3::OvmsServerV3(const char* name)
     {
     MyOvmsServerV3Modifier = MyMetrics.RegisterModifier();
     ESP_LOGI(TAG, "OVMS Server V3 registered metric modifier is #%d",MyOvmsServerV3Modifier);
+    MyOvmsServerV3JournalModifier = MyMetrics.RegisterModifier();
     }
 
   SetStatus("Server has been started", false, WaitNetwork);
@@ -203,13 +214,22 @@ OvmsServerV3::OvmsServerV3(const char* name)
   m_notify_data_waitcomp = 0;
   m_notify_data_waittype = NULL;
   m_notify_data_waitentry = NULL;
+  m_metrics_batch = false;
+  m_tx_metrics = 0;
+  m_tx_msgs = 0;
+  m_tx_bytes = 0;
+  memset(&m_sync, 0, sizeof(m_sync));
+  m_synced = false;
+  m_journal_interval = 60;
+  m_journal_rate = 10;
+  m_journal_lasttx = 0;
 
   ESP_LOGI(TAG, "OVMS Server v3 running");
 
   #undef bind  // Kludgy, but works
   using std::placeholders::_1;
   using std::placeholders::_2;
-  MyMetrics.RegisterListener(TAG, "*", std::bind(&OvmsServerV3::MetricModified, this, _1));
+  MyMetrics.RegisterListener(TAG, "*", std::bind(&OvmsServerV3::MetricModified, this, _1), true);
 
   if (MyOvmsServerV3Reader == 0)
     {
@@ -258,13 +278,39 @@ void OvmsServerV3::TransmitAllMetrics()
   if (!m_mgconn)
     return;
 
-  OvmsMetric* metric = MyMetrics.m_first;
-  while (metric != NULL)
+  uint32_t metrics = m_tx_metrics, msgs = m_tx_msgs, bytes = m_tx_bytes;
+  m_sync.start = esp_timer_get_time();
+
+  if (m_metrics_batch)
     {
-    metric->ClearModified(MyOvmsServerV3Modifier);
-    TransmitMetric(metric);
-    metric = metric->m_next;
+    TransmitMetricBatch(true);
+    }
+  else
+    {
+    OvmsMetric* metric = MyMetrics.m_first;
+    while (metric != NULL)
+      {
+      metric->ClearModified(MyOvmsServerV3Modifier);
+      TransmitMetric(metric);
+      metric = metric->m_next;
+      }
     }
+
+  m_sync.metrics = m_tx_metrics - metrics;
+  m_sync.msgs = m_tx_msgs - msgs;
+  m_sync.bytes = m_tx_bytes - bytes;
+  m_sync.encode_us = esp_timer_get_time() - m_sync.start;
+  m_sync.send_us = 0;
+  m_sync.pending = true;
+  ESP_LOGI(TAG, "Full sync: %u metrics in %u msgs, %u bytes, encoded in %u ms",
+    m_sync.metrics, m_sync.msgs, m_sync.bytes, m_sync.encode_us / 1000);
+  }
+
+void OvmsServerV3::SyncSent()
+  {
+  m_sync.send_us = esp_timer_get_time() - m_sync.start;
+  m_sync.pending = false;
+  ESP_LOGI(TAG, "Full sync: %u bytes sent in %u ms", m_sync.bytes, m_sync.send_us / 1000);
   }
 
 void OvmsServerV3::TransmitModifiedMetrics()
@@ -273,6 +319,12 @@ void OvmsServerV3::TransmitModifiedMetrics()
   if (!m_mgconn)
     return;
 
+  if (m_metrics_batch)
+    {
+    TransmitMetricBatch(false);
+    return;
+    }
+
   OvmsMetric* metric = MyMetrics.m_first;
   while (metric != NULL)
     {
@@ -284,26 +336,195 @@ void OvmsServerV3::TransmitModifiedMetrics()
     }
   }
 
-void OvmsServerV3::TransmitMetric(OvmsMetric* metric)
+/**
+ * MetricTopic: get the per metric topic from the cache, create if necessary
+ *  The cache is keyed by the metric pointer, so the entry is validated against
+ *  the metric name in case the metric has been replaced.
+ */
+const extram::string& OvmsServerV3::MetricTopic(OvmsMetric* metric)
   {
-  std::string topic(m_topic_prefix);
+  size_t offset = m_topic_prefix.length() + 7; // strlen("metric/")
+  auto it = m_metric_topics.find(metric);
+  if (it != m_metric_topics.end())
+    {
+    const extram::string& topic = it->second;
+    const char* name = metric->m_name;
+    size_t i = offset;
+    for (; i < topic.length() && *name; i++, name++)
+      {
+      if (topic[i] != ((*name == '.') ? '/' : *name))
+        break;
+      }
+    if (i == topic.length() && *name == 0)
+      return topic;
+    }
+
+  extram::string& topic = m_metric_topics[metric];
+  topic.assign(m_topic_prefix.c_str());
   topic.append("metric/");
   topic.append(metric->m_name);
 
   // Replace '.' inside the metric name by '/' for MQTT like namespacing.
-  for(size_t i = m_topic_prefix.length(); i < topic.length(); i++)
+  for(size_t i = offset; i < topic.length(); i++)
     {
       if(topic[i] == '.')
         topic[i] = '/';
     }
 
+  return topic;
+  }
+
+/**
+ * CountTx: account for an MQTT QoS 0 publish message
+ */
+void OvmsServerV3::CountTx(size_t topiclen, size_t payloadlen, int metrics)
+  {
+  size_t len = 2 + topiclen + payloadlen;
+  size_t hdr = 2;
+  for (size_t rl = len; rl >= 128; rl >>= 7)
+    hdr++;
+  m_tx_metrics += metrics;
+  m_tx_msgs++;
+  m_tx_bytes += hdr + len;
+  }
+
+void OvmsServerV3::TransmitMetric(OvmsMetric* metric)
+  {
+  const extram::string& topic = MetricTopic(metric);
   std::string val = metric->AsString();
 
   mg_mqtt_publish(m_mgconn, topic.c_str(), m_msgid++,
     MG_MQTT_QOS(0) | MG_MQTT_RETAIN, val.c_str(), val.length());
+  CountTx(topic.length(), val.length(), 1);
   ESP_LOGI(TAG,"Tx metric %s=%s",topic.c_str(),val.c_str());
   }
 
+/**
+ * TransmitMetricBatch: transmit all / all modified metrics in one JSON message
+ *  - all=true: retained full sync on topic <prefix>metrics/all
+ *  - all=false: modified metrics on topic <prefix>metrics/update
+ *  Payload: {"<metric name>":<JSON value>,...}
+ */
+void OvmsServerV3::TransmitMetricBatch(bool all)
+  {
+  extram::string msg;
+  msg.reserve(all ? 8192 : 1024);
+  msg = "{";
+  int cnt = 0;
+  for (OvmsMetric* metric = MyMetrics.m_first; metric != NULL; metric = metric->m_next)
+    {
+    if (all)
+      metric->ClearModified(MyOvmsServerV3Modifier);
+    else if (!metric->IsModifiedAndClear(MyOvmsServerV3Modifier))
+      continue;
+    if (cnt++) msg += ',';
+    msg += '"';
+    msg += metric->m_name;
+    msg += "\":";
+    msg += metric->AsJSON().c_str();
+    }
+  if (cnt == 0)
+    return;
+  msg += '}';
+
+  std::string topic(m_topic_prefix);
+  topic.append(all ? "metrics/all" : "metrics/update");
+
+  mg_mqtt_publish(m_mgconn, topic.c_str(), m_msgid++,
+    MG_MQTT_QOS(0) | (all ? MG_MQTT_RETAIN : 0), msg.data(), msg.length());
+  CountTx(topic.length(), msg.length(), cnt);
+  ESP_LOGI(TAG,"Tx metrics %s: %d metrics, %d bytes",topic.c_str(),cnt,(int)msg.length());
+  }
+
+/**
+ * JournalNotification: store notification in the journal while offline
+ *  Returns false if the journal is disabled or unavailable, so the
+ *  notification stays queued in OvmsNotify.
+ */
+bool OvmsServerV3::JournalNotification(const char* type, OvmsNotifyEntry* entry)
+  {
+  if (!m_journal.IsEnabled())
+    return false;
+  std::string topic("notify/");
+  topic.append(type);
+  topic.append("/");
+  topic.append(entry->m_subtype);
+  return m_journal.Add(topic.c_str(), mp_encode(entry->GetValue()));
+  }
+
+/**
+ * JournalMetrics: record time stamped metric changes while offline
+ *  Every journal.interval seconds, the metrics modified since the last
+ *  record are stored as one JSON object {"time":<unix time>,"metrics":{...}}
+ *  for replay on topic <prefix>history/metrics. Module & server status
+ *  metrics (m.*, s.*) are excluded.
+ */
+void OvmsServerV3::JournalMetrics()
+  {
+  int now = StandardMetrics.ms_m_monotonic->AsInt();
+  if (m_journal_lasttx == 0)
+    {
+    // We just went offline, record changes from now on:
+    for (OvmsMetric* metric = MyMetrics.m_first; metric != NULL; metric = metric->m_next)
+      metric->ClearModified(MyOvmsServerV3JournalModifier);
+    m_journal_lasttx = now;
+    return;
+    }
+  if (now < m_journal_lasttx + m_journal_interval)
+    return;
+  m_journal_lasttx = now;
+
+  extram::string msg;
+  msg.reserve(1024);
+  msg = "{\"time\":";
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", (long)time(NULL));
+  msg += buf;
+  msg += ",\"metrics\":{";
+  int cnt = 0;
+  for (OvmsMetric* metric = MyMetrics.m_first; metric != NULL; metric = metric->m_next)
+    {
+    if (!metric->IsModifiedAndClear(MyOvmsServerV3JournalModifier))
+      continue;
+    if ((metric->m_name[0] == 'm' || metric->m_name[0] == 's') && metric->m_name[1] == '.')
+      continue;
+    if (cnt++) msg += ',';
+    msg += '"';
+    msg += metric->m_name;
+    msg += "\":";
+    msg += metric->AsJSON().c_str();
+    }
+  if (cnt == 0)
+    return;
+  msg += "}}";
+  m_journal.Add("history/metrics", msg);
+  }
+
+/**
+ * DrainJournal: replay journal records, rate limited to journal.rate
+ *  records per second and paused while the send buffer is filled
+ */
+void OvmsServerV3::DrainJournal()
+  {
+  OvmsMutexLock mg(&m_mgconn_mutex);
+  if (!m_mgconn)
+    return;
+
+  int sent = m_journal.Drain(m_journal_rate, [this](const char* topic, const extram::string& payload) -> bool
+    {
+    if (m_mgconn->send_mbuf.len > 4096)
+      return false; // wait for the link to catch up
+    std::string t(m_topic_prefix);
+    t.append(topic);
+    int qos = (strncmp(topic, "notify/", 7) == 0) ? 1 : 0;
+    mg_mqtt_publish(m_mgconn, t.c_str(), m_msgid++,
+      MG_MQTT_QOS(qos), payload.data(), payload.length());
+    return true;
+    });
+  if (sent)
+    ESP_LOGI(TAG, "Journal: replayed %d records, %d pending", sent, m_journal.GetDepth());
+  }
+
 int OvmsServerV3::TransmitNotificationInfo(OvmsNotifyEntry* entry)
   {
   std::string topic(m_topic_prefix);
@@ -532,18 +753,35 @@ void OvmsServerV3::RunCommand(std::string client, std::string id, std::string co
   {
   ESP_LOGI(TAG,"Run command: %s",command.c_str());
 
-  BufferedShell* bs = new BufferedShell(false, COMMAND_RESULT_NORMAL);
-  bs->SetSecure(true); // this is an authorized channel
-  bs->ProcessChars(command.c_str(), command.length());
-  bs->ProcessChar('\n');
-  std::string val; bs->Dump(val);
-  delete bs;
-
   std::string topic(m_topic_prefix);
   topic.append("client/");
   topic.append(client);
   topic.append("/response/");
   topic.append(id);
+
+  // Execute by the command worker pool, so we don't block the network task:
+  BufferedShell* bs = new BufferedShell(false, COMMAND_RESULT_NORMAL);
+  bs->SetSecure(true); // this is an authorized channel
+  bool queued = MyCommandPool.Submit(bs, command, [topic](OvmsShell* shell)
+    {
+    std::string val; ((BufferedShell*)shell)->Dump(val);
+    delete shell;
+    // the server may have been stopped meanwhile:
+    OvmsMutexLock lock(&MyOvmsServerV3Lock);
+    if (MyOvmsServerV3)
+      MyOvmsServerV3->TransmitCommandResponse(topic, val);
+    }, "server.v3");
+  if (!queued)
+    {
+    delete bs;
+    TransmitCommandResponse(topic, "Error: command queue full, please retry");
+    }
+  }
+
+void OvmsServerV3::TransmitCommandResponse(std::string topic, std::string val)
+  {
+  OvmsMutexLock mg(&m_mgconn_mutex);
+  if (m_mgconn == NULL) return;
   mg_mqtt_publish(m_mgconn, topic.c_str(), m_msgid++,
     MG_MQTT_QOS(1), val.c_str(), val.length());
   }
@@ -657,6 +895,9 @@ void OvmsServerV3::Connect()
 
   SetStatus("Connecting...", false, Connecting);
   OvmsMutexLock mg(&m_mgconn_mutex);
+  m_metric_topics.clear(); // topic prefix may have changed
+  m_tx_metrics = m_tx_msgs = m_tx_bytes = 0;
+  m_sync.pending = false;
   struct mg_mgr* mgr = MyNetManager.GetMongooseMgr();
   struct mg_connect_opts opts;
   const char* err;
@@ -728,7 +969,7 @@ void OvmsServerV3::MetricModified(OvmsMetric* metric)
   {
   if (!StandardMetrics.ms_s_v3_connected->AsBool()) return;
 
-  if (m_streaming)
+  if (m_streaming && !m_metrics_batch)
     {
     OvmsMutexLock mg(&m_mgconn_mutex);
     if (!m_mgconn)
@@ -754,21 +995,21 @@ bool OvmsServerV3::IncomingNotification(OvmsNotifyType* type, OvmsNotifyEntry* e
   if (strcmp(type->m_name,"info")==0)
     {
     // Info notifications
-    if (!StandardMetrics.ms_s_v3_connected->AsBool()) return false;
+    if (!StandardMetrics.ms_s_v3_connected->AsBool()) return JournalNotification("info", entry);
     TransmitNotificationInfo(entry);
     return true; // Mark it as read, as we've managed to send it
     }
   else if (strcmp(type->m_name,"error")==0)
     {
     // Error notification
-    if (!StandardMetrics.ms_s_v3_connected->AsBool()) return false;
+    if (!StandardMetrics.ms_s_v3_connected->AsBool()) return JournalNotification("error", entry);
     TransmitNotificationError(entry);
     return true; // Mark it as read, as we've managed to send it
     }
   else if (strcmp(type->m_name,"alert")==0)
     {
     // Alert notifications
-    if (!StandardMetrics.ms_s_v3_connected->AsBool()) return false;
+    if (!StandardMetrics.ms_s_v3_connected->AsBool()) return JournalNotification("alert", entry);
     TransmitNotificationAlert(entry);
     return true; // Mark it as read, as we've managed to send it
     }
@@ -800,6 +1041,11 @@ void OvmsServerV3::ConfigChanged(OvmsConfigParam* param)
   m_streaming = MyConfig.GetParamValueInt("vehicle", "stream", 0);
   m_updatetime_connected = MyConfig.GetParamValueInt("server.v3", "updatetime.connected", 60);
   m_updatetime_idle = MyConfig.GetParamValueInt("server.v3", "updatetime.idle", 600);
+  m_metrics_batch = MyConfig.GetParamValueBool("server.v3", "metrics.batch", false);
+  m_journal_interval = MyConfig.GetParamValueInt("server.v3", "journal.interval", 60);
+  m_journal_rate = MyConfig.GetParamValueInt("server.v3", "journal.rate", 10);
+  m_journal.Configure(MyConfig.GetParamValue("server.v3", "journal.path"),
+    MyConfig.GetParamValueInt("server.v3", "journal.maxsize", 256));
   }
 
 void OvmsServerV3::NetUp(std::string event, void* data)
@@ -864,6 +1110,7 @@ void OvmsServerV3::Ticker1(std::string event, void* data)
 
   if (StandardMetrics.ms_s_v3_connected->AsBool())
     {
+    m_journal_lasttx = 0;
     if (m_sendall)
       {
       ESP_LOGI(TAG, "Subscribe to MQTT topics");
@@ -875,11 +1122,24 @@ void OvmsServerV3::Ticker1(std::string event, void* data)
         }
       mg_mqtt_subscribe(m_mgconn, topics, MQTT_CONN_NTOPICS, m_msgid++);
 
-      ESP_LOGI(TAG, "Transmit all metrics");
-      TransmitAllMetrics();
+      if (m_synced && m_journal.IsEnabled() && !m_metrics_batch)
+        {
+        // The server holds our retained metrics from the last session,
+        // so only the metrics modified while offline need to be sent:
+        ESP_LOGI(TAG, "Transmit modified metrics");
+        TransmitModifiedMetrics();
+        }
+      else
+        {
+        ESP_LOGI(TAG, "Transmit all metrics");
+        TransmitAllMetrics();
+        }
+      m_synced = true;
       m_sendall = false;
       }
 
+    if (m_journal.GetDepth() > 0) DrainJournal();
+
     if (m_notify_info_pending) TransmitPendingNotificationsInfo();
     if (m_notify_error_pending) TransmitPendingNotificationsError();
     if (m_notify_alert_pending) TransmitPendingNotificationsAlert();
@@ -897,9 +1157,15 @@ void OvmsServerV3::Ticker1(std::string event, void* data)
     else if (m_streaming && caron && m_peers && now > m_lasttx_stream+m_streaming)
       {
       // TODO: transmit streaming metrics
+      if (m_metrics_batch)
+        TransmitModifiedMetrics();
       m_lasttx_stream = now;
       }
     }
+  else if (m_journal.IsEnabled())
+    {
+    JournalMetrics();
+    }
   }
 
 void OvmsServerV3::Ticker60(std::string event, void* data)
@@ -937,6 +1203,7 @@ void ovmsv3_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
   {
   if (MyOvmsServerV3 != NULL)
     {
+    OvmsMutexLock lock(&MyOvmsServerV3Lock);
     delete MyOvmsServerV3;
     MyOvmsServerV3 = NULL;
     }
@@ -978,6 +1245,20 @@ void ovmsv3_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
         break;
       }
     writer->printf("       %s\n",MyOvmsServerV3->m_status.c_str());
+    writer->printf("Metrics: %s mode, %u metrics in %u msgs, %u bytes sent since connect\n",
+      MyOvmsServerV3->m_metrics_batch ? "batched" : "per-metric",
+      MyOvmsServerV3->m_tx_metrics, MyOvmsServerV3->m_tx_msgs, MyOvmsServerV3->m_tx_bytes);
+    const OvmsServerV3SyncStats& sync = MyOvmsServerV3->m_sync;
+    if (sync.start)
+      {
+      writer->printf("Last full sync: %u metrics in %u msgs, %u bytes, encoded in %u ms, ",
+        sync.metrics, sync.msgs, sync.bytes, sync.encode_us / 1000);
+      if (sync.pending)
+        writer->puts("sending...");
+      else
+        writer->printf("sent in %u ms\n", sync.send_us / 1000);
+      }
+    MyOvmsServerV3->m_journal.Status(writer);
     }
   }
 
@@ -1002,6 +1283,11 @@ OvmsServerV3Init::OvmsServerV3Init()
   //   'server': The server name/ip
   //   'user': The server username
   //   'port': The port to connect to (default: 1883)
+  //   'metrics.batch': yes = transmit metrics as JSON batches (default: no)
+  //   'journal.path': store-and-forward journal file while offline (default: none)
+  //   'journal.maxsize': journal size limit in kB (default: 256)
+  //   'journal.interval': metrics recording interval in seconds (default: 60)
+  //   'journal.rate': replay rate in records per second (default: 10)
   // Also note:
   //  Parameter "vehicle", instance "id", is the vehicle ID
   //  Parameter "password", instance "server.v3", is the server password
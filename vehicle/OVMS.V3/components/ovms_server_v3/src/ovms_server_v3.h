@@ -39,8 +39,23 @@
 #include "ovms_notify.h"
 #include "ovms_config.h"
 #include "ovms_mutex.h"
+#include "ovms.h"
+#include "ovms_server_v3_journal.h"
 
 typedef std::map<std::string, uint32_t> OvmsServerV3ClientMap;
+typedef std::map<OvmsMetric*, extram::string> OvmsServerV3TopicMap;
+
+// Metric transmission statistics of the last full sync:
+typedef struct
+  {
+  int64_t start;                // esp_timer start time [us]
+  uint32_t metrics;             // number of metrics
+  uint32_t msgs;                // number of MQTT publish messages
+  uint32_t bytes;               // MQTT packet bytes (excl. TCP/TLS overhead)
+  uint32_t encode_us;           // time to encode & queue all messages [us]
+  uint32_t send_us;             // time until the send buffer has been drained [us]
+  bool pending;                 // waiting for send buffer to drain
+  } OvmsServerV3SyncStats;
 
 #define MQTT_CONN_NTOPICS 2
 
@@ -108,6 +123,17 @@ class OvmsServerV3 : public OvmsServer
     OvmsNotifyType* m_notify_data_waittype;
     OvmsNotifyEntry* m_notify_data_waitentry;
     OvmsServerV3ClientMap m_clients;
+    OvmsServerV3TopicMap m_metric_topics;
+    bool m_metrics_batch;
+    uint32_t m_tx_metrics;
+    uint32_t m_tx_msgs;
+    uint32_t m_tx_bytes;
+    OvmsServerV3SyncStats m_sync;
+    bool m_synced;
+    OvmsServerV3Journal m_journal;
+    int m_journal_interval;
+    int m_journal_rate;
+    int m_journal_lasttx;
 
   public:
     virtual void SetPowerMode(PowerMode powermode);
@@ -127,12 +153,22 @@ class OvmsServerV3 : public OvmsServer
     void IncomingPubRec(int id);
     void IncomingEvent(std::string event, void* data);
     void RunCommand(std::string client, std::string id, std::string command);
+    void TransmitCommandResponse(std::string topic, std::string val);
     void AddClient(std::string id);
     void RemoveClient(std::string id);
     void CountClients();
 
   private:
     void TransmitMetric(OvmsMetric* metric);
+    void TransmitMetricBatch(bool all);
+    const extram::string& MetricTopic(OvmsMetric* metric);
+    void CountTx(size_t topiclen, size_t payloadlen, int metrics);
+    bool JournalNotification(const char* type, OvmsNotifyEntry* entry);
+    void JournalMetrics();
+    void DrainJournal();
+
+  public:
+    void SyncSent();
   };
 
 class OvmsServerV3Init
@@ -0,0 +1,465 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+#include "ovms_log.h"
+static const char *TAG = "ovms-server-v3";
+
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ovms_server_v3_journal.h"
+#include "ovms_config.h"
+#include "ovms_utils.h"
+#include "metrics_standard.h"
+#ifdef CONFIG_OVMS_COMP_SDCARD
+#include "ovms_peripherals.h"
+#endif // #ifdef CONFIG_OVMS_COMP_SDCARD
+
+OvmsServerV3Journal::OvmsServerV3Journal()
+  {
+  m_maxsize = 0;
+  m_scanned = false;
+  m_cur_size = 0;
+  m_cur_records = 0;
+  m_old_records = 0;
+  m_read_old = false;
+  m_read_pos = 0;
+  m_last_added_time = 0;
+  m_last_sent_time = 0;
+  m_dropped = 0;
+  m_deduped = 0;
+  m_replayed = 0;
+
+  m_metric_depth = MyMetrics.InitInt("s.v3.journal.depth", SM_STALE_MAX, 0);
+  m_metric_dropped = MyMetrics.InitInt("s.v3.journal.dropped", SM_STALE_MAX, 0);
+  m_metric_replayed = MyMetrics.InitInt("s.v3.journal.replayed", SM_STALE_MAX, 0);
+  m_metric_rate = MyMetrics.InitInt("s.v3.journal.rate", SM_STALE_MAX, 0);
+  }
+
+OvmsServerV3Journal::~OvmsServerV3Journal()
+  {
+  }
+
+/**
+ * Configure: set journal file path & size limit, path "" = disable
+ */
+void OvmsServerV3Journal::Configure(std::string path, int maxsize_kb)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (maxsize_kb < 8) maxsize_kb = 8;
+  if (path == m_path && maxsize_kb*1024 == m_maxsize)
+    return;
+
+  if (!path.empty() && MyConfig.ProtectedPath(path))
+    {
+    ESP_LOGE(TAG, "Journal: path '%s' is protected, journal disabled", path.c_str());
+    path.clear();
+    }
+
+  m_path = path;
+  m_maxsize = maxsize_kb*1024;
+  m_scanned = false;
+  m_cur_size = m_cur_records = m_old_records = 0;
+  m_read_old = false;
+  m_read_pos = 0;
+  m_last_added.clear();
+  m_last_sent.clear();
+
+  if (!m_path.empty())
+    {
+    ESP_LOGI(TAG, "Journal: using '%s', max size %d kB", m_path.c_str(), maxsize_kb);
+    if (Available()) Scan();
+    }
+  UpdateMetrics();
+  }
+
+bool OvmsServerV3Journal::Available()
+  {
+  if (m_path.empty())
+    return false;
+#ifdef CONFIG_OVMS_COMP_SDCARD
+  if (startsWith(m_path, "/sd") && (!MyPeripherals || !MyPeripherals->m_sdcard || !MyPeripherals->m_sdcard->isavailable()))
+    return false;
+#endif // #ifdef CONFIG_OVMS_COMP_SDCARD
+  return true;
+  }
+
+/**
+ * CountRecords: count records in a journal file starting at pos
+ */
+int OvmsServerV3Journal::CountRecords(const std::string& path, long pos)
+  {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f)
+    return 0;
+  int cnt = 0;
+  if (pos == 0 || fseek(f, pos, SEEK_SET) == 0)
+    {
+    int c;
+    while ((c = getc(f)) != EOF)
+      {
+      if (c == '\n') cnt++;
+      }
+    }
+  fclose(f);
+  return cnt;
+  }
+
+/**
+ * Scan: read replay position and count pending records
+ */
+void OvmsServerV3Journal::Scan()
+  {
+  std::string pospath = m_path + ".pos";
+  FILE* f = fopen(pospath.c_str(), "r");
+  if (f)
+    {
+    int old = 0;
+    long pos = 0;
+    if (fscanf(f, "%d %ld", &old, &pos) == 2)
+      {
+      m_read_old = (old != 0);
+      m_read_pos = pos;
+      }
+    fclose(f);
+    }
+
+  std::string oldpath = m_path + ".old";
+  if (m_read_old && !path_exists(oldpath))
+    {
+    m_read_old = false;
+    m_read_pos = 0;
+    }
+  m_old_records = m_read_old ? CountRecords(oldpath, m_read_pos) : 0;
+  m_cur_records = CountRecords(m_path, m_read_old ? 0 : m_read_pos);
+  struct stat st;
+  m_cur_size = (stat(m_path.c_str(), &st) == 0) ? st.st_size : 0;
+  m_scanned = true;
+
+  if (m_old_records + m_cur_records)
+    ESP_LOGI(TAG, "Journal: %d records pending", m_old_records + m_cur_records);
+  }
+
+/**
+ * Rotate: current file becomes old file, unsent records of old file are dropped
+ */
+void OvmsServerV3Journal::Rotate()
+  {
+  std::string oldpath = m_path + ".old";
+  if (m_old_records)
+    {
+    ESP_LOGW(TAG, "Journal: size limit reached, dropping %d records", m_old_records);
+    m_dropped += m_old_records;
+    }
+  unlink(oldpath.c_str());
+  if (rename(m_path.c_str(), oldpath.c_str()) != 0)
+    {
+    ESP_LOGE(TAG, "Journal: rename '%s' failed, clearing journal", m_path.c_str());
+    m_dropped += m_cur_records;
+    unlink(m_path.c_str());
+    m_cur_records = 0;
+    m_read_pos = 0;
+    }
+  if (m_read_old)
+    m_read_pos = 0;   // old file dropped, continue at start of former current file
+  m_read_old = (m_cur_records > 0);
+  if (!m_read_old)
+    {
+    unlink(oldpath.c_str());
+    m_read_pos = 0;
+    }
+  m_old_records = m_cur_records;
+  m_cur_records = 0;
+  m_cur_size = 0;
+  SavePosition();
+  }
+
+void OvmsServerV3Journal::SavePosition()
+  {
+  std::string pospath = m_path + ".pos";
+  if (!m_read_old && m_read_pos == 0)
+    {
+    unlink(pospath.c_str());
+    return;
+    }
+  FILE* f = fopen(pospath.c_str(), "w");
+  if (f)
+    {
+    fprintf(f, "%d %ld\n", m_read_old ? 1 : 0, m_read_pos);
+    fclose(f);
+    }
+  }
+
+/**
+ * Add: append a record
+ *  - topic: topic suffix (appended to the server topic prefix on replay)
+ *  - time: record time, 0 = now
+ *  Returns false if the journal is disabled or not available.
+ */
+bool OvmsServerV3Journal::Add(const char* topic, const extram::string& payload, time_t time)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (!Available())
+    return false;
+  if (!m_scanned)
+    Scan();
+
+  if (time == 0) time = ::time(NULL);
+  std::string key(topic);
+  key.append("\t");
+  key.append(payload.data(), payload.size());
+  if (IsDuplicate(key, time, m_last_added, m_last_added_time))
+    {
+    m_deduped++;
+    return true;
+    }
+
+  FILE* f = fopen(m_path.c_str(), "a");
+  if (!f)
+    {
+    ESP_LOGE(TAG, "Journal: can't write to '%s'", m_path.c_str());
+    return false;
+    }
+  int len = fprintf(f, "%ld %s ", (long)time, topic);
+  for (char c : payload)
+    {
+    switch (c)
+      {
+      case '\\': fputs("\\\\", f); len += 2; break;
+      case '\n': fputs("\\n", f); len += 2; break;
+      case '\r': fputs("\\r", f); len += 2; break;
+      default: fputc(c, f); len++; break;
+      }
+    }
+  fputc('\n', f);
+  len++;
+  bool ok = !ferror(f);
+  fclose(f);
+  if (!ok)
+    {
+    ESP_LOGE(TAG, "Journal: writing to '%s' failed", m_path.c_str());
+    return false;
+    }
+
+  m_last_added = key;
+  m_last_added_time = time;
+  m_cur_size += len;
+  m_cur_records++;
+  if (m_cur_size > m_maxsize/2)
+    Rotate();
+  UpdateMetrics();
+  return true;
+  }
+
+/**
+ * IsDuplicate: same record as the last one, within the dedup window
+ */
+bool OvmsServerV3Journal::IsDuplicate(const std::string& key, time_t time, const std::string& lastkey, time_t lasttime)
+  {
+  return key == lastkey && time >= lasttime && time - lasttime < OVMS_V3_JOURNAL_DEDUP_WINDOW;
+  }
+
+/**
+ * ReadRecord: read & decode next record, false = EOF
+ */
+bool OvmsServerV3Journal::ReadRecord(FILE* f, time_t& time, std::string& topic, extram::string& payload)
+  {
+  extram::string line;
+  char buf[256];
+  while (fgets(buf, sizeof(buf), f))
+    {
+    line.append(buf);
+    if (!line.empty() && line.back() == '\n')
+      break;
+    }
+  if (line.empty() || line.back() != '\n')
+    return false;
+
+  size_t p1 = line.find(' ');
+  size_t p2 = (p1 == extram::string::npos) ? p1 : line.find(' ', p1+1);
+  topic.clear();
+  payload.clear();
+  if (p2 == extram::string::npos)
+    return true;  // invalid record, skip
+  time = (time_t)strtol(line.c_str(), NULL, 10);
+  topic.assign(line.data()+p1+1, p2-p1-1);
+  payload.reserve(line.size()-p2);
+  for (size_t i = p2+1; i < line.size()-1; i++)
+    {
+    char c = line[i];
+    if (c == '\\' && i+1 < line.size()-1)
+      {
+      c = line[++i];
+      if (c == 'n') c = '\n';
+      else if (c == 'r') c = '\r';
+      }
+    payload += c;
+    }
+  return true;
+  }
+
+/**
+ * Drain: replay up to maxcount records via sender
+ *  The sender returns false if it cannot take more records now (the record
+ *  will be retried on the next call).
+ *  Returns the number of records sent.
+ */
+int OvmsServerV3Journal::Drain(int maxcount, OvmsServerV3JournalSender sender)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (!Available())
+    return 0;
+  if (!m_scanned)
+    Scan();
+  if (GetDepth() == 0)
+    {
+    *m_metric_rate = 0;
+    return 0;
+    }
+
+  int sent = 0;
+  time_t time;
+  std::string topic;
+  extram::string payload;
+  while (sent < maxcount && GetDepth() > 0)
+    {
+    std::string path = m_read_old ? m_path + ".old" : m_path;
+    FILE* f = fopen(path.c_str(), "r");
+    if (f && fseek(f, m_read_pos, SEEK_SET) != 0)
+      {
+      fclose(f);
+      f = NULL;
+      }
+    bool eof = true;
+    while (f)
+      {
+      if (sent >= maxcount)
+        {
+        eof = false;
+        break;
+        }
+      if (!ReadRecord(f, time, topic, payload))
+        break;
+      if (!topic.empty())
+        {
+        std::string key(topic);
+        key.append("\t");
+        key.append(payload.data(), payload.size());
+        if (IsDuplicate(key, time, m_last_sent, m_last_sent_time))
+          {
+          m_deduped++;
+          }
+        else if (sender(topic.c_str(), payload))
+          {
+          m_last_sent = key;
+          m_last_sent_time = time;
+          sent++;
+          }
+        else
+          {
+          eof = false;  // blocked, retry this record next time
+          break;
+          }
+        }
+      m_read_pos = ftell(f);
+      if (m_read_old)
+        { if (m_old_records) m_old_records--; }
+      else
+        { if (m_cur_records) m_cur_records--; }
+      }
+    if (f) fclose(f);
+    if (!eof)
+      break;
+
+    // file done:
+    unlink(path.c_str());
+    m_read_pos = 0;
+    if (m_read_old)
+      {
+      m_read_old = false;
+      m_old_records = 0;
+      }
+    else
+      {
+      m_cur_records = 0;
+      m_cur_size = 0;
+      m_last_added.clear();
+      break;
+      }
+    }
+
+  m_replayed += sent;
+  SavePosition();
+  *m_metric_rate = sent;
+  UpdateMetrics();
+  return sent;
+  }
+
+int OvmsServerV3Journal::GetDepth()
+  {
+  return m_old_records + m_cur_records;
+  }
+
+void OvmsServerV3Journal::Clear()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (m_path.empty())
+    return;
+  m_dropped += m_old_records + m_cur_records;
+  unlink((m_path + ".old").c_str());
+  unlink(m_path.c_str());
+  m_cur_size = m_cur_records = m_old_records = 0;
+  m_read_old = false;
+  m_read_pos = 0;
+  m_last_added.clear();
+  SavePosition();
+  UpdateMetrics();
+  }
+
+void OvmsServerV3Journal::UpdateMetrics()
+  {
+  *m_metric_depth = GetDepth();
+  *m_metric_dropped = (int)m_dropped;
+  *m_metric_replayed = (int)m_replayed;
+  }
+
+void OvmsServerV3Journal::Status(OvmsWriter* writer)
+  {
+  if (m_path.empty())
+    {
+    writer->puts("Journal: disabled");
+    return;
+    }
+  writer->printf("Journal: %s%s, %d records pending (%ld of %ld bytes)\n"
+    "         %u replayed, %u deduplicated, %u dropped\n",
+    m_path.c_str(), Available() ? "" : " (not available)",
+    GetDepth(), m_cur_size, m_maxsize/2,
+    m_replayed, m_deduped, m_dropped);
+  }
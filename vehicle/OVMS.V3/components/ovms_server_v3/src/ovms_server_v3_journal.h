@@ -0,0 +1,114 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+#ifndef __OVMS_SERVER_V3_JOURNAL_H__
+#define __OVMS_SERVER_V3_JOURNAL_H__
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <functional>
+#include "ovms.h"
+#include "ovms_mutex.h"
+#include "ovms_metrics.h"
+#include "ovms_shell.h"
+
+/**
+ * OvmsServerV3Journal: bounded persistent store-and-forward queue
+ *
+ * Holds outbound MQTT messages (topic suffix + payload) while the server is
+ * offline. Records are appended to a text file, one per line:
+ *    <unix time> <topic> <payload, with \\, \n & \r escaped>
+ *
+ * The journal consists of two files, <path> (current) and <path>.old. When the
+ * current file exceeds half the maximum size, it becomes the old file. Unsent
+ * records of a previous old file are dropped. The replay position is kept in
+ * <path>.pos so a reboot during replay resumes at the last record sent.
+ *
+ * Consecutive identical records (same topic & payload) are deduplicated on
+ * both recording and replay, if their record times are less than
+ * OVMS_V3_JOURNAL_DEDUP_WINDOW seconds apart (i.e. a repeated alert is kept
+ * once per window).
+ */
+
+#define OVMS_V3_JOURNAL_DEDUP_WINDOW  60    // seconds
+
+typedef std::function<bool(const char* topic, const extram::string& payload)> OvmsServerV3JournalSender;
+
+class OvmsServerV3Journal
+  {
+  public:
+    OvmsServerV3Journal();
+    ~OvmsServerV3Journal();
+
+  public:
+    void Configure(std::string path, int maxsize_kb);
+    bool IsEnabled() { return !m_path.empty(); }
+    bool Add(const char* topic, const extram::string& payload, time_t time = 0);
+    int Drain(int maxcount, OvmsServerV3JournalSender sender);
+    int GetDepth();
+    void Clear();
+    void Status(OvmsWriter* writer);
+
+  private:
+    bool Available();
+    void Scan();
+    void Rotate();
+    int CountRecords(const std::string& path, long pos);
+    bool ReadRecord(FILE* f, time_t& time, std::string& topic, extram::string& payload);
+    static bool IsDuplicate(const std::string& key, time_t time, const std::string& lastkey, time_t lasttime);
+    void SavePosition();
+    void UpdateMetrics();
+
+  protected:
+    OvmsMutex m_mutex;
+    std::string m_path;
+    long m_maxsize;
+    bool m_scanned;
+    long m_cur_size;              // bytes in current file
+    int m_cur_records;            // records in current file
+    int m_old_records;            // unsent records in old file
+    bool m_read_old;              // replay position is in old file
+    long m_read_pos;              // replay position
+    std::string m_last_added;     // last record added (dedup)
+    time_t m_last_added_time;
+    std::string m_last_sent;      // last record sent (dedup)
+    time_t m_last_sent_time;
+    uint32_t m_dropped;
+    uint32_t m_deduped;
+    uint32_t m_replayed;
+
+  protected:
+    OvmsMetricInt* m_metric_depth;
+    OvmsMetricInt* m_metric_dropped;
+    OvmsMetricInt* m_metric_replayed;
+    OvmsMetricInt* m_metric_rate;
+  };
+
+#endif //#ifndef __OVMS_SERVER_V3_JOURNAL_H__
@@ -0,0 +1,848 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "timeseries";
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "esp_timer.h"
+#include "ovms_timeseries.h"
+#include "ovms_events.h"
+#include "ovms_peripherals.h"
+#include "crypt_base64.h"
+
+OvmsTimeSeriesStore MyTimeSeries __attribute__ ((init_priority (1950)));
+
+#define TS_PARAM            "timeseries"
+#define TS_METRICS_PARAM    "timeseries.metrics"
+#define TS_SPILL_PATH       "/sd/timeseries"
+
+static const uint16_t ts_interval[TS_LEVELS] = { 1, 60, 900 };
+static const uint32_t ts_keep_default[TS_LEVELS] = { 3600, 86400, 30*86400 };
+
+
+////////////////////////////////////////////////////////////////////////
+// Varint / zigzag coding
+
+static inline uint32_t ts_zigzag(int32_t v)
+  {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+  }
+
+static inline int32_t ts_unzigzag(uint32_t v)
+  {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+  }
+
+static inline uint8_t* ts_put_varint(uint8_t* p, uint32_t v)
+  {
+  while (v >= 0x80)
+    {
+    *p++ = (v & 0x7f) | 0x80;
+    v >>= 7;
+    }
+  *p++ = v;
+  return p;
+  }
+
+static inline const uint8_t* ts_get_varint(const uint8_t* p, uint32_t* v)
+  {
+  uint32_t res = 0;
+  int shift = 0;
+  do
+    {
+    res |= (uint32_t)(*p & 0x7f) << shift;
+    shift += 7;
+    } while (*p++ & 0x80);
+  *v = res;
+  return p;
+  }
+
+
+////////////////////////////////////////////////////////////////////////
+// OvmsTimeSeriesLevel: ring buffer of delta encoded blocks
+
+OvmsTimeSeriesLevel::OvmsTimeSeriesLevel()
+  {
+  m_interval = 1;
+  m_rollup = false;
+  m_blocks = NULL;
+  m_size = 0;
+  m_head = 0;
+  m_used = 0;
+  m_samples = 0;
+  }
+
+OvmsTimeSeriesLevel::~OvmsTimeSeriesLevel()
+  {
+  if (m_blocks)
+    free(m_blocks);
+  }
+
+/**
+ * Init: allocate ring buffer for the given retention time
+ *  - size estimation: ~1.5 bytes per raw sample, ~4 bytes per rollup sample
+ *  - if the actual data is less compressible, the ring covers less time
+ */
+bool OvmsTimeSeriesLevel::Init(uint16_t interval, bool rollup, uint32_t keep)
+  {
+  if (m_blocks)
+    {
+    free(m_blocks);
+    m_blocks = NULL;
+    }
+  m_interval = interval;
+  m_rollup = rollup;
+  m_head = m_used = m_samples = 0;
+  m_size = 0;
+  if (keep == 0)
+    return true;
+
+  uint32_t bytes = (keep / interval) * (rollup ? 4 : 3) / 2;
+  m_size = bytes / sizeof(ts_block_t::data) + 2;
+  m_blocks = (ts_block_t*) ExternalRamCalloc(m_size, sizeof(ts_block_t));
+  if (!m_blocks)
+    {
+    ESP_LOGE(TAG, "Init: unable to allocate %u blocks", m_size);
+    m_size = 0;
+    return false;
+    }
+  return true;
+  }
+
+ts_block_t* OvmsTimeSeriesLevel::Block(size_t n)
+  {
+  return &m_blocks[(m_head + m_size - m_used + 1 + n) % m_size];
+  }
+
+bool OvmsTimeSeriesLevel::Append(ts_block_t* b, int32_t avg, int32_t min, int32_t max)
+  {
+  uint8_t tmp[15];
+  uint8_t* p = tmp;
+  if (b->count > 0)
+    p = ts_put_varint(p, ts_zigzag(avg - b->last));
+  if (m_rollup)
+    {
+    p = ts_put_varint(p, (uint32_t)(avg - min));
+    p = ts_put_varint(p, (uint32_t)(max - avg));
+    }
+  size_t len = p - tmp;
+  if (b->len + len > sizeof(b->data))
+    return false;
+  memcpy(b->data + b->len, tmp, len);
+  b->len += len;
+  b->last = avg;
+  b->count++;
+  return true;
+  }
+
+void OvmsTimeSeriesLevel::NewBlock(uint32_t time, int32_t avg, int32_t min, int32_t max)
+  {
+  if (m_used > 0)
+    {
+    if (m_spill)
+      m_spill(&m_blocks[m_head]);
+    m_head = (m_head + 1) % m_size;
+    }
+  if (m_used < m_size)
+    m_used++;
+  else
+    m_samples -= m_blocks[m_head].count;
+
+  ts_block_t* b = &m_blocks[m_head];
+  b->start = time;
+  b->first = avg;
+  b->last = avg;
+  b->count = 0;
+  b->len = 0;
+  Append(b, avg, min, max);
+  m_samples++;
+  }
+
+void OvmsTimeSeriesLevel::Add(uint32_t time, int32_t avg, int32_t min, int32_t max)
+  {
+  if (!m_blocks)
+    return;
+
+  if (m_used == 0)
+    {
+    NewBlock(time, avg, min, max);
+    return;
+    }
+
+  ts_block_t* b = &m_blocks[m_head];
+  uint32_t next = b->start + b->count * m_interval;
+  if (time < next)
+    {
+    // repeated sample (ticker jitter) or clock set backwards:
+    if (time + m_interval >= next)
+      return;
+    NewBlock(time, avg, min, max);
+    return;
+    }
+
+  // fill small gaps by repeating the last value:
+  uint32_t missing = (time - next) / m_interval;
+  if (missing > TS_MAX_FILL)
+    {
+    NewBlock(time, avg, min, max);
+    return;
+    }
+  for (; missing > 0; missing--)
+    {
+    if (!Append(b, b->last, b->last, b->last))
+      break;
+    m_samples++;
+    }
+  if (missing > 0 || !Append(b, avg, min, max))
+    NewBlock(time, avg, min, max);
+  else
+    m_samples++;
+  }
+
+uint32_t OvmsTimeSeriesLevel::FirstTime()
+  {
+  return (m_used > 0) ? Block(0)->start : 0;
+  }
+
+size_t OvmsTimeSeriesLevel::Bytes()
+  {
+  size_t bytes = 0;
+  for (size_t n = 0; n < m_used; n++)
+    bytes += TS_BLOCK_HEADER + Block(n)->len;
+  return bytes;
+  }
+
+uint32_t OvmsTimeSeriesLevel::QueryBlocks(uint32_t from, uint32_t to, ts_block_fn fn)
+  {
+  uint32_t cnt = 0;
+  for (size_t n = 0; n < m_used; n++)
+    {
+    const ts_block_t* b = Block(n);
+    if (b->start > to)
+      continue;                       // not break: blocks are unordered after a clock set back
+    if (b->start + (b->count-1) * m_interval < from)
+      continue;
+    fn(b);
+    cnt++;
+    }
+  return cnt;
+  }
+
+uint32_t OvmsTimeSeriesLevel::Query(uint32_t from, uint32_t to, ts_sample_fn fn)
+  {
+  uint32_t cnt = 0;
+  QueryBlocks(from, to, [&](const ts_block_t* b)
+    {
+    const uint8_t* p = b->data;
+    int32_t avg = b->first, min, max;
+    uint32_t time = b->start, v;
+    for (int i = 0; i < b->count; i++, time += m_interval)
+      {
+      if (i > 0)
+        {
+        p = ts_get_varint(p, &v);
+        avg += ts_unzigzag(v);
+        }
+      min = max = avg;
+      if (m_rollup)
+        {
+        p = ts_get_varint(p, &v);
+        min = avg - (int32_t)v;
+        p = ts_get_varint(p, &v);
+        max = avg + (int32_t)v;
+        }
+      if (time > to)
+        break;
+      if (time >= from)
+        {
+        fn(time, avg, min, max);
+        cnt++;
+        }
+      }
+    });
+  return cnt;
+  }
+
+
+////////////////////////////////////////////////////////////////////////
+// OvmsTimeSeries: metric sampling & rollups
+
+OvmsTimeSeries::OvmsTimeSeries(const char* name, OvmsMetric* metric, int scale, const uint32_t* keep)
+  {
+  m_name = name;
+  m_metric = metric;
+  m_units = metric ? metric->GetUnits() : Other;
+  m_scale = scale;
+  m_factor = powf(10, scale);
+  memset(m_acc, 0, sizeof(m_acc));
+  for (int i = 0; i < TS_LEVELS; i++)
+    m_level[i].Init(ts_interval[i], (i > 0), keep[i]);
+  }
+
+OvmsTimeSeries::~OvmsTimeSeries()
+  {
+  }
+
+void OvmsTimeSeries::Sample(uint32_t now)
+  {
+  if (!m_metric || !m_metric->IsDefined() || m_metric->IsStale())
+    return;
+  Add(now, m_metric->AsFloat());
+  }
+
+void OvmsTimeSeries::Add(uint32_t now, float value)
+  {
+  int32_t v = lroundf(value * m_factor);
+  OvmsMutexLock lock(&m_mutex);
+  m_level[0].Add(now, v, v, v);
+  Accumulate(1, now, v, v, v);
+  }
+
+void OvmsTimeSeries::Accumulate(int level, uint32_t time, int32_t avg, int32_t min, int32_t max)
+  {
+  if (level >= TS_LEVELS)
+    return;
+  uint32_t slot = time / ts_interval[level];
+  auto& acc = m_acc[level];
+  if (acc.cnt > 0 && acc.slot != slot)
+    {
+    int32_t ravg = acc.sum / acc.cnt;
+    uint32_t rtime = acc.slot * ts_interval[level];
+    m_level[level].Add(rtime, ravg, acc.min, acc.max);
+    Accumulate(level+1, rtime, ravg, acc.min, acc.max);
+    acc.cnt = 0;
+    }
+  if (acc.cnt == 0)
+    {
+    acc.slot = slot;
+    acc.sum = 0;
+    acc.min = min;
+    acc.max = max;
+    }
+  acc.sum += avg;
+  if (min < acc.min) acc.min = min;
+  if (max > acc.max) acc.max = max;
+  acc.cnt++;
+  }
+
+/**
+ * FindLevel: choose the finest level providing the resolution and covering the span
+ */
+int OvmsTimeSeries::FindLevel(uint32_t resolution, uint32_t span)
+  {
+  uint32_t now = time(NULL);
+  int best = -1;
+  for (int i = 0; i < TS_LEVELS; i++)
+    {
+    if (m_level[i].m_used == 0 || ts_interval[i] < resolution)
+      continue;
+    best = i;
+    if (m_level[i].FirstTime() <= now - span)
+      break;
+    }
+  return best;
+  }
+
+void OvmsTimeSeries::FormatValue(extram::string& buf, int32_t value)
+  {
+  char val[16];
+  if (m_scale > 0)
+    snprintf(val, sizeof(val), "%.*f", m_scale, (float)value / m_factor);
+  else
+    snprintf(val, sizeof(val), "%d", (int)(value / m_factor));
+  buf.append(val);
+  }
+
+/**
+ * QueryJSON: compact JSON representation of a time range
+ *  - samples are given as arrays at fixed intervals beginning at "start"
+ *  - missing samples are null
+ *  - rollup levels deliver "avg", "min" and "max" arrays
+ */
+uint32_t OvmsTimeSeries::QueryJSON(extram::string& buf, int level, uint32_t from, uint32_t to)
+  {
+  if (level < 0 || level >= TS_LEVELS)
+    return 0;
+  OvmsMutexLock lock(&m_mutex);
+  OvmsTimeSeriesLevel& lv = m_level[level];
+  extram::string vmin, vmax;
+  uint32_t start = 0, next = 0;
+  char val[80];
+
+  buf.append("{\"name\":\"");
+  buf.append(m_name.c_str());
+  buf.append("\",\"res\":");
+  buf.append(itoa(lv.m_interval, val, 10));
+  buf.append(",\"unit\":\"");
+  buf.append(OvmsMetricUnitLabel(m_units));
+  buf.append("\",\"avg\":[");
+  uint32_t cnt = 0;
+  lv.Query(from, to, [&](uint32_t time, int32_t avg, int32_t min, int32_t max)
+    {
+    if (start == 0)
+      start = next = time;
+    else if (time < next)
+      return;                         // out of order (clock set back): no slot in the array
+    for (; next < time; next += lv.m_interval, cnt++)
+      {
+      buf.append("null,");
+      if (lv.m_rollup) { vmin.append("null,"); vmax.append("null,"); }
+      }
+    FormatValue(buf, avg);
+    buf.append(",");
+    if (lv.m_rollup)
+      {
+      FormatValue(vmin, min); vmin.append(",");
+      FormatValue(vmax, max); vmax.append(",");
+      }
+    next = time + lv.m_interval;
+    cnt++;
+    });
+  if (cnt > 0)
+    {
+    buf.resize(buf.size()-1);
+    if (lv.m_rollup)
+      {
+      vmin.resize(vmin.size()-1);
+      vmax.resize(vmax.size()-1);
+      }
+    }
+  buf.append("]");
+  if (lv.m_rollup)
+    {
+    buf.append(",\"min\":[");
+    buf.append(vmin);
+    buf.append("],\"max\":[");
+    buf.append(vmax);
+    buf.append("]");
+    }
+  snprintf(val, sizeof(val), ",\"start\":%u,\"count\":%u}", start, cnt);
+  buf.append(val);
+  return cnt;
+  }
+
+/**
+ * QueryBinary: raw block dump of a time range
+ *  - header: "OVTS", version (1), level interval (u16), scale (i8), block count (u16)
+ *  - followed by the matching ts_block_t headers & data (little endian, packed)
+ *  - the first and last block may contain samples outside the range
+ */
+uint32_t OvmsTimeSeries::QueryBinary(extram::string& buf, int level, uint32_t from, uint32_t to)
+  {
+  if (level < 0 || level >= TS_LEVELS)
+    return 0;
+  OvmsMutexLock lock(&m_mutex);
+  OvmsTimeSeriesLevel& lv = m_level[level];
+  size_t hpos = buf.size();
+  buf.append("OVTS\x01", 5);
+  buf.append((const char*)&lv.m_interval, 2);
+  int8_t scale = m_scale;
+  buf.append((const char*)&scale, 1);
+  buf.append(2, '\0');
+  uint16_t cnt = lv.QueryBlocks(from, to, [&buf](const ts_block_t* b)
+    {
+    buf.append((const char*)b, TS_BLOCK_HEADER + b->len);
+    });
+  memcpy(&buf[hpos+8], &cnt, 2);
+  return cnt;
+  }
+
+size_t OvmsTimeSeries::Memory()
+  {
+  size_t mem = sizeof(*this);
+  for (int i = 0; i < TS_LEVELS; i++)
+    mem += m_level[i].Memory();
+  return mem;
+  }
+
+void OvmsTimeSeries::EnableSpill(bool enable)
+  {
+  using std::placeholders::_1;
+  for (int i = 1; i < TS_LEVELS; i++)
+    {
+    if (enable)
+      m_level[i].m_spill = std::bind(&OvmsTimeSeries::Spill, this, i, _1);
+    else
+      m_level[i].m_spill = nullptr;
+    }
+  }
+
+/**
+ * Spill: append completed rollup blocks to the SD card
+ *  - file format: sequence of packed ts_block_t headers & data
+ */
+void OvmsTimeSeries::Spill(int level, const ts_block_t* block)
+  {
+#ifdef CONFIG_OVMS_COMP_SDCARD
+  if (!MyPeripherals || !MyPeripherals->m_sdcard || !MyPeripherals->m_sdcard->ismounted())
+    return;
+  char path[80];
+  snprintf(path, sizeof(path), "%s/%s.%u", TS_SPILL_PATH, m_name.c_str(), ts_interval[level]);
+  FILE* f = fopen(path, "a");
+  if (!f && mkpath(TS_SPILL_PATH) == 0)
+    f = fopen(path, "a");
+  if (!f)
+    {
+    ESP_LOGW(TAG, "Spill: cannot open %s", path);
+    return;
+    }
+  fwrite(block, TS_BLOCK_HEADER + block->len, 1, f);
+  fclose(f);
+#endif // CONFIG_OVMS_COMP_SDCARD
+  }
+
+
+////////////////////////////////////////////////////////////////////////
+// Commands
+
+static void ts_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  OvmsMutexLock lock(&MyTimeSeries.m_mutex);
+  if (MyTimeSeries.m_series.empty())
+    {
+    writer->puts("No time series configured.");
+    return;
+    }
+  size_t total = 0;
+  writer->printf("%-25s %5s %8s %8s %8s %8s\n", "Metric", "Scale", "1s", "1m", "15m", "Memory");
+  for (auto it = MyTimeSeries.m_series.begin(); it != MyTimeSeries.m_series.end(); it++)
+    {
+    OvmsTimeSeries* ts = it->second;
+    if (!ts)
+      {
+      writer->printf("%-25s (metric not available)\n", it->first.c_str());
+      continue;
+      }
+    writer->printf("%-25s %5d %8u %8u %8u %8u\n", it->first.c_str(), ts->m_scale,
+      ts->m_level[0].m_samples, ts->m_level[1].m_samples, ts->m_level[2].m_samples, ts->Memory());
+    total += ts->Memory();
+    }
+  writer->printf("Total memory: %u bytes\n", total);
+  }
+
+static void ts_add(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int scale = (argc > 1) ? atoi(argv[1]) : 1;
+  if (scale < 0 || scale > 6)
+    {
+    writer->puts("Error: scale must be 0…6");
+    return;
+    }
+  MyConfig.SetParamValueInt(TS_METRICS_PARAM, argv[0], scale);
+  if (!MyMetrics.Find(argv[0]))
+    writer->printf("Time series for %s added (metric not yet available)\n", argv[0]);
+  else
+    writer->printf("Time series for %s added\n", argv[0]);
+  }
+
+static void ts_remove(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (!MyConfig.IsDefined(TS_METRICS_PARAM, argv[0]))
+    {
+    writer->puts("Error: no time series for this metric");
+    return;
+    }
+  MyConfig.DeleteInstance(TS_METRICS_PARAM, argv[0]);
+  writer->printf("Time series for %s removed\n", argv[0]);
+  }
+
+static void ts_get(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* name = NULL;
+  uint32_t span = 3600, resolution = 0;
+  bool binary = false;
+  for (int i = 0; i < argc; i++)
+    {
+    if (strcmp(argv[i], "-b") == 0)
+      binary = true;
+    else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+      resolution = atoi(argv[++i]);
+    else if (!name)
+      name = argv[i];
+    else
+      span = atoi(argv[i]);
+    }
+  if (!name)
+    {
+    writer->puts("Error: no metric given");
+    return;
+    }
+
+  OvmsMutexLock lock(&MyTimeSeries.m_mutex);
+  auto it = MyTimeSeries.m_series.find(name);
+  OvmsTimeSeries* ts = (it != MyTimeSeries.m_series.end()) ? it->second : NULL;
+  if (!ts)
+    {
+    writer->puts("Error: no time series for this metric");
+    return;
+    }
+  int level = ts->FindLevel(resolution, span);
+  if (level < 0)
+    {
+    writer->puts("Error: no data");
+    return;
+    }
+
+  uint32_t to = time(NULL);
+  uint32_t from = to - span;
+  extram::string buf;
+  if (binary)
+    {
+    ts->QueryBinary(buf, level, from, to);
+    std::string b64 = base64encode(std::string(buf.data(), buf.size()));
+    writer->write(b64.data(), b64.size());
+    }
+  else
+    {
+    ts->QueryJSON(buf, level, from, to);
+    writer->write(buf.data(), buf.size());
+    }
+  writer->puts("");
+  }
+
+/**
+ * ts_benchmark: storage efficiency & query latency for a synthetic 24 hour series
+ *  - "voltage": slow random walk, scale 2 (like a battery voltage)
+ *  - "power": noisy signal, scale 1 (like a drive power)
+ */
+static void ts_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const uint32_t samples = 86400;
+  const uint32_t keep[TS_LEVELS] = { samples, samples, 30*86400 };
+  uint32_t start = 1500000000;
+  srand(42);
+
+  for (int run = 0; run < 2; run++)
+    {
+    OvmsTimeSeries* ts = new OvmsTimeSeries(run ? "power" : "voltage", NULL, run ? 1 : 2, keep);
+    if (!ts->m_level[0].IsEnabled())
+      {
+      writer->puts("Error: out of memory");
+      delete ts;
+      return;
+      }
+    float value = run ? 0 : 380.0;
+    int64_t t0 = esp_timer_get_time();
+    for (uint32_t i = 0; i < samples; i++)
+      {
+      if (run)
+        value = 20.0 * sinf(i / 600.0) + (rand() % 100) / 10.0;
+      else if ((rand() % 10) == 0)
+        value += ((rand() % 3) - 1) / 100.0;
+      ts->Add(start + i, value);
+      }
+    int64_t t1 = esp_timer_get_time();
+
+    writer->printf("Series '%s' (scale %d): %u samples added in %lld ms = %.2f us/sample\n",
+      ts->m_name.c_str(), ts->m_scale, samples, (t1-t0)/1000, (float)(t1-t0)/samples);
+    for (int i = 0; i < TS_LEVELS; i++)
+      {
+      OvmsTimeSeriesLevel& lv = ts->m_level[i];
+      if (lv.m_samples)
+        writer->printf("  %4us level: %6u samples, %7u bytes = %.2f bytes/sample\n",
+          lv.m_interval, lv.m_samples, lv.Bytes(), (float)lv.Bytes() / lv.m_samples);
+      }
+
+    extram::string buf;
+    uint32_t cnt;
+    struct { int level; uint32_t span; bool binary; } queries[] =
+      { { 0, 3600, false }, { 0, samples, true }, { 1, samples, false }, { 1, samples, true } };
+    for (auto& q : queries)
+      {
+      buf.clear();
+      t0 = esp_timer_get_time();
+      if (q.binary)
+        cnt = ts->QueryBinary(buf, q.level, start + samples - q.span, start + samples);
+      else
+        cnt = ts->QueryJSON(buf, q.level, start + samples - q.span, start + samples);
+      t1 = esp_timer_get_time();
+      writer->printf("  Query %5us @ %2us %-6s: %5u %s, %7u bytes in %6lld us\n",
+        q.span, ts_interval[q.level], q.binary ? "binary" : "JSON",
+        cnt, q.binary ? "blocks " : "samples", buf.size(), t1-t0);
+      }
+
+    delete ts;
+    }
+  }
+
+
+////////////////////////////////////////////////////////////////////////
+// OvmsTimeSeriesStore: configuration & ticker
+
+OvmsTimeSeriesStore::OvmsTimeSeriesStore()
+  {
+  ESP_LOGI(TAG, "Initialising TIMESERIES (1950)");
+
+  for (int i = 0; i < TS_LEVELS; i++)
+    m_keep[i] = ts_keep_default[i];
+  m_spill = false;
+  m_unresolved = false;
+  m_deletes = 0;
+
+  OvmsCommand* cmd_ts = MyCommandApp.RegisterCommand("timeseries","METRIC time series store");
+  cmd_ts->RegisterCommand("status","Show time series status",ts_status);
+  cmd_ts->RegisterCommand("add","Add a metric time series",ts_add,"<metric> [<scale>]\n"
+    "<scale> = number of decimal places to store (default 1)", 1, 2);
+  cmd_ts->RegisterCommand("remove","Remove a metric time series",ts_remove,"<metric>", 1, 1);
+  cmd_ts->RegisterCommand("get","Query a metric time series",ts_get,"<metric> [<seconds>] [-r <resolution>] [-b]\n"
+    "<seconds> = time span back from now (default 3600)\n"
+    "-r = minimum sample interval in seconds (1, 60, 900)\n"
+    "-b = binary output (base64 encoded)", 1, 5);
+  cmd_ts->RegisterCommand("benchmark","Benchmark time series storage & queries",ts_benchmark);
+
+  MyConfig.RegisterParam(TS_PARAM, "Metric time series store", true, true);
+  MyConfig.RegisterParam(TS_METRICS_PARAM, "Metric time series list", true, true);
+
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsTimeSeriesStore::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"config.changed", std::bind(&OvmsTimeSeriesStore::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"vehicle.type.set", std::bind(&OvmsTimeSeriesStore::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"vehicle.type.cleared", std::bind(&OvmsTimeSeriesStore::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&OvmsTimeSeriesStore::Ticker1, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"ticker.10", std::bind(&OvmsTimeSeriesStore::Ticker10, this, _1, _2));
+  }
+
+OvmsTimeSeriesStore::~OvmsTimeSeriesStore()
+  {
+  for (auto it = m_series.begin(); it != m_series.end(); it++)
+    delete it->second;
+  }
+
+void OvmsTimeSeriesStore::EventListener(std::string event, void* data)
+  {
+  if (event == "config.changed")
+    {
+    OvmsConfigParam* param = (OvmsConfigParam*) data;
+    if (param && param->GetName() != TS_PARAM && param->GetName() != TS_METRICS_PARAM)
+      return;
+    }
+  ReloadMap();
+  }
+
+/**
+ * ReloadMap: sync series with configuration
+ *  - series are (re-)created when the metric object changes (i.e. vehicle type change)
+ *  - changing retention times drops all stored data
+ */
+void OvmsTimeSeriesStore::ReloadMap()
+  {
+  OvmsMutexLock lock(&m_mutex);
+
+  bool resize = false;
+  for (int i = 0; i < TS_LEVELS; i++)
+    {
+    char key[16];
+    snprintf(key, sizeof(key), "keep.%u", ts_interval[i]);
+    uint32_t keep = MyConfig.GetParamValueInt(TS_PARAM, key, ts_keep_default[i]);
+    if (keep != m_keep[i])
+      {
+      m_keep[i] = keep;
+      resize = true;
+      }
+    }
+  m_spill = MyConfig.GetParamValueBool(TS_PARAM, "spill", false);
+
+  const ConfigParamMap* map = MyConfig.GetParamMap(TS_METRICS_PARAM);
+  m_unresolved = false;
+  m_deletes = MyMetrics.m_deletecount;
+
+  // Add / update configured series:
+  if (map)
+    {
+    for (auto it = map->begin(); it != map->end(); it++)
+      {
+      OvmsMetric* metric = MyMetrics.Find(it->first.c_str());
+      int scale = atoi(it->second.c_str());
+      OvmsTimeSeries* ts = NULL;
+      auto k = m_series.find(it->first);
+      if (k != m_series.end())
+        ts = k->second;
+      if (ts && (resize || ts->m_metric != metric || ts->m_scale != scale))
+        {
+        delete ts;
+        ts = NULL;
+        }
+      if (!ts && metric)
+        {
+        ts = new OvmsTimeSeries(it->first.c_str(), metric, scale, m_keep);
+        ts->EnableSpill(m_spill);
+        }
+      else if (ts)
+        {
+        ts->m_units = metric->GetUnits();
+        ts->EnableSpill(m_spill);
+        }
+      if (!ts)
+        m_unresolved = true;
+      m_series[it->first] = ts;
+      }
+    }
+
+  // Remove unconfigured series:
+  for (auto it = m_series.begin(); it != m_series.end();)
+    {
+    if (!map || map->find(it->first) == map->end())
+      {
+      delete it->second;
+      it = m_series.erase(it);
+      }
+    else
+      it++;
+    }
+  }
+
+void OvmsTimeSeriesStore::Ticker1(std::string event, void* data)
+  {
+  // Metrics deleted (i.e. by SetVehicle): drop the stale pointers before
+  // sampling, the vehicle.type.set event arrives asynchronously
+  if (m_deletes != MyMetrics.m_deletecount)
+    ReloadMap();
+
+  uint32_t now = time(NULL);
+  OvmsMutexLock lock(&m_mutex);
+  for (auto it = m_series.begin(); it != m_series.end(); it++)
+    {
+    if (it->second)
+      it->second->Sample(now);
+    }
+  }
+
+void OvmsTimeSeriesStore::Ticker10(std::string event, void* data)
+  {
+  // Resolve metrics registered late (i.e. by the vehicle module):
+  if (m_unresolved)
+    ReloadMap();
+  }
@@ -0,0 +1,162 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __OVMS_TIMESERIES_H__
+#define __OVMS_TIMESERIES_H__
+
+#include <string>
+#include <functional>
+#include "ovms.h"
+#include "ovms_utils.h"
+#include "ovms_metrics.h"
+#include "ovms_mutex.h"
+#include "ovms_config.h"
+#include "ovms_command.h"
+
+#define TS_LEVELS             3       // raw (1 second), 1 minute, 15 minutes
+#define TS_BLOCK_SIZE         256     // bytes per ring buffer block
+#define TS_BLOCK_HEADER       16
+#define TS_MAX_FILL           2       // max missing samples filled by repeating the last value
+
+/**
+ * ts_block_t: ring buffer block of a time series level
+ *  - values are fixed-point integers (value * 10^scale)
+ *  - the first value is stored in full, following values as zigzag varint deltas
+ *  - rollup samples additionally carry (avg-min) and (max-avg) as varints
+ *  - samples in a block are contiguous at the level interval, a gap starts a new block
+ */
+typedef struct __attribute__ ((packed))
+  {
+  uint32_t start;                     // UTC timestamp of the first sample
+  int32_t first;                      // first value (avg for rollups)
+  int32_t last;                       // last value (delta encoder state)
+  uint16_t count;                     // number of samples in block
+  uint16_t len;                       // bytes used in data
+  uint8_t data[TS_BLOCK_SIZE-TS_BLOCK_HEADER];
+  } ts_block_t;
+
+typedef std::function<void(uint32_t time, int32_t avg, int32_t min, int32_t max)> ts_sample_fn;
+typedef std::function<void(const ts_block_t* block)> ts_block_fn;
+
+class OvmsTimeSeriesLevel
+  {
+  public:
+    OvmsTimeSeriesLevel();
+    ~OvmsTimeSeriesLevel();
+
+  public:
+    bool Init(uint16_t interval, bool rollup, uint32_t keep);
+    void Add(uint32_t time, int32_t avg, int32_t min, int32_t max);
+    uint32_t Query(uint32_t from, uint32_t to, ts_sample_fn fn);
+    uint32_t QueryBlocks(uint32_t from, uint32_t to, ts_block_fn fn);
+    uint32_t FirstTime();
+    size_t Memory() { return m_size * sizeof(ts_block_t); }
+    size_t Bytes();
+    bool IsEnabled() { return m_blocks != NULL; }
+
+  protected:
+    ts_block_t* Block(size_t n);  // n = 0 (oldest) … m_used-1 (newest)
+    void NewBlock(uint32_t time, int32_t avg, int32_t min, int32_t max);
+    bool Append(ts_block_t* b, int32_t avg, int32_t min, int32_t max);
+
+  public:
+    uint16_t m_interval;              // seconds per sample
+    bool m_rollup;                    // true = avg/min/max samples
+    ts_block_t* m_blocks;             // ring buffer (SPIRAM)
+    size_t m_size;                    // ring size in blocks
+    size_t m_head;                    // index of newest block
+    size_t m_used;                    // number of blocks in use
+    uint32_t m_samples;               // number of samples currently stored
+    ts_block_fn m_spill;              // called on completed blocks (optional)
+  };
+
+class OvmsTimeSeries : public ExternalRamAllocated
+  {
+  public:
+    OvmsTimeSeries(const char* name, OvmsMetric* metric, int scale, const uint32_t* keep);
+    ~OvmsTimeSeries();
+
+  public:
+    void Sample(uint32_t now);
+    void Add(uint32_t now, float value);
+    int FindLevel(uint32_t resolution, uint32_t span);
+    uint32_t QueryJSON(extram::string& buf, int level, uint32_t from, uint32_t to);
+    uint32_t QueryBinary(extram::string& buf, int level, uint32_t from, uint32_t to);
+    size_t Memory();
+    void EnableSpill(bool enable);
+
+  protected:
+    void Accumulate(int level, uint32_t time, int32_t avg, int32_t min, int32_t max);
+    void Spill(int level, const ts_block_t* block);
+    void FormatValue(extram::string& buf, int32_t value);
+
+  public:
+    std::string m_name;
+    OvmsMetric* m_metric;             // only valid while MyTimeSeries.m_deletes is current
+    metric_unit_t m_units;
+    int m_scale;                      // decimal places of fixed-point values
+    float m_factor;                   // 10^scale
+    OvmsMutex m_mutex;
+    OvmsTimeSeriesLevel m_level[TS_LEVELS];
+    struct
+      {
+      uint32_t slot;
+      int64_t sum;
+      int32_t min, max;
+      uint16_t cnt;
+      } m_acc[TS_LEVELS];             // rollup accumulators (level 1…)
+  };
+
+typedef NameMap<OvmsTimeSeries*> TimeSeriesMap;
+
+class OvmsTimeSeriesStore
+  {
+  public:
+    OvmsTimeSeriesStore();
+    ~OvmsTimeSeriesStore();
+
+  public:
+    void ReloadMap();
+    void Ticker1(std::string event, void* data);
+    void Ticker10(std::string event, void* data);
+    void EventListener(std::string event, void* data);
+
+  public:
+    OvmsMutex m_mutex;
+    TimeSeriesMap m_series;
+    uint32_t m_keep[TS_LEVELS];
+    bool m_spill;
+    bool m_unresolved;
+    uint32_t m_deletes;               // MyMetrics.m_deletecount at last ReloadMap
+  };
+
+extern OvmsTimeSeriesStore MyTimeSeries;
+
+#endif //#ifndef __OVMS_TIMESERIES_H__
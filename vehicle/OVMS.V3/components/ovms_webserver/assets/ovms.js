@@ -313,12 +313,14 @@ $.fn.loadcmd = function(command, filter, timeout) {
 var monitorTimer, last_monotonic = 0;
 var ws, ws_inhibit = 0;
 var metrics = {};
+var metrics_dict = [];
 var shellhist = [""], shellhpos = 0;
 var loghist = [];
 const loghist_maxsize = 100;
 
 function initSocketConnection(){
-  ws = new WebSocket('ws://' + location.host + '/msg');
+  ws = new WebSocket('ws://' + location.host + '/msg?compact=1');
+  metrics_dict = [];
   ws.onopen = function(ev) {
     console.log("WebSocket OPENED", ev);
     $(".receiver").subscribe();
@@ -349,6 +351,21 @@ function initSocketConnection(){
         $.extend(metrics, msg.metrics);
         $(".receiver").trigger("msg:metrics", msg.metrics);
       }
+      else if (msgtype == "mdict") {
+        // compact metrics: [first id, name, …]
+        for (var i = 1; i < msg.mdict.length; i++)
+          metrics_dict[msg.mdict[0] + i - 1] = msg.mdict[i];
+      }
+      else if (msgtype == "mu") {
+        // compact metrics: [id, value, …]
+        var upd = {};
+        for (var i = 0; i + 1 < msg.mu.length; i += 2) {
+          var name = metrics_dict[msg.mu[i]];
+          if (name) upd[name] = msg.mu[i+1];
+        }
+        $.extend(metrics, upd);
+        $(".receiver").trigger("msg:metrics", upd);
+      }
       else if (msgtype == "notify") {
         processNotification(msg.notify);
         $(".receiver").trigger("msg:notify", msg.notify);
@@ -34,6 +34,7 @@ static const char *TAG = "webcommand";
 #include <string.h>
 #include "buffered_shell.h"
 #include "log_buffers.h"
+#include "command_pool.h"
 #include "ovms_webserver.h"
 
 
@@ -59,12 +60,16 @@ HttpCommandStream::HttpCommandStream(mg_connection* nc, std::string command, int
   m_command = command;
   m_done = false;
   m_sent = m_ack = 0;
+  m_refs = 2;
   
-  // create write queue & command task:
+  // create write queue & submit command to worker pool:
   m_writequeue = xQueueCreate(30, sizeof(hcs_writebuf));
-  char name[configMAX_TASK_NAME_LEN];
-  snprintf(name, sizeof(name), "%s", command.c_str());
-  xTaskCreatePinnedToCore(CommandTask, name, CONFIG_OVMS_SYS_COMMAND_STACK_SIZE, (void*)this, 4, &m_cmdtask, CORE(1));
+  ESP_LOGI(TAG, "HttpCommandStream[%p]: %d bytes free, executing: %s",
+    nc, heap_caps_get_free_size(MALLOC_CAP_8BIT), command.c_str());
+  if (!MyCommandPool.Submit(this, command, [this](OvmsShell* shell) { CommandDone(); }, "http")) {
+    puts("Error: command queue full, please retry");
+    CommandDone();
+  }
 }
 
 HttpCommandStream::~HttpCommandStream()
@@ -83,31 +88,30 @@ void HttpCommandStream::Initialize(bool print)
 }
 
 
-void HttpCommandStream::CommandTask(void* object)
+void HttpCommandStream::CommandDone()
 {
-  HttpCommandStream* me = (HttpCommandStream*) object;
-  
-  ESP_LOGI(TAG, "HttpCommandStream[%p]: %d bytes free, executing: %s",
-    me->m_nc, heap_caps_get_free_size(MALLOC_CAP_8BIT), me->m_command.c_str());
-  
-  // execute command:
-  me->ProcessChars(me->m_command.data(), me->m_command.size());
-  me->ProcessChar('\n');
-  
-  me->m_done = true;
+  m_done = true;
   
 #if MG_ENABLE_BROADCAST && WEBSRV_USE_MG_BROADCAST
-  if (uxQueueMessagesWaiting(me->m_writequeue) > 0) {
-    ESP_LOGV(TAG, "HttpCommandStream[%p] RequestPollLast, qlen=%d done=%d sent=%d ack=%d", me->m_nc, uxQueueMessagesWaiting(me->m_writequeue), me->m_done, me->m_sent, me->m_ack);
-    me->RequestPoll();
-    ESP_LOGV(TAG, "HttpCommandStream[%p] RequestPollDone, qlen=%d done=%d sent=%d ack=%d", me->m_nc, uxQueueMessagesWaiting(me->m_writequeue), me->m_done, me->m_sent, me->m_ack);
+  if (uxQueueMessagesWaiting(m_writequeue) > 0) {
+    ESP_LOGV(TAG, "HttpCommandStream[%p] RequestPollLast, qlen=%d done=%d sent=%d ack=%d", m_nc, uxQueueMessagesWaiting(m_writequeue), m_done, m_sent, m_ack);
+    RequestPoll();
+    ESP_LOGV(TAG, "HttpCommandStream[%p] RequestPollDone, qlen=%d done=%d sent=%d ack=%d", m_nc, uxQueueMessagesWaiting(m_writequeue), m_done, m_sent, m_ack);
   }
 #endif // MG_ENABLE_BROADCAST && WEBSRV_USE_MG_BROADCAST
   
-  while (me->m_nc)
-    vTaskDelay(10/portTICK_PERIOD_MS);
-  delete me;
-  vTaskDelete(NULL);
+  Release();
+}
+
+
+/**
+ * Release: the command worker and the connection both hold a reference,
+ *  whichever finishes last deletes the stream.
+ */
+void HttpCommandStream::Release()
+{
+  if (--m_refs == 0)
+    delete this;
 }
 
 
@@ -138,6 +142,7 @@ void HttpCommandStream::ProcessQueue()
       mg_send_http_chunk(m_nc, "", 0);
       m_nc->user_data = NULL;
       m_nc = NULL;
+      Release();
     }
   }
 }
@@ -167,11 +172,12 @@ int HttpCommandStream::HandleEvent(int ev, void* p)
       ESP_LOGV(TAG, "HttpCommandStream[%p] EV_CLOSE qlen=%d done=%d sent=%d ack=%d",
         m_nc, uxQueueMessagesWaiting(m_writequeue), m_done, m_sent, m_ack);
       // connection has been closed, possibly externally:
-      // we need to let the command task finish normally to prevent problems
+      // we need to let the command worker finish normally to prevent problems
       // due to lost/locked ressources, so we just detach:
       m_nc->user_data = NULL;
       m_nc = NULL;
-      ProcessQueue();   // empty queue (no tx) to prevent task lockup on write
+      ProcessQueue();   // empty queue (no tx) to prevent worker lockup on write
+      Release();
       ev = 0;           // prevent deletion by main event handler
       break;
     
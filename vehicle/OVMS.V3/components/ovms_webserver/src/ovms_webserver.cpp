@@ -34,6 +34,7 @@ static const char *TAG = "webserver";
 
 #include <string.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <fstream>
 #include "ovms_webserver.h"
 #include "ovms_config.h"
@@ -493,6 +494,16 @@ void OvmsWebServer::EventHandler(mg_connection *nc, int ev, void *p)
   // framework handling:
   switch (ev)
   {
+    case MG_EV_WEBSOCKET_HANDSHAKE_REQUEST: // websocket connection request
+      {
+        // check for compact metrics encoding request:
+        struct http_message *hm = (struct http_message *) p;
+        char val[8];
+        if (mg_get_http_var(&hm->query_string, "compact", val, sizeof(val)) > 0 && strtol(val, NULL, 10) > 0)
+          nc->flags |= MG_F_WS_COMPACT;
+      }
+      break;
+
     case MG_EV_WEBSOCKET_HANDSHAKE_DONE:    // new websocket connection
       {
         MyWebServer.CreateWebSocketHandler(nc);
@@ -520,7 +531,7 @@ void OvmsWebServer::EventHandler(mg_connection *nc, int ev, void *p)
             mg_http_send_error(c.nc, 401, "Unauthorized");
             nc->flags |= MG_F_SEND_AND_CLOSE;
           }
-          else {
+          else if (!HttpFileSender::Serve(c, MyWebServer.m_file_opts)) {
             mg_serve_http(nc, c.hm, MyWebServer.m_file_opts);
           }
         }
@@ -820,6 +831,184 @@ int HttpStringSender::HandleEvent(int ev, void* p)
 }
 
 
+#if MG_ENABLE_FILESYSTEM
+/**
+ * HttpFileSender: bulk transfer of large static files
+ */
+
+int HttpFileSender::m_count = 0;
+
+HttpFileSender::HttpFileSender(mg_connection* nc, const char* path, size_t size)
+  : MgHandler(nc)
+{
+  m_size = size;
+  m_sent = 0;
+  m_reader.Open(path);
+  m_count++;
+}
+
+HttpFileSender::~HttpFileSender()
+{
+  m_count--;
+  if (m_sent < m_size) {
+    ESP_LOGV(TAG, "HttpFileSender[%p]: abort, %d/%d bytes sent", m_nc, m_sent, m_size);
+  }
+}
+
+/**
+ * GetMimeType: map file extension to mime type like mg_serve_http(),
+ *  custom mime types ("http.server" file options) take precedence
+ */
+std::string HttpFileSender::GetMimeType(const char* path, const mg_serve_http_opts& opts)
+{
+  size_t pathlen = strlen(path);
+  if (opts.custom_mime_types) {
+    struct mg_str k, v;
+    const char* list = opts.custom_mime_types;
+    while ((list = mg_next_comma_list_entry(list, &k, &v)) != NULL) {
+      if (pathlen > k.len && strncasecmp(path + pathlen - k.len, k.p, k.len) == 0)
+        return std::string(v.p, v.len);
+    }
+  }
+
+  static const char* const mimetypes[][2] = {
+    { ".html", "text/html" },
+    { ".htm",  "text/html" },
+    { ".js",   "application/javascript" },
+    { ".css",  "text/css" },
+    { ".json", "application/json" },
+    { ".txt",  "text/plain" },
+    { ".log",  "text/plain" },
+    { ".csv",  "text/csv" },
+    { ".png",  "image/png" },
+    { ".jpg",  "image/jpeg" },
+    { ".jpeg", "image/jpeg" },
+    { ".svg",  "image/svg+xml" },
+    { ".gz",   "application/gzip" },
+    { ".zip",  "application/zip" },
+  };
+  const char* ext = strrchr(path, '.');
+  if (ext) {
+    for (int i = 0; i < sizeof(mimetypes)/sizeof(mimetypes[0]); i++) {
+      if (strcasecmp(ext, mimetypes[i][0]) == 0)
+        return mimetypes[i][1];
+    }
+  }
+  return "application/octet-stream";
+}
+
+/**
+ * Serve: check if the request can be handled by a HttpFileSender, start transfer
+ *  - returns false if the request needs to be passed on to mg_serve_http()
+ */
+bool HttpFileSender::Serve(PageContext_t& c, const mg_serve_http_opts& opts)
+{
+  if (c.method != "GET" || !opts.document_root)
+    return false;
+  if (mg_get_http_header(c.hm, "Range") ||
+      mg_get_http_header(c.hm, "If-None-Match") ||
+      mg_get_http_header(c.hm, "If-Modified-Since"))
+    return false;
+
+  // decode & check path:
+  char uri[256];
+  int len = mg_url_decode(c.hm->uri.p, c.hm->uri.len, uri, sizeof(uri), 0);
+  if (len <= 0 || uri[0] != '/' || strstr(uri, "/..") || strstr(uri, "//"))
+    return false;
+  if (m_count >= XFER_FILE_MAXSENDERS)
+    return false;
+  const char* basename = strrchr(uri, '/') + 1;
+  if (opts.per_directory_auth_file && strcmp(basename, opts.per_directory_auth_file) == 0)
+    return false;
+
+  std::string path = opts.document_root;
+  path.append(uri);
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < XFER_FILE_MINSIZE)
+    return false;
+
+  // check auth like mg_serve_http(), let mongoose send the auth request if necessary:
+  if (!mg_http_is_authorized(c.hm, mg_mk_str(path.c_str()), opts.auth_domain, opts.global_auth_file,
+        MG_AUTH_FLAG_IS_GLOBAL_PASS_FILE|MG_AUTH_FLAG_ALLOW_MISSING_FILE) ||
+      !mg_http_is_authorized(c.hm, mg_mk_str(path.c_str()), opts.auth_domain, opts.per_directory_auth_file,
+        MG_AUTH_FLAG_ALLOW_MISSING_FILE))
+    return false;
+
+  HttpFileSender* sender = new HttpFileSender(c.nc, path.c_str(), st.st_size);
+  if (!sender->m_reader.IsOpen()) {
+    delete sender;
+    return false;
+  }
+
+  // send the same headers as mg_serve_http():
+  char etag[50], last_modified[50];
+  snprintf(etag, sizeof(etag), "\"%lx.%" INT64_FMT "\"", (unsigned long) st.st_mtime, (int64_t) st.st_size);
+  strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&st.st_mtime));
+  std::string headers = "Last-Modified: ";
+  headers.append(last_modified);
+  headers.append("\r\nEtag: ");
+  headers.append(etag);
+  headers.append("\r\nContent-Type: ");
+  headers.append(GetMimeType(path.c_str(), opts));
+  if (opts.extra_headers && *opts.extra_headers) {
+    headers.append("\r\n");
+    headers.append(opts.extra_headers);
+  }
+  mg_send_head(c.nc, 200, st.st_size, headers.c_str());
+  sender->Send();
+  return true;
+}
+
+int HttpFileSender::HandleEvent(int ev, void* p)
+{
+  switch (ev)
+  {
+    case MG_EV_SEND:          // last transmission has finished
+    case MG_EV_POLL:          // check for data read ahead
+      Send();
+      break;
+
+    default:
+      break;
+  }
+
+  return ev;
+}
+
+/**
+ * Send: fill the tx buffer from the read ahead queue
+ *  - does not wait for the reader, blocks not yet read are sent on the next poll
+ * Note: may delete this handler
+ */
+void HttpFileSender::Send()
+{
+  while (m_nc->send_mbuf.len < m_reader.m_bufsize) {
+    const uint8_t* data;
+    ssize_t len = m_reader.Read(&data, 0);
+    if (len == VFS_STREAM_PENDING)
+      return; // retry on next poll
+    if (len > 0) {
+      // the file may have grown since the content length was sent:
+      size_t n = MIN((size_t)len, m_size - m_sent);
+      mg_send(m_nc, data, n);
+      m_sent += n;
+      m_reader.Release();
+      if (m_sent < m_size)
+        continue;
+      len = 0;
+    }
+    // done:
+    if (len < 0 || m_sent < m_size) {
+      ESP_LOGW(TAG, "HttpFileSender[%p]: read error after %d/%d bytes", m_nc, m_sent, m_size);
+      m_nc->flags |= MG_F_SEND_AND_CLOSE;
+    }
+    delete this;
+    return;
+  }
+}
+#endif //MG_ENABLE_FILESYSTEM
+
+
 /**
  * CheckLogin: check username & password
  *
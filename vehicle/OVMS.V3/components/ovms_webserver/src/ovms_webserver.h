@@ -38,6 +38,7 @@
 #include <memory>
 #include <utility>
 #include <map>
+#include <atomic>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
@@ -51,6 +52,8 @@
 #include "ovms_netmanager.h"
 #include "ovms_utils.h"
 #include "log_buffers.h"
+#include "ovms_vfs.h"
+#include "ovms_websocketcodec.h"
 
 #define OVMS_GLOBAL_AUTH_FILE     "/store/.htpasswd"
 
@@ -60,6 +63,8 @@
 #define NUM_SESSIONS              5
 
 #define XFER_CHUNK_SIZE           1024
+#define XFER_FILE_MINSIZE         32768     // min file size for HttpFileSender
+#define XFER_FILE_MAXSENDERS      2         // max concurrent HttpFileSenders (reader task & buffers each)
 
 #define WEBSRV_USE_MG_BROADCAST   0  // Note: mg_broadcast() not working reliably yet, do not enable for production!
 
@@ -343,14 +348,51 @@ class HttpStringSender : public MgHandler
 };
 
 
+#if MG_ENABLE_FILESYSTEM
+/**
+ * HttpFileSender transmits large static files using the VFS bulk reader,
+ *  overlapping file reads with network transmission.
+ * Serve() only takes plain GET requests for large files, everything else
+ *  is left to mg_serve_http(). As each sender runs a reader task with two
+ *  buffers, the number of concurrent senders is limited to XFER_FILE_MAXSENDERS.
+ */
+class HttpFileSender : public MgHandler
+{
+  public:
+    HttpFileSender(mg_connection* nc, const char* path, size_t size);
+    ~HttpFileSender();
+
+  public:
+    static bool Serve(PageContext_t& c, const mg_serve_http_opts& opts);
+    static std::string GetMimeType(const char* path, const mg_serve_http_opts& opts);
+    int HandleEvent(int ev, void* p);
+    void Send();
+
+  public:
+    VfsStreamReader           m_reader;
+    size_t                    m_size;             // size of file (content length sent)
+    size_t                    m_sent;             // bytes sent
+    static int                m_count;            // number of active senders
+};
+#endif //MG_ENABLE_FILESYSTEM
+
+
 /**
  * WebSocketHandler transmits JSON data in chunks to the WebSocket client
  *  and coordinates transmits initiated from other contexts (i.e. events).
  *
  * On creation it will do a full update of all metrics.
  * Later on, it receives TX jobs through the queue.
+ *
+ * Clients connecting to "/msg?compact=1" get metrics in the compact encoding
+ * (see WebSocketMetricsEncoder), the connection is flagged by the handshake.
+ *
+ * Clients may restrict the metrics sent by subscribing to "metrics/<pattern>"
+ * (see WebSocketMetricsFilter), default is all metrics.
  */
 
+#define MG_F_WS_COMPACT           MG_F_USER_1     // websocket: compact metrics encoding
+
 enum WebSocketTxJobType
 {
   WSTX_None = 0,
@@ -414,6 +456,9 @@ class WebSocketHandler : public MgHandler, public OvmsWriter
     size_t                    m_modifier;         // "our" metrics modifier
     size_t                    m_reader;           // "our" notification reader id
     QueueHandle_t             m_jobqueue;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats*      m_jobqueue_stats;
+#endif
     uint32_t                  m_jobqueue_overflow_status;
     uint32_t                  m_jobqueue_overflow_logged;
     uint32_t                  m_jobqueue_overflow_dropcnt;
@@ -421,7 +466,14 @@ class WebSocketHandler : public MgHandler, public OvmsWriter
     WebSocketTxJob            m_job;
     int                       m_sent;
     int                       m_ack;
+    int                       m_checked;          // metrics job: list position
     std::set<std::string>     m_subscriptions;
+    WebSocketMetricsFilter    m_metrics_filter;   // metrics subscriptions
+    WebSocketMetricsEncoder   m_encoder;
+    uint32_t                  m_stat_frames;      // metrics frames sent
+    uint32_t                  m_stat_metrics;     // metrics values sent
+    uint64_t                  m_stat_bytes;       // metrics frame bytes sent
+    uint64_t                  m_stat_time;        // metrics encoding time [us]
 };
 
 struct WebSocketSlot
@@ -447,15 +499,16 @@ class HttpCommandStream : public OvmsShell, public MgHandler
   public:
     void ProcessQueue();
     int HandleEvent(int ev, void* p);
-    static void CommandTask(void* object);
+    void CommandDone();
+    void Release();
 
   public:
     std::string               m_command;
-    TaskHandle_t              m_cmdtask;
     QueueHandle_t             m_writequeue;
     bool                      m_done;
     size_t                    m_sent;
     int                       m_ack;
+    std::atomic_int           m_refs;         // command worker & connection
 
   public:
     void Initialize(bool print);
@@ -0,0 +1,240 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "ovms_websocketcodec.h"
+
+
+WebSocketMetricsEncoder::WebSocketMetricsEncoder()
+{
+  m_compact = false;
+  m_lastid = -1;
+  m_count = 0;
+}
+
+WebSocketMetricsEncoder::~WebSocketMetricsEncoder()
+{
+}
+
+void WebSocketMetricsEncoder::SetCompact(bool compact)
+{
+  if (compact != m_compact) {
+    m_compact = compact;
+    Reset();
+  }
+}
+
+void WebSocketMetricsEncoder::Reset()
+{
+  m_ids.clear();
+  m_dict_entries.clear();
+  m_lastid = -1;
+  m_count = 0;
+  m_dict.clear();
+  m_msg.clear();
+}
+
+int WebSocketMetricsEncoder::GetId(OvmsMetric* m, bool &added)
+{
+  // Metrics are normally encoded in list order, and ids get assigned in list
+  // order by the initial full update, so try the id following the last one first:
+  int id = m_lastid + 1;
+  if (id >= (int)m_dict_entries.size() || m_dict_entries[id].metric != m) {
+    auto it = m_ids.find(m);
+    id = (it != m_ids.end()) ? it->second : -1;
+  }
+  if (id >= 0 && m_dict_entries[id].name == m->m_name) {
+    added = false;
+  }
+  else {
+    // new metric (or a new metric reusing a freed instance address):
+    id = m_dict_entries.size();
+    m_dict_entries.push_back({ m, m->m_name });
+    m_ids[m] = id;
+    added = true;
+  }
+  m_lastid = id;
+  return id;
+}
+
+void WebSocketMetricsEncoder::Begin()
+{
+  m_count = 0;
+  m_dict.clear();
+  m_msg.clear();
+  if (!m_compact)
+    m_msg = "{\"metrics\":{";
+}
+
+static void append_id(extram::string& s, int id)
+{
+  char buf[12], *p = buf + sizeof(buf);
+  do {
+    *--p = '0' + id % 10;
+    id /= 10;
+  } while (id);
+  s.append(p, buf + sizeof(buf) - p);
+}
+
+void WebSocketMetricsEncoder::Add(OvmsMetric* m)
+{
+  if (!m_compact) {
+    if (m_count) m_msg += ',';
+    m_msg += '\"';
+    m_msg += m->m_name;
+    m_msg += "\":";
+    m_msg += m->AsJSON().c_str();
+  }
+  else {
+    bool added;
+    int id = GetId(m, added);
+    if (added) {
+      if (m_dict.empty()) {
+        m_dict = "\"mdict\":[";
+        append_id(m_dict, id);
+      }
+      m_dict += ",\"";
+      m_dict += m->m_name;
+      m_dict += '\"';
+    }
+    m_msg += m_count ? "," : "\"mu\":[";
+    append_id(m_msg, id);
+    m_msg += ',';
+    m_msg += m->AsJSON().c_str();
+  }
+  m_count++;
+}
+
+const extram::string& WebSocketMetricsEncoder::Finish()
+{
+  if (!m_compact) {
+    m_msg += "}}";
+  }
+  else if (m_dict.empty()) {
+    m_msg.insert(0, 1, '{');
+    m_msg += "]}";
+  }
+  else {
+    // dictionary entries need to be processed first by the client:
+    m_dict.insert(0, 1, '{');
+    m_dict += "],";
+    m_dict += m_msg;
+    m_dict += "]}";
+    m_msg.swap(m_dict);
+  }
+  return m_msg;
+}
+
+
+WebSocketMetricsFilter::WebSocketMetricsFilter()
+{
+  m_all = true;
+}
+
+WebSocketMetricsFilter::~WebSocketMetricsFilter()
+{
+}
+
+WebSocketMetricsFilter::Pattern WebSocketMetricsFilter::Compile(const std::string& pattern)
+{
+  if (!pattern.empty() && pattern.back() == '*')
+    return { pattern.substr(0, pattern.size()-1), true };
+  else
+    return { pattern, false };
+}
+
+bool WebSocketMetricsFilter::Covers(const Pattern& a, const Pattern& b)
+{
+  if (a.prefix)
+    return b.name.compare(0, a.name.size(), a.name) == 0;
+  else
+    return !b.prefix && a.name == b.name;
+}
+
+bool WebSocketMetricsFilter::Subscribe(const std::string& pattern)
+{
+  Pattern p = Compile(pattern);
+  if (p.prefix && p.name.empty()) {
+    // "*": all metrics
+    bool changed = !m_all;
+    m_all = true;
+    m_patterns.clear();
+    return changed;
+  }
+  if (m_all) {
+    // first subscription: switch from all to the match set
+    m_all = false;
+  }
+  else {
+    for (auto it = m_patterns.begin(); it != m_patterns.end();) {
+      if (Covers(*it, p))
+        return false;
+      else if (Covers(p, *it))
+        it = m_patterns.erase(it);
+      else
+        it++;
+    }
+  }
+  m_patterns.insert(std::upper_bound(m_patterns.begin(), m_patterns.end(), p), p);
+  return true;
+}
+
+bool WebSocketMetricsFilter::Unsubscribe(const std::string& pattern)
+{
+  Pattern p = Compile(pattern);
+  if (m_all) {
+    // we can't exclude from all, only switch to none:
+    if (!p.prefix || !p.name.empty())
+      return false;
+    m_all = false;
+    return true;
+  }
+  size_t size = m_patterns.size();
+  m_patterns.erase(std::remove_if(m_patterns.begin(), m_patterns.end(),
+    [&p](const Pattern& e) { return Covers(p, e); }), m_patterns.end());
+  return m_patterns.size() != size;
+}
+
+bool WebSocketMetricsFilter::Match(const char* name) const
+{
+  if (m_all)
+    return true;
+  // find the last pattern <= name:
+  auto it = std::upper_bound(m_patterns.begin(), m_patterns.end(), name,
+    [](const char* n, const Pattern& e) { return strcmp(n, e.name.c_str()) < 0; });
+  if (it == m_patterns.begin())
+    return false;
+  --it;
+  if (it->prefix)
+    return strncmp(name, it->name.data(), it->name.size()) == 0;
+  else
+    return strcmp(name, it->name.c_str()) == 0;
+}
@@ -0,0 +1,136 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+#ifndef __OVMS_WEBSOCKETCODEC_H__
+#define __OVMS_WEBSOCKETCODEC_H__
+
+#include <map>
+#include <vector>
+#include "ovms.h"
+#include "ovms_metrics.h"
+
+
+/**
+ * WebSocketMetricsEncoder builds the metrics frames for a websocket client.
+ *
+ * Standard frame (JSON):
+ *    {"metrics":{"<name>":<value>,...}}
+ *
+ * Compact frame (negotiated by the client via "/msg?compact=1"):
+ *    {"mdict":[<id>,"<name>",...],"mu":[<id>,<value>,...]}
+ *
+ * In compact mode, metrics are referenced by numeric ids. An id is assigned on
+ * the first transmission of a metric to the connection, ids are consecutive,
+ * and the "mdict" part of the frame introducing new ids lists their names
+ * starting at the first new id. So the client builds its dictionary
+ * incrementally, and the dictionary is sent once per connection.
+ * Values are encoded by OvmsMetric::AsJSON() in both modes.
+ */
+
+class WebSocketMetricsEncoder
+{
+  public:
+    WebSocketMetricsEncoder();
+    ~WebSocketMetricsEncoder();
+
+  public:
+    void SetCompact(bool compact);
+    bool IsCompact() { return m_compact; }
+    void Reset();
+    void Begin();
+    void Add(OvmsMetric* m);
+    size_t Size() { return m_dict.size() + m_msg.size(); }
+    int Count() { return m_count; }
+    const extram::string& Finish();
+    size_t GetDictSize() { return m_dict_entries.size(); }
+
+  protected:
+    int GetId(OvmsMetric* m, bool &added);
+
+  protected:
+    struct DictEntry
+    {
+      OvmsMetric*               metric;
+      const char*               name;             // detects instance address reuse
+    };
+    typedef std::map<OvmsMetric*, int, std::less<OvmsMetric*>,
+      ExtRamAllocator<std::pair<OvmsMetric* const, int>>> DictMap;
+    typedef std::vector<DictEntry, ExtRamAllocator<DictEntry>> DictEntries;
+
+    bool                        m_compact;
+    DictMap                     m_ids;            // metric → id
+    DictEntries                 m_dict_entries;   // id → metric
+    int                         m_lastid;
+    int                         m_count;
+    extram::string              m_dict;           // compact: new dictionary entries
+    extram::string              m_msg;            // frame / compact: values
+};
+
+
+/**
+ * WebSocketMetricsFilter: per client metrics subscriptions.
+ *
+ * Clients subscribe to "metrics/<pattern>", with <pattern> being a metric name
+ * or a name prefix followed by "*" (i.e. "metrics/v.b.*"). Without metrics
+ * subscriptions, a client receives all metrics (default for compatibility).
+ * The first subscription switches to the match set, pattern "*" back to all.
+ *
+ * Patterns covered by other patterns are dropped, the rest is kept sorted, so
+ * the only candidate for a match is the last pattern not greater than the name.
+ */
+
+class WebSocketMetricsFilter
+{
+  public:
+    WebSocketMetricsFilter();
+    ~WebSocketMetricsFilter();
+
+  public:
+    bool Subscribe(const std::string& pattern);
+    bool Unsubscribe(const std::string& pattern);
+    bool Match(const char* name) const;
+    bool IsAll() const { return m_all; }
+    size_t Size() const { return m_patterns.size(); }
+
+  protected:
+    struct Pattern
+    {
+      std::string               name;             // name or prefix
+      bool                      prefix;
+      bool operator<(const Pattern& b) const { return name < b.name; }
+    };
+    static Pattern Compile(const std::string& pattern);
+    static bool Covers(const Pattern& a, const Pattern& b);
+
+  protected:
+    bool                        m_all;
+    std::vector<Pattern>        m_patterns;       // sorted
+};
+
+#endif //#ifndef __OVMS_WEBSOCKETCODEC_H__
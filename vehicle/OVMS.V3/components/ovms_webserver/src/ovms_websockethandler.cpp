@@ -38,6 +38,7 @@ static const char *TAG = "websocket";
 #include "metrics_standard.h"
 #include "buffered_shell.h"
 #include "vehicle.h"
+#include "esp_timer.h"
 
 
 /**
@@ -62,12 +63,18 @@ WebSocketHandler::WebSocketHandler(mg_connection* nc, size_t slot, size_t modifi
   m_modifier = modifier;
   m_reader = reader;
   m_jobqueue = xQueueCreate(50, sizeof(WebSocketTxJob));
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_jobqueue_stats = OvmsContention::RegisterQueue(m_jobqueue, "websocket.job");
+#endif
   m_jobqueue_overflow_status = 0;
   m_jobqueue_overflow_logged = 0;
   m_jobqueue_overflow_dropcnt = 0;
   m_jobqueue_overflow_dropcntref = 0;
   m_job.type = WSTX_None;
-  m_sent = m_ack = 0;
+  m_sent = m_ack = m_checked = 0;
+  m_encoder.SetCompact((nc->flags & MG_F_WS_COMPACT) != 0);
+  m_stat_frames = m_stat_metrics = 0;
+  m_stat_bytes = m_stat_time = 0;
   
   // Register as logging console:
   SetMonitoring(true);
@@ -76,9 +83,19 @@ WebSocketHandler::WebSocketHandler(mg_connection* nc, size_t slot, size_t modifi
 
 WebSocketHandler::~WebSocketHandler()
 {
+  if (m_stat_frames) {
+    ESP_LOGD(TAG, "WebSocketHandler[%p]: %s metrics: %u frames, %u values, %llu bytes (%.1f per value), "
+      "encoding %llu us (%.1f per value), %u dictionary entries, %s", m_nc,
+      m_encoder.IsCompact() ? "compact" : "JSON", m_stat_frames, m_stat_metrics, m_stat_bytes,
+      (float) m_stat_bytes / m_stat_metrics, m_stat_time, (float) m_stat_time / m_stat_metrics,
+      m_encoder.GetDictSize(), m_metrics_filter.IsAll() ? "all metrics" : "subscribed metrics");
+  }
   MyCommandApp.DeregisterConsole(this);
   while (xQueueReceive(m_jobqueue, &m_job, 0) == pdTRUE)
     ClearTxJob(m_job);
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  OvmsContention::DeregisterQueue(m_jobqueue_stats);
+#endif
   vQueueDelete(m_jobqueue);
 }
 
@@ -111,33 +128,34 @@ void WebSocketHandler::ProcessTxJob()
     case WSTX_MetricsUpdate:
     {
       // Note: this loops over the metrics by index, keeping the checked count
-      //  in m_sent. It will not detect new metrics added between polls if they are
-      //  inserted before m_sent, so new metrics may not be sent until first changed.
+      //  in m_checked. It will not detect new metrics added between polls if they are
+      //  inserted before m_checked, so new metrics may not be sent until first changed.
       //  The Metrics set normally is static, so this should be no problem.
+      //  Metrics not subscribed to are checked (modified flag cleared), but not sent.
       
       // find start:
       int i;
       OvmsMetric* m;
-      for (i=0, m=MyMetrics.m_first; i < m_sent && m != NULL; m=m->m_next, i++);
+      for (i=0, m=MyMetrics.m_first; i < m_checked && m != NULL; m=m->m_next, i++);
       
       // build msg:
-      extram::string msg;
-      msg.reserve(2*XFER_CHUNK_SIZE+128);
-      msg = "{\"metrics\":{";
-      for (i=0; m && msg.size() < XFER_CHUNK_SIZE; m=m->m_next) {
-        if (m->IsModifiedAndClear(m_modifier) || m_job.type == WSTX_MetricsAll) {
-          if (i) msg += ',';
-          msg += '\"';
-          msg += m->m_name;
-          msg += "\":";
-          msg += m->AsJSON().c_str();
-          i++;
-        }
+      int64_t t0 = esp_timer_get_time();
+      m_encoder.Begin();
+      for (; m && m_encoder.Size() < XFER_CHUNK_SIZE; m=m->m_next, i++) {
+        if ((m->IsModifiedAndClear(m_modifier) || m_job.type == WSTX_MetricsAll)
+            && m_metrics_filter.Match(m->m_name))
+          m_encoder.Add(m);
       }
+      m_checked = i;
+      i = m_encoder.Count();
       
       // send msg:
       if (i) {
-        msg += "}}";
+        const extram::string& msg = m_encoder.Finish();
+        m_stat_time += esp_timer_get_time() - t0;
+        m_stat_frames++;
+        m_stat_metrics += i;
+        m_stat_bytes += msg.size();
         //ESP_LOGV(TAG, "WebSocket msg: %s", msg.c_str());
         mg_send_websocket_frame(m_nc, WEBSOCKET_OP_TEXT, msg.data(), msg.size());
         m_sent += i;
@@ -274,7 +292,7 @@ void WebSocketHandler::ClearTxJob(WebSocketTxJob &job)
 
 bool WebSocketHandler::AddTxJob(WebSocketTxJob job, bool init_tx)
 {
-  if (xQueueSend(m_jobqueue, &job, 0) != pdTRUE) {
+  if (OVMS_QUEUE_SEND(m_jobqueue_stats, m_jobqueue, &job, 0) != pdTRUE) {
     m_jobqueue_overflow_status |= 1;
     m_jobqueue_overflow_dropcnt++;
     return false;
@@ -292,7 +310,7 @@ bool WebSocketHandler::GetNextTxJob()
 {
   if (xQueueReceive(m_jobqueue, &m_job, 0) == pdTRUE) {
     // init new job state:
-    m_sent = m_ack = 0;
+    m_sent = m_ack = m_checked = 0;
     return true;
   } else {
     return false;
@@ -608,6 +626,14 @@ void OvmsWebServer::UpdateTicker(TimerHandle_t timer)
 
 void WebSocketHandler::Subscribe(std::string topic)
 {
+  if (startsWith(topic, "metrics/")) {
+    if (m_metrics_filter.Subscribe(topic.substr(8))) {
+      ESP_LOGD(TAG, "WebSocketHandler[%p]: subscription '%s' added", m_nc, topic.c_str());
+      // send current values of the metrics now subscribed:
+      AddTxJob({ WSTX_MetricsAll, NULL });
+    }
+    return;
+  }
   for (auto it = m_subscriptions.begin(); it != m_subscriptions.end();) {
     if (mg_mqtt_match_topic_expression(mg_mk_str(topic.c_str()), mg_mk_str((*it).c_str()))) {
       // remove topic covered by new subscription:
@@ -627,6 +653,11 @@ void WebSocketHandler::Subscribe(std::string topic)
 
 void WebSocketHandler::Unsubscribe(std::string topic)
 {
+  if (startsWith(topic, "metrics/")) {
+    if (m_metrics_filter.Unsubscribe(topic.substr(8)))
+      ESP_LOGD(TAG, "WebSocketHandler[%p]: subscription '%s' removed", m_nc, topic.c_str());
+    return;
+  }
   for (auto it = m_subscriptions.begin(); it != m_subscriptions.end();) {
     if (mg_mqtt_match_topic_expression(mg_mk_str(topic.c_str()), mg_mk_str((*it).c_str()))) {
       ESP_LOGD(TAG, "WebSocketHandler[%p]: subscription '%s' removed", m_nc, (*it).c_str());
@@ -1367,6 +1367,8 @@ void OvmsWebServer::HandleCfgServerV3(PageEntry_t& p, PageContext_t& c)
   std::string error;
   std::string server, user, password, port, topic_prefix;
   std::string updatetime_connected, updatetime_idle;
+  bool metrics_batch;
+  std::string journal_path, journal_maxsize;
 
   if (c.method == "POST") {
     // process form submission:
@@ -1377,6 +1379,9 @@ void OvmsWebServer::HandleCfgServerV3(PageEntry_t& p, PageContext_t& c)
     topic_prefix = c.getvar("topic_prefix");
     updatetime_connected = c.getvar("updatetime_connected");
     updatetime_idle = c.getvar("updatetime_idle");
+    metrics_batch = (c.getvar("metrics_batch") == "yes");
+    journal_path = c.getvar("journal_path");
+    journal_maxsize = c.getvar("journal_maxsize");
 
     // validate:
     if (port != "") {
@@ -1396,6 +1401,15 @@ void OvmsWebServer::HandleCfgServerV3(PageEntry_t& p, PageContext_t& c)
       }
     }
 
+    if (journal_path != "" && journal_path[0] != '/') {
+      error += "<li data-input=\"journal_path\">Journal path must be absolute (e.g. /sd/v3journal)</li>";
+    }
+    if (journal_maxsize != "") {
+      if (atoi(journal_maxsize.c_str()) < 8) {
+        error += "<li data-input=\"journal_maxsize\">Journal size must be at least 8 kB</li>";
+      }
+    }
+
     if (error == "") {
       // success:
       MyConfig.SetParamValue("server.v3", "server", server);
@@ -1406,6 +1420,9 @@ void OvmsWebServer::HandleCfgServerV3(PageEntry_t& p, PageContext_t& c)
       MyConfig.SetParamValue("server.v3", "topic.prefix", topic_prefix);
       MyConfig.SetParamValue("server.v3", "updatetime.connected", updatetime_connected);
       MyConfig.SetParamValue("server.v3", "updatetime.idle", updatetime_idle);
+      MyConfig.SetParamValueBool("server.v3", "metrics.batch", metrics_batch);
+      MyConfig.SetParamValue("server.v3", "journal.path", journal_path);
+      MyConfig.SetParamValue("server.v3", "journal.maxsize", journal_maxsize);
 
       c.head(200);
       c.alert("success", "<p class=\"lead\">Server V3 (MQTT) connection configured.</p>");
@@ -1428,6 +1445,9 @@ void OvmsWebServer::HandleCfgServerV3(PageEntry_t& p, PageContext_t& c)
     topic_prefix = MyConfig.GetParamValue("server.v3", "topic.prefix");
     updatetime_connected = MyConfig.GetParamValue("server.v3", "updatetime.connected");
     updatetime_idle = MyConfig.GetParamValue("server.v3", "updatetime.idle");
+    metrics_batch = MyConfig.GetParamValueBool("server.v3", "metrics.batch", false);
+    journal_path = MyConfig.GetParamValue("server.v3", "journal.path");
+    journal_maxsize = MyConfig.GetParamValue("server.v3", "journal.maxsize");
 
     // generate form:
     c.head(200);
@@ -1457,6 +1477,18 @@ void OvmsWebServer::HandleCfgServerV3(PageEntry_t& p, PageContext_t& c)
     "optional, in seconds, default: 600");
   c.fieldset_end();
 
+  c.input_checkbox("Batched metrics", "metrics_batch", metrics_batch,
+    "<p>Transmit metrics as JSON batches on topics <code>metrics/all</code> (retained full sync)"
+    " and <code>metrics/update</code> instead of one retained topic per metric.</p>"
+    "<p>Reduces connect traffic, but clients must support the batch topics.</p>");
+
+  c.fieldset_start("Offline journal");
+  c.input_text("Path", "journal_path", journal_path.c_str(), "optional, e.g. /sd/v3journal",
+    "<p>Store notifications &amp; metric changes while offline, replay on <code>history/metrics</code>"
+    " and <code>notify/…</code> when the connection is back. Empty = disabled.</p>");
+  c.input_text("Max size", "journal_maxsize", journal_maxsize.c_str(), "optional, in kB, default: 256");
+  c.fieldset_end();
+
   c.hr();
   c.input_button("default", "Save");
   c.form_end();
@@ -528,10 +528,12 @@ void OvmsWebServer::HandleBmsCellMonitor(PageEntry_t& p, PageContext_t& c)
     temp_warn_def=BMS_DEFTHR_TWARN, temp_alert_def=BMS_DEFTHR_TALERT;
   float volt_warn=0, volt_alert=0, temp_warn=0, temp_alert=0;
   bool alerts_enabled=true;
+  int history_tiers=0;
 
   // get vehicle BMS configuration:
   OvmsVehicle* vehicle = MyVehicleFactory.ActiveVehicle();
   if (vehicle) {
+    history_tiers = vehicle->BmsGetHistoryVoltage()->GetTierCount();
     int readings_v = vehicle->BmsGetCellArangementVoltage();
     if (readings_v) {
       stemwidth_v   = 0.1 + 20.0 / readings_v;  // 14 → 1.5 … 96 → 0.3
@@ -610,7 +612,52 @@ void OvmsWebServer::HandleBmsCellMonitor(PageEntry_t& p, PageContext_t& c)
         "<samp id=\"output\" class=\"samp-inline\"></samp>\n"
       "</div>\n"
     "</div>\n"
-    "\n"
+    "\n");
+
+  // Cell history panel:
+
+  c.print(
+    "<div class=\"panel panel-primary panel-single\">\n"
+      "<div class=\"panel-heading\">BMS Cell History</div>\n"
+      "<div class=\"panel-body\">\n");
+  if (!history_tiers) {
+    c.print(
+        "<p>The cell history is disabled. To enable, execute command <kbd>config set vehicle bms.history yes</kbd>.</p>"
+        "<p>Note: the history needs 6 bytes per cell and bucket, i.e. about 1.2 MB of SPIRAM for 96 cells with the default tiers.</p>\n");
+  }
+  c.print(
+        "<div id=\"histchart\" style=\"width: 100%; max-width: 100%; height: 40vh; min-height: 240px; margin: 0 auto\"></div>\n"
+      "</div>\n"
+      "<div class=\"panel-footer form-inline\">\n"
+        "<select class=\"form-control\" id=\"hist-kind\">"
+          "<option value=\"voltage\">Voltage</option>"
+          "<option value=\"temperature\">Temperature</option>"
+        "</select>\n"
+        "<select class=\"form-control\" id=\"hist-tier\">");
+  for (int i = 0; i < history_tiers; i++) {
+    uint32_t interval = vehicle->BmsGetHistoryVoltage()->m_tiers[i].interval;
+    if (interval % 3600 == 0)
+      c.printf("<option value=\"%d\">%u h buckets</option>", i+1, interval / 3600);
+    else if (interval % 60 == 0)
+      c.printf("<option value=\"%d\">%u min buckets</option>", i+1, interval / 60);
+    else
+      c.printf("<option value=\"%d\">%u s buckets</option>", i+1, interval);
+  }
+  c.print(
+        "</select>\n"
+        "<select class=\"form-control\" id=\"hist-span\">"
+          "<option value=\"60\">Last 60</option>"
+          "<option value=\"120\" selected>Last 120</option>"
+          "<option value=\"360\">Last 360</option>"
+          "<option value=\"0\">All</option>"
+        "</select>\n"
+        "<button type=\"button\" class=\"btn btn-default\" id=\"hist-load\">Load</button>\n"
+        "<samp id=\"hist-output\" class=\"samp-inline\"></samp>\n"
+      "</div>\n"
+    "</div>\n"
+    "\n");
+
+  c.print(
     "<div class=\"modal fade\" id=\"cfg-dialog\" role=\"dialog\" data-backdrop=\"true\" data-keyboard=\"true\">\n"
       "<div class=\"modal-dialog modal-lg\">\n"
         "<div class=\"modal-content\">\n"
@@ -1096,6 +1143,55 @@ void OvmsWebServer::HandleBmsCellMonitor(PageEntry_t& p, PageContext_t& c)
     "}\n"
     "\n"
     "\n"
+    "/**\n"
+     "* Cell history chart: deviation of cell averages from the pack average\n"
+     "*/\n"
+    "\n"
+    "var histchart;\n"
+    "\n"
+    "function load_history() {\n"
+      "if (!window.Highcharts || !$('#hist-tier').val()) return;\n"
+      "var cmd = 'bms history ' + $('#hist-kind').val() + ' -j -a -t' + $('#hist-tier').val() + ' -n' + $('#hist-span').val();\n"
+      "$('#hist-output').text('Loading…');\n"
+      "loadcmd(cmd).done(function(output) {\n"
+        "var hist;\n"
+        "try { hist = JSON.parse(output); }\n"
+        "catch (e) { $('#hist-output').text(output); return; }\n"
+        "$('#hist-output').empty();\n"
+        "var factor = (hist.unit == 'V') ? 1000 : 1, unit = (hist.unit == 'V') ? 'mV' : hist.unit;\n"
+        "var series = [], b, c;\n"
+        "for (c = 0; c < hist.cells; c++)\n"
+          "series.push({ name: '#' + (c+1), data: [] });\n"
+        "for (b = 0; b < hist.buckets; b++) {\n"
+          "var row = hist.avg[b], x = (hist.start + b * hist.interval) * 1000, sum = 0, cnt = 0;\n"
+          "for (c = 0; row && c < hist.cells; c++) {\n"
+            "if (row[c] != null) { sum += row[c]; cnt++; }\n"
+          "}\n"
+          "for (c = 0; c < hist.cells; c++) {\n"
+            "var dev = (cnt && row[c] != null) ? Math.round((row[c] - sum / cnt) * factor * 100) / 100 : null;\n"
+            "series[c].data.push([x, dev]);\n"
+          "}\n"
+        "}\n"
+        "if (histchart) histchart.destroy();\n"
+        "histchart = Highcharts.chart('histchart', {\n"
+          "chart: { type: 'line', zoomType: 'x' },\n"
+          "time: { useUTC: false },\n"
+          "title: { text: null },\n"
+          "credits: { enabled: false },\n"
+          "legend: { enabled: (hist.cells <= 32) },\n"
+          "xAxis: { type: 'datetime' },\n"
+          "yAxis: { title: { text: 'Deviation [' + unit + ']' } },\n"
+          "tooltip: { valueSuffix: ' ' + unit, xDateFormat: '%Y-%m-%d %H:%M' },\n"
+          "plotOptions: { series: { animation: false, marker: { enabled: false } } },\n"
+          "series: series\n"
+        "});\n"
+        "$('#histchart').data('chart', histchart).addClass('has-chart');\n"
+      "});\n"
+    "}\n"
+    "\n"
+    "$('#hist-load').on('click', load_history);\n"
+    "\n"
+    "\n"
     "/**\n"
      "* Chart initialization\n"
      "*/\n"
@@ -1103,6 +1199,7 @@ void OvmsWebServer::HandleBmsCellMonitor(PageEntry_t& p, PageContext_t& c)
     "function init_charts() {\n"
       "init_volt_chart();\n"
       "init_temp_chart();\n"
+      "load_history();\n"
     "}\n"
     "\n"
     "if (window.Highcharts) {\n"
@@ -39,6 +39,7 @@ static const char *TAG = "re";
 #include "ovms_events.h"
 #include "ovms_utils.h"
 #include "ovms_notify.h"
+#include "string_writer.h"
 
 re *MyRE = NULL;
 
@@ -287,7 +288,7 @@ re::re(const char* name, canfilter* filter)
   m_mode = Analyse;
   m_rxqueue = xQueueCreate(20,sizeof(CAN_frame_t));
   xTaskCreatePinnedToCore(RE_task, "OVMS RE", 4096, (void*)this, 5, &m_task, CORE(1));
-  MyCan.RegisterListener(m_rxqueue, true);
+  MyCan.RegisterListener(m_rxqueue, true, "retools.rx");
   }
 
 re::~re()
@@ -42,7 +42,6 @@
 #include "pcp.h"
 #include "ovms.h"
 #include "ovms_mutex.h"
-#include "ovms_netmanager.h"
 
 typedef struct
   {
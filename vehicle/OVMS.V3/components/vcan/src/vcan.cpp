@@ -0,0 +1,663 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "vcan";
+
+#include <string.h>
+#include <sstream>
+#include <iomanip>
+#include "vcan.h"
+#include "canformat.h"
+#include "canplay_vfs.h"
+#include "ovms.h"
+#include "ovms_command.h"
+#include "esp_timer.h"
+
+OvmsMutex vcan::s_mutex;
+vcan::event_queue_t vcan::s_events;
+TaskHandle_t vcan::s_task = NULL;
+std::map<std::string, vcan*> vcan::s_buses;
+
+////////////////////////////////////////////////////////////////////////
+// vcan command processing
+////////////////////////////////////////////////////////////////////////
+
+static vcan* vcan_find(OvmsWriter* writer, const char* name)
+  {
+  vcan* bus = vcan::Find(name);
+  if (bus == NULL)
+    writer->printf("Error: Cannot find virtual CAN bus %s\n", name);
+  return bus;
+  }
+
+void vcan_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (argc > 0)
+    {
+    vcan* bus = vcan_find(writer, argv[0]);
+    if (bus) writer->puts(bus->GetInfo().c_str());
+    return;
+    }
+  for (int k=0; k<CAN_MAXBUSES; k++)
+    {
+    char name[5] = { 'c', 'a', 'n', (char)('1'+k), 0 };
+    vcan* bus = vcan::Find(name);
+    if (bus) writer->puts(bus->GetInfo().c_str());
+    }
+  }
+
+void vcan_set(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  vcan* bus = vcan_find(writer, argv[0]);
+  if (!bus) return;
+  const char* param = argv[1];
+  const char* value = argv[2];
+  int val = atoi(value);
+
+  if (strcmp(param, "bitrate") == 0)
+    bus->m_bitrate = (strcmp(value, "auto") == 0) ? -1 : val;
+  else if (strcmp(param, "latency") == 0)
+    bus->m_latency = val;
+  else if (strcmp(param, "jitter") == 0)
+    bus->m_jitter = val;
+  else if (strcmp(param, "txerr") == 0 && val <= 1000)
+    bus->m_txerr = val;
+  else if (strcmp(param, "rxerr") == 0 && val <= 1000)
+    bus->m_rxerr = val;
+  else if (strcmp(param, "loopback") == 0)
+    bus->m_loopback = (strcmp(value, "on") == 0 || strcmp(value, "yes") == 0 || val);
+  else if (strcmp(param, "seed") == 0)
+    bus->m_seed = val;
+  else
+    {
+    writer->printf("Error: invalid parameter or value: %s %s\n", param, value);
+    return;
+    }
+  writer->printf("%s: %s set to %s\n", bus->GetName(), param, value);
+  }
+
+void vcan_connect(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  vcan* bus = vcan_find(writer, argv[0]);
+  vcan* peer = bus ? vcan_find(writer, argv[1]) : NULL;
+  if (!peer) return;
+  if (bus->Connect(peer))
+    writer->printf("%s and %s are now cross-connected\n", bus->GetName(), peer->GetName());
+  else
+    writer->puts("Error: cannot connect a bus to itself");
+  }
+
+void vcan_disconnect(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  vcan* bus = vcan_find(writer, argv[0]);
+  if (!bus) return;
+  bus->Disconnect();
+  writer->printf("%s disconnected\n", bus->GetName());
+  }
+
+void vcan_sim_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  vcan* bus = vcan_find(writer, argv[0]);
+  if (!bus) return;
+  std::string error;
+  if (bus->AttachSimulator(argv[1], error))
+    writer->printf("%s: ECU simulation %s started\n", bus->GetName(), argv[1]);
+  else
+    writer->printf("Error: %s\n", error.c_str());
+  }
+
+void vcan_sim_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  vcan* bus = vcan_find(writer, argv[0]);
+  if (!bus) return;
+  bus->DetachSimulator();
+  writer->printf("%s: ECU simulation stopped\n", bus->GetName());
+  }
+
+void vcan_replay(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  vcan* bus = vcan_find(writer, argv[0]);
+  if (!bus) return;
+
+  // transmit mode: frames take the wire of the virtual bus, so are subject
+  // to bit rate, errors & latency, and reach peer & ECU simulation:
+  std::string format(cmd->GetName());
+  canplay_vfs* player = new canplay_vfs(argv[1], format, canformat::Transmit);
+  player->SetTarget(bus);
+  player->Open();
+
+  if (player->IsOpen())
+    {
+    if (argc>2)
+      { MyCan.AddPlayer(player, argc-2, &argv[2]); }
+    else
+      { MyCan.AddPlayer(player); }
+    writer->printf("%s: replay active: %s\n", bus->GetName(), player->GetInfo().c_str());
+    }
+  else
+    {
+    writer->printf("Error: Could not start replay from: %s\n", player->GetInfo().c_str());
+    delete player;
+    }
+  }
+
+class vcanInit
+  {
+  public:
+    vcanInit();
+  } MyVCanInit  __attribute__ ((init_priority (4590)));
+
+vcanInit::vcanInit()
+  {
+  ESP_LOGI(TAG, "Initialising virtual CAN (4590)");
+
+  OvmsCommand* cmd_vcan = MyCommandApp.RegisterCommand("vcan","Virtual CAN framework");
+  cmd_vcan->RegisterCommand("status","Show virtual CAN bus status",vcan_status,"[<bus>]",0,1);
+  cmd_vcan->RegisterCommand("set","Set virtual CAN bus parameter",vcan_set,
+    "<bus> <param> <value>\n"
+    "bitrate   bit/s, auto = bus speed, 0 = unlimited\n"
+    "latency   RX latency [us]\n"
+    "jitter    RX latency jitter [us]\n"
+    "txerr     TX errors [per mille]\n"
+    "rxerr     RX losses [per mille]\n"
+    "loopback  on/off: receive own frames\n"
+    "seed      jitter & error random generator seed",
+    3, 3);
+  cmd_vcan->RegisterCommand("connect","Cross-connect virtual CAN buses",vcan_connect,"<bus> <peer>",2,2);
+  cmd_vcan->RegisterCommand("disconnect","Disconnect virtual CAN bus",vcan_disconnect,"<bus>",1,1);
+  OvmsCommand* cmd_sim = cmd_vcan->RegisterCommand("sim","ECU simulation framework");
+  cmd_sim->RegisterCommand("start","Attach ECU simulation to virtual CAN bus",vcan_sim_start,
+    "<bus> <scenario>\nSee tests/sim for scenario examples",2,2);
+  cmd_sim->RegisterCommand("stop","Detach ECU simulation",vcan_sim_stop,"<bus>",1,1);
+  OvmsCommand* cmd_replay = cmd_vcan->RegisterCommand("replay","Replay CAN log to virtual CAN bus");
+  MyCanFormatFactory.RegisterCommandSet(cmd_replay, "Replay CAN log to virtual CAN bus",
+    vcan_replay,
+    "<bus> <path> [filter1] ... [filterN]\n"
+    "Filter: <bus> | <id>[-<id>] | <bus>:<id>[-<id>]\n"
+    "Filters apply to the logged bus, use \"can play\" to control the player",
+    2, 10);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vcan: virtual CAN bus
+////////////////////////////////////////////////////////////////////////
+
+vcan::vcan(const char* name)
+  : canbus(name)
+  {
+  m_bitrate = -1;
+  m_latency = 0;
+  m_jitter = 0;
+  m_txerr = 0;
+  m_rxerr = 0;
+  m_loopback = false;
+  m_seed = m_busnumber + 1;
+  m_peer = NULL;
+  m_sim = NULL;
+  m_txbusy = false;
+  m_busfree = 0;
+  m_lastrx = 0;
+  m_started = 0;
+  m_bustime = 0;
+  m_powermode = Off;
+
+  OvmsMutexLock lock(&s_mutex);
+  s_buses[name] = this;
+  }
+
+vcan::~vcan()
+  {
+  Stop();
+  Disconnect();
+  DetachSimulator();
+  OvmsMutexLock lock(&s_mutex);
+  s_buses.erase(m_name);
+  }
+
+vcan* vcan::Find(const char* name)
+  {
+  OvmsMutexLock lock(&s_mutex);
+  auto it = s_buses.find(name);
+  return (it != s_buses.end()) ? it->second : NULL;
+  }
+
+esp_err_t vcan::Start(CAN_mode_t mode, CAN_speed_t speed)
+  {
+  canbus::Start(mode, speed);
+
+  OvmsMutexLock lock(&s_mutex);
+  m_mode = mode;
+  m_speed = speed;
+  m_txbusy = false;
+  m_started = m_busfree = m_lastrx = esp_timer_get_time();
+  m_bustime = 0;
+  if (s_task == NULL)
+    xTaskCreatePinnedToCore(Task, "OVMS VCan", 4096, NULL, 22, &s_task, CORE(0));
+
+  // And record that we are powered on
+  pcp::SetPowerMode(On);
+
+  return ESP_OK;
+  }
+
+esp_err_t vcan::Stop()
+  {
+  canbus::Stop();
+
+  OvmsMutexLock lock(&s_mutex);
+  m_txbusy = false;
+  xQueueReset(m_txqueue);
+  for (auto it = s_events.begin(); it != s_events.end();)
+    {
+    if (it->second.bus == this)
+      it = s_events.erase(it);
+    else
+      ++it;
+    }
+
+  // And record that we are powered down
+  pcp::SetPowerMode(Off);
+
+  return ESP_OK;
+  }
+
+void vcan::SetPowerMode(PowerMode powermode)
+  {
+  pcp::SetPowerMode(powermode);
+  switch (powermode)
+    {
+    case On:
+      if (m_mode != CAN_MODE_OFF) Start(m_mode,m_speed);
+      break;
+    case Sleep:
+    case DeepSleep:
+    case Off:
+      Stop();
+      break;
+    default:
+      break;
+    };
+  }
+
+bool vcan::Connect(vcan* peer)
+  {
+  if (peer == NULL || peer == this)
+    return false;
+  OvmsMutexLock lock(&s_mutex);
+  if (m_peer) m_peer->m_peer = NULL;
+  if (peer->m_peer) peer->m_peer->m_peer = NULL;
+  m_peer = peer;
+  peer->m_peer = this;
+  return true;
+  }
+
+void vcan::Disconnect()
+  {
+  OvmsMutexLock lock(&s_mutex);
+  if (m_peer) m_peer->m_peer = NULL;
+  m_peer = NULL;
+  }
+
+bool vcan::AttachSimulator(const char* path, std::string& error)
+  {
+  cansim* sim = new cansim();
+  if (!sim->Load(path))
+    {
+    error = sim->GetError();
+    delete sim;
+    return false;
+    }
+  sim->Start(esp_timer_get_time());
+  OvmsMutexLock lock(&s_mutex);
+  if (m_sim) delete m_sim;
+  m_sim = sim;
+  return true;
+  }
+
+void vcan::DetachSimulator()
+  {
+  OvmsMutexLock lock(&s_mutex);
+  if (m_sim) delete m_sim;
+  m_sim = NULL;
+  }
+
+std::string vcan::GetInfo()
+  {
+  OvmsMutexLock lock(&s_mutex);
+  std::ostringstream buf;
+  int64_t now = esp_timer_get_time();
+
+  buf << m_name << ": " << ((m_mode==CAN_MODE_OFF) ? "Off" : ((m_mode==CAN_MODE_LISTEN) ? "Listen" : "Active"));
+  if (m_mode != CAN_MODE_OFF)
+    {
+    buf << "/" << MAP_CAN_SPEED(m_speed);
+    if (now > m_started)
+      buf << " load " << std::fixed << std::setprecision(1) << (m_bustime * 100.0 / (now - m_started)) << "%";
+    }
+  buf << "\n  bitrate ";
+  if (m_bitrate < 0) buf << "auto"; else if (m_bitrate == 0) buf << "unlimited"; else buf << m_bitrate;
+  buf << ", latency " << m_latency << "+" << m_jitter << " us"
+    << ", txerr " << m_txerr << "/1000, rxerr " << m_rxerr << "/1000"
+    << ", loopback " << (m_loopback ? "on" : "off")
+    << "\n  peer " << (m_peer ? m_peer->GetName() : "none")
+    << ", rx " << m_status.packets_rx << ", tx " << m_status.packets_tx
+    << ", txdelay " << m_status.txbuf_delay << ", txovr " << m_status.txbuf_overflow
+    << ", rxovr " << m_status.rxbuf_overflow
+    << ", txerr " << m_status.errors_tx << ", rxerr " << m_status.errors_rx;
+  if (m_sim)
+    buf << "\n  sim " << m_sim->GetStats();
+  return buf.str();
+  }
+
+/**
+ * FrameBits: number of bits on the wire for a frame, including exact bit
+ *  stuffing (SOF to CRC), delimiters, ACK, EOF and interframe space.
+ */
+int vcan::FrameBits(const CAN_frame_t* frame)
+  {
+  uint8_t bit[128];
+  int n = 0;
+  uint32_t id = frame->MsgID;
+  int dlc = frame->FIR.B.DLC;
+  int len = (frame->FIR.B.RTR == CAN_RTR) ? 0 : ((dlc > 8) ? 8 : dlc);
+
+  bit[n++] = 0;                                         // SOF
+  if (frame->FIR.B.FF == CAN_frame_std)
+    {
+    for (int i=10; i>=0; i--) bit[n++] = (id >> i) & 1;
+    bit[n++] = frame->FIR.B.RTR;                        // RTR
+    bit[n++] = 0;                                       // IDE
+    bit[n++] = 0;                                       // r0
+    }
+  else
+    {
+    for (int i=28; i>=18; i--) bit[n++] = (id >> i) & 1;
+    bit[n++] = 1;                                       // SRR
+    bit[n++] = 1;                                       // IDE
+    for (int i=17; i>=0; i--) bit[n++] = (id >> i) & 1;
+    bit[n++] = frame->FIR.B.RTR;                        // RTR
+    bit[n++] = 0;                                       // r1
+    bit[n++] = 0;                                       // r0
+    }
+  for (int i=3; i>=0; i--) bit[n++] = (dlc >> i) & 1;
+  for (int k=0; k<len; k++)
+    for (int i=7; i>=0; i--) bit[n++] = (frame->data.u8[k] >> i) & 1;
+
+  // CRC-15:
+  uint16_t crc = 0;
+  for (int k=0; k<n; k++)
+    {
+    bool nxt = bit[k] ^ ((crc >> 14) & 1);
+    crc = (crc << 1) & 0x7fff;
+    if (nxt) crc ^= 0x4599;
+    }
+  for (int i=14; i>=0; i--) bit[n++] = (crc >> i) & 1;
+
+  // Stuff bits: one after each run of 5 equal bits (stuff bits count in the next run):
+  int stuff = 0, run = 1;
+  uint8_t last = bit[0];
+  for (int k=1; k<n; k++)
+    {
+    if (bit[k] == last)
+      {
+      if (++run == 5)
+        {
+        stuff++;
+        last = !last;
+        run = 1;
+        }
+      }
+    else
+      {
+      last = bit[k];
+      run = 1;
+      }
+    }
+
+  return n + stuff + 1 + 2 + 7 + 3;                     // CRC delimiter, ACK, EOF, IFS
+  }
+
+int64_t vcan::FrameTime(const CAN_frame_t* p_frame)
+  {
+  int64_t bitrate = (m_bitrate < 0) ? MAP_CAN_SPEED(m_speed) : m_bitrate;
+  if (bitrate == 0) return 0;
+  return (FrameBits(p_frame) * 1000000LL + bitrate/2) / bitrate;
+  }
+
+/**
+ * WireTime: put a frame on the wire shared with the peer, returns the end time
+ *  of the transmission.
+ */
+int64_t vcan::WireTime(const CAN_frame_t* p_frame, int64_t time)
+  {
+  int64_t start = time;
+  if (start < m_busfree) start = m_busfree;
+  if (m_peer && start < m_peer->m_busfree) start = m_peer->m_busfree;
+  int64_t duration = FrameTime(p_frame);
+  m_busfree = start + duration;
+  m_bustime += duration;
+  if (m_peer)
+    {
+    m_peer->m_busfree = m_busfree;
+    m_peer->m_bustime += duration;
+    }
+  return m_busfree;
+  }
+
+uint32_t vcan::Random(uint32_t range)
+  {
+  m_seed = m_seed * 1103515245 + 12345;
+  return (m_seed >> 16) % range;
+  }
+
+void vcan::Schedule(int64_t time, event_type_t type, vcan* bus, const CAN_frame_t* frame)
+  {
+  event_t ev;
+  ev.type = type;
+  ev.bus = bus;
+  ev.frame = *frame;
+  auto it = s_events.insert(std::make_pair(time, ev));
+  if (it == s_events.begin() && s_task)
+    xTaskNotifyGive(s_task);
+  }
+
+esp_err_t vcan::Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait /*=0*/)
+  {
+  if (m_mode != CAN_MODE_ACTIVE || m_powermode != On)
+    {
+    ESP_LOGW(TAG,"Cannot write %s when not in ACTIVE mode",m_name);
+    return ESP_OK;
+    }
+
+  s_mutex.Lock();
+  if (!m_txbusy)
+    {
+    Transmit(p_frame, esp_timer_get_time());
+    s_mutex.Unlock();
+    return ESP_OK;
+    }
+  s_mutex.Unlock();
+
+  esp_err_t res = QueueWrite(p_frame, maxqueuewait);
+  if (res == ESP_QUEUED)
+    {
+    // The wire may have become idle meanwhile:
+    OvmsMutexLock lock(&s_mutex);
+    CAN_frame_t frame;
+    if (!m_txbusy && xQueueReceive(m_txqueue, (void*)&frame, 0) == pdTRUE)
+      Transmit(&frame, esp_timer_get_time());
+    }
+  return res;
+  }
+
+void vcan::Transmit(const CAN_frame_t* p_frame, int64_t time)
+  {
+  m_txbusy = true;
+
+  // stats & logging:
+  canbus::Write(p_frame);
+
+  int64_t done = WireTime(p_frame, time);
+  if (m_txerr && Random(1000) < m_txerr)
+    {
+    m_status.errors_tx++;
+    Schedule(done, TxFail, this, p_frame);
+    }
+  else
+    {
+    Schedule(done, TxDone, this, p_frame);
+    }
+  }
+
+/**
+ * Transmitted: frame is on the wire, deliver to the receivers & simulators
+ */
+void vcan::Transmitted(const CAN_frame_t* p_frame, int64_t time)
+  {
+  if (m_loopback)
+    Deliver(p_frame, time);
+  if (m_peer)
+    m_peer->Deliver(p_frame, time);
+  if (m_sim)
+    Simulate(p_frame, time);
+  if (m_peer && m_peer->m_sim)
+    m_peer->Simulate(p_frame, time);
+  }
+
+void vcan::Simulate(const CAN_frame_t* p_frame, int64_t time)
+  {
+  m_sim->Process(p_frame, time, [this](const CAN_frame_t& frame, int64_t time_us)
+    {
+    int64_t end = WireTime(&frame, time_us);
+    Deliver(&frame, end);
+    if (m_peer)
+      m_peer->Deliver(&frame, end);
+    });
+  }
+
+void vcan::Deliver(const CAN_frame_t* p_frame, int64_t time)
+  {
+  if (m_mode == CAN_MODE_OFF || m_powermode != On)
+    return;
+  if (m_rxerr && Random(1000) < m_rxerr)
+    {
+    m_status.errors_rx++;
+    return;
+    }
+  time += m_latency;
+  if (m_jitter)
+    time += Random(m_jitter + 1);
+  // CAN does not reorder frames:
+  if (time < m_lastrx)
+    time = m_lastrx;
+  m_lastrx = time;
+
+  CAN_frame_t frame = *p_frame;
+  frame.origin = this;
+  frame.callback = NULL;
+  Schedule(time, Rx, this, &frame);
+  }
+
+void vcan::Receive(const CAN_frame_t* p_frame)
+  {
+  CAN_queue_msg_t msg;
+  msg.type = CAN_frame;
+  msg.body.frame = *p_frame;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  msg.body.frame.rxtime = esp_timer_get_time();
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
+  if (xQueueSend(MyCan.m_rxqueue, &msg, 0) != pdTRUE)
+    m_status.rxbuf_overflow++;
+  }
+
+/**
+ * Dispatch: process all events due at time <now>
+ *  Returns the time of the next event or -1 if there is none.
+ */
+int64_t vcan::Dispatch(int64_t now)
+  {
+  OvmsMutexLock lock(&s_mutex);
+  while (!s_events.empty())
+    {
+    auto it = s_events.begin();
+    if (it->first > now)
+      return it->first;
+    int64_t time = it->first;
+    event_t ev = it->second;
+    s_events.erase(it);
+
+    switch (ev.type)
+      {
+      case TxDone:
+      case TxFail:
+        {
+        CAN_queue_msg_t msg;
+        msg.type = (ev.type == TxDone) ? CAN_txcallback : CAN_txfailedcallback;
+        msg.body.frame = ev.frame;
+        msg.body.bus = ev.bus;
+        if (xQueueSend(MyCan.m_rxqueue, &msg, 0) != pdTRUE)
+          {
+          // CAN task busy, retry on next tick:
+          Schedule(now + portTICK_PERIOD_MS*1000, ev.type, ev.bus, &ev.frame);
+          return now + portTICK_PERIOD_MS*1000;
+          }
+        if (ev.type == TxDone)
+          ev.bus->Transmitted(&ev.frame, time);
+        // Wire has become available; send next queued frame (if any):
+        ev.bus->m_txbusy = false;
+        CAN_frame_t frame;
+        if (ev.bus->m_powermode == On && xQueueReceive(ev.bus->m_txqueue, (void*)&frame, 0) == pdTRUE)
+          ev.bus->Transmit(&frame, time);
+        break;
+        }
+      case Rx:
+        ev.bus->Receive(&ev.frame);
+        break;
+      }
+    }
+  return -1;
+  }
+
+void vcan::Task(void* pvParameters)
+  {
+  while (1)
+    {
+    int64_t next = Dispatch(esp_timer_get_time());
+    TickType_t ticks = portMAX_DELAY;
+    if (next >= 0)
+      {
+      int64_t wait = next - esp_timer_get_time();
+      if (wait <= 0) continue;
+      ticks = (wait + portTICK_PERIOD_MS*1000 - 1) / (portTICK_PERIOD_MS*1000);
+      }
+    ulTaskNotifyTake(pdTRUE, ticks);
+    }
+  }
@@ -0,0 +1,134 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __VCAN_H__
+#define __VCAN_H__
+
+#include <stdint.h>
+#include <map>
+#include "can.h"
+#include "cansim.h"
+#include "ovms_mutex.h"
+
+/**
+ * vcan: virtual CAN bus
+ *
+ * A canbus without transceiver for testing & load benchmarking. Frames
+ * written are put "on the wire" with the bus bit rate (including bit
+ * stuffing), and delivered as received frames to:
+ *  - the cross-connected virtual bus (if any), both buses share the wire
+ *  - the bus itself in loopback mode
+ *  - the ECU simulator attached to any bus on the wire (see cansim.h),
+ *    simulator responses take the wire like other frames
+ *
+ * Receivers add their latency (+ deterministic jitter), error injection
+ * drops TX (per mille of frames written, reported as TX failure) and RX
+ * frames (per mille per receiver). Queued TX frames follow back to back
+ * like from a controller TX FIFO. Replay sources: play a CAN log in
+ * transmit mode to a virtual bus, frames will then be timed by the bus.
+ *
+ * All virtual buses share one scheduler task. Bus times are exact, but
+ * delivery is done per FreeRTOS tick, so frames arrive in bursts.
+ */
+class vcan : public canbus
+  {
+  public:
+    vcan(const char* name);
+    ~vcan();
+
+  public:
+    esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed);
+    esp_err_t Stop();
+
+  public:
+    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0);
+
+  public:
+    void SetPowerMode(PowerMode powermode);
+
+  public:
+    bool Connect(vcan* peer);
+    void Disconnect();
+    bool AttachSimulator(const char* path, std::string& error);
+    void DetachSimulator();
+    std::string GetInfo();
+
+  public:
+    static vcan* Find(const char* name);
+    static int FrameBits(const CAN_frame_t* frame);
+    static int64_t Dispatch(int64_t now);
+
+  protected:
+    typedef enum { TxDone, TxFail, Rx } event_type_t;
+    typedef struct
+      {
+      event_type_t type;
+      vcan* bus;
+      CAN_frame_t frame;
+      } event_t;
+    typedef std::multimap<int64_t, event_t> event_queue_t;
+
+    void Transmit(const CAN_frame_t* p_frame, int64_t time);
+    void Transmitted(const CAN_frame_t* p_frame, int64_t time);
+    void Deliver(const CAN_frame_t* p_frame, int64_t time);
+    void Receive(const CAN_frame_t* p_frame);
+    void Simulate(const CAN_frame_t* p_frame, int64_t time);
+    int64_t WireTime(const CAN_frame_t* p_frame, int64_t time);
+    int64_t FrameTime(const CAN_frame_t* p_frame);
+    uint32_t Random(uint32_t range);
+    static void Schedule(int64_t time, event_type_t type, vcan* bus, const CAN_frame_t* frame);
+    static void Task(void* pvParameters);
+
+  public:
+    int32_t             m_bitrate;          // -1 = bus speed, 0 = unlimited
+    uint32_t            m_latency;          // RX latency [us]
+    uint32_t            m_jitter;           // RX jitter [us]
+    uint16_t            m_txerr;            // TX errors [per mille]
+    uint16_t            m_rxerr;            // RX losses [per mille]
+    bool                m_loopback;         // receive own frames
+    uint32_t            m_seed;             // jitter & error LCG state
+
+  protected:
+    vcan*               m_peer;             // cross-connected bus
+    cansim*             m_sim;              // attached ECU simulator
+    bool                m_txbusy;           // frame on the wire
+    int64_t             m_busfree;          // wire idle from [us]
+    int64_t             m_lastrx;           // last RX delivery [us]
+    int64_t             m_started;          // bus start time [us]
+    int64_t             m_bustime;          // wire busy time [us]
+
+  protected:
+    static OvmsMutex        s_mutex;
+    static event_queue_t    s_events;
+    static TaskHandle_t     s_task;
+    static std::map<std::string, vcan*> s_buses;
+  };
+
+#endif //#ifndef __VCAN_H__
@@ -32,6 +32,8 @@
 static const char *TAG = "vehicle";
 
 #include <stdio.h>
+#include <math.h>
+#include <sys/param.h>
 #include <algorithm>
 #include <ovms_command.h>
 #include <ovms_script.h>
@@ -43,6 +45,8 @@ static const char *TAG = "vehicle";
 #endif // #ifdef CONFIG_OVMS_COMP_WEBSERVER
 #include <ovms_peripherals.h>
 #include <string_writer.h>
+#include "esp_timer.h"
+#include "ovms.h"
 #include "vehicle.h"
 
 #undef SQR
@@ -97,6 +101,31 @@ void vehicle_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int arg
     }
   }
 
+void vehicle_poll_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle != NULL)
+    {
+    MyVehicleFactory.m_currentvehicle->PollerStatus(verbosity, writer);
+    }
+  else
+    {
+    writer->puts("No vehicle module selected");
+    }
+  }
+
+void vehicle_poll_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle != NULL)
+    {
+    MyVehicleFactory.m_currentvehicle->PollerResetStats();
+    writer->puts("Poller statistics have been reset.");
+    }
+  else
+    {
+    writer->puts("No vehicle module selected");
+    }
+  }
+
 void vehicle_wakeup(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (MyVehicleFactory.m_currentvehicle==NULL)
@@ -461,6 +490,68 @@ void bms_alerts(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
     }
   }
 
+void bms_history_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle == NULL)
+    {
+    writer->puts("No vehicle module selected");
+    return;
+    }
+  MyVehicleFactory.m_currentvehicle->BmsGetHistoryVoltage()->Status(verbosity, writer, monotonictime);
+  MyVehicleFactory.m_currentvehicle->BmsGetHistoryTemperature()->Status(verbosity, writer, monotonictime);
+  }
+
+void bms_history_report(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle == NULL)
+    {
+    writer->puts("No vehicle module selected");
+    return;
+    }
+  OvmsBmsHistory* history = (strcmp(cmd->GetName(), "voltage") == 0)
+    ? MyVehicleFactory.m_currentvehicle->BmsGetHistoryVoltage()
+    : MyVehicleFactory.m_currentvehicle->BmsGetHistoryTemperature();
+
+  int tier = 1, buckets = 0, cell = 0;
+  bool json = false, avgonly = false;
+  for (int i = 0; i < argc; i++)
+    {
+    if (strncmp(argv[i], "-t", 2) == 0)
+      tier = atoi(argv[i]+2);
+    else if (strncmp(argv[i], "-n", 2) == 0)
+      buckets = atoi(argv[i]+2);
+    else if (strncmp(argv[i], "-c", 2) == 0)
+      cell = atoi(argv[i]+2);
+    else if (strcmp(argv[i], "-j") == 0)
+      json = true;
+    else if (strcmp(argv[i], "-a") == 0)
+      avgonly = true;
+    else
+      {
+      writer->printf("Error: invalid option '%s'\n", argv[i]);
+      return;
+      }
+    }
+  if (tier < 1 || cell < 0)
+    {
+    writer->puts("Error: tier and cell numbers start at 1");
+    return;
+    }
+  history->Report(verbosity, writer, monotonictime, tier-1, buckets, cell-1, json, avgonly);
+  }
+
+void bms_history_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  if (MyVehicleFactory.m_currentvehicle == NULL)
+    {
+    writer->puts("No vehicle module selected");
+    return;
+    }
+  MyVehicleFactory.m_currentvehicle->BmsGetHistoryVoltage()->Clear();
+  MyVehicleFactory.m_currentvehicle->BmsGetHistoryTemperature()->Clear();
+  writer->puts("BMS history has been cleared.");
+  }
+
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
 static duk_ret_t DukOvmsVehicleType(duk_context *ctx)
@@ -806,6 +897,9 @@ OvmsVehicleFactory::OvmsVehicleFactory()
   cmd_vehicle->RegisterCommand("module","Set (or clear) vehicle module",vehicle_module,"<type>",0,1);
   cmd_vehicle->RegisterCommand("list","Show list of available vehicle modules",vehicle_list);
   cmd_vehicle->RegisterCommand("status","Show vehicle module status",vehicle_status);
+  OvmsCommand* cmd_poll = cmd_vehicle->RegisterCommand("poll","Vehicle poller framework");
+  cmd_poll->RegisterCommand("status","Show poller status & per PID statistics",vehicle_poll_status);
+  cmd_poll->RegisterCommand("reset","Reset poller statistics",vehicle_poll_reset);
 
   MyCommandApp.RegisterCommand("wakeup","Wake up vehicle",vehicle_wakeup);
   MyCommandApp.RegisterCommand("homelink","Activate specified homelink button",vehicle_homelink,"<homelink><durationms>",1,2);
@@ -832,6 +926,19 @@ OvmsVehicleFactory::OvmsVehicleFactory()
   cmd_bms->RegisterCommand("status","Show BMS status",bms_status);
   cmd_bms->RegisterCommand("reset","Reset BMS statistics",bms_reset);
   cmd_bms->RegisterCommand("alerts","Show BMS alerts",bms_alerts);
+  OvmsCommand* cmd_bmshist = cmd_bms->RegisterCommand("history","BMS cell history");
+  cmd_bmshist->RegisterCommand("status","Show BMS history status",bms_history_status);
+  const char* histusage =
+    "[-t<tier>] [-n<buckets>] [-c<cell>] [-j] [-a]\n"
+    "Shows min/avg/max per time bucket, default: summary per cell of tier 1.\n"
+    "-t\thistory tier 1…\n"
+    "-n\tlimit to the last <buckets>\n"
+    "-c\tshow time series of cell 1…\n"
+    "-j\toutput all cells per bucket as JSON\n"
+    "-a\tJSON: averages only";
+  cmd_bmshist->RegisterCommand("voltage","Show BMS voltage history",bms_history_report,histusage,0,5);
+  cmd_bmshist->RegisterCommand("temperature","Show BMS temperature history",bms_history_report,histusage,0,5);
+  cmd_bmshist->RegisterCommand("clear","Clear BMS history",bms_history_clear);
 
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   DuktapeObjectRegistration* dto = new DuktapeObjectRegistration("OvmsVehicle");
@@ -941,6 +1048,8 @@ static void OvmsVehicleRxTask(void *pvParameters)
   }
 
 OvmsVehicle::OvmsVehicle()
+  : m_bms_history_v("voltage", "V", 0.001, 0, 3),
+    m_bms_history_t("temperature", "°C", 0.01, -100, 1)
   {
   m_can1 = NULL;
   m_can2 = NULL;
@@ -956,10 +1065,12 @@ OvmsVehicle::OvmsVehicle()
   m_ready = false;
 
   m_poll_state = 0;
+  m_poll_mutex.SetName("vehicle.poll");
   m_poll_bus = NULL;
   m_poll_plist = NULL;
-  m_poll_plcur = NULL;
   m_poll_ticker = 0;
+  m_poll_busframes = 0;
+  m_poll_hash = 0;
   m_poll_moduleid_sent = 0;
   m_poll_moduleid_low = 0;
   m_poll_moduleid_high = 0;
@@ -1101,8 +1212,9 @@ OvmsVehicle::~OvmsVehicle()
     m_registeredlistener = false;
     }
 
-  vQueueDelete(m_rxqueue);
+  // stop the task before deleting the queue it's waiting on:
   vTaskDelete(m_rxtask);
+  vQueueDelete(m_rxqueue);
 
   MyEvents.DeregisterEvent(TAG);
   MyMetrics.DeregisterListener(TAG);
@@ -1123,6 +1235,9 @@ void OvmsVehicle::RxTask()
       {
       if (!m_ready)
         continue;
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      MyCan.LatencyRecord(CAN_Latency_VehQueue, &frame);
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
       if ((frame.origin == m_poll_bus)&&(m_poll_plist))
         {
         // This is intended for our poller
@@ -1136,6 +1251,9 @@ void OvmsVehicle::RxTask()
       else if (m_can2 == frame.origin) IncomingFrameCan2(&frame);
       else if (m_can3 == frame.origin) IncomingFrameCan3(&frame);
       else if (m_can4 == frame.origin) IncomingFrameCan4(&frame);
+#ifdef CONFIG_OVMS_HW_CAN_LATENCY_STATS
+      MyCan.LatencyRecord(CAN_Latency_Vehicle, &frame);
+#endif // CONFIG_OVMS_HW_CAN_LATENCY_STATS
       }
     }
   }
@@ -1196,7 +1314,7 @@ void OvmsVehicle::RegisterCanBus(int bus, CAN_mode_t mode, CAN_speed_t speed, db
   if (!m_registeredlistener)
     {
     m_registeredlistener = true;
-    MyCan.RegisterListener(m_rxqueue);
+    MyCan.RegisterListener(m_rxqueue, false, "vehicle.rx");
     }
   }
 
@@ -1217,6 +1335,9 @@ void OvmsVehicle::VehicleTicker1(std::string event, void* data)
 
   PollerSend();
 
+  m_bms_history_v.Tick(monotonictime);
+  m_bms_history_t.Tick(monotonictime);
+
   Ticker1(m_ticker);
   if ((m_ticker % 10) == 0) Ticker10(m_ticker);
   if ((m_ticker % 60) == 0) Ticker60(m_ticker);
@@ -1630,6 +1751,14 @@ void OvmsVehicle::VehicleConfigChanged(std::string event, void* data)
   // read vehicle framework config:
   if (!param || param->GetName() == "vehicle")
     {
+    // poll scheduler:
+    int poll_rate = MyConfig.GetParamValueInt("vehicle", "poll.rate", 1);
+    int poll_busload = MyConfig.GetParamValueInt("vehicle", "poll.busload", 0);
+    bool poll_adaptive = MyConfig.GetParamValueBool("vehicle", "poll.adaptive", false);
+    m_poll_mutex.Lock();
+    m_poll_sched.Configure(poll_rate, poll_busload, poll_adaptive);
+    m_poll_mutex.Unlock();
+
     // acceleration calculation:
     m_accel_smoothing = MyConfig.GetParamValueFloat("vehicle", "accel.smoothing", 2.0);
 
@@ -1649,6 +1778,9 @@ void OvmsVehicle::VehicleConfigChanged(std::string event, void* data)
     m_brakelight_basepwr = MyConfig.GetParamValueFloat("vehicle", "brakelight.basepwr", 0);
     m_brakelight_ignftbrk = MyConfig.GetParamValueBool("vehicle", "brakelight.ignftbrk", false);
     m_brakelight_start = 0;
+
+    // BMS cell history:
+    BmsConfigureHistory();
     }
 
   // read vehicle specific config:
@@ -1996,8 +2128,9 @@ void OvmsVehicle::PollSetPidList(canbus* bus, const poll_pid_t* plist)
   OvmsMutexLock lock(&m_poll_mutex);
   m_poll_bus = bus;
   m_poll_plist = plist;
-  m_poll_ticker = 0;
-  m_poll_plcur = NULL;
+  m_poll_busframes = bus ? bus->m_status.packets_rx + bus->m_status.packets_tx : 0;
+  m_poll_hash = 0;
+  m_poll_sched.SetList(plist, m_poll_state, m_poll_ticker);
   }
 
 void OvmsVehicle::PollSetState(uint8_t state)
@@ -2006,8 +2139,7 @@ void OvmsVehicle::PollSetState(uint8_t state)
     {
     OvmsMutexLock lock(&m_poll_mutex);
     m_poll_state = state;
-    m_poll_ticker = 0;
-    m_poll_plcur = NULL;
+    m_poll_sched.SetState(state, m_poll_ticker);
     }
   }
 
@@ -2015,77 +2147,125 @@ void OvmsVehicle::PollerSend()
   {
   OvmsMutexLock lock(&m_poll_mutex);
   if (!m_poll_bus || !m_poll_plist) return;
-  if (m_poll_plcur == NULL) m_poll_plcur = m_poll_plist;
 
-  while (m_poll_plcur->txmoduleid != 0)
+  m_poll_ticker++;
+
+  // Bus load of the last second, estimating 125 bits per frame (8 data bytes
+  //  incl. stuffing), includes our own requests:
+  uint32_t frames = m_poll_bus->m_status.packets_rx + m_poll_bus->m_status.packets_tx;
+  int busload = (uint64_t)(frames - m_poll_busframes) * 125 * 100 / MAP_CAN_SPEED(m_poll_bus->m_speed);
+  m_poll_busframes = frames;
+
+  m_poll_sched.Tick(m_poll_ticker, esp_timer_get_time(), busload);
+  PollerSendNext();
+  }
+
+/**
+ * PollerSendNext: send the next poll request due (if any)
+ *  Called with m_poll_mutex held, on the ticker and after a complete response.
+ */
+void OvmsVehicle::PollerSendNext()
+  {
+  if (!m_poll_bus || !m_poll_plist) return;
+  int index = m_poll_sched.Next(m_poll_ticker);
+  if (index < 0) return;
+  const poll_pid_t* p = &m_poll_plist[index];
+
+  m_poll_type = p->type;
+  m_poll_pid = p->pid;
+  if (p->rxmoduleid != 0)
     {
-    if ((m_poll_plcur->polltime[m_poll_state] > 0)&&
-        ((m_poll_ticker % m_poll_plcur->polltime[m_poll_state] ) == 0))
-      {
-      // We need to poll this one...
-      m_poll_type = m_poll_plcur->type;
-      m_poll_pid = m_poll_plcur->pid;
-      if (m_poll_plcur->rxmoduleid != 0)
-        {
-        // send to <moduleid>, listen to response from <rmoduleid>:
-        m_poll_moduleid_sent = m_poll_plcur->txmoduleid;
-        m_poll_moduleid_low = m_poll_plcur->rxmoduleid;
-        m_poll_moduleid_high = m_poll_plcur->rxmoduleid;
-        }
-      else
-        {
-        // broadcast: send to 0x7df, listen to all responses:
-        m_poll_moduleid_sent = 0x7df;
-        m_poll_moduleid_low = 0x7e8;
-        m_poll_moduleid_high = 0x7ef;
-        }
+    // send to <moduleid>, listen to response from <rmoduleid>:
+    m_poll_moduleid_sent = p->txmoduleid;
+    m_poll_moduleid_low = p->rxmoduleid;
+    m_poll_moduleid_high = p->rxmoduleid;
+    }
+  else
+    {
+    // broadcast: send to 0x7df, listen to all responses:
+    m_poll_moduleid_sent = 0x7df;
+    m_poll_moduleid_low = 0x7e8;
+    m_poll_moduleid_high = 0x7ef;
+    }
 
-      // ESP_LOGI(TAG, "Polling for %d/%02x (expecting %03x/%03x-%03x)",
-      //   m_poll_type,m_poll_pid,m_poll_moduleid_sent,m_poll_moduleid_low,m_poll_moduleid_high);
-      CAN_frame_t txframe;
-      memset(&txframe,0,sizeof(txframe));
-      txframe.origin = m_poll_bus;
-      txframe.MsgID = m_poll_moduleid_sent;
-      txframe.FIR.B.FF = CAN_frame_std;
-      txframe.FIR.B.DLC = 8;
-      switch (m_poll_plcur->type)
-        {
-        case VEHICLE_POLL_TYPE_OBDIICURRENT:
-        case VEHICLE_POLL_TYPE_OBDIIFREEZE:
-        case VEHICLE_POLL_TYPE_OBDIISESSION:
-          // 8 bit PID request for single frame response:
-          txframe.data.u8[0] = 0x02;
-          txframe.data.u8[1] = m_poll_type;
-          txframe.data.u8[2] = m_poll_pid;
-          break;
-        case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
-        case VEHICLE_POLL_TYPE_OBDIIGROUP:
-        case VEHICLE_POLL_TYPE_OBDII_1A:
-          // 8 bit PID request for multi frame response:
-          m_poll_ml_remain = 0;
-          txframe.data.u8[0] = 0x02;
-          txframe.data.u8[1] = m_poll_type;
-          txframe.data.u8[2] = m_poll_pid;
-          break;
-        case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
-          // 16 bit PID request:
-          m_poll_ml_remain = 0;
-          txframe.data.u8[0] = 0x03;
-          txframe.data.u8[1] = m_poll_type; //VEHICLE_POLL_TYPE_OBDIIEXTENDED;    // Get extended PID
-          txframe.data.u8[2] = m_poll_pid >> 8;
-          txframe.data.u8[3] = m_poll_pid & 0xff;
-          break;
-        }
-      m_poll_bus->Write(&txframe);
-      m_poll_plcur++;
-      return;
-      }
-    m_poll_plcur++;
+  // ESP_LOGI(TAG, "Polling for %d/%02x (expecting %03x/%03x-%03x)",
+  //   m_poll_type,m_poll_pid,m_poll_moduleid_sent,m_poll_moduleid_low,m_poll_moduleid_high);
+  CAN_frame_t txframe;
+  memset(&txframe,0,sizeof(txframe));
+  txframe.origin = m_poll_bus;
+  txframe.MsgID = m_poll_moduleid_sent;
+  txframe.FIR.B.FF = CAN_frame_std;
+  txframe.FIR.B.DLC = 8;
+  switch (p->type)
+    {
+    case VEHICLE_POLL_TYPE_OBDIICURRENT:
+    case VEHICLE_POLL_TYPE_OBDIIFREEZE:
+    case VEHICLE_POLL_TYPE_OBDIISESSION:
+      // 8 bit PID request for single frame response:
+      txframe.data.u8[0] = 0x02;
+      txframe.data.u8[1] = m_poll_type;
+      txframe.data.u8[2] = m_poll_pid;
+      break;
+    case VEHICLE_POLL_TYPE_OBDIIVEHICLE:
+    case VEHICLE_POLL_TYPE_OBDIIGROUP:
+    case VEHICLE_POLL_TYPE_OBDII_1A:
+      // 8 bit PID request for multi frame response:
+      m_poll_ml_remain = 0;
+      txframe.data.u8[0] = 0x02;
+      txframe.data.u8[1] = m_poll_type;
+      txframe.data.u8[2] = m_poll_pid;
+      break;
+    case VEHICLE_POLL_TYPE_OBDIIEXTENDED:
+      // 16 bit PID request:
+      m_poll_ml_remain = 0;
+      txframe.data.u8[0] = 0x03;
+      txframe.data.u8[1] = m_poll_type; //VEHICLE_POLL_TYPE_OBDIIEXTENDED;    // Get extended PID
+      txframe.data.u8[2] = m_poll_pid >> 8;
+      txframe.data.u8[3] = m_poll_pid & 0xff;
+      break;
     }
+  m_poll_hash = 0;
+  m_poll_bus->Write(&txframe);
+  m_poll_sched.Sent(index, m_poll_ticker, esp_timer_get_time());
+  }
 
-  m_poll_plcur = m_poll_plist;
-  m_poll_ticker++;
-  if (m_poll_ticker > 3600) m_poll_ticker -= 3600;
+/**
+ * PollerReceived: forward response data to the vehicle, update scheduler
+ */
+void OvmsVehicle::PollerReceived(canbus* bus, uint8_t* data, uint8_t length, uint16_t mlremain)
+  {
+  m_poll_hash = OvmsPollScheduler::Hash(m_poll_hash, data, length);
+  uint32_t hash = m_poll_hash;
+
+  IncomingPollReply(bus, m_poll_type, m_poll_pid, data, length, mlremain);
+
+  OvmsMutexLock lock(&m_poll_mutex);
+  if (mlremain)
+    {
+    m_poll_sched.Receiving(esp_timer_get_time());
+    }
+  else
+    {
+    m_poll_sched.Reply(hash, esp_timer_get_time());
+    m_poll_hash = 0;
+    // continue with next request within the rate budget:
+    PollerSendNext();
+    }
+  }
+
+void OvmsVehicle::PollerStatus(int verbosity, OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  if (!m_poll_plist)
+    writer->puts("Poller: no poll list");
+  else
+    m_poll_sched.Status(verbosity, writer, m_poll_ticker);
+  }
+
+void OvmsVehicle::PollerResetStats()
+  {
+  OvmsMutexLock lock(&m_poll_mutex);
+  m_poll_sched.ResetStats(m_poll_ticker);
   }
 
 void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
@@ -2101,7 +2281,7 @@ void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
           (frame->data.u8[2] == m_poll_pid))
         {
         m_poll_ml_frame = 0;
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[3], 5, 0);
+        PollerReceived(frame->origin, &frame->data.u8[3], 5, 0);
         return;
         }
       break;
@@ -2148,7 +2328,7 @@ void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
         m_poll_ml_frame = 0;
 
         // ESP_LOGI(TAG, "Poll ML first frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, m_poll_ml_remain);
+        PollerReceived(frame->origin, &frame->data.u8[4], 4, m_poll_ml_remain);
         return;
         }
       else if (((frame->data.u8[0]>>4)==0x2)&&(m_poll_ml_remain>0))
@@ -2169,7 +2349,7 @@ void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
           }
         m_poll_ml_frame++;
         // ESP_LOGI(TAG, "Poll ML subsequent frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[1], len, m_poll_ml_remain);
+        PollerReceived(frame->origin, &frame->data.u8[1], len, m_poll_ml_remain);
         return;
         }
       break;
@@ -2179,10 +2359,10 @@ void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
           (frame->data.u8[2] == 0x40+m_poll_type)&&
           ((frame->data.u8[4]+(((uint16_t) frame->data.u8[3]) << 8))  == m_poll_pid))
         {
-        // First frame is 4 bytes header (2 ISO-TP, 2 OBDII), 4 bytes data:
-        // [first=1,lenH] [lenL] [type+40] [pid] [data0] [data1] [data2] [data3]
+        // First frame is 5 bytes header (2 ISO-TP, 3 OBDII), 3 bytes data:
+        // [first=1,lenH] [lenL] [type+40] [pidH] [pidL] [data0] [data1] [data2]
         // Note that the value of 'len' includes the OBDII type and pid bytes,
-        // but we don't count these in the data we pass to IncomingPollReply.
+        // but we don't count these in the remaining length.
         //
         // First frame; send flow control frame:
         CAN_frame_t txframe;
@@ -2208,13 +2388,15 @@ void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
         txframe.data.u8[2] = 0x19; // with 25ms send interval
         txframe.Write();
 
-        // prepare frame processing, first frame contains first 4 bytes:
-        m_poll_ml_remain = (((uint16_t)(frame->data.u8[0]&0x0f))<<8) + frame->data.u8[1] - 3;
+        // prepare frame processing, first frame contains first 3 bytes:
+        // (the PID low byte is passed along as data[0] for compatibility,
+        //  so the scheduler sees the reply complete with the last frame)
+        m_poll_ml_remain = (((uint16_t)(frame->data.u8[0]&0x0f))<<8) + frame->data.u8[1] - 3 - 3;
         m_poll_ml_offset = 3;
         m_poll_ml_frame = 0;
 
         //ESP_LOGD(TAG, "Poll ML first frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, m_poll_ml_remain);
+        PollerReceived(frame->origin, &frame->data.u8[4], 4, m_poll_ml_remain);
         return;
         }
       else if (((frame->data.u8[0]>>4)==0x2)&&(m_poll_ml_remain>0))
@@ -2235,13 +2417,13 @@ void OvmsVehicle::PollerReceive(CAN_frame_t* frame)
           }
         m_poll_ml_frame++;
         //ESP_LOGD(TAG, "Poll ML subsequent frame (frame=%d, remain=%d)",m_poll_ml_frame,m_poll_ml_remain);
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[1], len, m_poll_ml_remain);
+        PollerReceived(frame->origin, &frame->data.u8[1], len, m_poll_ml_remain);
         return;
         }
       else if ((frame->data.u8[1] == 0x62)&&
                ((frame->data.u8[3]+(((uint16_t) frame->data.u8[2]) << 8)) == m_poll_pid))
         {
-        IncomingPollReply(frame->origin, m_poll_type, m_poll_pid, &frame->data.u8[4], 4, 0);
+        PollerReceived(frame->origin, &frame->data.u8[4], 4, 0);
         }
       break;
     }
@@ -2325,6 +2507,7 @@ void OvmsVehicle::BmsSetCellArrangementVoltage(int readings, int readingspermodu
   m_bms_readingspermodule_v = readingspermodule;
 
   BmsResetCellVoltages();
+  BmsConfigureHistory();
   }
 
 void OvmsVehicle::BmsSetCellArrangementTemperature(int readings, int readingspermodule)
@@ -2348,6 +2531,7 @@ void OvmsVehicle::BmsSetCellArrangementTemperature(int readings, int readingsper
   m_bms_readingspermodule_t = readingspermodule;
 
   BmsResetCellTemperatures();
+  BmsConfigureHistory();
   }
 
 int OvmsVehicle::BmsGetCellArangementVoltage(int* readings, int* readingspermodule)
@@ -2363,6 +2547,23 @@ int OvmsVehicle::BmsGetCellArangementTemperature(int* readings, int* readingsper
   return m_bms_readings_t;
   }
 
+/**
+ * BmsConfigureHistory: (re)configure the cell history from the "vehicle" config
+ *  bms.history         yes = enable (default no)
+ *  bms.history.tiers   <interval>:<count>,… (seconds : buckets)
+ *  bms.history.spill   directory to append the last tier to (i.e. /sd/bms), empty = off
+ */
+void OvmsVehicle::BmsConfigureHistory()
+  {
+  bool enable = MyConfig.GetParamValueBool("vehicle", "bms.history", false);
+  std::string tiers = MyConfig.GetParamValue("vehicle", "bms.history.tiers", BMS_HISTORY_DEFTIERS);
+  std::string spill = MyConfig.GetParamValue("vehicle", "bms.history.spill");
+  m_bms_history_v.Configure(enable ? m_bms_readings_v : 0, tiers.c_str());
+  m_bms_history_t.Configure(enable ? m_bms_readings_t : 0, tiers.c_str());
+  m_bms_history_v.SetSpill(spill.empty() ? spill : spill + "/bms-voltage.csv");
+  m_bms_history_t.SetSpill(spill.empty() ? spill : spill + "/bms-temperature.csv");
+  }
+
 void OvmsVehicle::BmsSetCellDefaultThresholdsVoltage(float warn, float alert)
   {
   m_bms_defthr_vwarn = warn;
@@ -2457,6 +2658,7 @@ void OvmsVehicle::BmsSetCellVoltage(int index, float value)
     StandardMetrics.ms_v_bat_pack_vstddev->SetValue(stddev);
     if (stddev > StandardMetrics.ms_v_bat_pack_vstddev_max->AsFloat())
       StandardMetrics.ms_v_bat_pack_vstddev_max->SetValue(stddev);
+    m_bms_history_v.Add(m_bms_voltages, monotonictime);
     StandardMetrics.ms_v_bat_cell_voltage->SetElemValues(0, m_bms_readings_v, m_bms_voltages);
     StandardMetrics.ms_v_bat_cell_vmin->SetElemValues(0, m_bms_readings_v, m_bms_vmins);
     StandardMetrics.ms_v_bat_cell_vmax->SetElemValues(0, m_bms_readings_v, m_bms_vmaxs);
@@ -2534,6 +2736,7 @@ void OvmsVehicle::BmsSetCellTemperature(int index, float value)
     StandardMetrics.ms_v_bat_pack_tstddev->SetValue(stddev);
     if (stddev > StandardMetrics.ms_v_bat_pack_tstddev_max->AsFloat())
       StandardMetrics.ms_v_bat_pack_tstddev_max->SetValue(stddev);
+    m_bms_history_t.Add(m_bms_temperatures, monotonictime);
     StandardMetrics.ms_v_bat_cell_temp->SetElemValues(0, m_bms_readings_t, m_bms_temperatures);
     StandardMetrics.ms_v_bat_cell_tmin->SetElemValues(0, m_bms_readings_t, m_bms_tmins);
     StandardMetrics.ms_v_bat_cell_tmax->SetElemValues(0, m_bms_readings_t, m_bms_tmaxs);
@@ -41,6 +41,8 @@
 #include "ovms_command.h"
 #include "metrics_standard.h"
 #include "ovms_mutex.h"
+#include "vehicle_poller.h"
+#include "vehicle_bmshistory.h"
 
 using namespace std;
 struct DashboardConfig;
@@ -58,8 +60,6 @@ struct DashboardConfig;
 #define VEHICLE_POLL_TYPE_OBDIIGROUP    0x21 // enhanced data by 8 bit PID
 #define VEHICLE_POLL_TYPE_OBDIIEXTENDED 0x22 // enhanced data by 16 bit PID
 
-#define VEHICLE_POLL_NSTATES            4
-
 
 // Standard MSG protocol commands:
 
@@ -124,6 +124,10 @@ class OvmsVehicle : public InternalRamAllocated
   private:
     void VehicleTicker1(std::string event, void* data);
     void VehicleConfigChanged(std::string event, void* data);
+    void PollerSendNext();
+    void PollerReceived(canbus* bus, uint8_t* data, uint8_t length, uint16_t mlremain);
+
+  protected:
     void PollerSend();
     void PollerReceive(CAN_frame_t* frame);
 
@@ -273,22 +277,17 @@ class OvmsVehicle : public InternalRamAllocated
     virtual const std::string GetFeature(int key);
 
   public:
-    typedef struct
-      {
-      uint32_t txmoduleid;
-      uint32_t rxmoduleid;
-      uint16_t type;
-      uint16_t pid;
-      uint16_t polltime[VEHICLE_POLL_NSTATES];
-      } poll_pid_t;
+    typedef vehicle_poll_pid_t poll_pid_t;
 
   protected:
     OvmsMutex         m_poll_mutex;           // Concurrency protection
     uint8_t           m_poll_state;           // Current poll state
     canbus*           m_poll_bus;             // Bus to poll on
     const poll_pid_t* m_poll_plist;           // Head of poll list
-    const poll_pid_t* m_poll_plcur;           // Current position in poll list
-    uint32_t          m_poll_ticker;          // Polling ticker
+    OvmsPollScheduler m_poll_sched;           // Poll list scheduler
+    uint32_t          m_poll_ticker;          // Polling ticker [s]
+    uint32_t          m_poll_busframes;       // Bus frame count at last tick (load measurement)
+    uint32_t          m_poll_hash;            // Hash of response data received
     uint32_t          m_poll_moduleid_sent;   // ModuleID last sent
     uint32_t          m_poll_moduleid_low;    // Expected response moduleid low mark
     uint32_t          m_poll_moduleid_high;   // Expected response moduleid high mark
@@ -302,6 +301,10 @@ class OvmsVehicle : public InternalRamAllocated
     void PollSetPidList(canbus* bus, const poll_pid_t* plist);
     void PollSetState(uint8_t state);
 
+  public:
+    void PollerStatus(int verbosity, OvmsWriter* writer);
+    void PollerResetStats();
+
   // BMS helpers
   protected:
     float* m_bms_voltages;                    // BMS voltages (current value)
@@ -334,6 +337,8 @@ class OvmsVehicle : public InternalRamAllocated
     float m_bms_defthr_valert;                // Default voltage deviation alert threshold [V]
     float m_bms_defthr_twarn;                 // Default temperature deviation warn threshold [°C]
     float m_bms_defthr_talert;                // Default temperature deviation alert threshold [°C]
+    OvmsBmsHistory m_bms_history_v;           // BMS voltage history (min/avg/max per time bucket)
+    OvmsBmsHistory m_bms_history_t;           // BMS temperature history (min/avg/max per time bucket)
 
   protected:
     void BmsSetCellArrangementVoltage(int readings, int readingspermodule);
@@ -348,6 +353,7 @@ class OvmsVehicle : public InternalRamAllocated
     void BmsResetCellTemperatures();
     void BmsRestartCellVoltages();
     void BmsRestartCellTemperatures();
+    void BmsConfigureHistory();
     virtual void NotifyBmsAlerts();
 
   public:
@@ -355,6 +361,8 @@ class OvmsVehicle : public InternalRamAllocated
     int BmsGetCellArangementTemperature(int* readings=NULL, int* readingspermodule=NULL);
     void BmsGetCellDefaultThresholdsVoltage(float* warn, float* alert);
     void BmsGetCellDefaultThresholdsTemperature(float* warn, float* alert);
+    OvmsBmsHistory* BmsGetHistoryVoltage() { return &m_bms_history_v; }
+    OvmsBmsHistory* BmsGetHistoryTemperature() { return &m_bms_history_t; }
     void BmsResetCellStats();
     virtual void BmsStatus(int verbosity, OvmsWriter* writer);
     virtual bool FormatBmsAlerts(int verbosity, OvmsWriter* writer, bool show_warnings);
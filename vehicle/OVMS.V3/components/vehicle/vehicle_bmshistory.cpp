@@ -0,0 +1,480 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "vehicle-bms";
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <sys/param.h>
+#include "ovms_malloc.h"
+#include "vehicle_bmshistory.h"
+
+OvmsBmsHistory::OvmsBmsHistory(const char* name, const char* unit, float scale, float offset, int decimals)
+  {
+  m_name = name;
+  m_unit = unit;
+  m_scale = scale;
+  m_offset = offset;
+  m_decimals = decimals;
+  m_cells = 0;
+  m_tiercnt = 0;
+  memset(m_tiers, 0, sizeof(m_tiers));
+  m_spilled = 0;
+  m_spillerrors = 0;
+  m_mutex.SetName("vehicle.bmshistory");
+  }
+
+OvmsBmsHistory::~OvmsBmsHistory()
+  {
+  Free();
+  }
+
+void OvmsBmsHistory::Free()
+  {
+  for (int i = 0; i < m_tiercnt; i++)
+    {
+    tier_t& t = m_tiers[i];
+    if (t.ring) free(t.ring);
+    if (t.acc_min) free(t.acc_min);
+    memset(&t, 0, sizeof(t));
+    }
+  m_tiercnt = 0;
+  m_spillbuf.clear();
+  }
+
+/**
+ * Configure: set cell count & tiers ("<interval>:<count>,…"), cells = 0 disables
+ *  Existing history is kept if nothing changed, else discarded.
+ */
+bool OvmsBmsHistory::Configure(int cells, const char* tiers)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (cells == m_cells && m_tierspec == tiers)
+    return true;
+
+  Free();
+  m_cells = cells;
+  m_tierspec = tiers;
+  if (cells <= 0)
+    return true;
+
+  size_t memory = 0;
+  const char* s = tiers;
+  while (*s)
+    {
+    char* end;
+    long interval = strtol(s, &end, 10);
+    long count = (*end == ':') ? strtol(end+1, &end, 10) : 0;
+    if (interval <= 0 || count <= 0 || (*end && *end != ',') || m_tiercnt == BMS_HISTORY_MAXTIERS)
+      {
+      ESP_LOGE(TAG, "BMS %s history: invalid tier configuration '%s'", m_name, tiers);
+      Free();
+      return false;
+      }
+    tier_t& t = m_tiers[m_tiercnt++];
+    t.interval = interval;
+    t.count = count;
+    t.ring = (bucket_t*) ExternalRamCalloc(count * cells, sizeof(bucket_t));
+    t.acc_min = (float*) ExternalRamCalloc(3 * cells, sizeof(float));
+    if (!t.ring || !t.acc_min)
+      {
+      ESP_LOGE(TAG, "BMS %s history: out of memory for tier %ld:%ld", m_name, interval, count);
+      Free();
+      return false;
+      }
+    t.acc_max = t.acc_min + cells;
+    t.acc_sum = t.acc_max + cells;
+    memory += count * cells * sizeof(bucket_t) + 3 * cells * sizeof(float);
+    s = (*end) ? end+1 : end;
+    }
+
+  ESP_LOGI(TAG, "BMS %s history: %d cells, %d tiers, %u bytes", m_name, m_cells, m_tiercnt, memory);
+  return true;
+  }
+
+void OvmsBmsHistory::SetSpill(const std::string& path)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  m_spill = path;
+  if (path.empty())
+    m_spillbuf.clear();
+  }
+
+void OvmsBmsHistory::Clear()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  for (int i = 0; i < m_tiercnt; i++)
+    {
+    tier_t& t = m_tiers[i];
+    memset(t.ring, 0, t.count * m_cells * sizeof(bucket_t));
+    t.stored = 0;
+    t.current = 0;
+    t.acc_count = 0;
+    }
+  m_spillbuf.clear();
+  }
+
+uint16_t OvmsBmsHistory::Quantise(float value)
+  {
+  float q = roundf((value - m_offset) / m_scale) + 1;
+  return (q < 1) ? 1 : (q > 65535) ? 65535 : (uint16_t) q;
+  }
+
+/**
+ * Add: add a complete set of cell readings
+ *  now: monotonic time [s]
+ */
+void OvmsBmsHistory::Add(const float* values, uint32_t now)
+  {
+  if (m_tiercnt == 0)
+    return;
+  OvmsMutexLock lock(&m_mutex);
+  for (int i = 0; i < m_tiercnt; i++)
+    {
+    tier_t& t = m_tiers[i];
+    uint32_t bucket = now / t.interval;
+    if (t.acc_count && bucket != t.current)
+      Close(i, now);
+    if (t.acc_count == 0)
+      {
+      t.current = bucket;
+      for (int c = 0; c < m_cells; c++)
+        t.acc_min[c] = t.acc_max[c] = t.acc_sum[c] = values[c];
+      }
+    else
+      {
+      for (int c = 0; c < m_cells; c++)
+        {
+        if (values[c] < t.acc_min[c]) t.acc_min[c] = values[c];
+        if (values[c] > t.acc_max[c]) t.acc_max[c] = values[c];
+        t.acc_sum[c] += values[c];
+        }
+      }
+    t.acc_count++;
+    }
+  }
+
+/**
+ * Tick: close buckets that have ended & write spilled buckets (call once per second)
+ */
+void OvmsBmsHistory::Tick(uint32_t now)
+  {
+  if (m_tiercnt == 0)
+    return;
+  std::string lines, path;
+    {
+    OvmsMutexLock lock(&m_mutex);
+    for (int i = 0; i < m_tiercnt; i++)
+      {
+      tier_t& t = m_tiers[i];
+      if (t.acc_count && now / t.interval != t.current)
+        Close(i, now);
+      }
+    if (m_spillbuf.empty())
+      return;
+    lines.swap(m_spillbuf);
+    path = m_spill;
+    }
+
+  // write outside the lock, the vehicle task may need to add readings:
+  FILE* f = fopen(path.c_str(), "a");
+  if (!f)
+    {
+    if (m_spillerrors++ == 0)
+      ESP_LOGW(TAG, "BMS %s history: cannot open spill file '%s'", m_name, path.c_str());
+    return;
+    }
+  if (ftell(f) == 0)
+    fprintf(f, "# BMS %s history [%s]: start,interval,min,avg,max per cell\n", m_name, m_unit);
+  if (fwrite(lines.data(), lines.size(), 1, f) != 1)
+    m_spillerrors++;
+  fclose(f);
+  }
+
+/**
+ * Close: store the accumulated bucket of a tier (mutex held)
+ */
+void OvmsBmsHistory::Close(int tier, uint32_t now)
+  {
+  tier_t& t = m_tiers[tier];
+  uint32_t bucket = t.current;
+
+  // clear buckets skipped without readings:
+  if (t.stored && bucket > t.stored)
+    {
+    uint32_t gap = MIN(bucket - t.stored, t.count);
+    for (uint32_t b = bucket - gap; b < bucket; b++)
+      memset(&t.ring[(b % t.count) * m_cells], 0, m_cells * sizeof(bucket_t));
+    }
+
+  bucket_t* slot = &t.ring[(bucket % t.count) * m_cells];
+  for (int c = 0; c < m_cells; c++)
+    {
+    slot[c].min = Quantise(t.acc_min[c]);
+    slot[c].avg = Quantise(t.acc_sum[c] / t.acc_count);
+    slot[c].max = Quantise(t.acc_max[c]);
+    }
+  t.stored = bucket + 1;
+  t.acc_count = 0;
+
+  // spill the last tier:
+  if (tier == m_tiercnt-1 && !m_spill.empty())
+    {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%ld,%u", (long)(time(NULL) - (now - bucket * t.interval)), t.interval);
+    m_spillbuf.append(buf);
+    for (int c = 0; c < m_cells; c++)
+      {
+      snprintf(buf, sizeof(buf), ",%.*f,%.*f,%.*f",
+        m_decimals, Value(slot[c].min), m_decimals, Value(slot[c].avg), m_decimals, Value(slot[c].max));
+      m_spillbuf.append(buf);
+      }
+    m_spillbuf.append("\n");
+    m_spilled++;
+    }
+  }
+
+/**
+ * Lookup: get cell aggregates of a bucket, including the bucket being accumulated (mutex held)
+ */
+bool OvmsBmsHistory::Lookup(int tier, uint32_t bucket, int cell, float* min, float* avg, float* max)
+  {
+  if (tier < 0 || tier >= m_tiercnt || cell < 0 || cell >= m_cells)
+    return false;
+  tier_t& t = m_tiers[tier];
+  if (t.acc_count && bucket == t.current)
+    {
+    if (min) *min = t.acc_min[cell];
+    if (avg) *avg = t.acc_sum[cell] / t.acc_count;
+    if (max) *max = t.acc_max[cell];
+    return true;
+    }
+  if (bucket >= t.stored || t.stored - bucket > t.count)
+    return false;
+  bucket_t& b = t.ring[(bucket % t.count) * m_cells + cell];
+  if (b.avg == 0)
+    return false;
+  if (min) *min = Value(b.min);
+  if (avg) *avg = Value(b.avg);
+  if (max) *max = Value(b.max);
+  return true;
+  }
+
+bool OvmsBmsHistory::Get(int tier, uint32_t bucket, int cell, float* min, float* avg, float* max)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  return Lookup(tier, bucket, cell, min, avg, max);
+  }
+
+void OvmsBmsHistory::Status(int verbosity, OvmsWriter* writer, uint32_t now)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (m_tiercnt == 0)
+    {
+    writer->printf("BMS %s history: disabled\n", m_name);
+    return;
+    }
+  size_t memory = 0;
+  for (int i = 0; i < m_tiercnt; i++)
+    memory += m_tiers[i].count * m_cells * sizeof(bucket_t) + 3 * m_cells * sizeof(float);
+  writer->printf("BMS %s history: %d cells, %u bytes\n", m_name, m_cells, memory);
+  for (int i = 0; i < m_tiercnt; i++)
+    {
+    tier_t& t = m_tiers[i];
+    writer->printf("  Tier %d: %u s buckets, %u buckets (%.1f h), %u buckets stored\n",
+      i+1, t.interval, t.count, (float)t.interval * t.count / 3600, MIN(t.stored, t.count));
+    }
+  if (!m_spill.empty())
+    writer->printf("  Spill: %s (%u buckets, %u errors)\n", m_spill.c_str(), m_spilled, m_spillerrors);
+  }
+
+/**
+ * Report: output the history of a tier
+ *  tier:     tier index
+ *  buckets:  number of buckets up to the current one (0 = all)
+ *  cell:     cell index for a time series, -1 = summary per cell
+ *  json:     output buckets as JSON (chart feed)
+ *  avgonly:  JSON: averages only
+ */
+void OvmsBmsHistory::Report(int verbosity, OvmsWriter* writer, uint32_t now, int tier, int buckets,
+                            int cell, bool json, bool avgonly)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (m_tiercnt == 0)
+    {
+    writer->printf("BMS %s history disabled, enable by: config set vehicle bms.history yes\n", m_name);
+    return;
+    }
+  if (tier < 0 || tier >= m_tiercnt)
+    {
+    writer->printf("Invalid tier, %d tiers configured\n", m_tiercnt);
+    return;
+    }
+  if (cell >= m_cells)
+    {
+    writer->printf("Invalid cell, %d cells available\n", m_cells);
+    return;
+    }
+
+  tier_t& t = m_tiers[tier];
+  if (t.acc_count == 0 && t.stored == 0)
+    {
+    writer->printf("No BMS %s history data available\n", m_name);
+    return;
+    }
+  uint32_t last = (t.acc_count) ? t.current : t.stored - 1;
+  if (buckets <= 0 || buckets > t.count)
+    buckets = t.count;
+  if (buckets > last + 1)
+    buckets = last + 1;
+  uint32_t first = last + 1 - buckets;
+  time_t tnow = time(NULL);
+  long start = (long)(tnow - (now - first * t.interval));
+
+  float min, avg, max;
+  if (json)
+    {
+    writer->printf("{\"type\":\"%s\",\"unit\":\"%s\",\"interval\":%u,\"start\":%ld,\"cells\":%d,\"buckets\":%d",
+      m_name, m_unit, t.interval, start, m_cells, buckets);
+    for (int field = (avgonly ? 1 : 0); field < (avgonly ? 2 : 3); field++)
+      {
+      writer->printf(",\"%s\":[", (field == 0) ? "min" : (field == 1) ? "avg" : "max");
+      for (uint32_t b = first; b <= last; b++)
+        {
+        std::string line = (b == first) ? "[" : ",[";
+        bool data = false;
+        char buf[16];
+        for (int c = 0; c < m_cells; c++)
+          {
+          if (Lookup(tier, b, c, &min, &avg, &max))
+            {
+            snprintf(buf, sizeof(buf), "%.*f", m_decimals, (field == 0) ? min : (field == 1) ? avg : max);
+            data = true;
+            }
+          else
+            strcpy(buf, "null");
+          if (c) line.append(",");
+          line.append(buf);
+          }
+        if (data)
+          writer->printf("%s]", line.c_str());
+        else
+          writer->printf("%snull", (b == first) ? "" : ",");
+        }
+      writer->printf("]");
+      }
+    writer->puts("}");
+    return;
+    }
+
+  // pack average per bucket (for cell deviations):
+  std::vector<float> packavg(buckets, 0);
+  std::vector<int> packcnt(buckets, 0);
+  for (uint32_t b = first; b <= last; b++)
+    {
+    for (int c = 0; c < m_cells; c++)
+      {
+      if (Lookup(tier, b, c, NULL, &avg, NULL))
+        {
+        packavg[b-first] += avg;
+        packcnt[b-first]++;
+        }
+      }
+    if (packcnt[b-first])
+      packavg[b-first] /= packcnt[b-first];
+    }
+
+  if (cell >= 0)
+    {
+    // time series of one cell:
+    writer->printf("BMS %s cell %d, tier %d: %u s buckets\n", m_name, cell+1, tier+1, t.interval);
+    writer->printf("%-16s %8s %8s %8s %8s\n", "Time", "Min", "Avg", "Max", "Dev");
+    char timestr[20];
+    for (uint32_t b = first; b <= last; b++)
+      {
+      if (!Lookup(tier, b, cell, &min, &avg, &max))
+        continue;
+      time_t btime = start + (b - first) * t.interval;
+      if (tnow > 1500000000)
+        strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", localtime(&btime));
+      else
+        snprintf(timestr, sizeof(timestr), "-%u s", now - b * t.interval);
+      writer->printf("%-16s %8.*f %8.*f %8.*f %+8.*f\n", timestr,
+        m_decimals, min, m_decimals, avg, m_decimals, max, m_decimals, avg - packavg[b-first]);
+      }
+    return;
+    }
+
+  // summary per cell:
+  int maxdevcell = -1;
+  float maxdev = 0;
+  int withdata = 0;
+  for (int n : packcnt)
+    if (n) withdata++;
+  writer->printf("BMS %s history, tier %d: %u s buckets, last %d buckets (%d with data)\n",
+    m_name, tier+1, t.interval, buckets, withdata);
+  writer->printf("%4s %8s %8s %8s %8s\n", "Cell", "Min", "Avg", "Max", "Dev");
+  for (int c = 0; c < m_cells; c++)
+    {
+    float cmin = 0, cmax = 0;
+    double sum = 0, devsum = 0;
+    int cnt = 0;
+    for (uint32_t b = first; b <= last; b++)
+      {
+      if (!Lookup(tier, b, c, &min, &avg, &max))
+        continue;
+      if (cnt == 0 || min < cmin) cmin = min;
+      if (cnt == 0 || max > cmax) cmax = max;
+      sum += avg;
+      devsum += avg - packavg[b-first];
+      cnt++;
+      }
+    if (cnt == 0)
+      {
+      writer->printf("%4d %8s %8s %8s %8s\n", c+1, "-", "-", "-", "-");
+      continue;
+      }
+    float dev = devsum / cnt;
+    if (maxdevcell < 0 || fabsf(dev) > fabsf(maxdev))
+      {
+      maxdevcell = c;
+      maxdev = dev;
+      }
+    writer->printf("%4d %8.*f %8.*f %8.*f %+8.*f\n", c+1,
+      m_decimals, cmin, m_decimals, (float)(sum / cnt), m_decimals, cmax, m_decimals, dev);
+    }
+  if (maxdevcell >= 0)
+    writer->printf("Max deviation: cell %d (%+.*f %s)\n", maxdevcell+1, m_decimals, maxdev, m_unit);
+  }
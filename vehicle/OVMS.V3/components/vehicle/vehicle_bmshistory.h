@@ -0,0 +1,128 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __VEHICLE_BMSHISTORY_H__
+#define __VEHICLE_BMSHISTORY_H__
+
+#include <stdint.h>
+#include <string>
+#include "ovms_command.h"
+#include "ovms_mutex.h"
+
+#define BMS_HISTORY_MAXTIERS            4
+#define BMS_HISTORY_DEFTIERS            "60:1440,3600:720"  // 1 min for 24 h, 1 h for 30 days
+
+/**
+ * OvmsBmsHistory: per cell history of BMS readings (voltages or temperatures)
+ *
+ * Readings are aggregated into fixed time buckets of one or more tiers, i.e.
+ * 1 minute buckets for 24 hours and 1 hour buckets for 30 days. Tiers are
+ * configured by a list of <interval>:<count> pairs (seconds : buckets).
+ *
+ * Every tier keeps a ring of buckets in SPIRAM, a bucket holds the min, avg
+ * and max of every cell as quantised 16 bit values: (value - offset) / scale + 1,
+ * 0 = no data. Memory needed: cells * count * 6 bytes per tier.
+ *
+ * Bucket numbers are the monotonic time divided by the tier interval, the
+ * bucket currently filled is included in queries (partial data).
+ *
+ * Spill: completed buckets of the last tier can be appended to a CSV file
+ * (i.e. on /sd) to keep the history beyond the RAM capacity, one line per
+ * bucket: <start time>,<interval>,<min>,<avg>,<max> [,<min>,<avg>,<max> …]
+ * The file is written by Tick(), so Add() can be called by the vehicle task.
+ */
+
+class OvmsBmsHistory
+  {
+  public:
+    OvmsBmsHistory(const char* name, const char* unit, float scale, float offset, int decimals);
+    ~OvmsBmsHistory();
+
+  public:
+    bool Configure(int cells, const char* tiers);
+    void SetSpill(const std::string& path);
+    void Clear();
+    void Add(const float* values, uint32_t now);
+    void Tick(uint32_t now);
+
+  public:
+    int GetTierCount() { return m_tiercnt; }
+    int GetCellCount() { return m_cells; }
+    bool Get(int tier, uint32_t bucket, int cell, float* min, float* avg, float* max);
+    void Status(int verbosity, OvmsWriter* writer, uint32_t now);
+    void Report(int verbosity, OvmsWriter* writer, uint32_t now, int tier=0, int buckets=0,
+                int cell=-1, bool json=false, bool avgonly=false);
+
+  public:
+    typedef struct
+      {
+      uint16_t min;
+      uint16_t avg;
+      uint16_t max;
+      } bucket_t;
+
+    typedef struct
+      {
+      uint32_t interval;                      // bucket length [s]
+      uint32_t count;                         // ring size [buckets]
+      uint32_t stored;                        // newest stored bucket number + 1, 0 = none
+      bucket_t* ring;                         // [count][cells]
+      uint32_t current;                       // bucket number accumulated
+      uint32_t acc_count;                     // readings accumulated
+      float* acc_min;                         // [cells]
+      float* acc_max;                         // [cells]
+      float* acc_sum;                         // [cells]
+      } tier_t;
+
+  protected:
+    void Free();
+    void Close(int tier, uint32_t now);
+    bool Lookup(int tier, uint32_t bucket, int cell, float* min, float* avg, float* max);
+    uint16_t Quantise(float value);
+    float Value(uint16_t q) { return (q - 1) * m_scale + m_offset; }
+
+  public:
+    const char*     m_name;                   // "voltage" / "temperature"
+    const char*     m_unit;
+    float           m_scale;
+    float           m_offset;
+    int             m_decimals;
+    std::string     m_tierspec;
+    std::string     m_spill;                  // spill file path, empty = off
+    std::string     m_spillbuf;               // CSV lines to be written by Tick()
+    int             m_cells;
+    int             m_tiercnt;
+    tier_t          m_tiers[BMS_HISTORY_MAXTIERS];
+    uint32_t        m_spilled;                // buckets spilled
+    uint32_t        m_spillerrors;
+    OvmsMutex       m_mutex;
+  };
+
+#endif //#ifndef __VEHICLE_BMSHISTORY_H__
@@ -0,0 +1,280 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "vehicle-poll";
+
+#include <string.h>
+#include <sys/param.h>
+#include "vehicle_poller.h"
+
+OvmsPollScheduler::OvmsPollScheduler()
+  {
+  m_plist = NULL;
+  m_state = 0;
+  m_rate = 1;
+  m_busload_max = 0;
+  m_adaptive = false;
+  m_busload = 0;
+  m_tick_sent = 0;
+  m_deferred = 0;
+  m_stats_start = 0;
+  m_waiting = -1;
+  m_waiting_since = 0;
+  m_waiting_rx = 0;
+  m_waiting_ticks = 0;
+  }
+
+OvmsPollScheduler::~OvmsPollScheduler()
+  {
+  }
+
+void OvmsPollScheduler::Configure(int rate, int busload, bool adaptive)
+  {
+  m_rate = MAX(rate, 1);
+  m_busload_max = MAX(busload, 0);
+  if (adaptive != m_adaptive)
+    {
+    m_adaptive = adaptive;
+    for (int i = 0; i < m_entries.size(); i++)
+      {
+      entry_t& e = m_entries[i];
+      e.due = e.due - e.interval + Nominal(i);
+      e.interval = Nominal(i);
+      e.unchanged = e.changed = 0;
+      }
+    }
+  }
+
+void OvmsPollScheduler::SetList(const vehicle_poll_pid_t* plist, uint8_t state, uint32_t now)
+  {
+  int cnt = 0;
+  m_plist = plist;
+  if (m_plist)
+    while (m_plist[cnt].txmoduleid != 0) cnt++;
+  m_entries.assign(cnt, entry_t());
+  m_waiting = -1;
+  m_tick_sent = 0;
+  SetState(state, now);
+  ResetStats(now);
+  }
+
+void OvmsPollScheduler::SetState(uint8_t state, uint32_t now)
+  {
+  // Everything is due now, the scheduler spreads the requests:
+  m_state = state;
+  for (int i = 0; i < m_entries.size(); i++)
+    {
+    entry_t& e = m_entries[i];
+    e.due = now;
+    e.interval = Nominal(i);
+    e.unchanged = e.changed = 0;
+    }
+  }
+
+void OvmsPollScheduler::Tick(uint32_t now, int64_t time_us, int busload)
+  {
+  m_busload = busload;
+  m_tick_sent = 0;
+  if (m_busload_max && m_busload > m_busload_max)
+    m_deferred++;
+
+  if (m_waiting >= 0)
+    {
+    // Give a request sent shortly before the tick some time to be answered,
+    // and multi frame responses up to three ticks as long as frames arrive:
+    if (time_us - m_waiting_since < 250000)
+      return;
+    if (m_waiting_rx == 0 || ++m_waiting_ticks >= 3)
+      {
+      ESP_LOGD(TAG, "Poll timeout for %03x %02x:%04x",
+        m_plist[m_waiting].txmoduleid, m_plist[m_waiting].type, m_plist[m_waiting].pid);
+      Timeout();
+      }
+    else
+      m_waiting_rx = 0;
+    }
+  }
+
+int OvmsPollScheduler::Next(uint32_t now)
+  {
+  if (m_waiting >= 0 || m_tick_sent >= m_rate)
+    return -1;
+  if (m_busload_max && m_busload > m_busload_max)
+    return -1;
+
+  // find the most overdue entry:
+  int next = -1;
+  for (int i = 0; i < m_entries.size(); i++)
+    {
+    entry_t& e = m_entries[i];
+    if (e.interval == 0 || (int32_t)(now - e.due) < 0)
+      continue;
+    if (next < 0 || (int32_t)(e.due - m_entries[next].due) < 0)
+      next = i;
+    }
+  return next;
+  }
+
+void OvmsPollScheduler::Sent(int index, uint32_t now, int64_t time_us)
+  {
+  entry_t& e = m_entries[index];
+  e.polls++;
+  e.due = now + e.interval;
+  m_tick_sent++;
+  m_waiting = index;
+  m_waiting_since = time_us;
+  m_waiting_rx = 0;
+  m_waiting_ticks = 0;
+  }
+
+void OvmsPollScheduler::Receiving(int64_t time_us)
+  {
+  m_waiting_rx = time_us;
+  }
+
+void OvmsPollScheduler::Reply(uint32_t hash, int64_t time_us)
+  {
+  if (m_waiting < 0)
+    return;
+  entry_t& e = m_entries[m_waiting];
+  e.replies++;
+  uint32_t latency = (time_us - m_waiting_since) / 1000;
+  e.latency_sum += latency;
+  if (latency > e.latency_max)
+    e.latency_max = latency;
+  if (e.hashed)
+    {
+    bool changed = (hash != e.hash);
+    if (changed) e.changes++;
+    Adapt(m_waiting, changed);
+    }
+  e.hash = hash;
+  e.hashed = true;
+  m_waiting = -1;
+  }
+
+void OvmsPollScheduler::Timeout()
+  {
+  if (m_waiting < 0)
+    return;
+  m_entries[m_waiting].timeouts++;
+  Adapt(m_waiting, false);
+  m_waiting = -1;
+  }
+
+void OvmsPollScheduler::Adapt(int index, bool changed)
+  {
+  entry_t& e = m_entries[index];
+  uint32_t nominal = Nominal(index);
+  uint32_t interval = e.interval;
+  if (!m_adaptive || nominal == 0)
+    return;
+
+  if (changed)
+    {
+    e.unchanged = 0;
+    if (interval > nominal)
+      interval = nominal;
+    else if (++e.changed >= 2)
+      {
+      interval = MAX(interval / 2, MAX(nominal / 4, 1));
+      e.changed = 0;
+      }
+    }
+  else
+    {
+    e.changed = 0;
+    if (interval < nominal)
+      interval = nominal;
+    else if (++e.unchanged >= 3)
+      {
+      interval = MIN(interval * 2, MIN(nominal * 4, 0xffff));
+      e.unchanged = 0;
+      }
+    }
+
+  if (interval != e.interval)
+    {
+    // reschedule relative to the last request:
+    e.due = e.due - e.interval + interval;
+    e.interval = interval;
+    }
+  }
+
+void OvmsPollScheduler::ResetStats(uint32_t now)
+  {
+  for (auto& e : m_entries)
+    {
+    e.polls = e.replies = e.changes = e.timeouts = 0;
+    e.latency_sum = e.latency_max = 0;
+    }
+  m_deferred = 0;
+  m_stats_start = now;
+  }
+
+void OvmsPollScheduler::Status(int verbosity, OvmsWriter* writer, uint32_t now)
+  {
+  uint32_t elapsed = now - m_stats_start;
+  writer->printf("Poller: state %d, %d entries, rate %d/s, adaptive %s\n",
+    m_state, m_entries.size(), m_rate, m_adaptive ? "on" : "off");
+  if (m_busload_max)
+    writer->printf("Bus load: %d%% (limit %d%%, %u s deferred)\n", m_busload, m_busload_max, m_deferred);
+  else
+    writer->printf("Bus load: %d%% (no limit)\n", m_busload);
+  writer->printf("Statistics: %u s\n", elapsed);
+  if (m_entries.empty())
+    return;
+
+  writer->puts("TxID RxID Type PID  | Nom   Cur | Polls   /min | Lat avg   max | Changes Timeouts");
+  for (int i = 0; i < m_entries.size(); i++)
+    {
+    const vehicle_poll_pid_t& p = m_plist[i];
+    entry_t& e = m_entries[i];
+    writer->printf("%03x  %03x  %02x   %04x | %4u %4u | %5u %6.1f | %7u %5u | %7u %8u\n",
+      p.txmoduleid, p.rxmoduleid, p.type, p.pid,
+      Nominal(i), e.interval,
+      e.polls, elapsed ? (float)e.polls * 60 / elapsed : 0.0f,
+      e.replies ? e.latency_sum / e.replies : 0, e.latency_max,
+      e.changes, e.timeouts);
+    }
+  }
+
+uint32_t OvmsPollScheduler::Hash(uint32_t hash, const uint8_t* data, int length)
+  {
+  // FNV-1a, start with hash = 0 (mapped to the offset basis):
+  if (hash == 0) hash = 2166136261u;
+  while (length-- > 0)
+    {
+    hash ^= *data++;
+    hash *= 16777619u;
+    }
+  return hash;
+  }
@@ -0,0 +1,127 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+#ifndef __VEHICLE_POLLER_H__
+#define __VEHICLE_POLLER_H__
+
+#include <stdint.h>
+#include <vector>
+#include "ovms_command.h"
+
+#define VEHICLE_POLL_NSTATES            4
+
+typedef struct
+  {
+  uint32_t txmoduleid;
+  uint32_t rxmoduleid;
+  uint16_t type;
+  uint16_t pid;
+  uint16_t polltime[VEHICLE_POLL_NSTATES];
+  } vehicle_poll_pid_t;
+
+/**
+ * OvmsPollScheduler: selects the next poll list entry to request
+ *
+ * The poll times of the list are nominal intervals in seconds (scheduler ticks).
+ * Every entry has its own due time, the scheduler always picks the most overdue
+ * entry (list order on ties), so requests get spread over the period instead
+ * of being sent in phase aligned bursts.
+ *
+ * Adaptive rates: the reply data of every entry is hashed. Entries repeatedly
+ * returning unchanged data or timing out are backed off up to 4 times their
+ * nominal interval, entries changing on consecutive replies are sped up down
+ * to a quarter of it. Any change resets a backed off entry to nominal.
+ *
+ * Budget: at most <rate> requests are sent per tick, and none while the bus load
+ * measured for the last tick exceeds <busload> percent (0 = no limit).
+ * Only one request is outstanding at a time.
+ */
+
+class OvmsPollScheduler
+  {
+  public:
+    OvmsPollScheduler();
+    ~OvmsPollScheduler();
+
+  public:
+    void Configure(int rate, int busload, bool adaptive);
+    void SetList(const vehicle_poll_pid_t* plist, uint8_t state, uint32_t now);
+    void SetState(uint8_t state, uint32_t now);
+    void Tick(uint32_t now, int64_t time_us, int busload);
+    int Next(uint32_t now);
+    void Sent(int index, uint32_t now, int64_t time_us);
+    void Receiving(int64_t time_us);
+    void Reply(uint32_t hash, int64_t time_us);
+    void Timeout();
+    bool IsWaiting() { return m_waiting >= 0; }
+    void ResetStats(uint32_t now);
+    void Status(int verbosity, OvmsWriter* writer, uint32_t now);
+
+  public:
+    static uint32_t Hash(uint32_t hash, const uint8_t* data, int length);
+
+  public:
+    typedef struct
+      {
+      uint32_t due;                           // next due time [tick]
+      uint16_t interval;                      // current interval [tick], 0 = off
+      uint8_t unchanged;                      // consecutive unchanged replies / timeouts
+      uint8_t changed;                        // consecutive changed replies
+      bool hashed;                            // hash valid
+      uint32_t hash;                          // last reply data hash
+      uint32_t polls;                         // statistics since reset:
+      uint32_t replies;
+      uint32_t changes;
+      uint32_t timeouts;
+      uint32_t latency_sum;                   // [ms]
+      uint32_t latency_max;                   // [ms]
+      } entry_t;
+
+  protected:
+    uint16_t Nominal(int index) { return m_plist[index].polltime[m_state]; }
+    void Adapt(int index, bool changed);
+
+  public:
+    const vehicle_poll_pid_t*   m_plist;
+    std::vector<entry_t>        m_entries;
+    uint8_t                     m_state;
+    int                         m_rate;         // max requests per tick
+    int                         m_busload_max;  // [%], 0 = no limit
+    bool                        m_adaptive;
+    int                         m_busload;      // last measured bus load [%]
+    int                         m_tick_sent;    // requests sent in current tick
+    uint32_t                    m_deferred;     // ticks skipped due to bus load
+    uint32_t                    m_stats_start;  // stats reset time [tick]
+    int                         m_waiting;      // outstanding entry, -1 = none
+    int64_t                     m_waiting_since;// [us]
+    int64_t                     m_waiting_rx;   // last response frame time [us]
+    int                         m_waiting_ticks;
+  };
+
+#endif //#ifndef __VEHICLE_POLLER_H__
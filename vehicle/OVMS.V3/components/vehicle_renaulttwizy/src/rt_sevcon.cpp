@@ -45,7 +45,7 @@ using namespace std;
  */
 
 SevconClient::SevconClient(OvmsVehicleRenaultTwizy* twizy)
-  : m_sync(twizy->m_can1), m_async(twizy->m_can1, 50)
+  : m_sync(twizy->m_can1), m_async(twizy->m_can1, 50), m_monitor(&m_async, m_nodeid)
 {
   ESP_LOGI(TAG, "sevcon subsystem init");
 
@@ -119,6 +119,7 @@ SevconClient::SevconClient(OvmsVehicleRenaultTwizy* twizy)
 
   cmd_mon->RegisterCommand("start", "Start monitoring", shell_mon_start, "[<filename>]", 0, 1);
   cmd_mon->RegisterCommand("stop", "Stop monitoring", shell_mon_stop);
+  cmd_mon->RegisterCommand("status", "Show monitoring status", shell_mon_status);
   cmd_mon->RegisterCommand("reset", "Reset monitoring", shell_mon_reset);
 
 
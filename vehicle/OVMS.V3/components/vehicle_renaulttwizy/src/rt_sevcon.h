@@ -28,6 +28,7 @@
 
 #include "freertos/timers.h"
 #include "canopen.h"
+#include "canopen_monitor.h"
 #include "rt_sevcon_mon.h"
 
 using namespace std;
@@ -213,6 +214,7 @@ class SevconClient : public InternalRamAllocated
     void InitMonitoring();
     void QueryMonitoringData();
     void ProcessMonitoringData(CANopenJob &job);
+    void ProcessMonitoringCycle();
     void SendMonitoringData();
   
   public:
@@ -243,6 +245,7 @@ class SevconClient : public InternalRamAllocated
     
     static void shell_mon_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
     static void shell_mon_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
+    static void shell_mon_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
     static void shell_mon_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv);
   
   private:
@@ -252,6 +255,7 @@ class SevconClient : public InternalRamAllocated
     CANopenAsyncClient        m_async;
     TaskHandle_t              m_asynctask = 0;
     sc_mondata                m_mon = {};
+    CANopenMonitor            m_monitor;
     bool                      m_mon_enable = false;
     volatile FILE*            m_mon_file = NULL;
     OvmsMutex                 m_mon_mutex;
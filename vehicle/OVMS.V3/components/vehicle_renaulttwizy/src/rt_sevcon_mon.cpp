@@ -116,34 +116,34 @@ void SevconClient::shell_mon_stop(int verbosity, OvmsWriter* writer, OvmsCommand
 
 /**
  * Shell command:
- *  - xrt mon reset
+ *  - xrt mon status
  */
-void SevconClient::shell_mon_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+void SevconClient::shell_mon_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
 {
-  SevconClient* me = GetInstance();
-  if (me->m_mon_enable) {
-    me->SendMonitoringData();
-  }
-  me->m_mon.reset_speedmaps();
-  writer->puts("Reset done.");
+  SevconClient* me = GetInstance(writer);
+  if (!me)
+    return;
+
+  writer->printf("Monitoring %s%s.\n",
+    me->m_mon_enable ? "running" : "stopped",
+    me->m_mon_file ? ", recording" : "");
+  me->m_monitor.StatusReport(verbosity, writer);
 }
 
 
 /**
- * Reset speed maps
+ * Shell command:
+ *  - xrt mon reset
  */
-void sc_mondata::reset_speedmaps()
+void SevconClient::shell_mon_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
 {
-  for (int i=0; i<SCMON_MAX_KPH; i++) {
-    bat_power_drv[i] = 0;
-    bat_power_rec[i] = 0;
-    mot_torque_drv[i] = 0;
-    mot_torque_rec[i] = 0;
+  SevconClient* me = GetInstance();
+  if (me->m_mon_enable) {
+    me->SendMonitoringData();
   }
-  m_bat_power_drv->ClearValue();
-  m_bat_power_rec->ClearValue();
-  m_mot_torque_drv->ClearValue();
-  m_mot_torque_rec->ClearValue();
+  me->m_monitor.ResetMaps();
+  me->m_monitor.ResetStats();
+  writer->puts("Reset done.");
 }
 
 
@@ -201,43 +201,81 @@ void SevconClient::InitMonitoring()
 
   m_mon.m_mot_torque_drv    = new OvmsMetricVector<float>("xrt.s.m.trq.drv", SM_STALE_HIGH, Nm);
   m_mon.m_mot_torque_rec    = new OvmsMetricVector<float>("xrt.s.m.trq.rec", SM_STALE_HIGH, Nm);
-}
 
+  // SDO sampling table:
+  //  - base cycle is the SEVCON status PDO 0x629 (100 ms)
+  //  - torque, current & voltage are needed for the speed maps => every cycle
+  //  - slow changing/secondary values are sampled at lower rates
 
-/**
- * QueryMonitoringData: request monitored SDOs from SEVCON
- *  - called by IncomingFrameCan1 (triggered by PDO 0x629, 100ms interval)
- *  - running in vehicle task context
- * Results are processed by ProcessMonitoringData()
- */
-void SevconClient::QueryMonitoringData()
-{
-  if (!m_mon_enable || m_cfgmode_request || CtrlCfgMode() || !CtrlLoggedIn() || StdMetrics.ms_v_env_gear->AsInt()==0)
-    return;
-  
   // 4600.0c Actual AC Motor Current [A]
-  SendRead(0x4600, 0x0c, &m_mon.mot_current_raw);
+  m_monitor.AddObject(0x4600, 0x0c, COMV_Int16, 1.0f, m_mon.mot_current, 1);
   // 4600.0d Actual AC Motor Voltage [1/16 V]
-  SendRead(0x4600, 0x0d, &m_mon.mot_voltage_raw);
+  m_monitor.AddObject(0x4600, 0x0d, COMV_Int16, 1/16.0f, m_mon.mot_voltage, 1);
   // 4600.0b Voltage modulation [100/255 %]
-  SendRead(0x4600, 0x0b, &m_mon.mot_voltmod_raw);
+  m_monitor.AddObject(0x4600, 0x0b, COMV_Int16, 100/255.0f, m_mon.mot_voltmod, 5);
 
   // 4600.01 Slip Frequency [1/256 rad/s]
-  SendRead(0x4600, 0x01, &m_mon.mot_slipfreq_raw);
+  m_monitor.AddObject(0x4600, 0x01, COMV_Int16, 1/256.0f, m_mon.mot_slipfreq, 5);
   // 4600.0f Electrical output frequency [1/16 rad/s]
-  SendRead(0x4600, 0x0f, &m_mon.mot_outputfreq_raw);
+  m_monitor.AddObject(0x4600, 0x0f, COMV_Int16, 1/16.0f, m_mon.mot_outputfreq, 5);
 
   // 4602.0b Torque demand value (U.T_d) [1/16 Nm]
-  SendRead(0x4602, 0x0b, &m_mon.mot_torque_demand_raw);
+  m_monitor.AddObject(0x4602, 0x0b, COMV_Int16, 1/16.0f, m_mon.mot_torque_demand, 2);
   // 4602.0c Torque actual value (DWork.Td) [1/16 Nm]
-  SendRead(0x4602, 0x0c, &m_mon.mot_torque_raw);
+  m_monitor.AddObject(0x4602, 0x0c, COMV_Int16, 1/16.0f, m_mon.mot_torque, 1);
   // 4602.0e Maximum power limit torque (Y.T_power_limit) [1/16 Nm]
-  SendRead(0x4602, 0x0e, &m_mon.mot_torque_limit_raw);
+  m_monitor.AddObject(0x4602, 0x0e, COMV_Int16, 1/16.0f, m_mon.mot_torque_limit, 2);
 
   // 4602.11 Battery Voltage [1/16 V]
-  SendRead(0x4602, 0x11, &m_mon.bat_voltage_raw);
+  m_monitor.AddObject(0x4602, 0x11, COMV_UInt16, 1/16.0f, m_mon.bat_voltage, 1);
   // 4602.12 Capacitor Voltage [1/16 V]
-  SendRead(0x4602, 0x12, &m_mon.cap_voltage_raw);
+  m_monitor.AddObject(0x4602, 0x12, COMV_UInt16, 1/16.0f, m_mon.cap_voltage, 5);
+
+  // Speed maps: drive/recup split by battery power direction
+
+  auto speed = []() -> float {
+    return StdMetrics.ms_v_pos_speed->AsFloat();
+  };
+  sc_mondata* mon = &m_mon;
+  auto batpwr = [mon]() -> float {
+    return mon->bat_voltage->AsFloat() * StdMetrics.ms_v_bat_current->AsFloat();
+  };
+
+  m_monitor.AddMap(m_mon.m_bat_power_drv, speed, [batpwr]() -> float {
+    float pwr = batpwr();
+    return (pwr > 0) ? ((int16_t)pwr) / 1000.0f : NAN;
+  }, SCMON_MAX_KPH);
+  m_monitor.AddMap(m_mon.m_bat_power_rec, speed, [batpwr]() -> float {
+    float pwr = batpwr();
+    return (pwr <= 0) ? (-(int16_t)pwr) / 1000.0f : NAN;
+  }, SCMON_MAX_KPH);
+  m_monitor.AddMap(m_mon.m_mot_torque_drv, speed, [batpwr, mon]() -> float {
+    float trq = mon->mot_torque->AsFloat();
+    return (batpwr() > 0 && trq > 0) ? trq : NAN;
+  }, SCMON_MAX_KPH);
+  m_monitor.AddMap(m_mon.m_mot_torque_rec, speed, [batpwr, mon]() -> float {
+    float trq = mon->mot_torque->AsFloat();
+    return (batpwr() <= 0 && trq < 0) ? -trq : NAN;
+  }, SCMON_MAX_KPH);
+
+  m_monitor.SetCycleCallback(std::bind(&SevconClient::ProcessMonitoringCycle, this));
+}
+
+
+/**
+ * QueryMonitoringData: request monitored SDOs from SEVCON
+ *  - called by IncomingFrameCan1 (triggered by PDO 0x629, 100ms interval)
+ *  - running in vehicle task context
+ * Results are processed by ProcessMonitoringData()
+ */
+void SevconClient::QueryMonitoringData()
+{
+  if (!m_mon_enable || m_cfgmode_request || CtrlCfgMode() || !CtrlLoggedIn() || StdMetrics.ms_v_env_gear->AsInt()==0)
+    return;
+  if (CheckBus() != COR_OK)
+    return;
+
+  m_monitor.Poll();
 }
 
 
@@ -245,135 +283,63 @@ void SevconClient::QueryMonitoringData()
  * ProcessMonitoringData: process async read results
  *  - called by SevconAsyncTask
  *  - running in m_asynctask context
+ * Metrics & speed maps are updated by the monitor, ProcessMonitoringCycle()
+ * is called when all reads of a sampling cycle are done.
  */
 void SevconClient::ProcessMonitoringData(CANopenJob &job)
 {
-  if (job.type != COJT_ReadSDO || job.result != COR_OK)
-    return;
+  m_monitor.ProcessResult(job);
+}
 
-  uint32_t addr = (uint32_t)job.sdo.index << 8 | job.sdo.subindex;
-  bool complete = false;
-  switch (addr) {
-    // 4600.0c Actual AC Motor Current [A]
-    case 0x46000c:
-      m_mon.mot_current->SetValue(m_mon.mot_current_raw);
-      break;
-    // 4600.0d Actual AC Motor Voltage [1/16 V]
-    case 0x46000d:
-      m_mon.mot_voltage->SetValue(m_mon.mot_voltage_raw / 16.0f);
-      m_mon.mot_power->SetValue(m_mon.mot_voltage_raw / 16.0f * m_mon.mot_current->AsFloat() / 1000.0f);
-      break;
-    // 4600.0b Voltage modulation [100/255 %]
-    case 0x46000b:
-      m_mon.mot_voltmod->SetValue(m_mon.mot_voltmod_raw * 100.0f / 255.0f);
-      break;
-
-    // 4600.01 Slip Frequency [1/256 rad/s]
-    case 0x460001:
-      m_mon.mot_slipfreq->SetValue(m_mon.mot_slipfreq_raw / 256.0f);
-      break;
-    // 4600.0f Electrical output frequency [1/16 rad/s]
-    case 0x46000f:
-      m_mon.mot_outputfreq->SetValue(m_mon.mot_outputfreq_raw / 16.0f);
-      break;
-
-    // 4602.0b Torque demand value (U.T_d) [1/16 Nm]
-    case 0x46020b:
-      m_mon.mot_torque_demand->SetValue(m_mon.mot_torque_demand_raw / 16.0f);
-      break;
-    // 4602.0c Torque actual value (DWork.Td) [1/16 Nm]
-    case 0x46020c:
-      m_mon.mot_torque->SetValue(m_mon.mot_torque_raw / 16.0f);
-      break;
-    // 4602.0e Maximum power limit torque (Y.T_power_limit) [1/16 Nm]
-    case 0x46020e:
-      m_mon.mot_torque_limit->SetValue(m_mon.mot_torque_limit_raw / 16.0f);
-      break;
-
-    // 4602.11 Battery Voltage [1/16 V]
-    case 0x460211:
-      m_mon.bat_voltage->SetValue(m_mon.bat_voltage_raw / 16.0f);
-      break;
-    // 4602.12 Capacitor Voltage [1/16 V]
-    case 0x460212:
-      m_mon.cap_voltage->SetValue(m_mon.cap_voltage_raw / 16.0f);
-      complete = true; // last in series
-      break;
-
-    default:
-      break;
-  }
 
-  if (complete) {
-    
-    // update speed maps:
-    
-    float spd = StdMetrics.ms_v_pos_speed->AsFloat();
-    float batpwr = m_mon.bat_voltage->AsFloat() * StdMetrics.ms_v_bat_current->AsFloat();
-    float mottrq = m_mon.mot_torque->AsFloat();
-    
-    int si = (int) spd;
-    if (si < SCMON_MAX_KPH) {
-      if (batpwr > 0) {
-        // drive:
-        if (m_mon.bat_power_drv[si] < (int16_t)batpwr) {
-          m_mon.bat_power_drv[si] = (int16_t)batpwr;
-          m_mon.m_bat_power_drv->SetElemValue(si, ((int16_t)batpwr) / 1000.0f);
-        }
-        if (m_mon.mot_torque_drv[si] < mottrq) {
-          m_mon.mot_torque_drv[si] = mottrq;
-          m_mon.m_mot_torque_drv->SetElemValue(si, mottrq);
-        }
-      } else {
-        // recup:
-        if (m_mon.bat_power_rec[si] < -(int16_t)batpwr) {
-          m_mon.bat_power_rec[si] = -(int16_t)batpwr;
-          m_mon.m_bat_power_rec->SetElemValue(si, (-(int16_t)batpwr) / 1000.0f);
-        }
-        if (m_mon.mot_torque_rec[si] < -mottrq) {
-          m_mon.mot_torque_rec[si] = -mottrq;
-          m_mon.m_mot_torque_rec->SetElemValue(si, -mottrq);
-        }
-      }
-    }
-    
-    // write log:
+/**
+ * ProcessMonitoringCycle: update derived metrics & write log
+ *  - called by m_monitor on sampling cycle completion
+ */
+void SevconClient::ProcessMonitoringCycle()
+{
+  float spd = StdMetrics.ms_v_pos_speed->AsFloat();
+  float batpwr = m_mon.bat_voltage->AsFloat() * StdMetrics.ms_v_bat_current->AsFloat();
+  float mottrq = m_mon.mot_torque->AsFloat();
+
+  m_mon.mot_power->SetValue(m_mon.mot_voltage->AsFloat() * m_mon.mot_current->AsFloat() / 1000.0f);
+
+  // write log:
+  if (m_mon_file) {
+    OvmsMutexLock lock(&m_mon_mutex);
     if (m_mon_file) {
-      OvmsMutexLock lock(&m_mon_mutex);
-      if (m_mon_file) {
-        fprintf((FILE*)m_mon_file,
-          // timestamp,kph,rpm,throttle,kickdown,brake,
-          "%u,%.1f,%d,%.0f,%u,%.0f,"
-          // mot_torque_limit,mot_torque_demand,mot_torque,
-          "%.1f,%.1f,%.1f,"
-          // bat_voltage,bat_current,bat_power,cap_voltage,
-          "%.1f,%.2f,%.1f,%.1f,"
-          // mot_voltage,mot_current,mot_power,mot_voltmod,mot_slipfreq,mot_outputfreq
-          "%.1f,%.0f,%.1f,%.1f,%.1f,%.1f\n",
-          
-          esp_log_timestamp(),
-          spd,
-          StdMetrics.ms_v_mot_rpm->AsInt(),
-          StdMetrics.ms_v_env_throttle->AsFloat(),
-          m_twizy->twizy_kickdown_hold,
-          StdMetrics.ms_v_env_footbrake->AsFloat(),
-          
-          m_mon.mot_torque_limit->AsFloat(),
-          m_mon.mot_torque_demand->AsFloat(),
-          mottrq,
-          
-          m_mon.bat_voltage->AsFloat(),
-          StdMetrics.ms_v_bat_current->AsFloat(),
-          batpwr,
-          m_mon.cap_voltage->AsFloat(),
-          
-          m_mon.mot_voltage->AsFloat(),
-          m_mon.mot_current->AsFloat(),
-          m_mon.mot_power->AsFloat(),
-          m_mon.mot_voltmod->AsFloat(),
-          m_mon.mot_slipfreq->AsFloat(),
-          m_mon.mot_outputfreq->AsFloat());
-      }
+      fprintf((FILE*)m_mon_file,
+        // timestamp,kph,rpm,throttle,kickdown,brake,
+        "%u,%.1f,%d,%.0f,%u,%.0f,"
+        // mot_torque_limit,mot_torque_demand,mot_torque,
+        "%.1f,%.1f,%.1f,"
+        // bat_voltage,bat_current,bat_power,cap_voltage,
+        "%.1f,%.2f,%.1f,%.1f,"
+        // mot_voltage,mot_current,mot_power,mot_voltmod,mot_slipfreq,mot_outputfreq
+        "%.1f,%.0f,%.1f,%.1f,%.1f,%.1f\n",
+        
+        esp_log_timestamp(),
+        spd,
+        StdMetrics.ms_v_mot_rpm->AsInt(),
+        StdMetrics.ms_v_env_throttle->AsFloat(),
+        m_twizy->twizy_kickdown_hold,
+        StdMetrics.ms_v_env_footbrake->AsFloat(),
+        
+        m_mon.mot_torque_limit->AsFloat(),
+        m_mon.mot_torque_demand->AsFloat(),
+        mottrq,
+        
+        m_mon.bat_voltage->AsFloat(),
+        StdMetrics.ms_v_bat_current->AsFloat(),
+        batpwr,
+        m_mon.cap_voltage->AsFloat(),
+        
+        m_mon.mot_voltage->AsFloat(),
+        m_mon.mot_current->AsFloat(),
+        m_mon.mot_power->AsFloat(),
+        m_mon.mot_voltmod->AsFloat(),
+        m_mon.mot_slipfreq->AsFloat(),
+        m_mon.mot_outputfreq->AsFloat());
     }
   }
 }
@@ -56,42 +56,22 @@ template <typename T> struct minmax {
 struct sc_mondata
 {
   //
-  // Direct SDO metrics
+  // Direct SDO metrics (sampled by SevconClient::m_monitor)
   //
   
-  // 4600.0c Actual AC Motor Current
-  int16_t               mot_current_raw;                    // [A]
-  OvmsMetricFloat*      mot_current;                        // [A]
-  // 4600.0d Actual AC Motor Voltage
-  int16_t               mot_voltage_raw;                    // [1/16 V]
-  OvmsMetricFloat*      mot_voltage;                        // [V]
-  // 4600.0b Voltage modulation
-  int16_t               mot_voltmod_raw;                    // [100/255 %]
-  OvmsMetricFloat*      mot_voltmod;                        // [%]
+  OvmsMetricFloat*      mot_current;                        // 4600.0c Actual AC Motor Current [A]
+  OvmsMetricFloat*      mot_voltage;                        // 4600.0d Actual AC Motor Voltage [V]
+  OvmsMetricFloat*      mot_voltmod;                        // 4600.0b Voltage modulation [%]
 
-  // 4600.01 Slip Frequency
-  int16_t               mot_slipfreq_raw;                   // [1/256 rad/s]
-  OvmsMetricFloat*      mot_slipfreq;                       // [rad/s]
-  // 4600.0f Electrical output frequency
-  int16_t               mot_outputfreq_raw;                 // [1/16 rad/s]
-  OvmsMetricFloat*      mot_outputfreq;                     // [rad/s]
+  OvmsMetricFloat*      mot_slipfreq;                       // 4600.01 Slip Frequency [rad/s]
+  OvmsMetricFloat*      mot_outputfreq;                     // 4600.0f Electrical output frequency [rad/s]
 
-  // 4602.0b Torque demand value (U.T_d)
-  int16_t               mot_torque_demand_raw;              // [1/16 Nm]
-  OvmsMetricFloat*      mot_torque_demand;                  // [Nm]
-  // 4602.0c Torque actual value (DWork.Td)
-  int16_t               mot_torque_raw;                     // [1/16 Nm]
-  OvmsMetricFloat*      mot_torque;                         // [Nm]
-  // 4602.0e Maximum power limit torque (Y.T_power_limit)
-  int16_t               mot_torque_limit_raw;               // [1/16 Nm]
-  OvmsMetricFloat*      mot_torque_limit;                   // [Nm]
+  OvmsMetricFloat*      mot_torque_demand;                  // 4602.0b Torque demand value (U.T_d) [Nm]
+  OvmsMetricFloat*      mot_torque;                         // 4602.0c Torque actual value (DWork.Td) [Nm]
+  OvmsMetricFloat*      mot_torque_limit;                   // 4602.0e Maximum power limit torque (Y.T_power_limit) [Nm]
 
-  // 4602.11 Battery Voltage
-  uint16_t              bat_voltage_raw;                    // [1/16 V]
-  OvmsMetricFloat*      bat_voltage;                        // [V]
-  // 4602.12 Capacitor Voltage
-  uint16_t              cap_voltage_raw;                    // [1/16 V]
-  OvmsMetricFloat*      cap_voltage;                        // [V]
+  OvmsMetricFloat*      bat_voltage;                        // 4602.11 Battery Voltage [V]
+  OvmsMetricFloat*      cap_voltage;                        // 4602.12 Capacitor Voltage [V]
 
   //
   // Derived metrics
@@ -100,20 +80,14 @@ struct sc_mondata
   OvmsMetricFloat*      mot_power;                          // current * voltage [kW]
   
   //
-  // Speed maps
+  // Speed maps (aggregated by SevconClient::m_monitor)
   //
   
-  int16_t               bat_power_drv[SCMON_MAX_KPH];       // [W]
-  int16_t               bat_power_rec[SCMON_MAX_KPH];       // [W]
   OvmsMetricVector<float>*      m_bat_power_drv;            // [kW]
   OvmsMetricVector<float>*      m_bat_power_rec;            // [kW]
 
-  float                 mot_torque_drv[SCMON_MAX_KPH];      // [Nm]
-  float                 mot_torque_rec[SCMON_MAX_KPH];      // [Nm]
   OvmsMetricVector<float>*      m_mot_torque_drv;           // [Nm]
   OvmsMetricVector<float>*      m_mot_torque_rec;           // [Nm]
-
-  void reset_speedmaps();
 };
 
 #endif // __rt_sevcon_mon_h__
@@ -109,7 +109,7 @@ void OvmsVehicleSmartED::IncomingPollReply(canbus* bus, uint16_t type, uint16_t
 
   int i;
   
-  //if (pid == 0xF111) ESP_LOGD(TAG, "IncomingPollReply: pid=%#x len=%d remain=%d", pid, length, remain);
+  //ESP_LOGD(TAG, "IncomingPollReply: pid=%#x len=%d remain=%d", pid, length, remain);
   
   if ( pid != last_pid || remain >= last_remain ) {
     // must be a new reply, so reset to the beginning
@@ -118,21 +118,13 @@ void OvmsVehicleSmartED::IncomingPollReply(canbus* bus, uint16_t type, uint16_t
     bufpos=0;
   }
   
-  if (pid == 0xF111 && remain <= 3) {
+  if (bufpos == MAX_POLL_DATA_LEN) { 
     remain=0;
     m_poll_ml_remain=0;
+  } else {
     for (i=0; i<length; i++) {
       if ( bufpos < sizeof(buf) ) buf[bufpos++] = data[i];
     }
-  } else {
-    if (bufpos == MAX_POLL_DATA_LEN) { 
-      remain=0;
-      m_poll_ml_remain=0;
-    } else {
-      for (i=0; i<length; i++) {
-        if ( bufpos < sizeof(buf) ) buf[bufpos++] = data[i];
-      }
-    }
   }
   if (remain==0) {
     uint32_t id_pid = m_poll_moduleid_low<<16 | pid;
@@ -0,0 +1,167 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "cmdpool";
+
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include "ovms.h"
+#include "command_pool.h"
+#include "ovms_module.h"
+#include "metrics_standard.h"
+
+OvmsCommandPool MyCommandPool __attribute__ ((init_priority (1880)));
+
+OvmsCommandPool::OvmsCommandPool()
+  {
+  ESP_LOGI(TAG, "Initialising COMMAND POOL (1880)");
+
+  m_wakeup = xSemaphoreCreateCounting(COMMAND_POOL_QUEUE_SIZE + CONFIG_OVMS_SYS_COMMAND_WORKERS, 0);
+  m_workers = 0;
+  m_idle = 0;
+  m_jobs = 0;
+  }
+
+OvmsCommandPool::~OvmsCommandPool()
+  {
+  }
+
+/**
+ * Submit: queue command for execution by the next free worker
+ *  - workers are started on demand up to CONFIG_OVMS_SYS_COMMAND_WORKERS
+ *  - source identifies the client for the per source worker limit
+ *  - returns false if the queue is full (shell & callback remain untouched)
+ */
+bool OvmsCommandPool::Submit(OvmsShell* shell, const std::string& command, OvmsCommandDoneCallback done /*=NULL*/,
+  const char* source /*=""*/)
+  {
+  OvmsMutexLock lock(&m_mutex);
+
+  if (m_queue.size() >= COMMAND_POOL_QUEUE_SIZE)
+    {
+    ESP_LOGW(TAG, "Submit: queue full, rejecting: %s", command.c_str());
+    return false;
+    }
+
+  Job* job = new Job;
+  job->shell = shell;
+  job->command = command;
+  job->done = done;
+  job->queued = esp_timer_get_time();
+  job->source = source;
+  m_queue.push_back(job);
+  StandardMetrics.ms_m_cmd_queue->SetValue(++m_jobs);
+
+  if ((int)m_queue.size() > m_idle && m_workers < CONFIG_OVMS_SYS_COMMAND_WORKERS)
+    {
+    char name[configMAX_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "OVMS CmdWorker%d", m_workers);
+    TaskHandle_t task;
+    if (xTaskCreatePinnedToCore(WorkerTask, name, CONFIG_OVMS_SYS_COMMAND_STACK_SIZE, (void*)this, 4, &task, CORE(1)) == pdPASS)
+      {
+      AddTaskToMap(task);
+      m_workers++;
+      }
+    else
+      ESP_LOGE(TAG, "Submit: cannot start worker task #%d", m_workers);
+    }
+
+  xSemaphoreGive(m_wakeup);
+  return true;
+  }
+
+/**
+ * NextJob: get the first queued job of a source below its worker limit
+ *  - call with m_mutex held, returns NULL if there is none
+ */
+OvmsCommandPool::Job* OvmsCommandPool::NextJob()
+  {
+  for (auto it = m_queue.begin(); it != m_queue.end(); it++)
+    {
+    Job* job = *it;
+    int& running = m_running[job->source];
+    if (running < COMMAND_POOL_SOURCE_MAX)
+      {
+      running++;
+      m_queue.erase(it);
+      return job;
+      }
+    }
+  return NULL;
+  }
+
+void OvmsCommandPool::WorkerTask(void* object)
+  {
+  ((OvmsCommandPool*)object)->Worker();
+  }
+
+void OvmsCommandPool::Worker()
+  {
+  Job* job;
+  for (;;)
+    {
+    m_mutex.Lock();
+    m_idle++;
+    while ((job = NextJob()) == NULL)
+      {
+      m_mutex.Unlock();
+      xSemaphoreTake(m_wakeup, portMAX_DELAY);
+      m_mutex.Lock();
+      }
+    m_idle--;
+    bool more = !m_queue.empty();
+    m_mutex.Unlock();
+    if (more)
+      xSemaphoreGive(m_wakeup); // pass on to the next idle worker
+
+    int64_t start = esp_timer_get_time();
+    ESP_LOGD(TAG, "Worker: %d bytes free, executing: %s",
+      heap_caps_get_free_size(MALLOC_CAP_8BIT), job->command.c_str());
+
+    job->shell->ProcessChars(job->command.data(), job->command.size());
+    job->shell->ProcessChar('\n');
+
+    StandardMetrics.ms_m_cmd_wait->SetValue((start - job->queued) / 1e6f);
+    StandardMetrics.ms_m_cmd_time->SetValue((esp_timer_get_time() - start) / 1e6f);
+
+    if (job->done)
+      job->done(job->shell);
+
+    m_mutex.Lock();
+    m_running[job->source]--;
+    StandardMetrics.ms_m_cmd_queue->SetValue(--m_jobs);
+    more = !m_queue.empty();
+    m_mutex.Unlock();
+    delete job;
+    if (more)
+      xSemaphoreGive(m_wakeup); // a job of this source may be runnable now
+    }
+  }
@@ -0,0 +1,103 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __COMMAND_POOL_H__
+#define __COMMAND_POOL_H__
+
+#include <string>
+#include <functional>
+#include <deque>
+#include <map>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "ovms_shell.h"
+#include "ovms_mutex.h"
+
+// Max jobs queued or running, only a guard against runaway clients: jobs
+// normally wait in the queue for a worker
+#define COMMAND_POOL_QUEUE_SIZE   100
+
+// Max workers running jobs of one source, the remaining worker(s) stay
+// available to other sources:
+#define COMMAND_POOL_SOURCE_MAX   (CONFIG_OVMS_SYS_COMMAND_WORKERS-1)
+
+/**
+ * OvmsCommandPool: shared command execution workers (static instance: MyCommandPool)
+ *
+ * Commands submitted are executed on the given shell by a pool of long lived
+ * worker tasks, replacing a dedicated task per command. Output is streamed by
+ * the shell as usual, the done callback is called by the worker after execution
+ * and may delete the shell.
+ *
+ * Jobs are taken in submission order, but a source (i.e. "http", "server.v3")
+ * can only occupy COMMAND_POOL_SOURCE_MAX workers, so long running commands of
+ * one client cannot starve the others. Further jobs of the source wait queued.
+ */
+
+typedef std::function<void(OvmsShell* shell)> OvmsCommandDoneCallback;
+
+class OvmsCommandPool
+  {
+  public:
+    OvmsCommandPool();
+    ~OvmsCommandPool();
+
+  public:
+    bool Submit(OvmsShell* shell, const std::string& command, OvmsCommandDoneCallback done=NULL,
+      const char* source="");
+
+  protected:
+    static void WorkerTask(void* object);
+    void Worker();
+
+  protected:
+    struct Job
+      {
+      OvmsShell*                shell;
+      std::string               command;
+      OvmsCommandDoneCallback   done;
+      int64_t                   queued;
+      std::string               source;
+      };
+
+    Job* NextJob();
+
+    OvmsMutex                   m_mutex;            // protects all of the following
+    std::deque<Job*>            m_queue;            // jobs waiting for a worker
+    std::map<std::string, int>  m_running;          // jobs running per source
+    SemaphoreHandle_t           m_wakeup;           // signals new or runnable jobs
+    int                         m_workers;          // worker tasks running
+    int                         m_idle;             // workers waiting for jobs
+    int                         m_jobs;             // jobs queued or running
+  };
+
+extern OvmsCommandPool MyCommandPool;
+
+#endif //#ifndef __COMMAND_POOL_H__
@@ -0,0 +1,398 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "metrics-snapshot";
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <stddef.h>
+#include "rom/crc.h"
+#include "ovms.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
+#include "ovms_command.h"
+#include "metrics_snapshot.h"
+
+metrics_snapshot_t __attribute__((section(".rtc.noload"))) rtc_snapshot;
+
+MetricsSnapshot MyMetricsSnapshot __attribute__ ((init_priority (1815)));
+
+// Maximum time to wait for live updates of all snapshot metrics:
+#define SNAPSHOT_TRACK_TIMEOUT  3600
+
+void metrics_snapshot_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyMetricsSnapshot.Status(writer);
+  }
+
+void metrics_snapshot_save(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyMetricsSnapshot.Save();
+  if (MyMetricsSnapshot.SaveFile())
+    writer->printf("Snapshot of %d metrics saved to RTC memory and %s\n", rtc_snapshot.count, METRICS_SNAPSHOT_FILE);
+  else
+    writer->printf("Snapshot of %d metrics saved to RTC memory, %s could not be written\n", rtc_snapshot.count, METRICS_SNAPSHOT_FILE);
+  }
+
+void metrics_snapshot_restore(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  int cnt = MyMetricsSnapshot.Restore();
+  if (cnt < 0)
+    writer->puts("No valid snapshot found");
+  else
+    writer->printf("%d metrics restored from %s\n", cnt, MyMetricsSnapshot.m_source);
+  }
+
+void metrics_snapshot_clear(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyMetricsSnapshot.Clear();
+  writer->puts("Snapshot cleared");
+  }
+
+MetricsSnapshot::MetricsSnapshot()
+  {
+  ESP_LOGI(TAG, "Initialising METRICS SNAPSHOT (1815)");
+
+  m_prefixes = "v.";
+  m_interval = 60;
+  m_restore = true;
+  m_source = "none";
+  m_restoretime = 0;
+  m_completetime = 0;
+  m_restored = 0;
+  m_tracked = 0;
+  m_pendingdeletes = 0;
+
+  OvmsCommand* cmd_metric = MyCommandApp.FindCommand("metrics");
+  if (cmd_metric)
+    {
+    OvmsCommand* cmd_snapshot = cmd_metric->RegisterCommand("snapshot","METRICS snapshot (warm start)",metrics_snapshot_status);
+    cmd_snapshot->RegisterCommand("status","Show snapshot & restore status",metrics_snapshot_status);
+    cmd_snapshot->RegisterCommand("save","Save snapshot now",metrics_snapshot_save);
+    cmd_snapshot->RegisterCommand("restore","Restore metrics from snapshot",metrics_snapshot_restore);
+    cmd_snapshot->RegisterCommand("clear","Discard saved snapshots",metrics_snapshot_clear);
+    }
+
+  MyConfig.RegisterParam("metrics", "Metrics configuration", true, true);
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&MetricsSnapshot::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"config.changed", std::bind(&MetricsSnapshot::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"system.shutdown", std::bind(&MetricsSnapshot::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&MetricsSnapshot::Ticker1, this, _1, _2));
+  }
+
+MetricsSnapshot::~MetricsSnapshot()
+  {
+  }
+
+void MetricsSnapshot::EventListener(std::string event, void* data)
+  {
+  if (event == "config.mounted" || event == "config.changed")
+    {
+    m_prefixes = MyConfig.GetParamValue("metrics", "snapshot.metrics", "v.");
+    m_interval = MyConfig.GetParamValueInt("metrics", "snapshot.interval", 60);
+    m_restore = MyConfig.GetParamValueBool("metrics", "snapshot.restore", true);
+    }
+  else if (event == "system.shutdown")
+    {
+    Save();
+    SaveFile();
+    }
+  }
+
+void MetricsSnapshot::Ticker1(std::string event, void* data)
+  {
+  if (m_interval > 0 && monotonictime > 0 && (monotonictime % m_interval) == 0)
+    Save();
+
+  // Track time to live data for all snapshot metrics:
+  OvmsMutexLock lock(&m_mutex);
+  if (m_pending.empty())
+    return;
+  if (m_pendingdeletes != MyMetrics.m_deletecount)
+    {
+    // metrics have been deleted (vehicle change), pointers may be invalid:
+    ESP_LOGI(TAG, "Metrics deleted, live data tracking stopped");
+    m_pending.clear();
+    return;
+    }
+  for (auto it = m_pending.begin(); it != m_pending.end();)
+    {
+    OvmsMetric* m = *it;
+    if (m->m_restored == 0 && m->m_lastmodified > m_restoretime)
+      it = m_pending.erase(it);
+    else
+      it++;
+    }
+  if (m_pending.empty())
+    {
+    m_completetime = monotonictime;
+    ESP_LOGI(TAG, "Live data complete for %d snapshot metrics after %u seconds (status available after %u seconds)",
+      m_tracked, m_completetime, (m_restored > 0) ? m_restoretime : m_completetime);
+    }
+  else if (monotonictime > m_restoretime + SNAPSHOT_TRACK_TIMEOUT)
+    {
+    ESP_LOGW(TAG, "%u of %d snapshot metrics still without live data, tracking stopped",
+      m_pending.size(), m_tracked);
+    m_pending.clear();
+    }
+  }
+
+bool MetricsSnapshot::Match(const char* name)
+  {
+  size_t pos = 0, end;
+  while (pos < m_prefixes.size())
+    {
+    end = m_prefixes.find(' ', pos);
+    if (end == std::string::npos)
+      end = m_prefixes.size();
+    if (end > pos && strncmp(name, m_prefixes.c_str()+pos, end-pos) == 0)
+      return true;
+    pos = end + 1;
+    }
+  return false;
+  }
+
+uint32_t MetricsSnapshot::Checksum(const metrics_snapshot_t* snap)
+  {
+  uint32_t crc = crc32_le(0, (const uint8_t*)&snap->length, offsetof(metrics_snapshot_t, data) - offsetof(metrics_snapshot_t, length));
+  crc = crc32_le(crc, (const uint8_t*)&snap->count, sizeof(snap->count));
+  return crc32_le(crc, snap->data, snap->length);
+  }
+
+bool MetricsSnapshot::Valid(const metrics_snapshot_t* snap)
+  {
+  return snap->magic == METRICS_SNAPSHOT_MAGIC
+    && snap->version == METRICS_SNAPSHOT_VERSION
+    && snap->length <= sizeof(snap->data)
+    && snap->crc == Checksum(snap);
+  }
+
+/**
+ * Save: write snapshot of all defined metrics matching the prefix list to RTC memory
+ *  - metrics only set during init (i.e. defaults) are skipped
+ *  - values longer than METRICS_SNAPSHOT_MAXVALUE (i.e. cell vectors) are skipped
+ *  - values of restored metrics still waiting for live data are kept with their age
+ */
+void MetricsSnapshot::Save()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  metrics_snapshot_t* snap = &rtc_snapshot;
+  uint8_t* p = snap->data;
+  uint8_t* end = snap->data + sizeof(snap->data);
+  int count = 0, dropped = 0;
+
+  snap->magic = 0;
+  for (OvmsMetric* m=MyMetrics.m_first; m != NULL; m=m->m_next)
+    {
+    if (!m->IsDefined() || (m->m_lastmodified == 0 && m->m_restored == 0) || !Match(m->m_name))
+      continue;
+    std::string value = m->AsString();
+    size_t nlen = strlen(m->m_name);
+    if (nlen > 255 || value.size() > METRICS_SNAPSHOT_MAXVALUE)
+      continue;
+    if (p + 1 + nlen + 1 + value.size() + 2 > end)
+      {
+      dropped++;
+      continue;
+      }
+    uint32_t age = m->Age();
+    uint16_t age16 = (age > UINT16_MAX) ? UINT16_MAX : age;
+    *p++ = nlen;
+    memcpy(p, m->m_name, nlen);
+    p += nlen;
+    *p++ = value.size();
+    memcpy(p, value.data(), value.size());
+    p += value.size();
+    memcpy(p, &age16, 2);
+    p += 2;
+    count++;
+    }
+
+  snap->version = METRICS_SNAPSHOT_VERSION;
+  snap->count = count;
+  snap->length = p - snap->data;
+  snap->savetime = time(NULL);
+  snap->uptime = monotonictime;
+  snap->crc = Checksum(snap);
+  snap->magic = METRICS_SNAPSHOT_MAGIC;
+
+  if (dropped)
+    ESP_LOGW(TAG, "Save: snapshot full, %d metrics dropped (increase CONFIG_OVMS_SYS_METRICS_SNAPSHOT_SIZE)", dropped);
+  else
+    ESP_LOGD(TAG, "Save: %d metrics, %u bytes", count, snap->length);
+  }
+
+bool MetricsSnapshot::SaveFile()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (!MyConfig.ismounted() || rtc_snapshot.magic != METRICS_SNAPSHOT_MAGIC)
+    return false;
+  FILE* f = fopen(METRICS_SNAPSHOT_FILE, "w");
+  if (!f)
+    {
+    ESP_LOGE(TAG, "SaveFile: cannot open %s", METRICS_SNAPSHOT_FILE);
+    return false;
+    }
+  size_t len = offsetof(metrics_snapshot_t, data) + rtc_snapshot.length;
+  bool ok = (fwrite(&rtc_snapshot, len, 1, f) == 1);
+  fclose(f);
+  return ok;
+  }
+
+bool MetricsSnapshot::LoadFile(metrics_snapshot_t* snap)
+  {
+  FILE* f = fopen(METRICS_SNAPSHOT_FILE, "r");
+  if (!f)
+    return false;
+  size_t hlen = offsetof(metrics_snapshot_t, data);
+  bool ok = (fread(snap, hlen, 1, f) == 1)
+    && snap->length <= sizeof(snap->data)
+    && fread(snap->data, 1, snap->length, f) == snap->length;
+  fclose(f);
+  return ok && Valid(snap);
+  }
+
+/**
+ * Restore: set metrics from the RTC snapshot (or the /store copy after power loss)
+ *  - only metrics without live data are restored
+ *  - restored metrics are marked stale, Age() includes the age at save and the downtime
+ *    (if the clock was valid at save & restore)
+ *  - all snapshot metrics are tracked to measure the time until live data is complete
+ *  Returns number of restored metrics or -1 if no valid snapshot was found.
+ */
+int MetricsSnapshot::Restore()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  metrics_snapshot_t* snap = NULL;
+  metrics_snapshot_t* file = NULL;
+
+  if (Valid(&rtc_snapshot))
+    {
+    snap = &rtc_snapshot;
+    m_source = "RTC memory";
+    }
+  else
+    {
+    file = (metrics_snapshot_t*) ExternalRamMalloc(sizeof(metrics_snapshot_t));
+    if (file && LoadFile(file))
+      {
+      snap = file;
+      m_source = METRICS_SNAPSHOT_FILE;
+      }
+    }
+  if (!snap)
+    {
+    m_source = "none";
+    if (file) free(file);
+    ESP_LOGI(TAG, "Restore: no valid snapshot found");
+    return -1;
+    }
+
+  uint32_t now = time(NULL);
+  uint32_t downtime = 0;
+  if (snap->savetime > 1500000000 && now > snap->savetime)
+    downtime = now - snap->savetime;
+
+  m_restoretime = monotonictime;
+  m_completetime = 0;
+  m_restored = 0;
+  m_tracked = 0;
+  m_pending.clear();
+  m_pendingdeletes = MyMetrics.m_deletecount;
+
+  const uint8_t* p = snap->data;
+  const uint8_t* end = snap->data + snap->length;
+  for (int i = 0; i < snap->count && p < end; i++)
+    {
+    size_t nlen = *p++;
+    if (p + nlen + 1 > end) break;
+    std::string name((const char*)p, nlen);
+    p += nlen;
+    size_t vlen = *p++;
+    if (p + vlen + 2 > end) break;
+    std::string value((const char*)p, vlen);
+    p += vlen;
+    uint16_t age16;
+    memcpy(&age16, p, 2);
+    p += 2;
+
+    OvmsMetric* m = MyMetrics.Find(name.c_str());
+    if (!m || !Match(m->m_name))
+      continue;
+    m_pending.push_back(m);
+    m_tracked++;
+    if (!m_restore || m->m_lastmodified > 0)
+      continue;
+
+    uint32_t age = age16 + downtime + 1;
+    m->RestoreValue(value, (age > UINT16_MAX) ? UINT16_MAX : age);
+    m_restored++;
+    }
+
+  if (file) free(file);
+  ESP_LOGI(TAG, "Restore: %d of %d metrics restored from %s (downtime %u seconds)",
+    m_restored, snap->count, m_source, downtime);
+  return m_restored;
+  }
+
+void MetricsSnapshot::Clear()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  memset(&rtc_snapshot, 0, offsetof(metrics_snapshot_t, data));
+  unlink(METRICS_SNAPSHOT_FILE);
+  }
+
+void MetricsSnapshot::Status(OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  writer->printf("Metrics: %s\n", m_prefixes.c_str());
+  writer->printf("Save interval: %d seconds, restore %s\n", m_interval, m_restore ? "enabled" : "disabled");
+  if (Valid(&rtc_snapshot))
+    writer->printf("RTC snapshot: %u metrics, %u of %u bytes, saved at uptime %u seconds\n",
+      rtc_snapshot.count, rtc_snapshot.length, sizeof(rtc_snapshot.data), rtc_snapshot.uptime);
+  else
+    writer->puts("RTC snapshot: none");
+
+  writer->printf("\nLast restore: %d metrics from %s at uptime %u seconds\n",
+    m_restored, m_source, m_restoretime);
+  if (m_tracked == 0)
+    return;
+  if (m_completetime)
+    writer->printf("Status complete after %u seconds, live data complete after %u seconds (%d metrics)\n",
+      (m_restored > 0) ? m_restoretime : m_completetime, m_completetime, m_tracked);
+  else
+    writer->printf("Waiting for live data: %u of %d metrics pending\n", m_pending.size(), m_tracked);
+  }
@@ -0,0 +1,101 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __METRICS_SNAPSHOT_H__
+#define __METRICS_SNAPSHOT_H__
+
+#include <string>
+#include <vector>
+#include "ovms_metrics.h"
+#include "ovms_mutex.h"
+
+#define METRICS_SNAPSHOT_MAGIC      0x4f4d5353    // "OMSS"
+#define METRICS_SNAPSHOT_VERSION    1
+#define METRICS_SNAPSHOT_FILE       "/store/metrics.snapshot"
+#define METRICS_SNAPSHOT_MAXVALUE   48
+
+/**
+ * metrics_snapshot_t: metric values persisted across reboots
+ *  - kept in RTC slow memory (survives resets & crashes), copied to /store on shutdown
+ *  - data: sequence of entries: <namelen:u8> <name> <valuelen:u8> <value> <age:u16>
+ *  - crc covers the header fields following it and the used data
+ */
+typedef struct
+  {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;                   // number of entries
+  uint32_t crc;
+  uint32_t length;                  // bytes used in data
+  uint32_t savetime;                // UTC time of save (0 = clock not set)
+  uint32_t uptime;                  // monotonictime at save
+  uint8_t data[CONFIG_OVMS_SYS_METRICS_SNAPSHOT_SIZE];
+  } metrics_snapshot_t;
+
+class MetricsSnapshot
+  {
+  public:
+    MetricsSnapshot();
+    ~MetricsSnapshot();
+
+  public:
+    void Save();
+    bool SaveFile();
+    int Restore();
+    void Clear();
+    void Status(OvmsWriter* writer);
+
+  protected:
+    bool Match(const char* name);
+    bool Valid(const metrics_snapshot_t* snap);
+    uint32_t Checksum(const metrics_snapshot_t* snap);
+    bool LoadFile(metrics_snapshot_t* snap);
+
+  public:
+    void EventListener(std::string event, void* data);
+    void Ticker1(std::string event, void* data);
+
+  public:
+    OvmsMutex m_mutex;
+    std::string m_prefixes;         // space separated list of metric name prefixes
+    int m_interval;                 // RTC save interval in seconds (0 = off)
+    bool m_restore;                 // false = measure only (don't restore values)
+    const char* m_source;           // snapshot source used for restore
+    uint32_t m_restoretime;         // monotonictime of restore
+    uint32_t m_completetime;        // monotonictime all snapshot metrics had live updates
+    int m_restored;                 // number of values restored
+    std::vector<OvmsMetric*> m_pending;  // metrics waiting for a live update
+    uint32_t m_pendingdeletes;      // MyMetrics.m_deletecount at restore (m_pending valid while equal)
+    int m_tracked;                  // number of metrics tracked for the measurement
+  };
+
+extern MetricsSnapshot MyMetricsSnapshot;
+
+#endif //#ifndef __METRICS_SNAPSHOT_H__
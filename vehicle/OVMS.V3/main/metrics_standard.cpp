@@ -41,6 +41,9 @@ MetricsStandard::MetricsStandard()
   ms_m_freeram = new OvmsMetricInt(MS_M_FREERAM, SM_STALE_MID);
   ms_m_monotonic = new OvmsMetricInt(MS_M_MONOTONIC, SM_STALE_MIN, Seconds);
   ms_m_timeutc = new OvmsMetricInt(MS_M_TIME_UTC, SM_STALE_MIN, Seconds);
+  ms_m_cmd_queue = new OvmsMetricInt(MS_M_CMD_QUEUE, SM_STALE_NONE);
+  ms_m_cmd_wait = new OvmsMetricFloat(MS_M_CMD_WAIT, SM_STALE_NONE, Seconds);
+  ms_m_cmd_time = new OvmsMetricFloat(MS_M_CMD_TIME, SM_STALE_NONE, Seconds);
 
   ms_m_net_type = new OvmsMetricString(MS_N_TYPE, SM_STALE_MAX);
   ms_m_net_sq = new OvmsMetricInt(MS_N_SQ, SM_STALE_MAX, dbm);
@@ -47,6 +47,9 @@
 #define MS_M_FREERAM                "m.freeram"
 #define MS_M_MONOTONIC              "m.monotonic"
 #define MS_M_TIME_UTC               "m.time.utc"
+#define MS_M_CMD_QUEUE              "m.cmd.queue"
+#define MS_M_CMD_WAIT               "m.cmd.wait"
+#define MS_M_CMD_TIME               "m.cmd.time"
 
 #define MS_N_TYPE                   "m.net.type"
 #define MS_N_SQ                     "m.net.sq"
@@ -217,6 +220,9 @@ class MetricsStandard
     OvmsMetricInt*    ms_m_freeram;
     OvmsMetricInt*    ms_m_monotonic;
     OvmsMetricInt*    ms_m_timeutc;
+    OvmsMetricInt*    ms_m_cmd_queue;               // Command pool jobs queued or running
+    OvmsMetricFloat*  ms_m_cmd_wait;                // Command pool queue wait time of last job [s]
+    OvmsMetricFloat*  ms_m_cmd_time;                // Command pool execution time of last job [s]
 
     OvmsMetricString* ms_m_net_type;                // none, wifi, modem
     OvmsMetricInt*    ms_m_net_sq;                  // Network signal quality [dbm]
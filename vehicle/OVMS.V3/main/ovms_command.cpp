@@ -38,13 +38,16 @@ static const char *TAG = "command";
 #include <functional>
 #include <esp_log.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
+#include <esp_timer.h>
 #include "freertos/FreeRTOS.h"
 #include "ovms_command.h"
 #include "ovms_config.h"
 #include "ovms_events.h"
 #include "ovms_peripherals.h"
 #include "ovms_utils.h"
+#include "ovms_vfs.h"
 #include "ovms_script.h"
 #include "buffered_shell.h"
 #include "log_buffers.h"
@@ -274,7 +277,7 @@ void OvmsCommand::PutUsage(OvmsWriter* writer)
     if (parent->m_validate)
       {
       size_t len = strlen(parent->m_usage_template);
-      char* dollar = index(parent->m_usage_template, '$');
+      const char* dollar = strchr(parent->m_usage_template, '$');
       if (dollar)
         {
         len = dollar - parent->m_usage_template;
@@ -719,9 +722,12 @@ OvmsCommandApp::OvmsCommandApp()
   ESP_LOGI(TAG, "Initialising COMMAND (1000)");
 
   m_logfile = NULL;
+  m_logtask_mutex.SetName("command.logtask");
   m_logfile_path = "";
   m_logfile_size = 0;
   m_logfile_maxsize = 0;
+  m_logindex_interval = 0;
+  m_logindex_next = 0;
   m_logtask = NULL;
   m_logtask_queue = NULL;
   m_logtask_dropcnt = 0;
@@ -965,6 +971,12 @@ void OvmsCommandApp::LogTask()
           time(&rawtime);
           struct tm* tmu = localtime(&rawtime);
           strftime(tb, sizeof(tb), "%Y-%m-%d %H:%M:%S %Z ", tmu);
+          // add sparse time index point:
+          if (m_logindex_interval && m_logfile_size >= m_logindex_next)
+            {
+            vfs_index_add(m_logfile_path.c_str(), m_logfile_size, tb);
+            m_logindex_next = m_logfile_size + m_logindex_interval*1024;
+            }
           m_logfile_size += fwrite(tb, 1, strlen(tb), m_logfile);
           // write log entry:
           std::string le = stripesc(*it);
@@ -1125,6 +1137,12 @@ bool OvmsCommandApp::OpenLogfile()
   else
     m_logfile_size = 0;
 
+  // new file: drop stale index
+  std::string idxpath = m_logfile_path + VFS_INDEX_SUFFIX;
+  if (m_logfile_size == 0)
+    unlink(idxpath.c_str());
+  m_logindex_next = 0;
+
   // open file, start task:
   FILE* file = fopen(m_logfile_path.c_str(), "a+");
   if (file == NULL)
@@ -1186,6 +1204,10 @@ bool OvmsCommandApp::CycleLogfile()
     {
     ESP_LOGI(TAG, "CycleLogfile: log file '%s' archived as '%s'", m_logfile_path.c_str(), archpath.c_str());
     m_logfile_cyclecnt++;
+    // move index along:
+    std::string idxpath = m_logfile_path + VFS_INDEX_SUFFIX;
+    std::string archidx = archpath + VFS_INDEX_SUFFIX;
+    rename(idxpath.c_str(), archidx.c_str());
     }
   else
     {
@@ -1336,6 +1358,7 @@ void OvmsCommandApp::ShowLogStatus(int verbosity, OvmsWriter* writer)
     "  Current size     : %.1f kB\n"
     "  Cycle size       : %u kB\n"
     "  Cycle count      : %u\n"
+    "  Index interval   : %u kB\n"
     "  Dropped messages : %u\n"
     "  Messages logged  : %u\n"
     "  Total fsync time : %.1f s\n"
@@ -1345,6 +1368,7 @@ void OvmsCommandApp::ShowLogStatus(int verbosity, OvmsWriter* writer)
     , (float) m_logfile_size / 1024.0f
     , m_logfile_maxsize
     , m_logfile_cyclecnt
+    , m_logindex_interval
     , m_logtask_dropcnt
     , m_logtask_linecnt
     , m_logtask_fsynctime / 1e6);
@@ -1394,6 +1418,7 @@ void OvmsCommandApp::ReadConfig()
 
   // configure log file:
   m_logfile_maxsize = MyConfig.GetParamValueInt("log", "file.maxsize", 1024);
+  m_logindex_interval = MyConfig.GetParamValueInt("log", "file.index", 0);
   if (MyConfig.GetParamValueBool("log", "file.enable", false) == true)
     SetLogfile(MyConfig.GetParamValue("log", "file.path"));
   }
@@ -307,6 +307,8 @@ class OvmsCommandApp : public OvmsWriter
     std::string m_logfile_path;
     size_t m_logfile_size;
     size_t m_logfile_maxsize;
+    size_t m_logindex_interval;
+    size_t m_logindex_next;
     TaskHandle_t m_logtask;
     OvmsMutex m_logtask_mutex;
     QueueHandle_t m_logtask_queue;
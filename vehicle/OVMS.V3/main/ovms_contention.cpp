@@ -0,0 +1,280 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "esp_timer.h"
+#include "ovms_contention.h"
+#include "ovms_command.h"
+
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+
+static portMUX_TYPE contention_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+OvmsContentionStats* OvmsContention::s_first = NULL;
+
+/**
+ * OvmsContentionStats
+ */
+
+OvmsContentionStats::OvmsContentionStats(const char* type, const char* name, const void* owner, uint32_t size)
+  {
+  m_prev = NULL;
+  m_next = NULL;
+  m_type = type;
+  m_name = name;
+  m_owner = owner;
+  m_size = size;
+  Reset();
+  OvmsContention::Register(this);
+  }
+
+OvmsContentionStats::~OvmsContentionStats()
+  {
+  OvmsContention::Deregister(this);
+  }
+
+void OvmsContentionStats::Reset()
+  {
+  m_count = 0;
+  m_contended = 0;
+  m_drops = 0;
+  m_highwater = 0;
+  m_maxwait = 0;
+  m_maxhold = 0;
+  m_waittime = 0;
+  m_holdtime = 0;
+  }
+
+void OvmsContentionStats::Acquired(int64_t wait)
+  {
+  m_count++;
+  if (wait < 0) return;
+  m_contended++;
+  m_waittime += wait;
+  if (wait > m_maxwait) m_maxwait = wait;
+  }
+
+void OvmsContentionStats::Released(int64_t hold)
+  {
+  m_holdtime += hold;
+  if (hold > m_maxhold) m_maxhold = hold;
+  }
+
+void OvmsContentionStats::Timeout()
+  {
+  m_drops++;
+  }
+
+void OvmsContentionStats::Sent(QueueHandle_t queue, bool ok, int64_t wait)
+  {
+  uint32_t fill = uxQueueMessagesWaiting(queue);
+  portENTER_CRITICAL(&contention_spinlock);
+  m_count++;
+  if (!ok) m_drops++;
+  if (wait >= 0)
+    {
+    m_contended++;
+    m_waittime += wait;
+    if (wait > m_maxwait) m_maxwait = wait;
+    }
+  if (fill > m_highwater) m_highwater = fill;
+  portEXIT_CRITICAL(&contention_spinlock);
+  }
+
+void OvmsContentionStats::Received(QueueHandle_t queue)
+  {
+  // Receiver side accounting for queues filled from ISRs:
+  // the fill level includes the item just received
+  uint32_t fill = uxQueueMessagesWaiting(queue) + 1;
+  m_count++;
+  if (fill > m_highwater) m_highwater = fill;
+  }
+
+/**
+ * OvmsContention: registry
+ */
+
+void OvmsContention::Register(OvmsContentionStats* stats)
+  {
+  portENTER_CRITICAL(&contention_spinlock);
+  stats->m_prev = NULL;
+  stats->m_next = s_first;
+  if (s_first) s_first->m_prev = stats;
+  s_first = stats;
+  portEXIT_CRITICAL(&contention_spinlock);
+  }
+
+void OvmsContention::Deregister(OvmsContentionStats* stats)
+  {
+  portENTER_CRITICAL(&contention_spinlock);
+  if (stats->m_prev)
+    stats->m_prev->m_next = stats->m_next;
+  else if (s_first == stats)
+    s_first = stats->m_next;
+  if (stats->m_next)
+    stats->m_next->m_prev = stats->m_prev;
+  stats->m_prev = stats->m_next = NULL;
+  portEXIT_CRITICAL(&contention_spinlock);
+  }
+
+OvmsContentionStats* OvmsContention::RegisterQueue(QueueHandle_t queue, const char* name)
+  {
+  if (!queue) return NULL;
+  return new OvmsContentionStats("queue", name, queue,
+    uxQueueMessagesWaiting(queue) + uxQueueSpacesAvailable(queue));
+  }
+
+void OvmsContention::DeregisterQueue(OvmsContentionStats* stats)
+  {
+  delete stats;
+  }
+
+void OvmsContention::Reset()
+  {
+  portENTER_CRITICAL(&contention_spinlock);
+  for (OvmsContentionStats* s = s_first; s; s = s->m_next)
+    s->Reset();
+  portEXIT_CRITICAL(&contention_spinlock);
+  }
+
+typedef struct
+  {
+  const char* type;
+  const char* name;
+  const void* owner;
+  uint32_t size, count, contended, drops, highwater, maxwait, maxhold;
+  uint64_t waittime, holdtime;
+  } contention_entry_t;
+
+void OvmsContention::Report(OvmsWriter* writer, const char* sortby, int count, const char* filter)
+  {
+  // Take a snapshot, allocating outside of the critical section:
+  std::vector<contention_entry_t> list;
+  size_t n = 0;
+  portENTER_CRITICAL(&contention_spinlock);
+  for (OvmsContentionStats* s = s_first; s; s = s->m_next) n++;
+  portEXIT_CRITICAL(&contention_spinlock);
+  list.reserve(n + 16);
+  portENTER_CRITICAL(&contention_spinlock);
+  for (OvmsContentionStats* s = s_first; s && list.size() < list.capacity(); s = s->m_next)
+    {
+    if (s->m_count == 0) continue;
+    contention_entry_t e =
+      {
+      s->m_type, s->m_name, s->m_owner,
+      s->m_size, s->m_count, s->m_contended, s->m_drops, s->m_highwater, s->m_maxwait, s->m_maxhold,
+      s->m_waittime, s->m_holdtime
+      };
+    list.push_back(e);
+    }
+  portEXIT_CRITICAL(&contention_spinlock);
+
+  if (filter && *filter)
+    {
+    list.erase(std::remove_if(list.begin(), list.end(), [filter](const contention_entry_t& e)
+      {
+      return !((e.name && strstr(e.name, filter)) || strstr(e.type, filter));
+      }), list.end());
+    }
+
+  if (!sortby) sortby = "wait";
+  std::sort(list.begin(), list.end(), [sortby](const contention_entry_t& a, const contention_entry_t& b)
+    {
+    if (strcmp(sortby, "hold") == 0)
+      return a.holdtime > b.holdtime;
+    else if (strcmp(sortby, "count") == 0)
+      return a.count > b.count;
+    else if (strcmp(sortby, "contended") == 0)
+      return a.contended > b.contended;
+    else if (strcmp(sortby, "drops") == 0)
+      return (a.drops != b.drops) ? a.drops > b.drops : a.highwater > b.highwater;
+    else
+      return a.waittime > b.waittime;
+    });
+
+  writer->printf("%-8s %-24s %9s %9s %6s %9s %19s %19s\n",
+    "Type", "Name/Owner", "Count", "Contended", "Drops", "Fill/Max", "Wait avg/max [us]", "Hold avg/max [us]");
+  int shown = 0;
+  for (auto& e : list)
+    {
+    if (count > 0 && shown >= count) break;
+    char name[32], fill[16] = "-", wait[24], hold[24] = "-";
+    if (e.name)
+      snprintf(name, sizeof(name), "%s", e.name);
+    else
+      {
+      const void* owner = e.owner;
+#ifdef __XTENSA__
+      // Mutex owners are return addresses, strip the windowed ABI call size bits:
+      if (!e.size && ((uint32_t)owner & 0x80000000))
+        owner = (const void*)(((uint32_t)owner & 0x3fffffff) | 0x40000000);
+#endif
+      snprintf(name, sizeof(name), "@%p", owner);
+      }
+    if (e.size)
+      snprintf(fill, sizeof(fill), "%u/%u", e.highwater, e.size);
+    snprintf(wait, sizeof(wait), "%u/%u",
+      e.contended ? (uint32_t)(e.waittime / e.contended) : 0, e.maxwait);
+    if (!e.size)
+      snprintf(hold, sizeof(hold), "%u/%u", (uint32_t)(e.holdtime / e.count), e.maxhold);
+    writer->printf("%-8s %-24s %9u %9u %6u %9s %19s %19s\n",
+      e.type, name, e.count, e.contended, e.drops, fill, wait, hold);
+    shown++;
+    }
+  if (list.size() > shown)
+    writer->printf("(%d more)\n", (int)(list.size() - shown));
+  else if (list.empty())
+    writer->puts("No contention data collected.");
+  }
+
+/**
+ * OvmsQueueSend: xQueueSend with statistics
+ */
+
+BaseType_t OvmsQueueSend(OvmsContentionStats* stats, QueueHandle_t queue, const void* item, TickType_t wait)
+  {
+  if (!stats)
+    return xQueueSend(queue, item, wait);
+  BaseType_t res = xQueueSend(queue, item, 0);
+  if (res == pdTRUE || wait == 0)
+    {
+    stats->Sent(queue, (res == pdTRUE), -1);
+    return res;
+    }
+  int64_t start = esp_timer_get_time();
+  res = xQueueSend(queue, item, wait);
+  stats->Sent(queue, (res == pdTRUE), esp_timer_get_time() - start);
+  return res;
+  }
+
+#endif // CONFIG_OVMS_DEV_CONTENTION_STATS
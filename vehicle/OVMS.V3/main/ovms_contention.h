@@ -0,0 +1,115 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __OVMS_CONTENTION_H__
+#define __OVMS_CONTENTION_H__
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+
+class OvmsWriter;
+
+/**
+ * OvmsContentionStats: wait & hold statistics of a mutex or queue
+ *
+ * Mutex statistics are updated by the lock holder, so need no locking
+ * (except timeouts, counted approximately). Queue statistics are updated
+ * by all senders in a critical section.
+ *
+ * Objects are identified by name, unnamed mutexes by the code address of
+ * their owner's constructor (resolve using addr2line on the firmware ELF).
+ */
+class OvmsContentionStats
+  {
+  public:
+    OvmsContentionStats(const char* type, const char* name, const void* owner, uint32_t size=0);
+    ~OvmsContentionStats();
+
+  public:
+    void Reset();
+    // Mutex:
+    void Acquired(int64_t wait);                  // wait < 0: lock was free
+    void Released(int64_t hold);
+    void Timeout();
+    // Queue:
+    void Sent(QueueHandle_t queue, bool ok, int64_t wait);
+    void Received(QueueHandle_t queue);
+
+  public:
+    OvmsContentionStats* m_prev;
+    OvmsContentionStats* m_next;
+    const char* m_type;
+    const char* m_name;
+    const void* m_owner;
+    uint32_t m_size;          // queue length
+    uint32_t m_count;         // locks / items sent
+    uint32_t m_contended;     // lock busy / sender had to wait
+    uint32_t m_drops;         // lock timeouts / items not queued
+    uint32_t m_highwater;     // queue fill level maximum
+    uint32_t m_maxwait;       // us
+    uint32_t m_maxhold;       // us
+    uint64_t m_waittime;      // us
+    uint64_t m_holdtime;      // us
+  };
+
+/**
+ * OvmsContention: registry & report (module contention)
+ */
+class OvmsContention
+  {
+  public:
+    static void Register(OvmsContentionStats* stats);
+    static void Deregister(OvmsContentionStats* stats);
+    static OvmsContentionStats* RegisterQueue(QueueHandle_t queue, const char* name);
+    static void DeregisterQueue(OvmsContentionStats* stats);
+    static void Report(OvmsWriter* writer, const char* sortby="wait", int count=20, const char* filter=NULL);
+    static void Reset();
+
+  protected:
+    static OvmsContentionStats* s_first;
+  };
+
+extern BaseType_t OvmsQueueSend(OvmsContentionStats* stats, QueueHandle_t queue, const void* item, TickType_t wait);
+
+#define OVMS_QUEUE_SEND(stats, queue, item, wait)   OvmsQueueSend(stats, queue, item, wait)
+#define OVMS_QUEUE_RECEIVED(stats, queue)           (stats)->Received(queue)
+
+#else // CONFIG_OVMS_DEV_CONTENTION_STATS
+
+#define OVMS_QUEUE_SEND(stats, queue, item, wait)   xQueueSend(queue, item, wait)
+#define OVMS_QUEUE_RECEIVED(stats, queue)
+
+#endif // CONFIG_OVMS_DEV_CONTENTION_STATS
+
+#endif //#ifndef __OVMS_CONTENTION_H__
@@ -39,6 +39,7 @@ static const char *TAG = "events";
 #include "ovms_events.h"
 #include "ovms_command.h"
 #include "ovms_script.h"
+#include "ovms_tracer.h"
 
 OvmsEvents MyEvents __attribute__ ((init_priority (1200)));
 
@@ -122,6 +123,8 @@ OvmsEvents::OvmsEvents()
   {
   ESP_LOGI(TAG, "Initialising EVENTS (1200)");
 
+  m_timers_mutex.SetName("events.timers");
+
 #ifdef CONFIG_OVMS_DEV_DEBUGEVENTS
   m_trace = true;
 #else
@@ -139,6 +142,9 @@ OvmsEvents::OvmsEvents()
   cmd_eventtrace->RegisterCommand("off","Turn event tracing OFF",event_trace);
 
   m_taskqueue = xQueueCreate(CONFIG_OVMS_HW_EVENT_QUEUE_SIZE,sizeof(event_queue_t));
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_taskqueue_stats = OvmsContention::RegisterQueue(m_taskqueue, "events.task");
+#endif
   xTaskCreatePinnedToCore(EventLaunchTask, "OVMS Events", 8192, (void*)this, 5, &m_taskid, CORE(1));
   AddTaskToMap(m_taskid);
   }
@@ -176,6 +182,11 @@ void OvmsEvents::HandleQueueSignalEvent(event_queue_t* msg)
   {
   std::string event(msg->body.signal.event);
 
+#ifdef CONFIG_OVMS_DEV_TRACER
+  uint16_t trace_id = MyTracer.m_running ? MyTracer.Intern(msg->body.signal.event) : 0;
+  if (trace_id) MyTracer.Record(TRACE_Begin, trace_id);
+#endif // CONFIG_OVMS_DEV_TRACER
+
   // Log everything but the excessively verbose ticker signals
   if (event.compare(0,7,"ticker.") != 0)
     {
@@ -216,6 +227,10 @@ void OvmsEvents::HandleQueueSignalEvent(event_queue_t* msg)
   MyScripts.EventScript(event, msg->body.signal.data);
 
   FreeQueueSignalEvent(msg);
+
+#ifdef CONFIG_OVMS_DEV_TRACER
+  if (trace_id) MyTracer.Record(TRACE_End, trace_id);
+#endif // CONFIG_OVMS_DEV_TRACER
   }
 
 void OvmsEvents::FreeQueueSignalEvent(event_queue_t* msg)
@@ -280,7 +295,7 @@ void OvmsEvents::DeregisterEvent(std::string caller)
 static void SignalScheduledEvent(TimerHandle_t timer)
   {
   event_queue_t* msg = (event_queue_t*) pvTimerGetTimerID(timer);
-  if (xQueueSend(MyEvents.m_taskqueue, msg, 0) != pdTRUE)
+  if (OVMS_QUEUE_SEND(MyEvents.m_taskqueue_stats, MyEvents.m_taskqueue, msg, 0) != pdTRUE)
     {
     ESP_LOGE(TAG, "SignalScheduledEvent: queue overflow, event '%s' dropped", msg->body.signal.event);
     MyEvents.FreeQueueSignalEvent(msg);
@@ -347,7 +362,7 @@ void OvmsEvents::SignalEvent(std::string event, void* data, event_signal_done_fn
 
   if (delay_ms == 0)
     {
-    if (xQueueSend(m_taskqueue, &msg, 0) != pdTRUE)
+    if (OVMS_QUEUE_SEND(m_taskqueue_stats, m_taskqueue, &msg, 0) != pdTRUE)
       {
       ESP_LOGE(TAG, "SignalEvent: queue overflow, event '%s' dropped", msg.body.signal.event);
       FreeQueueSignalEvent(&msg);
@@ -386,7 +401,7 @@ void OvmsEvents::SignalEvent(std::string event, void* data, size_t length,
 
   if (delay_ms == 0)
     {
-    if (xQueueSend(m_taskqueue, &msg, 0) != pdTRUE)
+    if (OVMS_QUEUE_SEND(m_taskqueue_stats, m_taskqueue, &msg, 0) != pdTRUE)
       {
       ESP_LOGE(TAG, "SignalEvent: queue overflow, event '%s' dropped", msg.body.signal.event);
       FreeQueueSignalEvent(&msg);
@@ -117,6 +117,9 @@ class OvmsEvents
     bool m_trace;
     TaskHandle_t m_taskid;
     QueueHandle_t m_taskqueue;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats* m_taskqueue_stats;
+#endif
   };
 
 extern OvmsEvents MyEvents;
@@ -45,6 +45,7 @@ static const char *TAG = "housekeeping";
 #include "ovms_config.h"
 #include "ovms_metrics.h"
 #include "metrics_standard.h"
+#include "metrics_snapshot.h"
 #include "ovms_config.h"
 #include "console_async.h"
 #include "ovms_module.h"
@@ -195,6 +196,9 @@ void Housekeeping::Init(std::string event, void* data)
     ESP_LOGI(TAG, "Auto init vehicle (free: %zu bytes)", heap_caps_get_free_size(MALLOC_CAP_8BIT|MALLOC_CAP_INTERNAL));
     MyVehicleFactory.AutoInit();
 
+    ESP_LOGI(TAG, "Restore metrics snapshot (free: %zu bytes)", heap_caps_get_free_size(MALLOC_CAP_8BIT|MALLOC_CAP_INTERNAL));
+    MyMetricsSnapshot.Restore();
+
 #ifdef CONFIG_OVMS_COMP_OBD2ECU
     ESP_LOGI(TAG, "Auto init obd2ecu (free: %zu bytes)", heap_caps_get_free_size(MALLOC_CAP_8BIT|MALLOC_CAP_INTERNAL));
     obd2ecuInit.AutoInit();
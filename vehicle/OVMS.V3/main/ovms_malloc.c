@@ -28,6 +28,7 @@
 ; THE SOFTWARE.
 */
 
+#include <stdlib.h>
 #include <strings.h>
 #include "ovms_malloc.h"
 #include "esp_heap_caps.h"
@@ -37,11 +37,14 @@ static const char *TAG = "metrics";
 #include "ovms.h"
 #include "ovms_metrics.h"
 #include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
 #include "ovms_script.h"
 #include "string.h"
 
 using namespace std;
 
+OvmsMetricArena   MyMetricArena   __attribute__ ((init_priority (1790)));
 OvmsMetrics       MyMetrics       __attribute__ ((init_priority (1800)));
 
 void metrics_list(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
@@ -92,6 +95,50 @@ void metrics_set(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc,
     writer->puts("Metric could not be set");
   }
 
+void metrics_listeners(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyMetrics.ListListeners(writer);
+  }
+
+void metrics_memory(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  struct usage_t { int count; size_t bytes; };
+  std::map<std::string, usage_t> types;
+  usage_t total = { 0, 0 };
+
+  for (OvmsMetric* m=MyMetrics.m_first; m != NULL; m=m->m_next)
+    {
+    // metric objects are heap allocated:
+    size_t bytes = m->GetMemoryUsage() + METRICS_HEAP_OVERHEAD;
+    usage_t& type = types[m->GetTypeName()];
+    type.count++;
+    type.bytes += bytes;
+    total.count++;
+    total.bytes += bytes;
+    for (int i=0;i<argc;i++)
+      {
+      if (strstr(m->m_name,argv[i]))
+        {
+        writer->printf("%-40.40s %-8s %6u\n", m->m_name, m->GetTypeName(), (unsigned)bytes);
+        break;
+        }
+      }
+    }
+
+  if (argc > 0)
+    writer->puts("");
+  writer->printf("%-10s %6s %8s %6s\n", "Type", "Count", "Bytes", "Avg");
+  for (auto it=types.begin(); it!=types.end(); ++it)
+    {
+    writer->printf("%-10s %6d %8u %6u\n", it->first.c_str(), it->second.count,
+      (unsigned)it->second.bytes, (unsigned)(it->second.bytes / it->second.count));
+    }
+  writer->printf("%-10s %6d %8u %6u\n", "Total", total.count,
+    (unsigned)total.bytes, total.count ? (unsigned)(total.bytes / total.count) : 0);
+
+  MyMetricArena.GetStatus(writer);
+  }
+
 void metrics_trace(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   if (strcmp(cmd->GetName(),"on")==0)
@@ -145,28 +192,81 @@ static duk_ret_t DukOvmsMetricFloat(duk_context *ctx)
 
 #endif //#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
 
-MetricCallbackEntry::MetricCallbackEntry(const char* caller, MetricCallback callback)
+MetricCallbackEntry::MetricCallbackEntry(const char* caller, MetricCallback callback, bool deferred, bool stale)
   {
   m_caller = caller;
   m_callback = callback;
+  m_deferred = deferred;
+  m_stale = stale;
+  m_refs = 0;
   }
 
 MetricCallbackEntry::~MetricCallbackEntry()
   {
   }
 
+// Listener entries deregistered by a listener call of their own are deleted
+//  when that call returns:
+#define LISTENER_REMOVED  0x80000000u
+
+void MetricCallbackEntry::Release()
+  {
+  if (m_refs.fetch_sub(1) == (LISTENER_REMOVED | 1))
+    delete this;
+  }
+
+// Listener calls in progress on the current task, so DeregisterListener()
+//  doesn't wait for a call it has been invoked from:
+struct MetricCallbackFrame
+  {
+  MetricCallbackEntry* entry;
+  MetricCallbackFrame* prev;
+  };
+static __thread MetricCallbackFrame* metric_callback_frames = NULL;
+
+static uint32_t MetricCallbackFrames(MetricCallbackEntry* entry)
+  {
+  uint32_t cnt = 0;
+  for (MetricCallbackFrame* f = metric_callback_frames; f; f = f->prev)
+    {
+    if (f->entry == entry)
+      cnt++;
+    }
+  return cnt;
+  }
+
 OvmsMetrics::OvmsMetrics()
   {
   ESP_LOGI(TAG, "Initialising METRICS (1810)");
 
-  m_nextmodifier = 1;
+  m_listenermutex.SetName("metrics.listener");
+  m_notifymutex.SetName("metrics.notify");
+  m_stalemutex.SetName("metrics.stale");
+
+  m_nextmodifier = METRICS_FIRST_MODIFIER;
   m_first = NULL;
   m_trace = false;
+  m_deletecount = 0;
+  m_wildcards = 0;
+  m_notifycurrent = NULL;
+  m_notifytask = NULL;
+  m_notifycount = 0;
+  m_notifycoalesced = 0;
+  m_staletime = monotonictime;
+  m_stalecurrent = NULL;
+  m_staletask = NULL;
+  m_staleticking = false;
+  m_stalescheduled = 0;
+  m_staleexpired = 0;
+  m_staleevents = false;
 
   // Register our commands
   OvmsCommand* cmd_metric = MyCommandApp.RegisterCommand("metrics","METRICS framework");
   cmd_metric->RegisterCommand("list","Show all metrics",metrics_list, "[<metric>] [-s]", 0, 2);
   cmd_metric->RegisterCommand("set","Set the value of a metric",metrics_set, "<metric> <value>", 2, 2);
+  cmd_metric->RegisterCommand("listeners","Show metric listeners",metrics_listeners);
+  cmd_metric->RegisterCommand("memory","Show metrics memory usage",metrics_memory,
+    "[<metric1>] ... [<metricN>]\nShows usage by type, and of metrics matching the given names", 0, 9);
   OvmsCommand* cmd_metrictrace = cmd_metric->RegisterCommand("trace","METRIC trace framework");
   cmd_metrictrace->RegisterCommand("on","Turn metric tracing ON",metrics_trace);
   cmd_metrictrace->RegisterCommand("off","Turn metric tracing OFF",metrics_trace);
@@ -179,6 +279,15 @@ OvmsMetrics::OvmsMetrics()
   dto->RegisterDuktapeFunction(DukOvmsMetricFloat, 1, "AsFloat");
   MyScripts.RegisterDuktapeObject(dto);
 #endif //#ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
+
+  MyConfig.RegisterParam("metrics", "Metrics configuration", true, true);
+
+  #undef bind  // Kludgy, but works
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG,"config.mounted", std::bind(&OvmsMetrics::ConfigListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"config.changed", std::bind(&OvmsMetrics::ConfigListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG,"ticker.1", std::bind(&OvmsMetrics::TickerListener, this, _1, _2));
   }
 
 OvmsMetrics::~OvmsMetrics()
@@ -193,6 +302,15 @@ OvmsMetrics::~OvmsMetrics()
 
 void OvmsMetrics::RegisterMetric(OvmsMetric* metric)
   {
+  // Flag listeners registered by name before the metric was created:
+  m_listenermutex.Lock();
+  m_listeners.Read([metric](const MetricListenerTable& table)
+    {
+    if (table.named.find(metric->m_name) != table.named.end())
+      metric->m_modified.fetch_or(METRICS_LISTENED);
+    });
+  m_listenermutex.Unlock();
+
   // Quick simple check for if we are the first metric.
   if (m_first == NULL)
     {
@@ -225,13 +343,12 @@ void OvmsMetrics::RegisterMetric(OvmsMetric* metric)
     }
   }
 
-void OvmsMetrics::DeregisterMetric(OvmsMetric* metric)
+bool OvmsMetrics::UnlinkMetric(OvmsMetric* metric)
   {
   if (m_first == metric)
     {
     m_first = metric->m_next;
-    delete metric;
-    return;
+    return true;
     }
 
   for (OvmsMetric* m=m_first;m!=NULL;m=m->m_next)
@@ -239,10 +356,16 @@ void OvmsMetrics::DeregisterMetric(OvmsMetric* metric)
     if (m->m_next == metric)
       {
       m->m_next = metric->m_next;
-      delete metric;
-      return;
+      return true;
       }
     }
+  return false;
+  }
+
+void OvmsMetrics::DeregisterMetric(OvmsMetric* metric)
+  {
+  metric->Unregister();
+  delete metric;
   }
 
 bool OvmsMetrics::Set(const char* metric, const char* value)
@@ -329,53 +452,121 @@ OvmsMetricFloat* OvmsMetrics::InitFloat(const char* metric, uint16_t autostale,
   return m;
   }
 
-void OvmsMetrics::RegisterListener(const char* caller, const char* name, MetricCallback callback)
+void OvmsMetrics::RegisterListener(const char* caller, const char* name, MetricCallback callback, bool deferred, bool stale)
   {
-  auto k = m_listeners.find(name);
-  if (k == m_listeners.end())
+  OvmsRecMutexLock lock(&m_listenermutex);
+
+  if (deferred && !m_notifytask)
     {
-    m_listeners[name] = new MetricCallbackList();
-    k = m_listeners.find(name);
+    if (xTaskCreatePinnedToCore(NotifierTask, "OVMS MetricNotify", 6*1024, (void*)this, 5, &m_notifytask, CORE(1)) != pdPASS)
+      {
+      ESP_LOGE(TAG, "Cannot start notifier task, metric %s for caller %s will be notified synchronously",name,caller);
+      m_notifytask = NULL;
+      deferred = false;
+      }
     }
-  if (k == m_listeners.end())
+
+  MetricCallbackEntry* entry = new MetricCallbackEntry(caller,callback,deferred,stale);
+  bool wildcard = (strcmp(name, "*") == 0);
+  m_listeners.Modify([this,name,entry,wildcard](const MetricListenerTable& cur, MetricListenerTable& next)
     {
-    ESP_LOGE(TAG, "Problem registering metric %s for caller %s",name,caller);
-    return;
+    next = cur;
+    if (wildcard)
+      {
+      AddListener(next.wildcard, entry);
+      m_wildcards = next.wildcard.size();
+      }
+    else
+      {
+      AddListener(next.named[name], entry);
+      }
+    return true;
+    });
+
+  // Flag the metric, so SetValue() only looks up metrics having listeners:
+  if (!wildcard)
+    {
+    OvmsMetric* m = Find(name);
+    if (m) m->m_modified.fetch_or(METRICS_LISTENED);
     }
+  }
 
-  MetricCallbackList *ml = k->second;
-  ml->push_back(new MetricCallbackEntry(caller,callback));
+void OvmsMetrics::AddListener(MetricCallbackList& ml, MetricCallbackEntry* entry)
+  {
+  // Keep synchronous listeners (in registration order) before deferred ones,
+  //  so NotifyModified() can stop at the first deferred entry:
+  MetricCallbackList::iterator itc=ml.begin();
+  if (!entry->m_deferred)
+    {
+    while (itc!=ml.end() && !(*itc)->m_deferred)
+      ++itc;
+    }
+  else
+    {
+    itc = ml.end();
+    }
+  ml.insert(itc, entry);
   }
 
 void OvmsMetrics::DeregisterListener(const char* caller)
   {
-  MetricCallbackMap::iterator itm=m_listeners.begin();
-  while (itm!=m_listeners.end())
+  std::vector<MetricCallbackEntry*> removed;
+  m_listenermutex.Lock();
+  m_listeners.Modify([this,caller,&removed](const MetricListenerTable& cur, MetricListenerTable& next)
     {
-    MetricCallbackList* ml = itm->second;
-    MetricCallbackList::iterator itc=ml->begin();
-    while (itc!=ml->end())
+    next = cur;
+    auto remove = [caller,&removed](MetricCallbackList& ml)
+      {
+      MetricCallbackList::iterator itc=ml.begin();
+      while (itc!=ml.end())
+        {
+        if ((*itc)->m_caller == caller)
+          {
+          removed.push_back(*itc);
+          itc = ml.erase(itc);
+          }
+        else
+          {
+          ++itc;
+          }
+        }
+      };
+    remove(next.wildcard);
+    m_wildcards = next.wildcard.size();
+    MetricCallbackMap::iterator itm=next.named.begin();
+    while (itm!=next.named.end())
       {
-      MetricCallbackEntry* ec = *itc;
-      if (ec->m_caller == caller)
+      remove(itm->second);
+      if (itm->second.empty())
         {
-        itc = ml->erase(itc);
-        delete ec;
+        OvmsMetric* m = Find(itm->first);
+        if (m) m->m_modified.fetch_and(~METRICS_LISTENED);
+        itm = next.named.erase(itm);
         }
       else
         {
-        ++itc;
+        ++itm;
         }
       }
-    if (ml->empty())
-      {
-      itm = m_listeners.erase(itm);
-      delete ml;
-      }
+    return !removed.empty();
+    });
+  m_listenermutex.Unlock();
+  if (removed.empty())
+    return;
+
+  // No new calls can start after all readers of the former registrations
+  //  have left. Wait for calls in progress, as the caller may be destroyed
+  //  next, except for calls of this task (deregistering from a listener):
+  m_listeners.Synchronize();
+  for (MetricCallbackEntry* ec : removed)
+    {
+    uint32_t own = MetricCallbackFrames(ec);
+    while (ec->m_refs != own)
+      vTaskDelay(1);
+    if (own == 0)
+      delete ec;
     else
-      {
-      ++itm;
-      }
+      ec->m_refs.fetch_add(LISTENER_REMOVED);
     }
   }
 
@@ -392,23 +583,355 @@ void OvmsMetrics::NotifyModified(OvmsMetric* metric)
       metric->m_name, metric->AsUnitString().c_str());
     }
 
-  auto k = m_listeners.find("*");
-  for (int x=0;x<2;x++)
+  // Call synchronous listeners, queue the metric if there are deferred ones:
+  if (CallListeners(metric, false))
+    NotifyDeferred(metric);
+  }
+
+/**
+ * CallListeners: call the synchronous or deferred listeners of a metric, or
+ *  the stale listeners (stale=true)
+ *  The entries are collected from the current registrations and referenced,
+ *  then called outside the read section. Returns true if there are deferred
+ *  listeners (when calling the synchronous ones).
+ */
+bool OvmsMetrics::CallListeners(OvmsMetric* metric, bool deferred, bool stale)
+  {
+  if (m_wildcards == 0 && !(metric->m_modified & METRICS_LISTENED))
+    return false;
+
+  MetricCallbackEntry* snap[METRICS_LISTENER_SNAP];
+  std::vector<MetricCallbackEntry*> more;
+  int cnt = 0;
+  bool others = false;
+
+  m_listeners.Read([&](const MetricListenerTable& table)
     {
-    if (k != m_listeners.end())
+    const MetricCallbackList* ml = &table.wildcard;
+    for (int x=0;x<2;x++)
       {
-      MetricCallbackList* ml = k->second;
       if (ml)
         {
-        for (MetricCallbackList::iterator itc=ml->begin(); itc!=ml->end(); ++itc)
+        for (MetricCallbackEntry* ec : *ml)
+          {
+          if (stale)
+            {
+            if (!ec->m_stale)
+              continue;
+            }
+          else if (ec->m_deferred != deferred)
+            {
+            // synchronous entries come first:
+            if (ec->m_deferred)
+              {
+              others = true;
+              break;
+              }
+            continue;
+            }
+          ec->m_refs++;
+          if (cnt < METRICS_LISTENER_SNAP)
+            snap[cnt] = ec;
+          else
+            more.push_back(ec);
+          cnt++;
+          }
+        }
+      ml = NULL;
+      if (metric->m_modified & METRICS_LISTENED)
+        {
+        auto k = table.named.find(metric->m_name);
+        if (k != table.named.end())
+          ml = &k->second;
+        }
+      }
+    });
+
+  for (int i=0; i<cnt; i++)
+    {
+    MetricCallbackEntry* ec = (i < METRICS_LISTENER_SNAP) ? snap[i] : more[i-METRICS_LISTENER_SNAP];
+    MetricCallbackFrame frame = { ec, metric_callback_frames };
+    metric_callback_frames = &frame;
+    ec->m_callback(metric);
+    metric_callback_frames = frame.prev;
+    ec->Release();
+    }
+  return others;
+  }
+
+void OvmsMetrics::NotifyDeferred(OvmsMetric* metric)
+  {
+  // Coalesce: a metric already queued will be notified with its then current value
+  if (metric->m_modified & METRICS_NOTIFY_QUEUED)
+    {
+    m_notifycoalesced++;
+    return;
+    }
+
+  OvmsMutexLock lock(&m_notifymutex);
+  if (metric->m_modified.fetch_or(METRICS_NOTIFY_QUEUED) & METRICS_NOTIFY_QUEUED)
+    {
+    m_notifycoalesced++;
+    return;
+    }
+  m_notifyqueue.push_back(metric);
+  m_notifycount++;
+  xTaskNotifyGive(m_notifytask);
+  }
+
+void OvmsMetrics::CancelDeferred(OvmsMetric* metric)
+  {
+  if (!(metric->m_modified & METRICS_NOTIFY_QUEUED) && m_notifycurrent != metric)
+    return;
+
+  m_notifymutex.Lock();
+  if (metric->m_modified.fetch_and(~METRICS_NOTIFY_QUEUED) & METRICS_NOTIFY_QUEUED)
+    {
+    auto it = std::find(m_notifyqueue.begin(), m_notifyqueue.end(), metric);
+    if (it != m_notifyqueue.end())
+      m_notifyqueue.erase(it);
+    }
+
+  // Wait for a running dispatch of the metric to finish (unless called
+  //  by a deferred listener, i.e. deleting the metric it is notified about):
+  while (m_notifycurrent == metric && xTaskGetCurrentTaskHandle() != m_notifytask)
+    {
+    m_notifymutex.Unlock();
+    vTaskDelay(1);
+    m_notifymutex.Lock();
+    }
+  m_notifymutex.Unlock();
+  }
+
+void OvmsMetrics::NotifierTask(void *pvParameters)
+  {
+  OvmsMetrics* me = (OvmsMetrics*)pvParameters;
+  me->Notifier();
+  }
+
+void OvmsMetrics::Notifier()
+  {
+  while (true)
+    {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (true)
+      {
+      // Dequeue the next metric, further changes will queue it again.
+      //  It's set as current before clearing the queued flag, as
+      //  CancelDeferred() checks the flag first without locking, then waits
+      //  for the current dispatch, so the metric cannot be deleted while the
+      //  listeners run:
+      m_notifymutex.Lock();
+      OvmsMetric* metric = NULL;
+      if (!m_notifyqueue.empty())
+        {
+        metric = m_notifyqueue.front();
+        m_notifyqueue.pop_front();
+        }
+      m_notifycurrent = metric;
+      if (metric)
+        metric->m_modified.fetch_and(~METRICS_NOTIFY_QUEUED);
+      m_notifymutex.Unlock();
+      if (!metric) break;
+
+      CallListeners(metric, true);
+
+      m_notifymutex.Lock();
+      m_notifycurrent = NULL;
+      m_notifymutex.Unlock();
+      }
+    }
+  }
+
+void OvmsMetrics::ListListeners(OvmsWriter* writer)
+  {
+  OvmsRecMutexLock lock(&m_listenermutex);
+  m_listeners.Read([writer](const MetricListenerTable& table)
+    {
+    for (MetricCallbackEntry* ec : table.wildcard)
+      writer->printf("%-40.40s %s%s\n", "*", ec->m_caller, ec->m_deferred ? " (deferred)" : "");
+    for (auto& k : table.named)
+      {
+      for (MetricCallbackEntry* ec : k.second)
+        writer->printf("%-40.40s %s%s\n", k.first, ec->m_caller, ec->m_deferred ? " (deferred)" : "");
+      }
+    });
+  writer->printf("Deferred notifications: %u queued, %u coalesced\n", m_notifycount, m_notifycoalesced);
+  writer->printf("Stale expiry: %u scheduled, %u expired%s\n", m_stalescheduled, m_staleexpired,
+    m_staleevents ? " (events on)" : "");
+  }
+
+void OvmsMetrics::ConfigListener(std::string event, void* data)
+  {
+  m_staleevents = MyConfig.GetParamValueBool("metrics", "stale.events", false);
+  }
+
+void OvmsMetrics::TickerListener(std::string event, void* data)
+  {
+  StaleTicker();
+  }
+
+/**
+ * Stale expiry timer wheel
+ *
+ * Level 0 has one slot per second, level n slots span 64^n seconds. A metric
+ * is added to the slot of its expiry deadline (last modification +
+ * autostale) on the level covering the distance. Higher level slots are
+ * cascaded down when their time is reached. Slots are vectors held by the
+ * wheel, the metric only carries a scheduled flag.
+ *
+ * Updates of scheduled metrics don't touch the wheel: the deadline is
+ * recalculated when the slot is processed, a metric modified in the meantime
+ * is just added to its new slot. So scheduling costs O(1) once per
+ * expiry period, and updates only check the flag.
+ *
+ * Expired metrics are collected under the wheel lock and notified after
+ * releasing it, as SetValue() takes the lock from any task (listeners may
+ * wait for these). CancelStale() waits for a running expiry notification.
+ *
+ * Expiry is no value change: the modification flags are left untouched, only
+ * listeners registered for staleness are called. A fresh value clears the
+ * stale state silently, listeners are notified if the value has changed.
+ */
+
+#define STALE_SLOTS   (1 << METRICS_STALE_BITS)
+#define STALE_MASK    (STALE_SLOTS - 1)
+
+void OvmsMetrics::ScheduleStale(OvmsMetric* metric)
+  {
+  OvmsRecMutexLock lock(&m_stalemutex);
+  if (!(metric->m_modified & METRICS_STALE_QUEUED) && metric->m_autostale > 0)
+    InsertStale(metric);
+  }
+
+void OvmsMetrics::InsertStale(OvmsMetric* metric)
+  {
+  // Note: the metric is stale if older than m_autostale seconds (see IsStale())
+  uint32_t deadline = metric->m_lastmodified + metric->m_autostale + 1;
+  if ((int32_t)(deadline - m_staletime) <= 0)
+    deadline = m_staletime + 1;
+  uint32_t delta = deadline - m_staletime;
+  int level = 0;
+  while (level < METRICS_STALE_LEVELS-1 && delta >= (1u << ((level+1) * METRICS_STALE_BITS)))
+    level++;
+  m_stalewheel[level][(deadline >> (level * METRICS_STALE_BITS)) & STALE_MASK].push_back(metric);
+  metric->m_modified.fetch_or(METRICS_STALE_QUEUED);
+  m_stalescheduled++;
+  }
+
+void OvmsMetrics::CancelStale(OvmsMetric* metric)
+  {
+  if (!(metric->m_modified & METRICS_STALE_QUEUED))
+    return;
+
+  m_stalemutex.Lock();
+  for (int level = 0; level < METRICS_STALE_LEVELS; level++)
+    {
+    for (int k = 0; k < STALE_SLOTS; k++)
+      {
+      std::vector<OvmsMetric*>& slot = m_stalewheel[level][k];
+      auto it = std::find(slot.begin(), slot.end(), metric);
+      if (it == slot.end()) continue;
+      *it = slot.back();
+      slot.pop_back();
+      metric->m_modified.fetch_and(~METRICS_STALE_QUEUED);
+      m_stalescheduled--;
+      m_stalemutex.Unlock();
+      return;
+      }
+    }
+
+  // Expired, not yet notified:
+  auto it = std::find(m_staleexpiring.begin(), m_staleexpiring.end(), metric);
+  if (it != m_staleexpiring.end())
+    {
+    m_staleexpiring.erase(it);
+    metric->m_modified.fetch_and(~METRICS_STALE_QUEUED);
+    }
+
+  // Being notified: wait for the listeners (unless deleted by one of them):
+  while (m_stalecurrent == metric && xTaskGetCurrentTaskHandle() != m_staletask)
+    {
+    m_stalemutex.Unlock();
+    vTaskDelay(1);
+    m_stalemutex.Lock();
+    }
+  m_stalemutex.Unlock();
+  }
+
+void OvmsMetrics::ExpireStale(OvmsMetric* metric)
+  {
+  if (metric->m_stale || metric->m_restored)
+    return;
+  metric->m_stale = true;
+  m_staleexpired++;
+  CallListeners(metric, false, true);
+  if (m_staleevents)
+    MyEvents.SignalEvent("metric.stale", (void*)metric->m_name, strlen(metric->m_name)+1);
+  }
+
+void OvmsMetrics::StaleTicker()
+  {
+  m_stalemutex.Lock();
+  if (m_staleticking)
+    {
+    // already running on another task (or called by a stale listener):
+    m_stalemutex.Unlock();
+    return;
+    }
+  m_staleticking = true;
+  while ((int32_t)(monotonictime - m_staletime) > 0)
+    {
+    uint32_t now = ++m_staletime;
+
+    // Cascade higher level slots reached, then process the level 0 slot:
+    for (int level = METRICS_STALE_LEVELS-1; level >= 0; level--)
+      {
+      int shift = level * METRICS_STALE_BITS;
+      if (now & ((1u << shift) - 1))
+        continue;
+      // Take the slot content (slot & due list swap their capacity):
+      m_staledue.swap(m_stalewheel[level][(now >> shift) & STALE_MASK]);
+      for (OvmsMetric* m : m_staledue)
+        {
+        m_stalescheduled--;
+        if (m->m_autostale == 0)
+          {
+          m->m_modified.fetch_and(~METRICS_STALE_QUEUED);
+          }
+        else if ((int32_t)(m->m_lastmodified + m->m_autostale + 1 - now) > 0)
           {
-          MetricCallbackEntry* ec = *itc;
-          ec->m_callback(metric);
+          // not expired (modified since scheduling, or cascading):
+          InsertStale(m);
+          }
+        else
+          {
+          // keep the flag set until notified, so updates don't reschedule:
+          m_staleexpiring.push_back(m);
           }
         }
+      m_staledue.clear();
       }
-    k = m_listeners.find(metric->m_name);
     }
+
+  // Notify expiries without holding the lock:
+  m_staletask = xTaskGetCurrentTaskHandle();
+  while (!m_staleexpiring.empty())
+    {
+    OvmsMetric* m = m_staleexpiring.back();
+    m_staleexpiring.pop_back();
+    m_stalecurrent = m;
+    m_stalemutex.Unlock();
+    ExpireStale(m);
+    m_stalemutex.Lock();
+    m_stalecurrent = NULL;
+    m->m_modified.fetch_and(~METRICS_STALE_QUEUED);
+    if (m->m_autostale > 0 && (int32_t)(m->m_lastmodified + m->m_autostale + 1 - m_staletime) > 0)
+      InsertStale(m);   // modified by a listener
+    }
+  m_staleticking = false;
+  m_stalemutex.Unlock();
   }
 
 size_t OvmsMetrics::RegisterModifier()
@@ -424,19 +947,38 @@ OvmsMetric::OvmsMetric(const char* name, uint16_t autostale, metric_unit_t units
   m_lastmodified = 0;
   m_autostale = autostale;
   m_units = units;
+  m_stale = false;
+  m_restored = 0;
   m_next = NULL;
   MyMetrics.RegisterMetric(this);
   }
 
 OvmsMetric::~OvmsMetric()
   {
-  MyMetrics.DeregisterMetric(this);
+  Unregister();
 
   // Warning: pointers to a deleted OvmsMetric can still be held locally in
   //  other modules. If you delete metrics, take care to inform all readers
   //  (i.e. by broadcasting a module shutdown event).
   }
 
+/**
+ * Unregister: remove the metric from the registry & pending notifications,
+ *  waits for listener calls in progress. Called by the destructors (of the
+ *  most derived class, so listeners still see an intact value), deleting a
+ *  metric without DeregisterMetric() is safe. The metric must not be set
+ *  anymore after unregistering.
+ */
+void OvmsMetric::Unregister()
+  {
+  if (!MyMetrics.UnlinkMetric(this))
+    return;
+  m_modified.fetch_and(~METRICS_LISTENED);
+  MyMetrics.CancelDeferred(this);
+  MyMetrics.CancelStale(this);
+  MyMetrics.m_deletecount++;
+  }
+
 std::string OvmsMetric::AsString(const char* defvalue, metric_unit_t units, int precision)
   {
   return std::string(defvalue);
@@ -490,15 +1032,48 @@ void OvmsMetric::SetModified(bool changed)
     m_defined = FirstDefined;
   else
     m_defined = Defined;
-  m_stale = false;
+  if (m_restored == METRICS_RESTORING)
+    return;               // RestoreValue(): not live data, no notification
+  m_stale = false;        // fresh, notified only if changed
+  if (m_restored)
+    {
+    m_restored = 0;
+    changed = true;       // first live value, the restored one was not notified
+    }
   m_lastmodified = monotonictime;
+  if (m_autostale > 0 && !(m_modified & METRICS_STALE_QUEUED))
+    MyMetrics.ScheduleStale(this);
   if (changed)
     {
-    m_modified = ULONG_MAX;
+    m_modified.fetch_or(~METRICS_FLAGS);
     MyMetrics.NotifyModified(this);
     }
   }
 
+/**
+ * RestoreValue: set a value restored from a snapshot
+ *  The metric is marked restored & stale, its age continues from the given
+ *  age (seconds). Listeners are not notified, as the value is not live data.
+ */
+void OvmsMetric::RestoreValue(std::string value, uint16_t age)
+  {
+  m_restored = METRICS_RESTORING;
+  SetValue(value);
+  m_lastmodified = monotonictime - age;
+  m_restored = METRICS_RESTORED;
+  m_stale = true;
+  }
+
+const char* OvmsMetric::GetTypeName()
+  {
+  return "other";
+  }
+
+size_t OvmsMetric::GetMemoryUsage()
+  {
+  return sizeof(*this);
+  }
+
 bool OvmsMetric::IsDefined()
   {
   return (m_defined != NeverDefined);
@@ -511,12 +1086,12 @@ bool OvmsMetric::IsFirstDefined()
 
 bool OvmsMetric::IsStale()
   {
+  if (m_restored)
+    return true;
   if (m_autostale>0)
     {
-    if (m_lastmodified < (monotonictime-m_autostale))
-      m_stale=true;
-    else
-      m_stale=false;
+    // Note: m_stale is maintained by the stale expiry ticker in this case
+    return (monotonictime - m_lastmodified > m_autostale);
     }
   return m_stale;
   }
@@ -528,7 +1103,10 @@ void OvmsMetric::SetStale(bool stale)
 
 void OvmsMetric::SetAutoStale(uint16_t seconds)
   {
+  MyMetrics.CancelStale(this);
   m_autostale = seconds;
+  if (m_autostale > 0 && IsDefined())
+    MyMetrics.ScheduleStale(this);
   }
 
 metric_unit_t OvmsMetric::GetUnits()
@@ -561,6 +1139,7 @@ OvmsMetricInt::OvmsMetricInt(const char* name, uint16_t autostale, metric_unit_t
 
 OvmsMetricInt::~OvmsMetricInt()
   {
+  Unregister();
   }
 
 std::string OvmsMetricInt::AsString(const char* defvalue, metric_unit_t units, int precision)
@@ -632,6 +1211,16 @@ void OvmsMetricInt::SetValue(std::string value)
     SetModified(false);
   }
 
+const char* OvmsMetricInt::GetTypeName()
+  {
+  return "int";
+  }
+
+size_t OvmsMetricInt::GetMemoryUsage()
+  {
+  return sizeof(*this);
+  }
+
 void OvmsMetricInt::SetValue(dbcNumber& value)
   {
   SetValue(value.GetSignedInteger());
@@ -645,6 +1234,7 @@ OvmsMetricBool::OvmsMetricBool(const char* name, uint16_t autostale, metric_unit
 
 OvmsMetricBool::~OvmsMetricBool()
   {
+  Unregister();
   }
 
 std::string OvmsMetricBool::AsString(const char* defvalue, metric_unit_t units, int precision)
@@ -716,6 +1306,16 @@ void OvmsMetricBool::SetValue(std::string value)
     SetModified(false);
   }
 
+const char* OvmsMetricBool::GetTypeName()
+  {
+  return "bool";
+  }
+
+size_t OvmsMetricBool::GetMemoryUsage()
+  {
+  return sizeof(*this);
+  }
+
 void OvmsMetricBool::SetValue(dbcNumber& value)
   {
   SetValue((bool)value.GetUnsignedInteger());
@@ -729,6 +1329,7 @@ OvmsMetricFloat::OvmsMetricFloat(const char* name, uint16_t autostale, metric_un
 
 OvmsMetricFloat::~OvmsMetricFloat()
   {
+  Unregister();
   }
 
 std::string OvmsMetricFloat::AsString(const char* defvalue, metric_unit_t units, int precision)
@@ -806,6 +1407,16 @@ void OvmsMetricFloat::SetValue(std::string value)
     SetModified(false);
   }
 
+const char* OvmsMetricFloat::GetTypeName()
+  {
+  return "float";
+  }
+
+size_t OvmsMetricFloat::GetMemoryUsage()
+  {
+  return sizeof(*this);
+  }
+
 void OvmsMetricFloat::SetValue(dbcNumber& value)
   {
   SetValue((float)value.GetDouble());
@@ -818,14 +1429,16 @@ OvmsMetricString::OvmsMetricString(const char* name, uint16_t autostale, metric_
 
 OvmsMetricString::~OvmsMetricString()
   {
+  Unregister();
   }
 
 std::string OvmsMetricString::AsString(const char* defvalue, metric_unit_t units, int precision)
   {
   if (IsDefined())
     {
-    OvmsMutexLock lock(&m_mutex);
-    return m_value;
+    std::string result;
+    m_value.Read([&result](const extram::string& v) { result.assign(v.data(), v.size()); });
+    return result;
     }
   else
     {
@@ -835,17 +1448,132 @@ std::string OvmsMetricString::AsString(const char* defvalue, metric_unit_t units
 
 void OvmsMetricString::SetValue(std::string value)
   {
-  if (m_mutex.Lock())
+  SetModified(m_value.Modify([&value](const extram::string& cur, extram::string& next)
+    {
+    if (cur.size() == value.size() && cur.compare(0, cur.size(), value.data(), value.size()) == 0)
+      return false;
+    next.assign(value.data(), value.size());
+    return true;
+    }));
+  }
+
+const char* OvmsMetricString::GetTypeName()
+  {
+  return "string";
+  }
+
+size_t OvmsMetricString::GetMemoryUsage()
+  {
+  // short strings are stored in the string object:
+  return sizeof(*this) + m_value.GetStorage([](const extram::string& value)
+    { return (value.capacity() > 15) ? value.capacity() + 1 + METRICS_HEAP_OVERHEAD : 0; });
+  }
+
+OvmsMetricArena::OvmsMetricArena()
+  {
+  memset(m_free, 0, sizeof(m_free));
+  m_chunk = NULL;
+  m_chunkfree = 0;
+  m_chunks = 0;
+  m_used = 0;
+  m_large = 0;
+  }
+
+OvmsMetricArena::~OvmsMetricArena()
+  {
+  }
+
+void* OvmsMetricArena::Alloc(size_t size)
+  {
+  size_t bs = Round(size ? size : 1);
+  if (bs > METRICS_ARENA_MAXBLOCK)
     {
-    bool modified = false;
-    if (m_value.compare(value)!=0)
+    void* ptr = ExternalRamMalloc(bs);
+    if (!ptr)
+      OutOfMemory(bs);
+    OvmsMutexLock lock(&m_mutex);
+    m_large += bs;
+    return ptr;
+    }
+
+  OvmsMutexLock lock(&m_mutex);
+  void*& head = m_free[bs / METRICS_ARENA_ALIGN];
+  void* ptr = head;
+  if (ptr)
+    {
+    // recycle freed block, the link is stored in the block:
+    head = *(void**)ptr;
+    }
+  else
+    {
+    if (m_chunkfree < bs)
       {
-      m_value = value;
-      modified = true;
+      // keep the chunk remainder for smaller blocks:
+      if (m_chunkfree)
+        {
+        void*& rest = m_free[m_chunkfree / METRICS_ARENA_ALIGN];
+        *(void**)m_chunk = rest;
+        rest = m_chunk;
+        }
+      m_chunk = (char*)ExternalRamMalloc(METRICS_ARENA_CHUNK);
+      m_chunkfree = m_chunk ? METRICS_ARENA_CHUNK : 0;
+      if (!m_chunk)
+        {
+        // heap too fragmented for a chunk: allocate the block alone, it
+        //  joins the free list of its size class when freed
+        ESP_LOGW(TAG, "Arena: no memory for a %u byte chunk, allocating %u bytes from heap",
+          (unsigned)METRICS_ARENA_CHUNK, (unsigned)bs);
+        ptr = ExternalRamMalloc(bs);
+        if (!ptr)
+          OutOfMemory(bs);
+        m_used += bs;
+        return ptr;
+        }
+      m_chunks++;
       }
-    m_mutex.Unlock();
-    SetModified(modified);
+    ptr = m_chunk;
+    m_chunk += bs;
+    m_chunkfree -= bs;
+    }
+  m_used += bs;
+  return ptr;
+  }
+
+void OvmsMetricArena::OutOfMemory(size_t size)
+  {
+  // the std::vector allocator interface cannot return NULL:
+  ESP_LOGE(TAG, "Arena: out of memory allocating %u bytes, aborting", (unsigned)size);
+  abort();
+  }
+
+void OvmsMetricArena::Free(void* ptr, size_t size)
+  {
+  if (!ptr) return;
+  size_t bs = Round(size ? size : 1);
+  OvmsMutexLock lock(&m_mutex);
+  if (bs > METRICS_ARENA_MAXBLOCK)
+    {
+    m_large -= bs;
+    free(ptr);
+    return;
     }
+  void*& head = m_free[bs / METRICS_ARENA_ALIGN];
+  *(void**)ptr = head;
+  head = ptr;
+  m_used -= bs;
+  }
+
+size_t OvmsMetricArena::BlockSize(size_t size)
+  {
+  size_t bs = Round(size ? size : 1);
+  return (bs > METRICS_ARENA_MAXBLOCK) ? bs + METRICS_HEAP_OVERHEAD : bs;
+  }
+
+void OvmsMetricArena::GetStatus(OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  writer->printf("\nArena: %u chunks of %u bytes, %u bytes used, %u bytes in large blocks\n",
+    (unsigned)m_chunks, (unsigned)METRICS_ARENA_CHUNK, (unsigned)m_used, (unsigned)m_large);
   }
 
 const char* OvmsMetricUnitLabel(metric_unit_t units)
@@ -34,6 +34,7 @@
 #include <functional>
 #include <map>
 #include <list>
+#include <deque>
 #include <string>
 #include <bitset>
 #include <stdint.h>
@@ -41,11 +42,28 @@
 #include <set>
 #include <vector>
 #include <atomic>
+#include <algorithm>
 #include "ovms_utils.h"
 #include "ovms_mutex.h"
+#include "ovms_seqlock.h"
 #include "dbc_number.h"
 
 #define METRICS_MAX_MODIFIERS 32
+#define METRICS_HEAP_OVERHEAD 8     // heap block header & alignment (estimate for memory accounting)
+#define METRICS_STALE_LEVELS  3     // stale expiry timer wheel levels
+#define METRICS_STALE_BITS    6     // 64 slots per level, 1 second resolution, 72 hours range
+#define METRICS_LISTENER_SNAP 16    // listener calls collected on the stack (more use the heap)
+
+// OvmsMetric::m_modified bits 0-2 are flags, modifiers use the others:
+#define METRICS_NOTIFY_QUEUED (1ul<<0)  // queued for deferred listeners
+#define METRICS_STALE_QUEUED  (1ul<<1)  // scheduled in the stale expiry wheel (or expiring)
+#define METRICS_LISTENED      (1ul<<2)  // listeners registered by name
+#define METRICS_FLAGS         (METRICS_NOTIFY_QUEUED|METRICS_STALE_QUEUED|METRICS_LISTENED)
+#define METRICS_FIRST_MODIFIER 3
+
+// OvmsMetric::m_restored states:
+#define METRICS_RESTORED      1         // value restored from snapshot, not yet live
+#define METRICS_RESTORING     2         // RestoreValue() setting the value
 
 using namespace std;
 
@@ -107,6 +125,10 @@ typedef enum : uint8_t
   Defined
 } metric_defined_t;
 
+class OvmsWriter;
+class MetricCallbackEntry;
+typedef std::vector<MetricCallbackEntry*> MetricCallbackList;
+
 extern const char* OvmsMetricUnitLabel(metric_unit_t units);
 extern int UnitConvert(metric_unit_t from, metric_unit_t to, int value);
 extern float UnitConvert(metric_unit_t from, metric_unit_t to, float value);
@@ -137,16 +159,25 @@ class OvmsMetric
     virtual bool IsModifiedAndClear(size_t modifier);
     virtual void ClearModified(size_t modifier);
     virtual void SetModified(bool changed=true);
+    void RestoreValue(std::string value, uint16_t age);
+    void Unregister();
+    virtual const char* GetTypeName();
+    virtual size_t GetMemoryUsage();
 
   public:
+    // Note: words first, 16 & 8 bit fields last, so the typed value of
+    //  bool/int/float metrics fits into the tail padding. Notification
+    //  state is kept in m_modified flags, queues & wheel slots are held by
+    //  MyMetrics.
     OvmsMetric* m_next;
     const char* m_name;
-    std::atomic_ulong m_modified;
-    uint32_t m_lastmodified;
+    std::atomic_ulong m_modified;   // modifier bits & METRICS_FLAGS
+    uint32_t m_lastmodified;        // restored: monotonictime at restore - age
     uint16_t m_autostale;
     metric_unit_t m_units;
     metric_defined_t m_defined;
     bool m_stale;
+    uint8_t m_restored;             // METRICS_RESTORED / METRICS_RESTORING, 0 = live
   };
 
 class OvmsMetricBool : public OvmsMetric
@@ -165,6 +196,8 @@ class OvmsMetricBool : public OvmsMetric
     void SetValue(std::string value);
     void SetValue(dbcNumber& value);
     void operator=(std::string value) { SetValue(value); }
+    const char* GetTypeName();
+    size_t GetMemoryUsage();
 
   protected:
     bool m_value;
@@ -186,6 +219,8 @@ class OvmsMetricInt : public OvmsMetric
     void SetValue(std::string value);
     void SetValue(dbcNumber& value);
     void operator=(std::string value) { SetValue(value); }
+    const char* GetTypeName();
+    size_t GetMemoryUsage();
 
   protected:
     int m_value;
@@ -207,6 +242,8 @@ class OvmsMetricFloat : public OvmsMetric
     void SetValue(std::string value);
     void SetValue(dbcNumber& value);
     void operator=(std::string value) { SetValue(value); }
+    const char* GetTypeName();
+    size_t GetMemoryUsage();
 
   protected:
     float m_value;
@@ -222,10 +259,11 @@ class OvmsMetricString : public OvmsMetric
     std::string AsString(const char* defvalue = "", metric_unit_t units = Other, int precision = -1);
     void SetValue(std::string value);
     void operator=(std::string value) { SetValue(value); }
+    const char* GetTypeName();
+    size_t GetMemoryUsage();
 
   protected:
-    OvmsMutex m_mutex;
-    std::string m_value;
+    OvmsRcuValue<extram::string> m_value;       // long strings are stored in SPIRAM
   };
 
 
@@ -243,6 +281,7 @@ class OvmsMetricBitset : public OvmsMetric
       }
     virtual ~OvmsMetricBitset()
       {
+      Unregister();
       }
 
   public:
@@ -251,10 +290,10 @@ class OvmsMetricBitset : public OvmsMetric
       if (!IsDefined())
         return std::string(defvalue);
       std::ostringstream ss;
-      OvmsMutexLock lock(&m_mutex);
+      std::bitset<N> value = m_value.Read();
       for (int i = 0; i < N; i++)
         {
-        if (m_value[i])
+        if (value[i])
           {
           if (ss.tellp() > 0)
             ss << ',';
@@ -294,29 +333,20 @@ class OvmsMetricBitset : public OvmsMetric
       {
       if (!IsDefined())
         return defvalue;
-      OvmsMutexLock lock(&m_mutex);
-      return m_value;
+      return m_value.Read();
       }
 
     void SetValue(std::bitset<N> value, metric_unit_t units = Other)
       {
-      if (m_mutex.Lock())
-        {
-        bool modified = false;
-        if (m_value != value)
-          {
-          m_value = value;
-          modified = true;
-          }
-        m_mutex.Unlock();
-        SetModified(modified);
-        }
+      SetModified(m_value.Write(value));
       }
     void operator=(std::bitset<N> value) { SetValue(value); }
 
+    const char* GetTypeName() { return "bitset"; }
+    size_t GetMemoryUsage() { return sizeof(*this); }
+
   protected:
-    OvmsMutex m_mutex;
-    std::bitset<N> m_value;
+    OvmsSeqlock< std::bitset<N> > m_value;
   };
 
 
@@ -335,6 +365,7 @@ class OvmsMetricSet : public OvmsMetric
       }
     virtual ~OvmsMetricSet()
       {
+      Unregister();
       }
 
   public:
@@ -343,13 +374,15 @@ class OvmsMetricSet : public OvmsMetric
       if (!IsDefined())
         return std::string(defvalue);
       std::ostringstream ss;
-      OvmsMutexLock lock(&m_mutex);
-      for (auto i = m_value.begin(); i != m_value.end(); i++)
+      m_value.Read([&ss](const std::set<ElemType>& value)
         {
-        if (ss.tellp() > 0)
-          ss << ',';
-        ss << *i;
-        }
+        for (auto i = value.begin(); i != value.end(); i++)
+          {
+          if (ss.tellp() > 0)
+            ss << ',';
+          ss << *i;
+          }
+        });
       return ss.str();
       }
 
@@ -381,30 +414,85 @@ class OvmsMetricSet : public OvmsMetric
       {
       if (!IsDefined())
         return defvalue;
-      OvmsMutexLock lock(&m_mutex);
-      return m_value;
+      return m_value.Get();
       }
 
     void SetValue(std::set<ElemType> value, metric_unit_t units = Other)
       {
-      if (m_mutex.Lock())
-        {
-        bool modified = false;
-        if (m_value != value)
-          {
-          m_value = value;
-          modified = true;
-          }
-        m_mutex.Unlock();
-        SetModified(modified);
-        }
+      SetModified(m_value.Write(value));
       }
     void operator=(std::set<ElemType> value) { SetValue(value); }
 
+    const char* GetTypeName() { return "set"; }
+    size_t GetMemoryUsage()
+      {
+      // set nodes: element + color & 3 pointers, plus heap block overhead
+      return sizeof(*this) + m_value.GetStorage([](const std::set<ElemType>& value)
+        { return value.size() * (sizeof(ElemType) + 4 * sizeof(void*) + METRICS_HEAP_OVERHEAD); });
+      }
+
   protected:
-    OvmsMutex m_mutex;
-    std::set<ElemType> m_value;
+    OvmsRcuValue< std::set<ElemType> > m_value;
+  };
+
+
+/**
+ * Metric arena: shared storage for vector metric elements
+ *  - blocks are cut from chunks in SPIRAM (if available), sizes rounded up to
+ *    METRICS_ARENA_ALIGN, freed blocks are recycled per size class
+ *  - blocks larger than METRICS_ARENA_MAXBLOCK are allocated directly
+ *  - chunks are never returned, as metrics normally live until reboot
+ *  - without memory for a new chunk, single blocks are taken from the heap;
+ *    if that fails as well, Alloc() logs an error and aborts
+ */
+#define METRICS_ARENA_CHUNK     4096
+#define METRICS_ARENA_ALIGN     8
+#define METRICS_ARENA_MAXBLOCK  1024
+
+class OvmsMetricArena
+  {
+  public:
+    OvmsMetricArena();
+    ~OvmsMetricArena();
+
+  public:
+    void* Alloc(size_t size);
+    void Free(void* ptr, size_t size);
+    static size_t BlockSize(size_t size);
+    void GetStatus(OvmsWriter* writer);
+
+  protected:
+    static size_t Round(size_t size) { return (size + METRICS_ARENA_ALIGN - 1) & ~(METRICS_ARENA_ALIGN - 1); }
+    static void OutOfMemory(size_t size) __attribute__ ((noreturn));
+
+  protected:
+    OvmsMutex       m_mutex;
+    void*           m_free[METRICS_ARENA_MAXBLOCK / METRICS_ARENA_ALIGN + 1];
+    char*           m_chunk;            // current chunk
+    size_t          m_chunkfree;        // unused bytes of current chunk
+    uint32_t        m_chunks;           // chunks allocated
+    size_t          m_used;             // arena bytes in use
+    size_t          m_large;            // bytes in direct allocations
+  };
+
+extern OvmsMetricArena MyMetricArena;
+
+template <class T>
+struct OvmsMetricAllocator
+  {
+  typedef T value_type;
+  OvmsMetricAllocator() = default;
+  template <class U> constexpr OvmsMetricAllocator(const OvmsMetricAllocator<U>&) noexcept {}
+  T* allocate(std::size_t n)
+    {
+    return static_cast<T*>(MyMetricArena.Alloc(n*sizeof(T)));
+    }
+  void deallocate(T* p, std::size_t n) noexcept { MyMetricArena.Free(p, n*sizeof(T)); }
   };
+template <class T, class U>
+bool operator==(const OvmsMetricAllocator<T>&, const OvmsMetricAllocator<U>&) { return true; }
+template <class T, class U>
+bool operator!=(const OvmsMetricAllocator<T>&, const OvmsMetricAllocator<U>&) { return false; }
 
 
 /**
@@ -420,7 +508,8 @@ class OvmsMetricSet : public OvmsMetric
  *  float myvals[3] = { 5.5, 6.6, 7.7 };
  *  vf->SetElemValues(10, 3, myvals);
  *
- * Note: use ExtRamAllocator<type> for large vectors (= use SPIRAM)
+ * Note: the value is stored in the metric arena (see above), Allocator is
+ *  used for the vectors passed in & out
  */
 template
   <
@@ -429,6 +518,9 @@ template
   >
 class OvmsMetricVector : public OvmsMetric
   {
+  protected:
+    typedef std::vector<ElemType, OvmsMetricAllocator<ElemType>> storage_t;
+
   public:
     OvmsMetricVector(const char* name, uint16_t autostale=0, metric_unit_t units = Other)
       : OvmsMetric(name, autostale, units)
@@ -436,6 +528,7 @@ class OvmsMetricVector : public OvmsMetric
       }
     virtual ~OvmsMetricVector()
       {
+      Unregister();
       }
 
   public:
@@ -449,13 +542,15 @@ class OvmsMetricVector : public OvmsMetric
         ss.precision(precision); // Set desired precision
         ss << fixed;
         }
-      OvmsMutexLock lock(&m_mutex);
-      for (auto i = m_value.begin(); i != m_value.end(); i++)
+      m_value.Read([&ss](const storage_t& value)
         {
-        if (ss.tellp() > 0)
-          ss << ',';
-        ss << *i;
-        }
+        for (auto i = value.begin(); i != value.end(); i++)
+          {
+          if (ss.tellp() > 0)
+            ss << ',';
+          ss << *i;
+          }
+        });
       return ss.str();
       }
 
@@ -485,17 +580,13 @@ class OvmsMetricVector : public OvmsMetric
 
     void SetValue(std::vector<ElemType, Allocator> value, metric_unit_t units = Other)
       {
-      if (m_mutex.Lock())
+      SetModified(m_value.Modify([&value](const storage_t& cur, storage_t& next)
         {
-        bool modified = false;
-        if (m_value != value)
-          {
-          m_value = value;
-          modified = true;
-          }
-        m_mutex.Unlock();
-        SetModified(modified);
-        }
+        if (cur.size() == value.size() && std::equal(cur.begin(), cur.end(), value.begin()))
+          return false;
+        next.assign(value.begin(), value.end());
+        return true;
+        }));
       }
     void operator=(std::vector<ElemType, Allocator> value) { SetValue(value); }
 
@@ -503,11 +594,11 @@ class OvmsMetricVector : public OvmsMetric
       {
       if (IsDefined())
         {
-        if (m_mutex.Lock())
+        m_value.Modify([](const storage_t& value, storage_t& next)
           {
-          m_value.clear();
-          m_mutex.Unlock();
-          }
+          next.clear();
+          return true;
+          });
         SetModified(true);
         }
       }
@@ -516,64 +607,66 @@ class OvmsMetricVector : public OvmsMetric
       {
       if (!IsDefined())
         return defvalue;
-      OvmsMutexLock lock(&m_mutex);
-      return m_value;
+      std::vector<ElemType, Allocator> result;
+      m_value.Read([&result](const storage_t& value) { result.assign(value.begin(), value.end()); });
+      return result;
       }
 
     ElemType GetElemValue(size_t n)
       {
       ElemType val{};
-      OvmsMutexLock lock(&m_mutex);
-      if (m_value.size() > n)
-        val = m_value[n];
+      m_value.Read([&val, n](const storage_t& value)
+        {
+        if (value.size() > n)
+          val = value[n];
+        });
       return val;
       }
 
     void SetElemValue(size_t n, ElemType value)
       {
-      bool modified = false;
-      if (m_mutex.Lock())
-        {
-        if (m_value.size() < n+1)
-          m_value.resize(n+1);
-        if (m_value[n] != value)
-          {
-          m_value[n] = value;
-          modified = true;
-          }
-        m_mutex.Unlock();
-        }
-      SetModified(modified);
+      SetElemValues(n, 1, &value);
       }
 
     void SetElemValues(size_t start, size_t cnt, ElemType* values)
       {
-      bool modified = false;
-      if (m_mutex.Lock())
+      bool modified = m_value.Modify([start, cnt, values](const storage_t& value, storage_t& next)
         {
-        if (m_value.size() < start+cnt)
-          m_value.resize(start+cnt);
-        for (size_t i = 0; i < cnt; i++)
+        // check for changes before copying:
+        size_t i = 0;
+        if (value.size() >= start+cnt)
           {
-          if (m_value[start+i] != values[i])
-            {
-            m_value[start+i] = values[i];
-            modified = true;
-            }
+          while (i < cnt && value[start+i] == values[i])
+            i++;
+          if (i == cnt)
+            return false;
           }
-        m_mutex.Unlock();
-        }
+        next = value;
+        if (next.size() < start+cnt)
+          next.resize(start+cnt);
+        for (; i < cnt; i++)
+          next[start+i] = values[i];
+        return true;
+        });
       SetModified(modified);
       }
 
     uint32_t GetSize()
       {
-      return m_value.size();
+      uint32_t size = 0;
+      m_value.Read([&size](const storage_t& value) { size = value.size(); });
+      return size;
+      }
+
+    const char* GetTypeName() { return "vector"; }
+    size_t GetMemoryUsage()
+      {
+      return sizeof(*this) + m_value.GetStorage([](const storage_t& value)
+        { return value.capacity() ? OvmsMetricArena::BlockSize(value.capacity() * sizeof(ElemType)) : 0; });
       }
 
   protected:
-    OvmsMutex m_mutex;
-    std::vector<ElemType, Allocator> m_value;
+    OvmsRcuValue<storage_t> m_value;
   };
 
 
@@ -582,16 +675,27 @@ typedef std::function<void(OvmsMetric*)> MetricCallback;
 class MetricCallbackEntry
   {
   public:
-    MetricCallbackEntry(const char* caller, MetricCallback callback);
+    MetricCallbackEntry(const char* caller, MetricCallback callback, bool deferred=false, bool stale=false);
     virtual ~MetricCallbackEntry();
 
+  public:
+    void Release();
+
   public:
     const char *m_caller;
     MetricCallback m_callback;
+    bool m_deferred;          // called by the notifier task
+    bool m_stale;             // also called on stale expiry (by the stale ticker)
+    std::atomic<uint32_t> m_refs; // calls in progress, high bit set when deregistered
   };
 
-typedef std::list<MetricCallbackEntry*> MetricCallbackList;
-typedef std::map<const char*, MetricCallbackList*, CmpStrOp> MetricCallbackMap;
+typedef std::map<const char*, MetricCallbackList, CmpStrOp> MetricCallbackMap;
+
+struct MetricListenerTable
+  {
+  MetricCallbackMap named;              // by metric name
+  MetricCallbackList wildcard;          // "*" listeners
+  };
 
 class OvmsMetrics
   {
@@ -601,6 +705,7 @@ class OvmsMetrics
 
   public:
     void RegisterMetric(OvmsMetric* metric);
+    bool UnlinkMetric(OvmsMetric* metric);
     void DeregisterMetric(OvmsMetric* metric);
 
   public:
@@ -643,12 +748,65 @@ class OvmsMetrics
       }
 
   public:
-    void RegisterListener(const char* caller, const char* name, MetricCallback callback);
+    // Listeners are called synchronously by SetValue() on the modifying task,
+    //  or if deferred, from the notifier task (changes coalesced per metric).
+    //  Registrations are published copy on write, SetValue() takes no lock,
+    //  listeners are called without holding one, so they may wait for other
+    //  tasks setting metrics. DeregisterListener() waits for calls in progress.
+    //  Stale expiry is no value change: only listeners registered with stale=true
+    //  are called, by the stale ticker, with IsStale() true.
+    void RegisterListener(const char* caller, const char* name, MetricCallback callback, bool deferred=false, bool stale=false);
     void DeregisterListener(const char* caller);
     void NotifyModified(OvmsMetric* metric);
+    void CancelDeferred(OvmsMetric* metric);
+    void ListListeners(OvmsWriter* writer);
+
+  public:
+    // Stale expiry: metrics with autostale are scheduled on modification,
+    //  StaleTicker() (run by the events task on "ticker.1") marks them stale
+    //  & calls the stale listeners on expiry.
+    void ScheduleStale(OvmsMetric* metric);
+    void CancelStale(OvmsMetric* metric);
+    void StaleTicker();
+
+  protected:
+    void AddListener(MetricCallbackList& ml, MetricCallbackEntry* entry);
+    bool CallListeners(OvmsMetric* metric, bool deferred, bool stale=false);
+    void InsertStale(OvmsMetric* metric);
+    void ExpireStale(OvmsMetric* metric);
+    void ConfigListener(std::string event, void* data);
+    void TickerListener(std::string event, void* data);
+    void NotifyDeferred(OvmsMetric* metric);
+    static void NotifierTask(void *pvParameters);
+    void Notifier();
 
   protected:
-    MetricCallbackMap m_listeners;
+    OvmsRcuValue<MetricListenerTable> m_listeners;
+    std::atomic<int> m_wildcards;         // "*" listeners registered
+    OvmsRecMutex m_listenermutex;         // serializes registration
+    OvmsMutex m_notifymutex;              // protects the deferred queue
+    std::deque<OvmsMetric*> m_notifyqueue;
+    std::atomic<OvmsMetric*> m_notifycurrent; // metric being dispatched by the notifier
+    TaskHandle_t m_notifytask;
+
+  public:
+    uint32_t m_notifycount;               // deferred notifications queued
+    uint32_t m_notifycoalesced;           // deferred notifications saved by coalescing
+
+  protected:
+    std::vector<OvmsMetric*> m_stalewheel[METRICS_STALE_LEVELS][1 << METRICS_STALE_BITS];
+    std::vector<OvmsMetric*> m_staledue;  // slot being processed
+    OvmsRecMutex m_stalemutex;            // protects the wheel & expiry list
+    uint32_t m_staletime;                 // monotonictime processed by StaleTicker()
+    std::vector<OvmsMetric*> m_staleexpiring; // expired, to be notified (unlocked)
+    std::atomic<OvmsMetric*> m_stalecurrent;  // expiry being notified
+    TaskHandle_t m_staletask;             // task running StaleTicker()
+    bool m_staleticking;                  // StaleTicker() running (protected by m_stalemutex)
+
+  public:
+    uint32_t m_stalescheduled;            // metrics currently scheduled
+    uint32_t m_staleexpired;              // expiries notified
+    bool m_staleevents;                   // signal "metric.stale" events (config)
 
   public:
     size_t RegisterModifier();
@@ -659,6 +817,7 @@ class OvmsMetrics
   public:
     OvmsMetric* m_first;
     bool m_trace;
+    std::atomic<uint32_t> m_deletecount;  // metrics deleted: cached OvmsMetric pointers need a new lookup
   };
 
 extern OvmsMetrics MyMetrics;
@@ -49,6 +49,7 @@ static const char *TAG = "module";
 #endif
 #include "ovms_boot.h"
 #include "ovms_mutex.h"
+#include "ovms_contention.h"
 #include "ovms_notify.h"
 #include "string_writer.h"
 
@@ -1024,6 +1025,33 @@ static void module_summary(int verbosity, OvmsWriter* writer, OvmsCommand* cmd,
   writer->puts("\nREPORT ENDS");
   }
 
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+static void module_contention(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* sortby = "wait";
+  const char* filter = NULL;
+  int count = 20;
+  for (int i=0; i<argc; i++)
+    {
+    if (strcmp(argv[i], "-a") == 0)
+      count = 0;
+    else if (strncmp(argv[i], "-n", 2) == 0 && argv[i][2])
+      count = atoi(argv[i]+2);
+    else if (strncmp(argv[i], "-s", 2) == 0 && argv[i][2])
+      sortby = argv[i]+2;
+    else
+      filter = argv[i];
+    }
+  OvmsContention::Report(writer, sortby, count, filter);
+  }
+
+static void module_contention_reset(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  OvmsContention::Reset();
+  writer->puts("Contention statistics reset");
+  }
+#endif // CONFIG_OVMS_DEV_CONTENTION_STATS
+
 class OvmsModuleInit
   {
   public:
@@ -1050,6 +1078,16 @@ class OvmsModuleInit
     cmd_module->RegisterCommand("reset","Reset module",module_reset);
     cmd_module->RegisterCommand("check","Check heap integrity",module_check);
     cmd_module->RegisterCommand("summary","Show module summary",module_summary);
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsCommand* cmd_contention = cmd_module->RegisterCommand("contention","Show mutex & queue contention statistics",module_contention,
+      "[-a] [-n<count>] [-s<wait|hold|count|contended|drops>] [<filter>]\n"
+      "Lists the worst offenders, default: top 20 by total wait time.\n"
+      "-a\tshow all entries\n"
+      "-n\tshow <count> entries\n"
+      "-s\tsort by field\n"
+      "<filter>\tname or type substring",0,3);
+    cmd_contention->RegisterCommand("reset","Reset contention statistics",module_contention_reset);
+#endif // CONFIG_OVMS_DEV_CONTENTION_STATS
     OvmsCommand* cmd_factory = cmd_module->RegisterCommand("factory","MODULE FACTORY framework");
     cmd_factory->RegisterCommand("reset","Factory Reset module",module_factory_reset,"[-noconfirm]",0,1);
     }
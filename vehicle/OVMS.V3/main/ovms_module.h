@@ -30,6 +30,9 @@
 
 #ifndef __OVMS_MODULE_H__
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 extern void AddTaskToMap(TaskHandle_t task);
 
 #define __OVMS_MODULE_H__
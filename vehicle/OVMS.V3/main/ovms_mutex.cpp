@@ -29,11 +29,17 @@
 */
 
 #include "ovms_mutex.h"
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+#include "esp_timer.h"
+#endif
 
 /**
  * Standard Mutex:
  */
 OvmsMutex::OvmsMutex()
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  : m_stats("mutex", NULL, __builtin_return_address(0))
+#endif
   {
   m_mutex = xSemaphoreCreateMutex();
   }
@@ -45,11 +51,31 @@ OvmsMutex::~OvmsMutex()
 
 bool OvmsMutex::Lock(TickType_t timeout)
   {
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  int64_t wait = -1;
+  if (xSemaphoreTake(m_mutex, 0) != pdTRUE)
+    {
+    int64_t start = esp_timer_get_time();
+    if (timeout == 0 || xSemaphoreTake(m_mutex, timeout) != pdTRUE)
+      {
+      m_stats.Timeout();
+      return false;
+      }
+    wait = esp_timer_get_time() - start;
+    }
+  m_locktime = esp_timer_get_time();
+  m_stats.Acquired(wait);
+  return true;
+#else
   return (xSemaphoreTake(m_mutex, timeout) == pdTRUE);
+#endif
   }
 
 void OvmsMutex::Unlock()
   {
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_stats.Released(esp_timer_get_time() - m_locktime);
+#endif
   xSemaphoreGive(m_mutex);
   }
 
@@ -73,8 +99,14 @@ bool OvmsMutexLock::IsLocked()
  * Recursive Mutex:
  */
 OvmsRecMutex::OvmsRecMutex()
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  : m_stats("recmutex", NULL, __builtin_return_address(0))
+#endif
   {
   m_mutex = xSemaphoreCreateRecursiveMutex();
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_depth = 0;
+#endif
   }
 
 OvmsRecMutex::~OvmsRecMutex()
@@ -84,11 +116,36 @@ OvmsRecMutex::~OvmsRecMutex()
 
 bool OvmsRecMutex::Lock(TickType_t timeout)
   {
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  int64_t wait = -1;
+  if (xSemaphoreTakeRecursive(m_mutex, 0) != pdTRUE)
+    {
+    int64_t start = esp_timer_get_time();
+    if (timeout == 0 || xSemaphoreTakeRecursive(m_mutex, timeout) != pdTRUE)
+      {
+      m_stats.Timeout();
+      return false;
+      }
+    wait = esp_timer_get_time() - start;
+    }
+  // Only the outermost lock counts:
+  if (m_depth++ == 0)
+    {
+    m_locktime = esp_timer_get_time();
+    m_stats.Acquired(wait);
+    }
+  return true;
+#else
   return (xSemaphoreTakeRecursive(m_mutex, timeout) == pdTRUE);
+#endif
   }
 
 void OvmsRecMutex::Unlock()
   {
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  if (--m_depth == 0)
+    m_stats.Released(esp_timer_get_time() - m_locktime);
+#endif
   xSemaphoreGiveRecursive(m_mutex);
   }
 
@@ -35,6 +35,7 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include <freertos/semphr.h>
+#include "ovms_contention.h"
 
 /**
  * Standard Mutex:
@@ -48,9 +49,18 @@ class OvmsMutex
   public:
     bool Lock(TickType_t timeout = portMAX_DELAY);
     void Unlock();
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    void SetName(const char* name) { m_stats.m_name = name; }
+#else
+    void SetName(const char* name) {}
+#endif
 
   protected:
     QueueHandle_t m_mutex;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats m_stats;
+    int64_t m_locktime;
+#endif
   };
 
 class OvmsMutexLock
@@ -79,9 +89,19 @@ class OvmsRecMutex
   public:
     bool Lock(TickType_t timeout = portMAX_DELAY);
     void Unlock();
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    void SetName(const char* name) { m_stats.m_name = name; }
+#else
+    void SetName(const char* name) {}
+#endif
 
   protected:
     QueueHandle_t m_mutex;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats m_stats;
+    int64_t m_locktime;
+    int m_depth;
+#endif
   };
 
 class OvmsRecMutexLock
@@ -34,6 +34,7 @@ static const char *TAG = "notify";
 #include <stdlib.h>
 #include <stdio.h>
 #include <sstream>
+#include <vector>
 #include "ovms.h"
 #include "ovms_notify.h"
 #include "ovms_command.h"
@@ -44,6 +45,7 @@ static const char *TAG = "notify";
 #include "buffered_shell.h"
 #include "string.h"
 #include "ovms_mutex.h"
+#include "ovms_module.h"
 
 using namespace std;
 
@@ -73,6 +75,9 @@ void notify_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
     writer->printf("  %s(%d): verbosity=%d\n", mc->m_caller, mc->m_reader, mc->m_verbosity);
     }
 
+  writer->printf("Command notifications: %u queued, %u dropped, max execution time %u ms\n",
+    MyNotify.m_cmd_queued, MyNotify.m_cmd_dropped, MyNotify.m_cmd_time_max);
+
   if (MyNotify.m_types.size() > 0)
     {
     writer->puts("Notify types:");
@@ -80,8 +85,11 @@ void notify_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc
       {
       OvmsNotifyType* mt = itm->second;
       OvmsRecMutexLock lock(&mt->m_mutex);
-      writer->printf("  %s: %d entries\n",
-        mt->m_name, mt->m_entries.size());
+      writer->printf("  %s: %d entries, %u bytes (max %u, cap %u), %d undelivered\n",
+        mt->m_name, mt->m_entries.size(), mt->m_queuedbytes, mt->m_maxbytes, mt->m_cap, mt->m_pending.size());
+      writer->printf("    %u queued, %u dropped, %u delivered, latency avg %u / max %u ms\n",
+        mt->m_queued, mt->m_dropped, mt->m_delivered,
+        mt->m_delivered ? (uint32_t)(mt->m_latency_sum / mt->m_delivered) : 0, mt->m_latency_max);
       for (NotifyEntryMap_t::iterator ite=mt->m_entries.begin(); ite!=mt->m_entries.end(); ++ite)
         {
         OvmsNotifyEntry* e = ite->second;
@@ -179,7 +187,7 @@ bool OvmsNotifyEntry::IsRead(size_t reader)
 int OvmsNotifyEntry::CountPending()
   {
   int cnt = 0;
-  unsigned long pend = m_pendingreaders;
+  unsigned long pend = m_pendingreaders & ~NOTIFY_DISPATCH_HOLD;
   for (int i=0; i<NOTIFY_MAX_READERS; i++)
     {
     cnt += pend & 1;
@@ -224,7 +232,8 @@ const extram::string OvmsNotifyEntryString::GetValue()
 
 ////////////////////////////////////////////////////////////////////////
 // OvmsNotifyEntryCommand is the notification entry for a command
-// callback type.
+// callback type. The command is executed on construction, this is
+// done by the notification task (see OvmsNotify::ExecuteCommand).
 
 OvmsNotifyEntryCommand::OvmsNotifyEntryCommand(const char* subtype, int verbosity, const char* cmd)
   : OvmsNotifyEntry(subtype)
@@ -264,40 +273,120 @@ OvmsNotifyType::OvmsNotifyType(const char* name)
   {
   m_name = name;
   m_nextid = 1;
+  m_mutex.SetName("notify.type");
+  m_cap = 0;
+  m_queuedbytes = 0;
+  m_maxbytes = 0;
+  m_queued = 0;
+  m_dropped = 0;
+  m_delivered = 0;
+  m_latency_max = 0;
+  m_latency_sum = 0;
   }
 
 OvmsNotifyType::~OvmsNotifyType()
   {
   }
 
+/**
+ * QueueEntry: add an entry & schedule the hand-off to the readers
+ *  The entry is owned by the type after the call. If the type's byte cap
+ *  would be exceeded, the entry is dropped and 0 is returned. Queued
+ *  entries are never discarded, as readers may hold references to them.
+ */
 uint32_t OvmsNotifyType::QueueEntry(OvmsNotifyEntry* entry)
   {
-  OvmsRecMutexLock lock(&m_mutex);
-  uint32_t id = m_nextid++;
+  uint32_t id;
+    {
+    OvmsRecMutexLock lock(&m_mutex);
 
-  entry->m_id = id;
-  entry->m_type = this;
-  m_entries[id] = entry;
+    size_t size = entry->GetValueSize();
+    if (m_cap && m_queuedbytes + size > m_cap)
+      {
+      // data records are lost for the server history, so log each of them:
+      if (strcmp(m_name, "data") == 0)
+        ESP_LOGW(TAG, "Type %s has %u bytes queued (cap %u): dropped %s record (%u dropped)",
+          m_name, m_queuedbytes, m_cap, entry->m_subtype, ++m_dropped);
+      else if ((m_dropped++ % 100) == 0)
+        ESP_LOGW(TAG, "Type %s has %u bytes queued (cap %u): dropped %u entries",
+          m_name, m_queuedbytes, m_cap, m_dropped);
+      delete entry;
+      return 0;
+      }
 
-  if (strcmp(m_name, "data") != 0 &&
-      strcmp(m_name, "stream") != 0)
-    {
-    std::string event("notify.");
-    event.append(m_name);
-    event.append(".");
-    event.append(entry->m_subtype);
-    MyEvents.SignalEvent(event, (void*)id);
+    id = m_nextid++;
+    entry->m_id = id;
+    entry->m_type = this;
+    m_entries[id] = entry;
+    m_pending.push_back(id);
+    m_queued++;
+    m_queuedbytes += size;
+    if (m_queuedbytes > m_maxbytes)
+      m_maxbytes = m_queuedbytes;
+
+    if (strcmp(m_name, "data") != 0 &&
+        strcmp(m_name, "stream") != 0)
+      {
+      std::string event("notify.");
+      event.append(m_name);
+      event.append(".");
+      event.append(entry->m_subtype);
+      MyEvents.SignalEvent(event, (void*)(intptr_t)id);
+      }
     }
 
-  // Dispatch the callbacks...
-  MyNotify.NotifyReaders(this, entry);
-
-  // Check if we can cleanup...
-  Cleanup(entry);
+  // Dispatch the callbacks (asynchronously):
+  MyNotify.RequestDispatch();
 
   return id;
   }
 
+/**
+ * Dispatch: hand queued entries to the readers (notification task)
+ *  Delivers up to max entries. The readers are called without holding
+ *  the mutex, the entries are held against cleanup meanwhile.
+ */
+int OvmsNotifyType::Dispatch(int max)
+  {
+  OvmsNotifyEntry* batch[NOTIFY_DISPATCH_BATCH];
+  int cnt = 0;
+    {
+    OvmsRecMutexLock lock(&m_mutex);
+    if (max > NOTIFY_DISPATCH_BATCH)
+      max = NOTIFY_DISPATCH_BATCH;
+    while (cnt < max && !m_pending.empty())
+      {
+      uint32_t id = m_pending.front();
+      m_pending.pop_front();
+      auto k = m_entries.find(id);
+      if (k == m_entries.end())
+        continue; // already read by all readers
+
+      OvmsNotifyEntry* entry = k->second;
+      uint32_t latency = esp_log_timestamp() - entry->m_created;
+      m_delivered++;
+      m_latency_sum += latency;
+      if (latency > m_latency_max)
+        m_latency_max = latency;
+
+      entry->m_pendingreaders |= NOTIFY_DISPATCH_HOLD;
+      batch[cnt++] = entry;
+      }
+    }
+
+  for (int i=0; i<cnt; i++)
+    MyNotify.NotifyReaders(this, batch[i]);
+
+  // Release the entries & check if we can cleanup...
+  OvmsRecMutexLock lock(&m_mutex);
+  for (int i=0; i<cnt; i++)
+    {
+    batch[i]->m_pendingreaders &= ~NOTIFY_DISPATCH_HOLD;
+    Cleanup(batch[i]);
+    }
+  return cnt;
+  }
+
 uint32_t OvmsNotifyType::AllocateNextID()
   {
   OvmsRecMutexLock lock(&m_mutex);
@@ -359,6 +448,7 @@ void OvmsNotifyType::Cleanup(OvmsNotifyEntry* entry, NotifyEntryMap_t::iterator*
       {
       NotifyEntryMap_t::iterator it = m_entries.erase(k);
       if (next) *next = it;
+      m_queuedbytes -= entry->GetValueSize();
       }
     if (MyNotify.m_trace && strcmp(m_name, "stream") != 0)
       ESP_LOGI(TAG,"Cleanup type %s id %d",m_name,entry->m_id);
@@ -379,6 +469,7 @@ OvmsNotifyCallbackEntry::OvmsNotifyCallbackEntry(const char* caller, size_t read
   m_callback = callback;
   m_configfiltered = configfiltered;
   m_filtercallback = filtercallback;
+  m_refs = 1;
   }
 
 OvmsNotifyCallbackEntry::~OvmsNotifyCallbackEntry()
@@ -408,14 +499,38 @@ bool OvmsNotifyCallbackEntry::Accepts(OvmsNotifyType* type, const char* subtype,
 
 
 ////////////////////////////////////////////////////////////////////////
-// OvmsNotifyCallbackEntry contains the callback function for a
-//
+// OvmsNotify is the notification framework. Entries are queued by the
+// raising task, the hand-off to the readers and the execution of
+// command notifications is done by the notification task.
+
+// Default queue byte caps per type in kB, override by config notify cap.<type>:
+//  data records are kept until delivered (entries are stored in SPIRAM)
+static int notify_default_cap(const char* type)
+  {
+  if (strcmp(type, "data") == 0)
+    return 0;
+  else if (strcmp(type, "stream") == 0)
+    return 32;
+  else
+    return 16;
+  }
+
+static void NotifyLaunchTask(void *pvParameters)
+  {
+  OvmsNotify* me = (OvmsNotify*)pvParameters;
+  me->NotifyTask();
+  }
 
 OvmsNotify::OvmsNotify()
   {
   ESP_LOGI(TAG, "Initialising NOTIFICATIONS (1820)");
 
   m_nextreader = 1;
+  m_mutex.SetName("notify");
+  m_dispatch_requested = false;
+  m_cmd_queued = 0;
+  m_cmd_dropped = 0;
+  m_cmd_time_max = 0;
 
 #ifdef CONFIG_OVMS_DEV_DEBUGNOTIFICATIONS
   m_trace = true;
@@ -445,6 +560,18 @@ OvmsNotify::OvmsNotify()
   RegisterType("data");     // payload: MP historical data record (tagged CSV, see MP documentation)
   RegisterType("stream");   // payload: subtype specific, use for high volume / short latency data streams
 
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  MyEvents.RegisterEvent(TAG, "config.mounted", std::bind(&OvmsNotify::EventListener, this, _1, _2));
+  MyEvents.RegisterEvent(TAG, "config.changed", std::bind(&OvmsNotify::EventListener, this, _1, _2));
+
+  m_jobqueue = xQueueCreate(CONFIG_OVMS_HW_NOTIFY_QUEUE_SIZE, sizeof(OvmsNotifyCommandJob_t*));
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  m_jobqueue_stats = OvmsContention::RegisterQueue(m_jobqueue, "notify.job");
+#endif
+  xTaskCreatePinnedToCore(NotifyLaunchTask, "OVMS Notify", 8192, (void*)this, 5, &m_taskid, CORE(1));
+  AddTaskToMap(m_taskid);
+
 #ifdef CONFIG_OVMS_SC_JAVASCRIPT_DUKTAPE
   ESP_LOGI(TAG, "Expanding DUKTAPE javascript engine");
   DuktapeObjectRegistration* dto = new DuktapeObjectRegistration("OvmsNotify");
@@ -457,6 +584,104 @@ OvmsNotify::~OvmsNotify()
   {
   }
 
+void OvmsNotify::ReadConfig()
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  for (OvmsNotifyTypeMap_t::iterator itm=m_types.begin(); itm!=m_types.end(); ++itm)
+    {
+    OvmsNotifyType* mt = itm->second;
+    std::string key("cap.");
+    key.append(mt->m_name);
+    int cap = MyConfig.GetParamValueInt("notify", key, notify_default_cap(mt->m_name));
+    OvmsRecMutexLock lock(&mt->m_mutex);
+    mt->m_cap = (cap > 0) ? cap * 1024 : 0;
+    }
+  }
+
+void OvmsNotify::EventListener(std::string event, void* data)
+  {
+  if (event == "config.mounted")
+    {
+    ReadConfig();
+    }
+  else if (event == "config.changed")
+    {
+    OvmsConfigParam* param = (OvmsConfigParam*) data;
+    if (param && param->GetName() == "notify")
+      ReadConfig();
+    }
+  }
+
+/**
+ * RequestDispatch: wake up the notification task to hand new entries
+ *  to the readers. Wakeups are merged until the task has started
+ *  the dispatch.
+ */
+void OvmsNotify::RequestDispatch()
+  {
+  OvmsRecMutexLock lock(&m_mutex);
+  if (m_dispatch_requested)
+    return;
+  m_dispatch_requested = true;
+  // a full queue will wake the task anyway:
+  OvmsNotifyCommandJob_t* wakeup = NULL;
+  xQueueSend(m_jobqueue, &wakeup, 0);
+  }
+
+void OvmsNotify::NotifyTask()
+  {
+  OvmsNotifyCommandJob_t* job;
+  while (true)
+    {
+    if (xQueueReceive(m_jobqueue, &job, portMAX_DELAY) != pdTRUE)
+      continue;
+    if (job)
+      {
+      ExecuteCommand(job);
+      free(job->subtype);
+      free(job->cmd);
+      delete job;
+      }
+    Dispatch();
+    }
+  }
+
+/**
+ * Dispatch: hand all queued entries to the readers
+ *  Entries are delivered in batches per type, the mutex is not held while
+ *  calling the readers, so they may raise notifications or (un)register.
+ */
+void OvmsNotify::Dispatch()
+  {
+  std::vector<OvmsNotifyType*> types;
+    {
+    OvmsRecMutexLock lock(&m_mutex);
+    types.reserve(m_types.size());
+    for (OvmsNotifyTypeMap_t::iterator itm=m_types.begin(); itm!=m_types.end(); ++itm)
+      types.push_back(itm->second);
+    }
+  int cnt;
+  do
+    {
+      {
+      OvmsRecMutexLock lock(&m_mutex);
+      m_dispatch_requested = false;
+      }
+    cnt = 0;
+    for (OvmsNotifyType* mt : types)
+      cnt += mt->Dispatch(NOTIFY_DISPATCH_BATCH);
+    } while (cnt > 0);
+  }
+
+/**
+ * ReleaseReader: drop a reference, the last one deletes the reader entry
+ */
+void OvmsNotify::ReleaseReader(OvmsNotifyCallbackEntry* mc)
+  {
+  if (--mc->m_refs == 0)
+    delete mc;
+  }
+
 size_t OvmsNotify::RegisterReader(const char* caller, int verbosity, OvmsNotifyCallback_t callback,
                                   bool configfiltered/*=false*/, OvmsNotifyFilterCallback_t filtercallback/*=NULL*/)
   {
@@ -472,6 +697,9 @@ void OvmsNotify::RegisterReader(size_t reader, const char* caller, int verbosity
                                 bool configfiltered/*=false*/, OvmsNotifyFilterCallback_t filtercallback/*=NULL*/)
   {
   OvmsRecMutexLock lock(&m_mutex);
+  auto k = m_readers.find(reader);
+  if (k != m_readers.end())
+    ReleaseReader(k->second);
   m_readers[reader] = new OvmsNotifyCallbackEntry(caller, reader, verbosity, callback, configfiltered, filtercallback);
   }
 
@@ -488,7 +716,7 @@ void OvmsNotify::ClearReader(size_t reader)
       }
     OvmsNotifyCallbackEntry* ec = k->second;
     m_readers.erase(k);
-    delete ec;
+    ReleaseReader(ec);
     }
   }
 
@@ -507,23 +735,46 @@ OvmsNotifyType* OvmsNotify::GetType(const char* type)
     return k->second;
   }
 
+/**
+ * NotifyReaders: deliver an entry to the readers
+ *  The readers are collected under the mutex, and called without it
+ *  holding a reference, so they may be cleared meanwhile. The caller
+ *  needs to hold the entry against cleanup.
+ */
 void OvmsNotify::NotifyReaders(OvmsNotifyType* type, OvmsNotifyEntry* entry)
   {
-  OvmsRecMutexLock lock(&m_mutex);
-  for (OvmsNotifyCallbackMap_t::iterator itc=m_readers.begin(); itc!=m_readers.end(); ++itc)
+  OvmsNotifyCallbackEntry* readers[NOTIFY_MAX_READERS];
+  int cnt = 0;
     {
-    OvmsNotifyCallbackEntry* mc = itc->second;
-    if (mc->Accepts(type, entry->GetSubType(), entry->GetValueSize()))
+    OvmsRecMutexLock lock(&m_mutex);
+    for (OvmsNotifyCallbackMap_t::iterator itc=m_readers.begin(); itc!=m_readers.end() && cnt<NOTIFY_MAX_READERS; ++itc)
       {
-      // deliver notification:
-      if (mc->m_callback(type,entry) == true)
+      OvmsNotifyCallbackEntry* mc = itc->second;
+      if (entry->IsRead(mc->m_reader))
+        {
+        // not addressed, or already read by polling
+        continue;
+        }
+      if (mc->Accepts(type, entry->GetSubType(), entry->GetValueSize()))
+        {
+        mc->m_refs++;
+        readers[cnt++] = mc;
+        }
+      else
+        {
+        // in case the acceptance filter changed since queueing:
         entry->m_pendingreaders &= ~(1ul << mc->m_reader);
+        }
       }
-    else
-      {
-      // in case the acceptance filter changed since queueing:
+    }
+
+  // deliver notification:
+  for (int i=0; i<cnt; i++)
+    {
+    OvmsNotifyCallbackEntry* mc = readers[i];
+    if (mc->m_callback(type,entry) == true)
       entry->m_pendingreaders &= ~(1ul << mc->m_reader);
-      }
+    ReleaseReader(mc);
     }
   }
 
@@ -542,10 +793,15 @@ bool OvmsNotify::HasReader(const char* type, const char* subtype, size_t size)
 
 void OvmsNotify::RegisterType(const char* type)
   {
+  OvmsRecMutexLock lock(&m_mutex);
   OvmsNotifyType* mt = GetType(type);
   if (mt == NULL)
     {
     mt = new OvmsNotifyType(type);
+    std::string key("cap.");
+    key.append(type);
+    int cap = MyConfig.GetParamValueInt("notify", key, notify_default_cap(type));
+    mt->m_cap = (cap > 0) ? cap * 1024 : 0;
     m_types[type] = mt;
     ESP_LOGI(TAG,"Registered notification type %s",type);
     }
@@ -588,6 +844,11 @@ uint32_t OvmsNotify::NotifyString(const char* type, const char* subtype, const c
   return mt->QueueEntry(msg);
   }
 
+/**
+ * NotifyCommand: queue a command notification for the notification task
+ *  - returns 1 if the command has been queued, 0 if not (the entry IDs are
+ *    assigned after execution)
+ */
 uint32_t OvmsNotify::NotifyCommand(const char* type, const char* subtype, const char* cmd)
   {
   OvmsRecMutexLock lock(&m_mutex);
@@ -598,28 +859,68 @@ uint32_t OvmsNotify::NotifyCommand(const char* type, const char* subtype, const
     return 0;
     }
 
-  if (m_trace && strcmp(type, "stream") != 0)
+  bool trace = (m_trace && strcmp(type, "stream") != 0);
+  if (trace)
     ESP_LOGI(TAG, "Raise command %s/%s: %s", type, subtype, cmd);
 
+  if (!trace && !HasReader(type, subtype))
+    {
+    ESP_LOGD(TAG, "Abort: no readers for type '%s' subtype '%s'", type, subtype);
+    return 0;
+    }
+
+  // The command is executed by the notification task, entry IDs are assigned
+  // when the entries are queued, so IDs keep the queue order readers rely on
+  // (i.e. server v2 resuming after the last ID sent):
+  OvmsNotifyCommandJob_t* job = new OvmsNotifyCommandJob_t;
+  job->type = mt;
+  job->subtype = strdup(subtype);
+  job->cmd = strdup(cmd);
+  job->created = esp_log_timestamp();
+
+  if (OVMS_QUEUE_SEND(m_jobqueue_stats, m_jobqueue, &job, 0) != pdTRUE)
+    {
+    if ((m_cmd_dropped++ % 10) == 0)
+      ESP_LOGW(TAG, "Command notification %s/%s dropped: queue full (%u dropped)", type, subtype, m_cmd_dropped);
+    free(job->subtype);
+    free(job->cmd);
+    delete job;
+    return 0;
+    }
+  m_cmd_queued++;
+
+  return 1;
+  }
+
+/**
+ * ExecuteCommand: create the entries for a command notification (notification task)
+ */
+void OvmsNotify::ExecuteCommand(OvmsNotifyCommandJob_t* job)
+  {
+  OvmsNotifyType* mt = job->type;
+  const char* type = mt->m_name;
+  const char* subtype = job->subtype;
+  const char* cmd = job->cmd;
+  bool trace = (m_trace && strcmp(type, "stream") != 0);
+
   // Strategy:
   //  to minimize RAM usage and command calls we try to reuse higher verbosity messages
   //  if their result length fits for lower verbosity readers as well.
 
   // get verbosity levels needed by readers accepting the message:
   std::map<int, OvmsNotifyEntryCommand*> verbosity_msgs;
-  std::bitset<NOTIFY_MAX_READERS> readers;
-  for (auto itc=m_readers.begin(); itc!=m_readers.end(); itc++)
     {
-    OvmsNotifyCallbackEntry* mc = itc->second;
-    if (mc->Accepts(mt, subtype))
+    OvmsRecMutexLock lock(&m_mutex);
+    for (auto itc=m_readers.begin(); itc!=m_readers.end(); itc++)
       {
-      verbosity_msgs[mc->m_verbosity] = NULL;
-      readers.set(mc->m_reader); // cache acceptance
+      OvmsNotifyCallbackEntry* mc = itc->second;
+      if (mc->Accepts(mt, subtype))
+        verbosity_msgs[mc->m_verbosity] = NULL;
       }
     }
   if (verbosity_msgs.size() == 0)
     {
-    if (m_trace && strcmp(type, "stream") != 0)
+    if (trace)
       {
       // no readers, but tracing enabled, so log command result:
       const int verbosity = COMMAND_RESULT_NORMAL;
@@ -628,10 +929,12 @@ uint32_t OvmsNotify::NotifyCommand(const char* type, const char* subtype, const
       delete msg;
       }
     ESP_LOGD(TAG, "Abort: no readers for type '%s' subtype '%s'", type, subtype);
-    return 0;
+    return;
     }
 
-  // fetch verbosity levels beginning at highest verbosity:
+  // fetch verbosity levels beginning at highest verbosity
+  // (without holding the mutex, commands may take some time):
+  uint32_t start = esp_log_timestamp();
   OvmsNotifyEntryCommand *msg = NULL;
   size_t msglen = 0;
   for (auto ritm=verbosity_msgs.rbegin(); ritm!=verbosity_msgs.rend(); ritm++)
@@ -649,39 +952,49 @@ uint32_t OvmsNotify::NotifyCommand(const char* type, const char* subtype, const
         {
         // create verbosity level message:
         msg = new OvmsNotifyEntryCommand(subtype, verbosity, cmd);
+        msg->m_created = job->created;
         msglen = msg->GetValueSize();
         verbosity_msgs[verbosity] = msg;
-        if (m_trace && strcmp(type, "stream") != 0)
+        if (trace)
           ESP_LOGI(TAG, "Raise cmdres[%d] %s/%s: %s", verbosity, type, subtype, msg->GetValue().c_str());
         }
       }
     }
+  uint32_t runtime = esp_log_timestamp() - start;
+
+  OvmsRecMutexLock lock(&m_mutex);
+  if (runtime > m_cmd_time_max)
+    m_cmd_time_max = runtime;
 
-  // add readers:
+  // add readers (readers may have changed during the execution):
   for (auto itc=m_readers.begin(); itc!=m_readers.end(); itc++)
     {
     OvmsNotifyCallbackEntry* mc = itc->second;
-    if (readers.test(mc->m_reader))
+    if (mc->Accepts(mt, subtype))
       {
-      msg = verbosity_msgs[mc->m_verbosity];
-      msg->m_pendingreaders |= (1ul << mc->m_reader);
+      auto k = verbosity_msgs.find(mc->m_verbosity);
+      if (k != verbosity_msgs.end())
+        k->second->m_pendingreaders |= (1ul << mc->m_reader);
       }
     }
 
   // queue all verbosity level messages beginning at lowest verbosity (fastest delivery):
   msg = NULL;
-  uint32_t queue_id = 0;
   for (auto itm=verbosity_msgs.begin(); itm!=verbosity_msgs.end(); itm++)
     {
     if (itm->second == msg)
       continue; // already queued
     msg = itm->second;
+    if (msg->IsAllRead())
+      {
+      // all readers of this verbosity level have gone:
+      delete msg;
+      continue;
+      }
     ESP_LOGD(TAG, "Created entry type '%s' subtype '%s' verbosity %d has %d readers pending",
              type, subtype, itm->first, msg->CountPending());
-    queue_id = mt->QueueEntry(msg);
+    mt->QueueEntry(msg);
     }
-
-  return queue_id;
   }
 
 
@@ -34,6 +34,7 @@
 #include <functional>
 #include <map>
 #include <list>
+#include <deque>
 #include <string>
 #include <bitset>
 #include <atomic>
@@ -41,9 +42,14 @@
 #include "ovms.h"
 #include "ovms_utils.h"
 #include "ovms_mutex.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 
 #define NOTIFY_MAX_READERS 32
 #define NOTIFY_ERROR_AUTOSUPPRESS 120 // Auto-suppress for 120 seconds
+#define NOTIFY_DISPATCH_BATCH 16      // Max entries handed to readers per lock cycle
+#define NOTIFY_DISPATCH_HOLD (1ul<<0) // Pending bit holding entries during hand-off (reader IDs start at 1)
 
 using namespace std;
 
@@ -103,6 +109,7 @@ class OvmsNotifyEntryCommand : public OvmsNotifyEntry
 
 typedef std::map<uint32_t, OvmsNotifyEntry*, std::less<uint32_t>,
   ExtRamAllocator<std::pair<const uint32_t, OvmsNotifyEntry*>>> NotifyEntryMap_t;
+typedef std::deque<uint32_t, ExtRamAllocator<uint32_t>> NotifyIdQueue_t;
 
 class OvmsNotifyType
   {
@@ -113,6 +120,7 @@ class OvmsNotifyType
   public:
     uint32_t QueueEntry(OvmsNotifyEntry* entry);
     uint32_t AllocateNextID();
+    int Dispatch(int max);
     void ClearReader(size_t reader);
     OvmsNotifyEntry* FirstUnreadEntry(size_t reader, uint32_t floor);
     OvmsNotifyEntry* FindEntry(uint32_t id);
@@ -125,7 +133,18 @@ class OvmsNotifyType
     const char* m_name;
     uint32_t m_nextid;
     NotifyEntryMap_t m_entries;
+    NotifyIdQueue_t m_pending;        // entries waiting for reader hand-off
     OvmsRecMutex m_mutex;
+
+  public:
+    size_t m_cap;                     // max bytes queued, 0 = unlimited
+    size_t m_queuedbytes;             // current payload bytes queued
+    size_t m_maxbytes;                // payload bytes high water mark
+    uint32_t m_queued;                // entries queued
+    uint32_t m_dropped;               // entries dropped due to cap
+    uint32_t m_delivered;             // entries handed to readers
+    uint32_t m_latency_max;           // ms from raise to hand-off
+    uint64_t m_latency_sum;           // ms
   };
 
 typedef std::function<bool(OvmsNotifyType*,OvmsNotifyEntry*)> OvmsNotifyCallback_t;
@@ -148,6 +167,7 @@ class OvmsNotifyCallbackEntry
     int m_verbosity;
     OvmsNotifyCallback_t m_callback;
     OvmsNotifyFilterCallback_t m_filtercallback;
+    std::atomic<int> m_refs;          // registration + callbacks in progress
   };
 
 typedef struct
@@ -164,6 +184,14 @@ typedef std::map<const char*, OvmsNotifyType*, CmpStrOp,
   ExtRamAllocator<std::pair<const char*, OvmsNotifyCallbackEntry*>>> OvmsNotifyTypeMap_t;
 typedef std::map<uint32_t, OvmsNotifyErrorCodeEntry_t*> OvmsNotifyErrorCodeMap_t;
 
+typedef struct
+  {
+  OvmsNotifyType* type;
+  char* subtype;
+  char* cmd;
+  uint32_t created;
+  } OvmsNotifyCommandJob_t;
+
 class OvmsNotify : public ExternalRamAllocated
   {
   public:
@@ -189,12 +217,34 @@ class OvmsNotify : public ExternalRamAllocated
     uint32_t NotifyCommandf(const char* type, const char* subtype, const char* fmt, ...);
     void NotifyErrorCode(uint32_t code, uint32_t data, bool raised, bool force=false);
 
+  public:
+    void ReadConfig();
+    void EventListener(std::string event, void* data);
+    void RequestDispatch();
+    void NotifyTask();
+
+  protected:
+    void Dispatch();
+    void ExecuteCommand(OvmsNotifyCommandJob_t* job);
+    void ReleaseReader(OvmsNotifyCallbackEntry* mc);
+
   public:
     OvmsNotifyCallbackMap_t m_readers;
     OvmsRecMutex m_mutex;
 
   protected:
     size_t m_nextreader;
+    TaskHandle_t m_taskid;
+    QueueHandle_t m_jobqueue;
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+    OvmsContentionStats* m_jobqueue_stats;
+#endif
+    bool m_dispatch_requested;
+
+  public:
+    uint32_t m_cmd_queued;            // command jobs queued
+    uint32_t m_cmd_dropped;           // command jobs dropped (queue full)
+    uint32_t m_cmd_time_max;          // ms command execution time
 
   public:
     OvmsNotifyTypeMap_t m_types;
@@ -151,6 +151,20 @@ Peripherals::Peripherals()
   m_mcp2515_swcan = new swcan("can4", m_spibus, VSPI_NODMA_HOST, 10000000, VSPI_PIN_MCP2515_SWCAN_CS, VSPI_PIN_MCP2515_SWCAN_INT, false);
 #endif // #ifdef CONFIG_OVMS_COMP_EXTERNAL_SWCAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+  // Virtual buses take the CAN bus slots not used by hardware drivers:
+  for (int k=0;k<CAN_MAXBUSES;k++)
+    {
+    static const char* name[CAN_MAXBUSES] = {"can1", "can2", "can3", "can4", "can5"};
+    m_vcan[k] = NULL;
+    if (MyPcpApp.FindDeviceByName(name[k]) == NULL)
+      {
+      ESP_LOGI(TAG, "  %s/vcan (VIRTUAL CAN BUS)", name[k]);
+      m_vcan[k] = new vcan(name[k]);
+      }
+    }
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_SDCARD
   ESP_LOGI(TAG, "  SD CARD");
   m_sdcard = new sdcard("sdcard", true, true, SDCARD_PIN_CD);
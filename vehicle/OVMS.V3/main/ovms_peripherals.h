@@ -51,6 +51,10 @@
 #include "esp32can.h"
 #endif // #ifdef CONFIG_OVMS_COMP_ESP32CAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+#include "vcan.h"
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_MAX7317
 #include "max7317.h"
 #endif // #ifdef CONFIG_OVMS_COMP_MAX7317
@@ -173,6 +177,10 @@ class Peripherals : public InternalRamAllocated
     swcan* m_mcp2515_swcan;
 #endif // #ifdef CONFIG_OVMS_COMP_EXTERNAL_SWCAN
 
+#ifdef CONFIG_OVMS_COMP_VCAN
+    vcan* m_vcan[CAN_MAXBUSES];
+#endif // #ifdef CONFIG_OVMS_COMP_VCAN
+
 #ifdef CONFIG_OVMS_COMP_SDCARD
     sdcard* m_sdcard;
 #endif // #ifdef CONFIG_OVMS_COMP_SDCARD
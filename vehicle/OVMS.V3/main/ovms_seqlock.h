@@ -0,0 +1,361 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __OVMS_SEQLOCK_H__
+#define __OVMS_SEQLOCK_H__
+
+#include <atomic>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * Lock free value stores: readers never block each other and never take a
+ * kernel object. Writers of the same store are serialized by a spin flag,
+ * so keep write sections short. Both use a single 32 bit atomic word, as
+ * the ESP32 only has native 32 bit atomics.
+ *
+ * Waiting is done by spinning & sleeping, there is no priority inheritance:
+ * a preempted lower priority task holding a store delays the waiter until
+ * it gets scheduled again. Readers never hold off writers of OvmsRcuValue.
+ */
+
+/**
+ * Wait for a lock free store: spin briefly, then sleep a tick so lower
+ * priority tasks holding the store can proceed.
+ */
+inline void OvmsSeqlockBackoff(int& spins)
+  {
+  if (++spins < 100)
+    taskYIELD();
+  else
+    vTaskDelay(1);
+  }
+
+/**
+ * OvmsSeqlock<T>: sequence lock for trivially copyable values
+ *  - the sequence is odd while a write is in progress
+ *  - readers copy the value and retry if the sequence changed meanwhile
+ */
+template <typename T>
+class OvmsSeqlock
+  {
+  public:
+    OvmsSeqlock() : m_seq(0), m_value() {}
+
+  public:
+    T Read() const
+      {
+      T value;
+      uint32_t seq;
+      int spins = 0;
+      while (true)
+        {
+        seq = m_seq.load(std::memory_order_acquire);
+        if (seq & 1)
+          {
+          OvmsSeqlockBackoff(spins);
+          continue;
+          }
+        value = m_value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_seq.load(std::memory_order_relaxed) == seq)
+          return value;
+        }
+      }
+
+    // Returns true if the value has been changed:
+    bool Write(const T& value)
+      {
+      BeginWrite();
+      bool modified = !(m_value == value);
+      if (modified)
+        m_value = value;
+      EndWrite();
+      return modified;
+      }
+
+  protected:
+    void BeginWrite()
+      {
+      int spins = 0;
+      uint32_t seq = m_seq.load(std::memory_order_relaxed);
+      while ((seq & 1) || !m_seq.compare_exchange_weak(seq, seq+1, std::memory_order_acquire))
+        {
+        OvmsSeqlockBackoff(spins);
+        seq = m_seq.load(std::memory_order_relaxed);
+        }
+      std::atomic_thread_fence(std::memory_order_release);
+      }
+    void EndWrite()
+      {
+      m_seq.fetch_add(1, std::memory_order_release);
+      }
+
+  protected:
+    std::atomic<uint32_t> m_seq;
+    T m_value;
+  };
+
+/**
+ * OvmsRcuValue<T>: copy on write store for values with heap storage
+ *  (strings, vectors, sets, maps), where a torn read could follow a freed
+ *  pointer.
+ *  - readers register on the active reader generation, then read the
+ *    current node in place
+ *  - writers fill a new node & publish it, the former node is retired and
+ *    reclaimed once both generations have been seen without readers after
+ *    retirement; the active generation is switched when the other one has
+ *    drained, so continuous readers cannot keep a node from being reclaimed
+ *  - writers never wait for readers: retired nodes are reclaimed by later
+ *    writes, one reclaimed node is kept to be reused with its capacity, so
+ *    steady state writes don't allocate
+ *  - no value is allocated until the first write, readers see T() before
+ *
+ * State word: bit 31 = write lock, bit 30 = active generation,
+ *  bits 0-14 / 15-29 = readers of generation 0 / 1.
+ */
+template <typename T>
+class OvmsRcuValue
+  {
+  public:
+    OvmsRcuValue() : m_value(NULL), m_retired(NULL), m_state(0) {}
+    ~OvmsRcuValue()
+      {
+      delete m_value.load();
+      FreeNodes(m_retired);
+      }
+
+  public:
+    // Call reader(const T&) on the current value:
+    template <typename Reader> void Read(Reader reader) const
+      {
+      int g = ReadLock();
+      Node* node = m_value.load();
+      reader(node ? node->value : Empty());
+      ReadUnlock(g);
+      }
+
+    T Get() const
+      {
+      T value;
+      Read([&value](const T& v) { value = v; });
+      return value;
+      }
+
+    // Replace the value, returns true if it has been changed:
+    bool Write(const T& value)
+      {
+      return Modify([&value](const T& cur, T& next)
+        {
+        if (cur == value)
+          return false;
+        next = value;
+        return true;
+        });
+      }
+
+    // Modify the value by modifier(const T& current, T& next): next is a
+    //  reused node with undefined content, to change the value the modifier
+    //  assigns the new value to next and returns true:
+    template <typename Modifier> bool Modify(Modifier modifier)
+      {
+      WriteLock();
+      Node* cur = m_value.load();
+      Node* node = Reclaim();
+      if (!node)
+        node = new Node();
+      bool modified = modifier(cur ? cur->value : Empty(), node->value);
+      if (modified)
+        {
+        m_value.store(node);
+        if (cur)
+          Retire(cur);
+        }
+      else
+        {
+        Keep(node);
+        }
+      WriteUnlock();
+      return modified;
+      }
+
+    // Sum sizer(const T&) plus the node size over all nodes held:
+    template <typename Sizer> size_t GetStorage(Sizer sizer)
+      {
+      WriteLock();
+      size_t size = 0;
+      Node* node = m_value.load();
+      if (node)
+        size += sizeof(Node) + sizer(node->value);
+      for (node = m_retired; node; node = node->next)
+        size += sizeof(Node) + sizer(node->value);
+      WriteUnlock();
+      return size;
+      }
+
+    // Wait until all former values have been reclaimed, i.e. no reader can
+    //  still access an object referenced by a former value:
+    void Synchronize()
+      {
+      int spins = 0;
+      while (true)
+        {
+        WriteLock();
+        Node* spare = Reclaim();
+        bool pending = false;
+        for (Node* node = m_retired; node; node = node->next)
+          pending |= (node->wait != 0);
+        if (spare)
+          Keep(spare);
+        WriteUnlock();
+        if (!pending)
+          return;
+        OvmsSeqlockBackoff(spins);
+        }
+      }
+
+  protected:
+    struct Node
+      {
+      Node() : next(NULL), wait(0) {}
+      T value;
+      Node* next;
+      uint32_t wait;      // generations to be seen drained (bit 0 / 1)
+      };
+
+    static const uint32_t WRITING = 1u << 31;
+    static const uint32_t ACTIVE = 1u << 30;
+    static uint32_t Reader(int g) { return g ? (1u << 15) : 1u; }
+    static uint32_t Drained(uint32_t state)
+      {
+      return ((state & 0x7fff) ? 0 : 1) | (((state >> 15) & 0x7fff) ? 0 : 2);
+      }
+    static const T& Empty()
+      {
+      static const T empty{};
+      return empty;
+      }
+    static void FreeNodes(Node* node)
+      {
+      while (node)
+        {
+        Node* next = node->next;
+        delete node;
+        node = next;
+        }
+      }
+
+    int ReadLock() const
+      {
+      // Register on the active generation; if it has been switched meanwhile,
+      //  retry, so the former one can drain:
+      while (true)
+        {
+        int g = (m_state.load() & ACTIVE) ? 1 : 0;
+        uint32_t state = m_state.fetch_add(Reader(g));
+        if (((state & ACTIVE) ? 1 : 0) == g)
+          return g;
+        m_state.fetch_sub(Reader(g));
+        }
+      }
+    void ReadUnlock(int g) const
+      {
+      m_state.fetch_sub(Reader(g));
+      }
+
+    void WriteLock()
+      {
+      int spins = 0;
+      while (m_state.fetch_or(WRITING) & WRITING)
+        OvmsSeqlockBackoff(spins);
+      }
+    void WriteUnlock()
+      {
+      m_state.fetch_and(~WRITING);
+      }
+
+    // Add a node to the retired list, it needs to be seen drained in all
+    //  generations having readers now (after it has been unpublished):
+    void Retire(Node* node)
+      {
+      node->wait = 3 & ~Drained(m_state.load());
+      node->next = m_retired;
+      m_retired = node;
+      }
+
+    // Keep an unpublished node for reuse:
+    void Keep(Node* node)
+      {
+      node->wait = 0;
+      node->next = m_retired;
+      m_retired = node;
+      }
+
+    // Reclaim drained nodes: returns one for reuse (or NULL), frees the others.
+    //  Switches the active generation if nodes wait for it to drain and the
+    //  other generation has drained:
+    Node* Reclaim()
+      {
+      uint32_t state = m_state.load();
+      uint32_t drained = Drained(state);
+      uint32_t active = (state & ACTIVE) ? 2 : 1;
+      uint32_t waiting = 0;
+      Node* spare = NULL;
+      Node** link = &m_retired;
+      while (Node* node = *link)
+        {
+        node->wait &= ~drained;
+        if (node->wait)
+          {
+          waiting |= node->wait;
+          link = &node->next;
+          continue;
+          }
+        *link = node->next;
+        if (spare)
+          delete node;
+        else
+          spare = node;
+        }
+      if ((waiting & active) && (drained & ~active & 3))
+        m_state.fetch_xor(ACTIVE);
+      if (spare)
+        spare->next = NULL;
+      return spare;
+      }
+
+  protected:
+    std::atomic<Node*> m_value;
+    Node* m_retired;                  // former values & spare, owned by the writer
+    mutable std::atomic<uint32_t> m_state;
+  };
+
+#endif //#ifndef __OVMS_SEQLOCK_H__
@@ -0,0 +1,556 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms_log.h"
+static const char *TAG = "tracer";
+
+#include <string.h>
+#include <errno.h>
+#include <set>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "ovms.h"
+#include "ovms_tracer.h"
+#include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_utils.h"
+
+#ifdef CONFIG_OVMS_DEV_TRACER
+
+// Guards the ring indices (m_head, m_tail, m_dropped) against concurrent
+//  task, ISR & flush access:
+static portMUX_TYPE tracer_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+OvmsTracer MyTracer __attribute__ ((init_priority (1150)));
+
+OvmsTracer::OvmsTracer()
+  {
+  ESP_LOGI(TAG, "Initialising TRACER (1150)");
+
+  m_running = false;
+  m_names.push_back("?");
+  m_nameids["?"] = 0;
+  m_nameswritten = 0;
+  m_ring = NULL;
+  m_size = 0;
+  m_head = m_tail = m_dropped = 0;
+  m_task = NULL;
+  m_file = NULL;
+  m_period = 0;
+  m_starttime = 0;
+  m_written = 0;
+  m_droptotal = 0;
+  m_totalruntime = 0;
+  }
+
+OvmsTracer::~OvmsTracer()
+  {
+  Stop();
+  }
+
+/**
+ * Intern: get the id of a name, register if new
+ *  (not from ISR, ids are permanent)
+ */
+uint16_t OvmsTracer::Intern(const char* name)
+  {
+  OvmsMutexLock lock(&m_namemutex);
+  auto it = m_nameids.find(name);
+  if (it != m_nameids.end())
+    return it->second;
+  if (m_names.size() > 0xffff)
+    return 0;
+  uint16_t id = m_names.size();
+  m_names.push_back(name);
+  m_nameids[name] = id;
+  return id;
+  }
+
+static inline IRAM_ATTR void tracer_add(ovms_trace_record_t* ring, uint32_t size, uint32_t& head, uint32_t tail,
+  uint32_t& dropped, ovms_trace_type_t type, uint16_t id, uint16_t task, uint32_t value)
+  {
+  if (!ring)
+    return;
+  if (head - tail >= size)
+    {
+    dropped++;
+    return;
+    }
+  ovms_trace_record_t* rec = &ring[head & (size-1)];
+  rec->time = (uint32_t) esp_timer_get_time();
+  rec->type = type;
+  rec->core = xPortGetCoreID();
+  rec->id = id;
+  rec->task = task;
+  rec->reserved = 0;
+  rec->value = value;
+  head++;
+  }
+
+void OvmsTracer::Record(ovms_trace_type_t type, uint16_t id, uint32_t value)
+  {
+  uint16_t task = uxTaskGetTaskNumber(xTaskGetCurrentTaskHandle());
+  portENTER_CRITICAL(&tracer_spinlock);
+  tracer_add(m_ring, m_size, m_head, m_tail, m_dropped, type, id, task, value);
+  portEXIT_CRITICAL(&tracer_spinlock);
+  }
+
+void IRAM_ATTR OvmsTracer::RecordFromISR(ovms_trace_type_t type, uint16_t id, uint32_t value)
+  {
+  portENTER_CRITICAL_ISR(&tracer_spinlock);
+  tracer_add(m_ring, m_size, m_head, m_tail, m_dropped, type, id, OVMS_TRACE_NOTASK, value);
+  portEXIT_CRITICAL_ISR(&tracer_spinlock);
+  }
+
+bool OvmsTracer::Start(const char* path, uint32_t size, uint32_t period, std::string& error)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (m_running)
+    {
+    error = "tracer already running to " + m_path;
+    return false;
+    }
+  if (MyConfig.ProtectedPath(path))
+    {
+    error = "protected path";
+    return false;
+    }
+
+  // Round up ring size to a power of 2:
+  uint32_t n = 64;
+  while (n < size && n < 16384) n <<= 1;
+  ovms_trace_record_t* ring = (ovms_trace_record_t*) heap_caps_malloc(n * sizeof(ovms_trace_record_t),
+    MALLOC_CAP_INTERNAL|MALLOC_CAP_8BIT);
+  if (!ring)
+    {
+    error = "out of memory";
+    return false;
+    }
+
+  m_file = fopen(path, "w");
+  if (!m_file)
+    {
+    heap_caps_free(ring);
+    error = std::string("can't open ") + path + ": " + strerror(errno);
+    return false;
+    }
+
+  m_path = path;
+  m_period = (period < 10) ? 10 : period;
+  m_starttime = esp_timer_get_time();
+  m_written = 0;
+  m_droptotal = 0;
+  m_nameswritten = 0;
+  m_runtime.clear();
+  m_totalruntime = 0;
+
+  ovms_trace_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, OVMS_TRACE_MAGIC, sizeof(header.magic));
+  header.version = OVMS_TRACE_VERSION;
+  header.recordsize = sizeof(ovms_trace_record_t);
+  header.starttime = m_starttime;
+  header.period = m_period;
+  fwrite(&header, sizeof(header), 1, m_file);
+
+  // Take the run time baseline:
+  SampleTasks();
+
+  portENTER_CRITICAL(&tracer_spinlock);
+  m_ring = ring;
+  m_size = n;
+  m_head = m_tail = m_dropped = 0;
+  portEXIT_CRITICAL(&tracer_spinlock);
+
+  m_running = true;
+  xTaskCreatePinnedToCore(TracerTask, "OVMS Tracer", 4096, (void*)this, 10, &m_task, CORE(1));
+  ESP_LOGI(TAG, "Tracing to %s, %u records buffer, %u ms period", m_path.c_str(), m_size, m_period);
+  return true;
+  }
+
+void OvmsTracer::Stop()
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (!m_running)
+    return;
+  m_running = false;
+  xTaskNotifyGive(m_task);
+  m_stopped.Take();
+  m_task = NULL;
+
+  SampleTasks();
+  Flush();
+  fclose(m_file);
+  m_file = NULL;
+
+  portENTER_CRITICAL(&tracer_spinlock);
+  ovms_trace_record_t* ring = m_ring;
+  m_ring = NULL;
+  portEXIT_CRITICAL(&tracer_spinlock);
+  heap_caps_free(ring);
+  ESP_LOGI(TAG, "Tracing stopped: %u records written to %s, %u dropped",
+    m_written, m_path.c_str(), m_droptotal);
+  }
+
+void OvmsTracer::TracerTask(void* param)
+  {
+  OvmsTracer* me = (OvmsTracer*)param;
+  TickType_t period = pdMS_TO_TICKS(me->m_period);
+  while (me->m_running)
+    {
+    ulTaskNotifyTake(pdTRUE, period);
+    if (!me->m_running) break;
+    me->SampleTasks();
+    me->Flush();
+    }
+  me->m_stopped.Give();
+  vTaskDelete(NULL);
+  }
+
+/**
+ * SampleTasks: add run time deltas of all tasks active since the last sample
+ */
+void OvmsTracer::SampleTasks()
+  {
+  UBaseType_t cnt = uxTaskGetNumberOfTasks() + 4;
+  std::vector<TaskStatus_t> tasks(cnt);
+  uint32_t total;
+  cnt = uxTaskGetSystemState(tasks.data(), cnt, &total);
+  bool baseline = m_runtime.empty();
+  for (UBaseType_t i = 0; i < cnt; i++)
+    {
+    TaskStatus_t& ts = tasks[i];
+    auto it = m_runtime.find(ts.xTaskNumber);
+    // (tasks created since the last sample: all run time is new)
+    uint32_t delta = (it != m_runtime.end()) ? ts.ulRunTimeCounter - it->second
+      : (baseline ? 0 : ts.ulRunTimeCounter);
+    m_runtime[ts.xTaskNumber] = ts.ulRunTimeCounter;
+    if (delta > 0)
+      {
+      uint16_t id = Intern(ts.pcTaskName);
+      portENTER_CRITICAL(&tracer_spinlock);
+      tracer_add(m_ring, m_size, m_head, m_tail, m_dropped, TRACE_TaskRun, id, ts.xTaskNumber, delta);
+      portEXIT_CRITICAL(&tracer_spinlock);
+      }
+    }
+  if (!baseline)
+    {
+    portENTER_CRITICAL(&tracer_spinlock);
+    tracer_add(m_ring, m_size, m_head, m_tail, m_dropped, TRACE_TaskTotal, 0, 0, total - m_totalruntime);
+    portEXIT_CRITICAL(&tracer_spinlock);
+    }
+  m_totalruntime = total;
+  }
+
+void OvmsTracer::WriteName(uint16_t id, const std::string& name)
+  {
+  ovms_trace_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.type = TRACE_Name;
+  rec.id = id;
+  rec.value = name.size();
+  fwrite(&rec, sizeof(rec), 1, m_file);
+  char pad[sizeof(rec)];
+  memset(pad, 0, sizeof(pad));
+  fwrite(name.data(), 1, name.size(), m_file);
+  size_t rest = name.size() % sizeof(rec);
+  if (rest) fwrite(pad, 1, sizeof(rec) - rest, m_file);
+  }
+
+/**
+ * Flush: write new names & buffered records to the trace file
+ *  Records are complete up to the head snapshot and not touched by the
+ *  producers until the tail is advanced, so we can write without locking.
+ */
+void OvmsTracer::Flush()
+  {
+  portENTER_CRITICAL(&tracer_spinlock);
+  uint32_t head = m_head, tail = m_tail, dropped = m_dropped;
+  m_dropped = 0;
+  portEXIT_CRITICAL(&tracer_spinlock);
+  if (!m_ring || !m_file)
+    return;
+
+  // Names interned before the head snapshot:
+  {
+  OvmsMutexLock lock(&m_namemutex);
+  for (; m_nameswritten < m_names.size(); m_nameswritten++)
+    WriteName(m_nameswritten, m_names[m_nameswritten]);
+  }
+
+  if (dropped)
+    {
+    ovms_trace_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.time = (uint32_t) esp_timer_get_time();
+    rec.type = TRACE_Drop;
+    rec.task = OVMS_TRACE_NOTASK;
+    rec.value = dropped;
+    fwrite(&rec, sizeof(rec), 1, m_file);
+    m_droptotal += dropped;
+    }
+
+  while (tail != head)
+    {
+    uint32_t index = tail & (m_size-1);
+    uint32_t n = std::min(head - tail, m_size - index);
+    fwrite(&m_ring[index], sizeof(ovms_trace_record_t), n, m_file);
+    tail += n;
+    m_written += n;
+    }
+  fflush(m_file);
+
+  portENTER_CRITICAL(&tracer_spinlock);
+  m_tail = tail;
+  portEXIT_CRITICAL(&tracer_spinlock);
+  }
+
+void OvmsTracer::Status(OvmsWriter* writer)
+  {
+  OvmsMutexLock lock(&m_mutex);
+  if (!m_running)
+    {
+    writer->printf("Tracer: stopped, %d names\n", (int) m_names.size());
+    if (!m_path.empty())
+      writer->printf("Last trace: %s, %u records, %u dropped\n", m_path.c_str(), m_written, m_droptotal);
+    return;
+    }
+  portENTER_CRITICAL(&tracer_spinlock);
+  uint32_t fill = m_head - m_tail, dropped = m_dropped;
+  portEXIT_CRITICAL(&tracer_spinlock);
+  writer->printf("Tracer: running for %.1f s to %s\n",
+    (float)(esp_timer_get_time() - m_starttime) / 1000000, m_path.c_str());
+  writer->printf("Buffer: %u/%u records, period %u ms\n", fill, m_size, m_period);
+  writer->printf("Written: %u records, %u dropped, %d names\n", m_written, m_droptotal + dropped, (int) m_names.size());
+  }
+
+/**
+ * Export: convert a trace file to Chrome trace event JSON
+ *  - spans are shown as slices on their task's track, ISRs & marks as instants
+ *  - task run times are shown as CPU usage counters (% of one core)
+ */
+bool OvmsTracer::Export(const char* source, const char* dest, std::string& error)
+  {
+  FILE* in = fopen(source, "r");
+  if (!in)
+    {
+    error = std::string("can't open ") + source;
+    return false;
+    }
+  ovms_trace_header_t header;
+  if (fread(&header, sizeof(header), 1, in) != 1
+    || memcmp(header.magic, OVMS_TRACE_MAGIC, sizeof(header.magic)) != 0
+    || header.recordsize != sizeof(ovms_trace_record_t))
+    {
+    fclose(in);
+    error = std::string(source) + " is not an OVMS trace file";
+    return false;
+    }
+  FILE* out = fopen(dest, "w");
+  if (!out)
+    {
+    fclose(in);
+    error = std::string("can't open ") + dest;
+    return false;
+    }
+
+  std::vector<std::string> names;
+  std::set<uint16_t> tasknamed;
+  std::vector<ovms_trace_record_t> sample;
+  std::set<uint16_t> cpuactive, cpunow;
+  int64_t last = header.starttime;
+  ovms_trace_record_t rec;
+  auto name = [&](uint16_t id) -> std::string
+    {
+    return json_encode((id < names.size()) ? names[id] : std::string("?"));
+    };
+
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+    "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"OVMS\"}},\n"
+    "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"ISR\"}}",
+    OVMS_TRACE_NOTASK);
+
+  while (fread(&rec, sizeof(rec), 1, in) == 1)
+    {
+    if (rec.type == TRACE_Name)
+      {
+      if (rec.value > 0xffff)
+        break;
+      std::string text(rec.value, '\0');
+      size_t padded = (rec.value + sizeof(rec) - 1) / sizeof(rec) * sizeof(rec);
+      if (rec.value && fread(&text[0], 1, rec.value, in) != rec.value)
+        break;
+      fseek(in, padded - rec.value, SEEK_CUR);
+      if (names.size() <= rec.id) names.resize(rec.id + 1);
+      names[rec.id] = text;
+      continue;
+      }
+
+    // Extend time to 64 bit, records are in time order:
+    last += (int32_t)(rec.time - (uint32_t)last);
+    double ts = (double)(last - header.starttime);
+
+    switch (rec.type)
+      {
+      case TRACE_Begin:
+      case TRACE_End:
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.0f,\"pid\":1,\"tid\":%u}",
+          name(rec.id).c_str(), (rec.type == TRACE_Begin) ? 'B' : 'E', ts, rec.task);
+        break;
+      case TRACE_Isr:
+      case TRACE_Mark:
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.0f,\"pid\":1,\"tid\":%u,"
+          "\"args\":{\"value\":%u,\"core\":%u}}",
+          name(rec.id).c_str(), ts, rec.task, rec.value, rec.core);
+        break;
+      case TRACE_Drop:
+        fprintf(out, ",\n{\"name\":\"dropped\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.0f,\"pid\":1,"
+          "\"args\":{\"records\":%u}}", ts, rec.value);
+        break;
+      case TRACE_TaskRun:
+        if (tasknamed.insert(rec.task).second)
+          fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            rec.task, name(rec.id).c_str());
+        sample.push_back(rec);
+        break;
+      case TRACE_TaskTotal:
+        // End of sample period: output CPU usage counters, zero idle tasks
+        cpunow.clear();
+        for (auto& s : sample)
+          {
+          fprintf(out, ",\n{\"name\":\"cpu %s\",\"ph\":\"C\",\"ts\":%.0f,\"pid\":1,\"args\":{\"%%\":%.1f}}",
+            name(s.id).c_str(), ts, rec.value ? (double)s.value * 100 / rec.value : 0.0);
+          cpunow.insert(s.id);
+          }
+        for (uint16_t id : cpuactive)
+          {
+          if (cpunow.count(id) == 0)
+            fprintf(out, ",\n{\"name\":\"cpu %s\",\"ph\":\"C\",\"ts\":%.0f,\"pid\":1,\"args\":{\"%%\":0}}",
+              name(id).c_str(), ts);
+          }
+        cpuactive.swap(cpunow);
+        sample.clear();
+        break;
+      default:
+        break;
+      }
+    }
+
+  fprintf(out, "\n]}\n");
+  bool ok = (ferror(out) == 0);
+  fclose(out);
+  fclose(in);
+  if (!ok)
+    error = std::string("write error on ") + dest;
+  return ok;
+  }
+
+/**
+ * Commands
+ */
+
+static void tracer_start(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  uint32_t size = 512, period = 100;
+  const char* path = "/sd/trace.otr";
+  for (int i = 0; i < argc; i++)
+    {
+    if (strncmp(argv[i], "-b", 2) == 0 && argv[i][2])
+      size = atoi(argv[i]+2);
+    else if (strncmp(argv[i], "-p", 2) == 0 && argv[i][2])
+      period = atoi(argv[i]+2);
+    else
+      path = argv[i];
+    }
+  std::string error;
+  if (!MyTracer.Start(path, size, period, error))
+    writer->printf("Error: %s\n", error.c_str());
+  else
+    writer->printf("Tracing to %s\n", path);
+  }
+
+static void tracer_stop(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyTracer.Stop();
+  MyTracer.Status(writer);
+  }
+
+static void tracer_status(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  MyTracer.Status(writer);
+  }
+
+static void tracer_export(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  std::string dest;
+  if (argc > 1)
+    dest = argv[1];
+  else
+    {
+    dest = argv[0];
+    size_t dot = dest.rfind('.');
+    if (dot != std::string::npos && dest.find('/', dot) == std::string::npos)
+      dest.resize(dot);
+    dest += ".json";
+    }
+  if (MyConfig.ProtectedPath(argv[0]) || MyConfig.ProtectedPath(dest))
+    {
+    writer->puts("Error: protected path");
+    return;
+    }
+  std::string error;
+  if (!OvmsTracer::Export(argv[0], dest.c_str(), error))
+    writer->printf("Error: %s\n", error.c_str());
+  else
+    writer->printf("Exported to %s\n", dest.c_str());
+  }
+
+class OvmsTracerInit
+  {
+  public: OvmsTracerInit();
+} MyOvmsTracerInit  __attribute__ ((init_priority (5150)));
+
+OvmsTracerInit::OvmsTracerInit()
+  {
+  ESP_LOGI(TAG, "Initialising TRACER COMMANDS (5150)");
+
+  OvmsCommand* cmd_module = MyCommandApp.RegisterCommand("module","MODULE framework");
+  OvmsCommand* cmd_trace = cmd_module->RegisterCommand("trace","Task, event & ISR tracer");
+  cmd_trace->RegisterCommand("start","Start tracing to file",tracer_start,
+    "[-b<records>] [-p<period_ms>] [<path>]\n"
+    "Default: 512 records buffer, 100 ms period, /sd/trace.otr", 0, 3);
+  cmd_trace->RegisterCommand("stop","Stop tracing",tracer_stop);
+  cmd_trace->RegisterCommand("status","Show tracer status",tracer_status);
+  cmd_trace->RegisterCommand("export","Convert trace file to Chrome trace JSON",tracer_export,
+    "<path> [<json_path>]\n"
+    "View using chrome://tracing or https://ui.perfetto.dev", 1, 2);
+  }
+
+#endif // CONFIG_OVMS_DEV_TRACER
@@ -0,0 +1,208 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __OVMS_TRACER_H__
+#define __OVMS_TRACER_H__
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_OVMS_DEV_TRACER
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "ovms_mutex.h"
+#include "ovms_semaphore.h"
+
+class OvmsWriter;
+
+/**
+ * Trace file format (.otr), all values little endian:
+ *
+ *  - header: ovms_trace_header_t (32 bytes)
+ *  - records: ovms_trace_record_t (16 bytes)
+ *  - name table entries: a TRACE_Name record (id = name id, value = length)
+ *    followed by the name, zero padded to the record size. Names are written
+ *    before the first record referencing them.
+ *
+ * Record times are the lower 32 bits of esp_timer_get_time(), the reader
+ * extends them to 64 bit (records are written in time order).
+ *
+ * Export: "module trace export" converts to the Chrome trace event JSON format
+ * (chrome://tracing, https://ui.perfetto.dev).
+ */
+
+#define OVMS_TRACE_MAGIC      "OVMSTRC1"
+#define OVMS_TRACE_VERSION    1
+#define OVMS_TRACE_NOTASK     0xffff        // record from ISR
+
+typedef enum : uint8_t
+  {
+  TRACE_None = 0,
+  TRACE_Name,             // name table entry: id, value = length
+  TRACE_Begin,            // span begin: id = span name
+  TRACE_End,              // span end: id = span name
+  TRACE_Isr,              // ISR entry: id = ISR name, value = argument
+  TRACE_Mark,             // instant event: id = name, value = argument
+  TRACE_TaskRun,          // task sample: task, id = task name, value = run time delta
+  TRACE_TaskTotal,        // end of task sample period: value = total run time delta
+  TRACE_Drop,             // value = records lost by ring buffer overflows
+  } ovms_trace_type_t;
+
+typedef struct
+  {
+  uint32_t time;          // us (lower 32 bits)
+  uint8_t type;           // ovms_trace_type_t
+  uint8_t core;           // CPU core
+  uint16_t id;            // name id
+  uint16_t task;          // task number / OVMS_TRACE_NOTASK
+  uint16_t reserved;
+  uint32_t value;
+  } ovms_trace_record_t;
+
+typedef struct
+  {
+  char magic[8];          // OVMS_TRACE_MAGIC
+  uint32_t version;       // OVMS_TRACE_VERSION
+  uint32_t recordsize;    // sizeof(ovms_trace_record_t)
+  uint64_t starttime;     // us, esp_timer_get_time()
+  uint32_t period;        // task sample period, ms
+  uint32_t reserved;
+  } ovms_trace_header_t;
+
+/**
+ * OvmsTracer: task CPU, ISR, event & span tracer
+ *
+ * Trace points add records to a ring buffer in internal RAM (so they can be
+ * used in IRAM interrupt handlers), the tracer task samples the task run
+ * time counters and streams the buffer to the trace file every period.
+ * Trace points cost a single flag test while the tracer is stopped.
+ */
+class OvmsTracer
+  {
+  public:
+    OvmsTracer();
+    ~OvmsTracer();
+
+  public:
+    bool Start(const char* path, uint32_t size, uint32_t period, std::string& error);
+    void Stop();
+    bool IsRunning() { return m_running; }
+    void Status(OvmsWriter* writer);
+
+  public:
+    uint16_t Intern(const char* name);
+    void Record(ovms_trace_type_t type, uint16_t id, uint32_t value=0);
+    void RecordFromISR(ovms_trace_type_t type, uint16_t id, uint32_t value=0);
+
+  public:
+    static bool Export(const char* source, const char* dest, std::string& error);
+
+  protected:
+    static void TracerTask(void* param);
+    void SampleTasks();
+    void Flush();
+    void WriteName(uint16_t id, const std::string& name);
+
+  public:
+    volatile bool m_running;
+
+  protected:
+    OvmsMutex m_mutex;                      // Start/Stop/Status
+    OvmsMutex m_namemutex;                  // name table
+    std::vector<std::string> m_names;       // by id
+    std::map<std::string, uint16_t> m_nameids;
+    size_t m_nameswritten;
+
+    ovms_trace_record_t* m_ring;
+    uint32_t m_size;                        // power of 2
+    uint32_t m_head;                        // records added
+    uint32_t m_tail;                        // records written
+    uint32_t m_dropped;
+
+    TaskHandle_t m_task;
+    OvmsSemaphore m_stopped;
+    FILE* m_file;
+    std::string m_path;
+    uint32_t m_period;                      // ms
+    int64_t m_starttime;
+    uint32_t m_written;                     // records written
+    uint32_t m_droptotal;
+    std::map<UBaseType_t, uint32_t> m_runtime;  // last task run time counters
+    uint32_t m_totalruntime;
+  };
+
+extern OvmsTracer MyTracer;
+
+/**
+ * OvmsTraceSpan: RAII span (see OVMS_TRACE_SPAN)
+ */
+class OvmsTraceSpan
+  {
+  public:
+    OvmsTraceSpan(uint16_t id) : m_id(id)
+      {
+      if (MyTracer.m_running) MyTracer.Record(TRACE_Begin, m_id);
+      }
+    ~OvmsTraceSpan()
+      {
+      if (MyTracer.m_running) MyTracer.Record(TRACE_End, m_id);
+      }
+  protected:
+    uint16_t m_id;
+  };
+
+// Trace points: names are interned once (static literals), ISRs need
+// an id interned beforehand (i.e. in the driver constructor).
+#define OVMS_TRACE_CONCAT2(a,b)       a##b
+#define OVMS_TRACE_CONCAT(a,b)        OVMS_TRACE_CONCAT2(a,b)
+#define OVMS_TRACE_SPAN(name) \
+  static uint16_t OVMS_TRACE_CONCAT(_trace_id_,__LINE__) = MyTracer.Intern(name); \
+  OvmsTraceSpan OVMS_TRACE_CONCAT(_trace_span_,__LINE__)(OVMS_TRACE_CONCAT(_trace_id_,__LINE__))
+#define OVMS_TRACE_MARK(name, value) \
+  do { if (MyTracer.m_running) { \
+    static uint16_t _trace_id = MyTracer.Intern(name); \
+    MyTracer.Record(TRACE_Mark, _trace_id, value); } } while (0)
+#define OVMS_TRACE_ISR(id, value) \
+  do { if (MyTracer.m_running) MyTracer.RecordFromISR(TRACE_Isr, id, value); } while (0)
+
+#else // CONFIG_OVMS_DEV_TRACER
+
+#define OVMS_TRACE_SPAN(name)
+#define OVMS_TRACE_MARK(name, value)
+#define OVMS_TRACE_ISR(id, value)
+
+#endif // CONFIG_OVMS_DEV_TRACER
+
+#endif //#ifndef __OVMS_TRACER_H__
@@ -47,7 +47,7 @@
 
 struct CmpStrOp
   {
-  bool operator()(char const *a, char const *b)
+  bool operator()(char const *a, char const *b) const
     {
     return std::strcmp(a, b) < 0;
     }
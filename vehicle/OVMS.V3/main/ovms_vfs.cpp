@@ -33,6 +33,8 @@ static const char *TAG = "vfs";
 
 #include <string>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -41,15 +43,387 @@ static const char *TAG = "vfs";
 #include <dirent.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <functional>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include "ovms.h"
+#include "ovms_malloc.h"
 #include "ovms_vfs.h"
 #include "ovms_config.h"
 #include "ovms_command.h"
+#include "ovms_peripherals.h"
 #include "crypt_md5.h"
 
 #ifdef CONFIG_OVMS_COMP_EDITOR
 #include "vfsedit.h"
 #endif // #ifdef CONFIG_OVMS_COMP_EDITOR
 
+/**
+ * VfsStreamReader: bulk file reader with double buffered read-ahead
+ */
+
+VfsStreamReader::VfsStreamReader(size_t bufsize /*=CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE*/)
+  {
+  // round up to full SD sectors:
+  m_maxbufsize = m_bufsize = (bufsize + 511) & ~511;
+  m_size = 0;
+  m_done = 0;
+  m_fd = -1;
+  for (int i = 0; i < VFS_STREAM_BUFCNT; i++)
+    m_buf[i] = NULL;
+  m_freequeue = NULL;
+  m_fullqueue = NULL;
+  m_readerdone = NULL;
+  m_readertask = NULL;
+  m_inline = false;
+  m_abort = false;
+  m_held = -1;
+  m_final = 0;
+  }
+
+VfsStreamReader::~VfsStreamReader()
+  {
+  Close();
+  }
+
+/**
+ * Open: open file & start reading ahead
+ */
+bool VfsStreamReader::Open(const char* path)
+  {
+  Close();
+
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  m_fd = open(path, O_RDONLY);
+  if (m_fd < 0)
+    return false;
+  m_size = st.st_size;
+  m_done = 0;
+  m_abort = false;
+  m_held = -1;
+  m_final = 1;
+
+  // Small files are read inline into a single buffer (one byte more than
+  // the file size, so the first read doesn't stop short of EOF):
+  int bufcnt = VFS_STREAM_BUFCNT;
+  m_bufsize = m_maxbufsize;
+  if (m_size < m_bufsize)
+    {
+    m_bufsize = (m_size + 512) & ~511;
+    bufcnt = 1;
+    }
+
+  // SDMMC transfers directly into DMA capable buffers, SPIRAM buffers
+  // need to be bounced sector by sector by the driver. Internal RAM is
+  // only used if enough is left for the system:
+  bool dma = (strncmp(path, "/sd/", 4) == 0) &&
+    heap_caps_get_free_size(MALLOC_CAP_DMA|MALLOC_CAP_INTERNAL) >= bufcnt * m_bufsize + VFS_STREAM_MINFREE;
+  while (!AllocBuffers(bufcnt, dma))
+    {
+    if (m_bufsize <= 512)
+      {
+      ESP_LOGE(TAG, "VfsStreamReader: out of memory (%d x %zu bytes)", bufcnt, m_bufsize);
+      Close();
+      return false;
+      }
+    m_bufsize = (m_bufsize / 2 + 511) & ~511;
+    }
+  if (bufcnt == 1)
+    {
+    m_inline = true;
+    return true;
+    }
+
+  m_freequeue = xQueueCreate(VFS_STREAM_BUFCNT, sizeof(int));
+  m_fullqueue = xQueueCreate(VFS_STREAM_BUFCNT, sizeof(block_t));
+  m_readerdone = xSemaphoreCreateBinary();
+  for (int i = 0; i < VFS_STREAM_BUFCNT; i++)
+    xQueueSend(m_freequeue, &i, 0);
+
+  if (xTaskCreatePinnedToCore(ReaderTaskEntry, "OVMS VfsRead", 3*1024, (void*)this, 6, &m_readertask, CORE(1)) != pdPASS)
+    {
+    ESP_LOGW(TAG, "VfsStreamReader: can't create reader task, reading inline");
+    m_readertask = NULL;
+    m_inline = true;
+    free(m_buf[1]);
+    m_buf[1] = NULL;
+    }
+  return true;
+  }
+
+/**
+ * AllocBuffers: allocate count buffers of m_bufsize, DMA capable if possible
+ */
+bool VfsStreamReader::AllocBuffers(int count, bool dma)
+  {
+  for (int i = 0; i < count; i++)
+    {
+    m_buf[i] = NULL;
+    if (dma)
+      m_buf[i] = (uint8_t*) heap_caps_malloc(m_bufsize, MALLOC_CAP_DMA|MALLOC_CAP_32BIT);
+    if (!m_buf[i])
+      m_buf[i] = (uint8_t*) ExternalRamMalloc(m_bufsize);
+    if (!m_buf[i])
+      {
+      FreeBuffers();
+      return false;
+      }
+    }
+  return true;
+  }
+
+void VfsStreamReader::FreeBuffers()
+  {
+  for (int i = 0; i < VFS_STREAM_BUFCNT; i++)
+    {
+    if (m_buf[i])
+      {
+      free(m_buf[i]);
+      m_buf[i] = NULL;
+      }
+    }
+  }
+
+void VfsStreamReader::ReaderTaskEntry(void *pvParameters)
+  {
+  VfsStreamReader* me = (VfsStreamReader*) pvParameters;
+  me->ReaderTask();
+  xSemaphoreGive(me->m_readerdone);
+  vTaskDelete(NULL);
+  }
+
+void VfsStreamReader::ReaderTask()
+  {
+  block_t block;
+  while (xQueueReceive(m_freequeue, &block.index, portMAX_DELAY) == pdTRUE)
+    {
+    if (m_abort)
+      break;
+    block.len = read(m_fd, m_buf[block.index], m_bufsize);
+    if (block.len < 0)
+      block.len = -1;
+    // Note: the full queue can hold all buffers, so this won't block:
+    xQueueSend(m_fullqueue, &block, portMAX_DELAY);
+    if (block.len <= 0)
+      break;
+    }
+  }
+
+/**
+ * Read: get next data block
+ *  - returns block length, 0 on EOF, -1 on error or VFS_STREAM_PENDING if
+ *    no block was available within maxwait
+ *  - the block stays valid until the next Read(), Release() or Close()
+ */
+ssize_t VfsStreamReader::Read(const uint8_t** data, TickType_t maxwait /*=portMAX_DELAY*/)
+  {
+  Release();
+  if (m_final <= 0)
+    return m_final;
+
+  if (m_inline)
+    {
+    ssize_t len = read(m_fd, m_buf[0], m_bufsize);
+    if (len <= 0)
+      {
+      m_final = (len < 0) ? -1 : 0;
+      return m_final;
+      }
+    m_done += len;
+    *data = m_buf[0];
+    return len;
+    }
+
+  block_t block;
+  if (xQueueReceive(m_fullqueue, &block, maxwait) != pdTRUE)
+    return VFS_STREAM_PENDING;
+  if (block.len <= 0)
+    {
+    m_final = block.len;
+    xQueueSend(m_freequeue, &block.index, 0);
+    return m_final;
+    }
+
+  m_held = block.index;
+  m_done += block.len;
+  *data = m_buf[block.index];
+  return block.len;
+  }
+
+/**
+ * Release: give back current data block for reading ahead
+ */
+void VfsStreamReader::Release()
+  {
+  if (m_held >= 0)
+    {
+    xQueueSend(m_freequeue, &m_held, 0);
+    m_held = -1;
+    }
+  }
+
+void VfsStreamReader::Close()
+  {
+  if (m_readertask)
+    {
+    // stop reader task: wake it up if waiting for a free buffer
+    m_abort = true;
+    int dummy = 0;
+    xQueueSend(m_freequeue, &dummy, 0);
+    xSemaphoreTake(m_readerdone, portMAX_DELAY);
+    m_readertask = NULL;
+    }
+  m_held = -1;
+  m_final = 0;
+  m_inline = false;
+  if (m_readerdone)
+    {
+    vSemaphoreDelete(m_readerdone);
+    m_readerdone = NULL;
+    }
+  if (m_fullqueue)
+    {
+    vQueueDelete(m_fullqueue);
+    m_fullqueue = NULL;
+    }
+  if (m_freequeue)
+    {
+    vQueueDelete(m_freequeue);
+    m_freequeue = NULL;
+    }
+  FreeBuffers();
+  if (m_fd >= 0)
+    {
+    close(m_fd);
+    m_fd = -1;
+    }
+  }
+
+/**
+ * Process: read all data, pass blocks to callback
+ *  - the callback may return false to abort
+ *  - returns the number of bytes processed or -1 on error/abort
+ */
+ssize_t VfsStreamReader::Process(VfsStreamCallback callback)
+  {
+  const uint8_t* data;
+  ssize_t len;
+  while ((len = Read(&data)) > 0)
+    {
+    if (!callback(data, len))
+      {
+      len = -1;
+      break;
+      }
+    }
+  Release();
+  return (len < 0) ? -1 : m_done;
+  }
+
+/**
+ * vfs_copy: bulk file copy
+ *  - returns the number of bytes copied or -1 on error
+ */
+ssize_t vfs_copy(const char* source, const char* target)
+  {
+  VfsStreamReader reader;
+  if (!reader.Open(source))
+    return -1;
+  int fd = open(target, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0)
+    return -1;
+  ssize_t res = reader.Process([fd](const uint8_t* data, size_t len) -> bool
+    {
+    return (write(fd, data, len) == (ssize_t)len);
+    });
+  if (close(fd) != 0)
+    res = -1;
+  return res;
+  }
+
+/**
+ * vfs_md5: calculate MD5 digest (16 bytes) of a file
+ *  - returns the file size or -1 on error
+ */
+ssize_t vfs_md5(const char* path, uint8_t* digest)
+  {
+  VfsStreamReader reader;
+  if (!reader.Open(path))
+    return -1;
+  OVMS_MD5_CTX* md5 = new OVMS_MD5_CTX;
+  OVMS_MD5_Init(md5);
+  ssize_t res = reader.Process([md5](const uint8_t* data, size_t len) -> bool
+    {
+    OVMS_MD5_Update(md5, data, len);
+    return true;
+    });
+  OVMS_MD5_Final(digest, md5);
+  delete md5;
+  return res;
+  }
+
+/**
+ * vfs_index_add: append an index point to the sparse time index of a file
+ */
+bool vfs_index_add(const char* path, off_t offset, const char* timestamp)
+  {
+  std::string idxpath = path;
+  idxpath.append(VFS_INDEX_SUFFIX);
+  FILE* f = fopen(idxpath.c_str(), "a");
+  if (!f)
+    return false;
+  fprintf(f, "%ld %.*s\n", (long) offset, VFS_TIMESTAMP_LEN, timestamp);
+  return (fclose(f) == 0);
+  }
+
+/**
+ * vfs_index_lookup: find a file offset at or before the first line logged at <timestamp>
+ *  - timestamp: "YYYY-MM-DD HH:MM:SS" (or a prefix of this)
+ *  - returns the offset to start scanning from, or -1 if there is no index
+ */
+off_t vfs_index_lookup(const char* path, const char* timestamp)
+  {
+  std::string idxpath = path;
+  idxpath.append(VFS_INDEX_SUFFIX);
+  FILE* f = fopen(idxpath.c_str(), "r");
+  if (!f)
+    return -1;
+  size_t tslen = MIN(strlen(timestamp), VFS_TIMESTAMP_LEN);
+  char line[64];
+  long offset;
+  off_t best = 0;
+  while (fgets(line, sizeof(line), f))
+    {
+    char* ts = strchr(line, ' ');
+    if (!ts || sscanf(line, "%ld", &offset) != 1)
+      continue;
+    if (strncmp(ts+1, timestamp, tslen) >= 0)
+      break;
+    best = offset;
+    }
+  fclose(f);
+  return best;
+  }
+
+/**
+ * vfs_is_timestamp: check for a log line timestamp "YYYY-MM-DD HH:MM:SS"
+ */
+static bool vfs_is_timestamp(const char* line)
+  {
+  for (int i = 0; i < VFS_TIMESTAMP_LEN; i++)
+    {
+    if (!line[i])
+      return false;
+    if (i == 4 || i == 7) { if (line[i] != '-') return false; }
+    else if (i == 10) { if (line[i] != ' ') return false; }
+    else if (i == 13 || i == 16) { if (line[i] != ':') return false; }
+    else if (!isdigit(line[i])) return false;
+    }
+  return true;
+  }
+
 void vfs_ls(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
   {
   DIR *dir;
@@ -117,19 +491,18 @@ void vfs_cat(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, cons
     return;
     }
 
-  FILE* f = fopen(argv[0], "r");
-  if (f == NULL)
+  VfsStreamReader reader;
+  if (!reader.Open(argv[0]))
     {
     writer->puts("Error: VFS file cannot be opened");
     return;
     }
 
-  char buf[512];
-  while(size_t n = fread(buf, sizeof(char), sizeof(buf), f))
+  reader.Process([writer](const uint8_t* data, size_t len) -> bool
     {
-    writer->write(buf, n);
-    }
-  fclose(f);
+    writer->write(data, len);
+    return true;
+    });
   }
 
 void vfs_head(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
@@ -181,35 +554,20 @@ void vfs_stat(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, con
     return;
     }
 
-  FILE* f = fopen(argv[0], "r");
-  if (f == NULL)
+  uint8_t rmd5[16];
+  ssize_t filesize = vfs_md5(argv[0], rmd5);
+  if (filesize < 0)
     {
     writer->puts("Error: VFS file cannot be opened");
     return;
     }
 
-  OVMS_MD5_CTX* md5 = new OVMS_MD5_CTX;
-  OVMS_MD5_Init(md5);
-  int filesize = 0;
-  uint8_t *buf = new uint8_t[512];
-  while(size_t n = fread(buf, sizeof(char), 512, f))
-    {
-    filesize += n;
-    OVMS_MD5_Update(md5, buf, n);
-    }
-  uint8_t* rmd5 = new uint8_t[16];
-  OVMS_MD5_Final(rmd5, md5);
-
   char dchecksum[33];
   sprintf(dchecksum,"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
     rmd5[0],rmd5[1],rmd5[2],rmd5[3],rmd5[4],rmd5[5],rmd5[6],rmd5[7],
     rmd5[8],rmd5[9],rmd5[10],rmd5[11],rmd5[12],rmd5[13],rmd5[14],rmd5[15]);
   writer->printf("File %s size is %d and digest %s\n",
-    argv[0],filesize,dchecksum);
-
-  delete [] rmd5;
-  delete [] buf;
-  fclose(f);
+    argv[0],(int)filesize,dchecksum);
   }
 
 void vfs_rm(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
@@ -285,28 +643,18 @@ void vfs_cp(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const
     return;
     }
 
-  FILE* f = fopen(argv[0], "r");
-  if (f == NULL)
+  struct stat st;
+  if (stat(argv[0], &st) != 0 || !S_ISREG(st.st_mode))
     {
     writer->puts("Error: VFS source file cannot be opened");
     return;
     }
 
-  FILE* w = fopen(argv[1], "w");
-  if (w == NULL)
+  if (vfs_copy(argv[0], argv[1]) < 0)
     {
-    writer->puts("Error: VFS target file cannot be opened");
-    fclose(f);
+    writer->puts("Error: VFS copy failed");
     return;
     }
-
-  char buf[512];
-  while(size_t n = fread(buf, sizeof(char), sizeof(buf), f))
-    {
-    fwrite(buf,n,1,w);
-    }
-  fclose(w);
-  fclose(f);
   writer->puts("VFS copy complete");
   }
 
@@ -332,14 +680,322 @@ void vfs_append(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, c
   }
 
 
+/**
+ * vfs grep: stream a file through a bounded line buffer, print matching lines
+ *  - lines longer than the buffer are matched on their first part only
+ *  - -t seeks via the sparse time index (if any) and skips lines logged before <time>
+ */
+
+static const char* vfs_strfind(const char* haystack, const char* needle, bool icase)
+  {
+  if (!icase)
+    return strstr(haystack, needle);
+  size_t nlen = strlen(needle);
+  for (; *haystack; haystack++)
+    {
+    if (strncasecmp(haystack, needle, nlen) == 0)
+      return haystack;
+    }
+  return (nlen == 0) ? haystack : NULL;
+  }
+
+void vfs_grep(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  bool icase = false, invert = false, count = false;
+  int maxcnt = 0;
+  const char* pattern = NULL;
+  const char* filename = NULL;
+  const char* timearg = NULL;
+
+  for (int i=0; i<argc; i++)
+    {
+    if (strcmp(argv[i], "-i") == 0)
+      icase = true;
+    else if (strcmp(argv[i], "-v") == 0)
+      invert = true;
+    else if (strcmp(argv[i], "-c") == 0)
+      count = true;
+    else if (strcmp(argv[i], "-m") == 0 && i+1 < argc)
+      maxcnt = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      timearg = argv[++i];
+    else if (!pattern)
+      pattern = argv[i];
+    else
+      filename = argv[i];
+    }
+
+  if (!pattern || !filename)
+    {
+    writer->puts("Error: pattern and filename required");
+    return;
+    }
+  if (MyConfig.ProtectedPath(filename))
+    {
+    writer->puts("Error: protected path");
+    return;
+    }
+
+  FILE* f = fopen(filename, "r");
+  if (f == NULL)
+    {
+    writer->puts("Error: VFS file cannot be opened");
+    return;
+    }
+
+  char buf[512];
+  std::string since;
+  if (timearg)
+    {
+    // time only: refers to the date of the first line in the file
+    since = timearg;
+    if (since.size() <= 8)
+      {
+      if (fgets(buf, sizeof(buf), f) && vfs_is_timestamp(buf))
+        since = std::string(buf, 11) + since;
+      rewind(f);
+      }
+    off_t offset = vfs_index_lookup(filename, since.c_str());
+    if (offset > 0)
+      fseek(f, offset, SEEK_SET);
+    if (verbosity >= COMMAND_RESULT_VERBOSE)
+      writer->printf("[grep: from '%s' at offset %ld%s]\n", since.c_str(), (long) MAX(offset, 0),
+        (offset < 0) ? ", no index" : "");
+    }
+
+  // match complete lines, getline() grows the buffer as needed:
+  int matchcnt = 0;
+  bool skipping = timearg;
+  char* line = NULL;
+  size_t linesize = 0;
+  ssize_t len;
+  while ((len = getline(&line, &linesize, f)) > 0)
+    {
+    if (skipping && vfs_is_timestamp(line))
+      skipping = (strncmp(line, since.c_str(), since.size()) < 0);
+    if (skipping || ((vfs_strfind(line, pattern, icase) != NULL) == invert))
+      continue;
+    matchcnt++;
+    if (!count)
+      {
+      writer->write(line, len);
+      if (line[len-1] != '\n')
+        writer->puts("");
+      }
+    if (maxcnt > 0 && matchcnt >= maxcnt)
+      break;
+    }
+  free(line);
+  fclose(f);
+
+  if (count)
+    writer->printf("%d\n", matchcnt);
+  }
+
+/**
+ * vfs index: (re)build the sparse time index for a timestamped log file
+ */
+void vfs_index(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  const char* filename = argv[0];
+  int interval = (argc > 1) ? atoi(argv[1]) : 64;
+  if (MyConfig.ProtectedPath(filename) || interval <= 0)
+    {
+    writer->puts("Error: invalid/protected path or interval");
+    return;
+    }
+
+  FILE* f = fopen(filename, "r");
+  if (f == NULL)
+    {
+    writer->puts("Error: VFS file cannot be opened");
+    return;
+    }
+  std::string idxpath = filename;
+  idxpath.append(VFS_INDEX_SUFFIX);
+  unlink(idxpath.c_str());
+
+  char buf[512];
+  off_t offset = 0, next = 0;
+  int entries = 0;
+  bool linestart = true;
+  while (fgets(buf, sizeof(buf), f) != NULL)
+    {
+    size_t len = strlen(buf);
+    if (linestart && offset >= next && vfs_is_timestamp(buf))
+      {
+      if (!vfs_index_add(filename, offset, buf))
+        {
+        writer->puts("Error: VFS index file cannot be written");
+        fclose(f);
+        return;
+        }
+      entries++;
+      next = offset + interval * 1024;
+      }
+    offset += len;
+    linestart = (len > 0 && buf[len-1] == '\n');
+    }
+  fclose(f);
+  writer->printf("Indexed %ld bytes, %d index points written to '%s'\n", (long) offset, entries, idxpath.c_str());
+  }
+
+
+/**
+ * vfs benchmark: compare bulk stream I/O with the classic 512 byte stdio loops
+ */
+
+static float vfs_bench_mbps(size_t bytes, int64_t us)
+  {
+  return (us > 0) ? (float) bytes / us : 0;
+  }
+
+static void vfs_bench_dir(OvmsWriter* writer, const char* dir, size_t size)
+  {
+  std::string src = std::string(dir) + "/.vfsbench.src";
+  std::string dst = std::string(dir) + "/.vfsbench.dst";
+  int64_t t0, t1;
+  char buf[512];
+  size_t n, total;
+
+  writer->printf("%s (%u KB, buffer size %u):\n", dir, size/1024, CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE);
+
+  // create test file:
+  int fd = open(src.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd < 0)
+    {
+    writer->printf("  Error: cannot create %s\n", src.c_str());
+    return;
+    }
+  uint8_t* wbuf = (uint8_t*) ExternalRamMalloc(CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE);
+  if (!wbuf)
+    {
+    writer->puts("  Error: out of memory");
+    close(fd);
+    return;
+    }
+  for (int i = 0; i < CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE; i++)
+    wbuf[i] = i * 7;
+  t0 = esp_timer_get_time();
+  for (total = 0; total < size; total += n)
+    {
+    n = MIN(size - total, CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE);
+    if (write(fd, wbuf, n) != (ssize_t)n)
+      break;
+    }
+  close(fd);
+  t1 = esp_timer_get_time();
+  free(wbuf);
+  if (total < size)
+    {
+    writer->puts("  Error: write failed (disk full?)");
+    unlink(src.c_str());
+    return;
+    }
+  writer->printf("  write           : %6.2f MB/s\n", vfs_bench_mbps(size, t1-t0));
+
+  // copy:
+  t0 = esp_timer_get_time();
+  FILE* f = fopen(src.c_str(), "r");
+  FILE* w = fopen(dst.c_str(), "w");
+  if (f && w)
+    {
+    while ((n = fread(buf, sizeof(char), sizeof(buf), f)) > 0)
+      fwrite(buf, n, 1, w);
+    }
+  if (w) fclose(w);
+  if (f) fclose(f);
+  t1 = esp_timer_get_time();
+  writer->printf("  copy    stdio   : %6.2f MB/s\n", vfs_bench_mbps(size, t1-t0));
+  unlink(dst.c_str());
+
+  t0 = esp_timer_get_time();
+  ssize_t res = vfs_copy(src.c_str(), dst.c_str());
+  t1 = esp_timer_get_time();
+  writer->printf("  copy    stream  : %6.2f MB/s%s\n", vfs_bench_mbps(size, t1-t0), (res < 0) ? " (failed)" : "");
+  unlink(dst.c_str());
+
+  // MD5:
+  uint8_t digest[16];
+  t0 = esp_timer_get_time();
+  f = fopen(src.c_str(), "r");
+  if (f)
+    {
+    OVMS_MD5_CTX* md5 = new OVMS_MD5_CTX;
+    OVMS_MD5_Init(md5);
+    while ((n = fread(buf, sizeof(char), sizeof(buf), f)) > 0)
+      OVMS_MD5_Update(md5, (uint8_t*)buf, n);
+    OVMS_MD5_Final(digest, md5);
+    delete md5;
+    fclose(f);
+    }
+  t1 = esp_timer_get_time();
+  writer->printf("  md5     stdio   : %6.2f MB/s\n", vfs_bench_mbps(size, t1-t0));
+
+  t0 = esp_timer_get_time();
+  res = vfs_md5(src.c_str(), digest);
+  t1 = esp_timer_get_time();
+  writer->printf("  md5     stream  : %6.2f MB/s%s\n", vfs_bench_mbps(size, t1-t0), (res < 0) ? " (failed)" : "");
+
+  // serve (read path of HTTP file transfers):
+  t0 = esp_timer_get_time();
+  f = fopen(src.c_str(), "r");
+  if (f)
+    {
+    while (fread(buf, sizeof(char), sizeof(buf), f) > 0)
+      ;
+    fclose(f);
+    }
+  t1 = esp_timer_get_time();
+  writer->printf("  serve   stdio   : %6.2f MB/s\n", vfs_bench_mbps(size, t1-t0));
+
+  t0 = esp_timer_get_time();
+  VfsStreamReader reader;
+  res = -1;
+  if (reader.Open(src.c_str()))
+    {
+    res = reader.Process([](const uint8_t* data, size_t len) -> bool { return true; });
+    reader.Close();
+    }
+  t1 = esp_timer_get_time();
+  writer->printf("  serve   stream  : %6.2f MB/s%s\n", vfs_bench_mbps(size, t1-t0), (res < 0) ? " (failed)" : "");
+
+  unlink(src.c_str());
+  }
+
+void vfs_benchmark(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  size_t sizekb = (argc > 1) ? atoi(argv[1]) : 0;
+  if (argc > 0)
+    {
+    if (MyConfig.ProtectedPath(argv[0]))
+      {
+      writer->puts("Error: protected path");
+      return;
+      }
+    vfs_bench_dir(writer, argv[0], (sizekb ? sizekb : 1024) * 1024);
+    return;
+    }
+
+#ifdef CONFIG_OVMS_COMP_SDCARD
+  if (MyPeripherals->m_sdcard->ismounted())
+    vfs_bench_dir(writer, "/sd", (sizekb ? sizekb : 1024) * 1024);
+  else
+    writer->puts("/sd: not mounted");
+#endif // #ifdef CONFIG_OVMS_COMP_SDCARD
+  vfs_bench_dir(writer, "/store", (sizekb ? sizekb : 256) * 1024);
+  }
+
+
 class VfsTailCommand : public OvmsCommandTask
   {
   using OvmsCommandTask::OvmsCommandTask;
   public:
     char* filename = NULL;
     int nrlines = 0;
+    bool follow = false;
     int fd = -1;
-    char buf[128];
+    char buf[512];
     off_t fpos;
     ssize_t len;
 
@@ -348,7 +1004,11 @@ class VfsTailCommand : public OvmsCommandTask
       // parse args:
       for (int i=0; i<argc; i++)
         {
-        if (argv[i][0] == '-')
+        if (strcmp(argv[i], "-f") == 0)
+          follow = true;
+        else if (strcmp(argv[i], "-n") == 0 && i+1 < argc)
+          nrlines = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
           nrlines = atoi(argv[i]+1);
         else
           filename = argv[i];
@@ -386,7 +1046,7 @@ class VfsTailCommand : public OvmsCommandTask
         }
 
       // determine run mode:
-      if (nrlines <= 0 && writer->IsInteractive())
+      if ((follow || nrlines <= 0) && writer->IsInteractive())
         {
         writer->puts("[tail: in follow mode, press Ctrl-C to abort]");
         return OCS_RunLoop;
@@ -407,6 +1067,11 @@ class VfsTailCommand : public OvmsCommandTask
           writer->puts("[tail: file lost, abort]");
           break;
           }
+        if (lseek(fd, 0, SEEK_END) < fpos)
+          {
+          writer->puts("[tail: file truncated, restarting]");
+          fpos = 0;
+          }
         lseek(fd, fpos, SEEK_SET);
         while ((len = read(fd, buf, sizeof buf)) > 0)
           writer->write(buf, len);
@@ -450,7 +1115,16 @@ VfsInit::VfsInit()
   cmd_vfs->RegisterCommand("mv","VFS Rename a file",vfs_mv, "<source> <target>", 2, 2);
   cmd_vfs->RegisterCommand("cp","VFS Copy a file",vfs_cp, "<source> <target>", 2, 2);
   cmd_vfs->RegisterCommand("append","VFS Append a line to a file",vfs_append, "<quoted line> <file>", 2, 2);
-  cmd_vfs->RegisterCommand("tail","VFS output tail of a file",VfsTailCommand::Execute, "[-nrlines] <file>", 1, 2);
+  cmd_vfs->RegisterCommand("tail","VFS output tail of a file",VfsTailCommand::Execute,
+    "[-n <nrlines> | -<nrlines>] [-f] <file>\n"
+    "Default: 10 lines, follow file appends on interactive consoles unless -n is given", 1, 4);
+  cmd_vfs->RegisterCommand("grep","VFS search lines in a file",vfs_grep,
+    "[-i] [-v] [-c] [-m <maxcnt>] [-t <time>] <pattern> <file>\n"
+    "-i: ignore case, -v: invert match, -c: count matches only, -m: stop after <maxcnt> matches\n"
+    "-t: start at log time [YYYY-MM-DD ]HH:MM[:SS] (using the file index, if available)\n"
+    "Use an empty pattern \"\" to match all lines", 2, 11);
+  cmd_vfs->RegisterCommand("index","VFS build time index for a log file",vfs_index, "<file> [<interval_kb>]\nDefault interval: 64 kB", 1, 2);
+  cmd_vfs->RegisterCommand("benchmark","VFS bulk I/O benchmark",vfs_benchmark, "[<dir> [<size_kb>]]", 0, 2);
   #ifdef CONFIG_OVMS_COMP_EDITOR
   cmd_vfs->RegisterCommand("edit","VFS edit a file",vfs_edit, "<path>", 1, 1);
   #endif // #ifdef CONFIG_OVMS_COMP_EDITOR
@@ -31,4 +31,100 @@
 #ifndef __VFS_H__
 #define __VFS_H__
 
+#include <stdint.h>
+#include <sys/types.h>
+#include <functional>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * VfsStreamReader: bulk file reader with double buffered read-ahead
+ *
+ * A reader task fills the next buffer while the caller processes the
+ * current one, so storage access overlaps with processing (hashing,
+ * flash writes, network transmission). Buffers are read using direct
+ * read() calls of the buffer size, bypassing the stdio buffering, which
+ * allows the SD driver to do multi sector transfers.
+ *
+ * Files fitting into one buffer are read inline by Read(), without the
+ * reader task. If internal RAM is low, buffers are taken from SPIRAM, if
+ * memory is low in general, the buffer size is reduced, and without memory
+ * for the reader task, all blocks are read inline.
+ *
+ * Usage:
+ *    VfsStreamReader reader;
+ *    if (reader.Open(path)) {
+ *      const uint8_t* data;
+ *      ssize_t len;
+ *      while ((len = reader.Read(&data)) > 0)
+ *        process(data, len);
+ *      reader.Close();
+ *    }
+ * …or simply use Process() with a callback.
+ */
+
+#define VFS_STREAM_BUFCNT       2
+#define VFS_STREAM_PENDING      -2      // Read(): no data available yet
+#define VFS_STREAM_MINFREE      32768   // internal RAM to leave free when allocating DMA buffers
+
+typedef std::function<bool(const uint8_t* data, size_t len)> VfsStreamCallback;
+
+class VfsStreamReader
+  {
+  public:
+    VfsStreamReader(size_t bufsize=CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE);
+    ~VfsStreamReader();
+
+  public:
+    bool Open(const char* path);
+    ssize_t Read(const uint8_t** data, TickType_t maxwait=portMAX_DELAY);
+    void Release();
+    void Close();
+    ssize_t Process(VfsStreamCallback callback);
+    bool IsOpen() { return m_fd >= 0; }
+
+  protected:
+    bool AllocBuffers(int count, bool dma);
+    void FreeBuffers();
+    static void ReaderTaskEntry(void *pvParameters);
+    void ReaderTask();
+
+  public:
+    size_t                m_bufsize;          // current buffer size
+    size_t                m_maxbufsize;       // configured buffer size
+    size_t                m_size;             // file size
+    size_t                m_done;             // bytes delivered to caller
+
+  protected:
+    typedef struct
+      {
+      int                 index;
+      ssize_t             len;                // 0 = EOF, -1 = error
+      } block_t;
+
+    int                   m_fd;
+    uint8_t*              m_buf[VFS_STREAM_BUFCNT];
+    QueueHandle_t         m_freequeue;        // buffers available for reading
+    QueueHandle_t         m_fullqueue;        // buffers ready for processing
+    SemaphoreHandle_t     m_readerdone;
+    TaskHandle_t          m_readertask;
+    bool                  m_inline;           // read by Read(), no reader task
+    volatile bool         m_abort;
+    int                   m_held;             // buffer held by caller, -1 = none
+    ssize_t               m_final;            // 1 = running, 0 = EOF, -1 = error
+  };
+
+extern ssize_t vfs_copy(const char* source, const char* target);
+extern ssize_t vfs_md5(const char* path, uint8_t* digest);
+
+// Sparse time index for timestamped log files: "<file>.idx" holds one line
+// "<offset> <YYYY-MM-DD HH:MM:SS>" per index point, offsets ascending.
+#define VFS_INDEX_SUFFIX        ".idx"
+#define VFS_TIMESTAMP_LEN       19
+
+extern bool vfs_index_add(const char* path, off_t offset, const char* timestamp);
+extern off_t vfs_index_lookup(const char* path, const char* timestamp);
+
 #endif //#ifndef __VFS_H__
@@ -0,0 +1,262 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host build test runner: executes the tests & benchmarks registered
+// by the test_*.cpp files (see hosttest.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include "host_platform.h"
+#include "ovms_config.h"
+#include "hosttest.h"
+
+struct HostTestEntry
+  {
+  std::string group;
+  std::string name;
+  HostTestFunction test;
+  HostBenchFunction bench;
+  };
+
+static std::vector<HostTestEntry>& HostTests()
+  {
+  static std::vector<HostTestEntry> tests;
+  return tests;
+  }
+
+HostTestRegistration::HostTestRegistration(const char* group, const char* name, HostTestFunction fn)
+  {
+  HostTests().push_back({ group, name, fn, NULL });
+  }
+
+HostTestRegistration::HostTestRegistration(const char* group, const char* name, HostBenchFunction fn)
+  {
+  HostTests().push_back({ group, name, NULL, fn });
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Tests
+
+HostTest::HostTest(const char* group, const char* name)
+  : m_group(group), m_name(name)
+  {
+  m_checks = 0;
+  m_failures = 0;
+  }
+
+bool HostTest::Check(bool ok, const char* file, int line, const char* expr)
+  {
+  m_checks++;
+  if (ok) return true;
+  m_failures++;
+  printf("    %s:%d: check failed: %s\n", file, line, expr);
+  return false;
+  }
+
+bool HostTest::Fail(const char* file, int line, const std::string& msg)
+  {
+  m_checks++;
+  m_failures++;
+  printf("    %s:%d: check failed: %s\n", file, line, msg.c_str());
+  return false;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+HostBench::HostBench(const char* group, const char* name, uint64_t iterations)
+  : m_group(group), m_name(name), n(iterations)
+  {
+  m_bytes = 0;
+  ResetTimer();
+  }
+
+void HostBench::ResetTimer()
+  {
+  m_start = host_timer_real();
+  }
+
+static void HostBenchRun(const HostTestEntry& entry, double mintime)
+  {
+  std::string fullname = entry.group + "." + entry.name;
+  uint64_t n = 1;
+  int64_t mintime_us = mintime * 1000000;
+  while (true)
+    {
+    HostBench bench(entry.group.c_str(), entry.name.c_str(), n);
+    entry.bench(bench);
+    int64_t elapsed = host_timer_real() - bench.m_start;
+    if (elapsed >= mintime_us || n >= 1000000000ULL)
+      {
+      double ns = (double)elapsed * 1000.0 / n;
+      printf("%-40s %12llu  %12.1f ns/op  %14.0f op/s",
+        fullname.c_str(), (unsigned long long)n, ns, (ns > 0) ? 1e9 / ns : 0.0);
+      if (bench.m_bytes)
+        printf("  %8.1f MB/s", (double)bench.m_bytes * n / elapsed);
+      printf("\n");
+      fflush(stdout);
+      return;
+      }
+    // Predict the iterations needed, grow by factor 2…100:
+    double factor = (elapsed > 0) ? (double)mintime_us * 1.2 / elapsed : 100.0;
+    factor = std::min(100.0, std::max(2.0, factor));
+    n = (uint64_t)(n * factor);
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Runner
+
+static bool HostTestMatch(const HostTestEntry& entry, const std::vector<std::string>& filters)
+  {
+  if (filters.empty()) return true;
+  std::string fullname = entry.group + "." + entry.name;
+  for (const std::string& filter : filters)
+    {
+    if (fullname.compare(0, filter.size(), filter) == 0)
+      return true;
+    }
+  return false;
+  }
+
+static void usage(const char* prog)
+  {
+  printf("Usage: %s test|bench|list [-v[v[v]]] [-t <seconds>] [-d <dir>] [<filter> ...]\n", prog);
+  printf("  test            run unit tests\n");
+  printf("  bench           run micro benchmarks\n");
+  printf("  list            list tests & benchmarks\n");
+  printf("  -v              log level info (-vv debug, -vvv verbose), default: warnings\n");
+  printf("  -t <seconds>    minimum time per benchmark, default 0.5\n");
+  printf("  -d <dir>        VFS root directory (kept), default: temporary directory\n");
+  printf("  <filter>        run only tests with <group>[.<name>] prefix\n");
+  }
+
+int main(int argc, char* argv[])
+  {
+  if (argc < 2)
+    {
+    usage(argv[0]);
+    return 2;
+    }
+  std::string mode = argv[1];
+  if (mode != "test" && mode != "bench" && mode != "list")
+    {
+    usage(argv[0]);
+    return 2;
+    }
+
+  esp_log_level_t loglevel = ESP_LOG_WARN;
+  double mintime = 0.5;
+  const char* vfsroot = NULL;
+  std::vector<std::string> filters;
+  for (int i = 2; i < argc; i++)
+    {
+    if (strncmp(argv[i], "-v", 2) == 0)
+      loglevel = (esp_log_level_t) std::min<int>(ESP_LOG_VERBOSE, ESP_LOG_WARN + strlen(argv[i]) - 1);
+    else if (strcmp(argv[i], "-t") == 0 && i+1 < argc)
+      mintime = atof(argv[++i]);
+    else if (strcmp(argv[i], "-d") == 0 && i+1 < argc)
+      vfsroot = argv[++i];
+    else if (argv[i][0] == '-')
+      {
+      usage(argv[0]);
+      return 2;
+      }
+    else
+      filters.push_back(argv[i]);
+    }
+
+  std::vector<HostTestEntry> entries;
+  for (const HostTestEntry& entry : HostTests())
+    {
+    if (((mode == "test" && entry.test) || (mode == "bench" && entry.bench) || mode == "list")
+        && HostTestMatch(entry, filters))
+      entries.push_back(entry);
+    }
+  std::sort(entries.begin(), entries.end(), [](const HostTestEntry& a, const HostTestEntry& b)
+    {
+    return (a.group != b.group) ? (a.group < b.group) : (a.name < b.name);
+    });
+
+  if (mode == "list")
+    {
+    for (const HostTestEntry& entry : entries)
+      printf("%-6s %s.%s\n", entry.test ? "test" : "bench", entry.group.c_str(), entry.name.c_str());
+    fflush(stdout);
+    _exit(0);
+    }
+
+  // Framework startup, as far as covered by the host build (see ovms_main.cpp):
+  host_log_level(loglevel);
+  if (!host_vfs_init(vfsroot))
+    {
+    fprintf(stderr, "Failed to initialise VFS root directory\n");
+    return 2;
+    }
+  MyConfig.mount();
+  MyConfig.RegisterParam("vehicle", "Vehicle", true, true);
+
+  int failed = 0;
+  if (mode == "test")
+    {
+    int checks = 0;
+    for (const HostTestEntry& entry : entries)
+      {
+      HostTest test(entry.group.c_str(), entry.name.c_str());
+      printf("%s.%s ...\n", entry.group.c_str(), entry.name.c_str());
+      fflush(stdout);
+      entry.test(test);
+      checks += test.m_checks;
+      if (test.m_failures)
+        {
+        printf("  FAILED (%d of %d checks)\n", test.m_failures, test.m_checks);
+        failed++;
+        }
+      }
+    printf("\n%d tests, %d checks, %d failed\n", (int)entries.size(), checks, failed);
+    }
+  else
+    {
+    printf("%-40s %12s  %15s  %17s\n", "Benchmark", "Iterations", "Time", "Rate");
+    for (const HostTestEntry& entry : entries)
+      HostBenchRun(entry, mintime);
+    }
+
+  // Framework tasks are still running, skip the global destructors
+  // (the firmware objects are not designed for destruction):
+  fflush(stdout);
+  fflush(stderr);
+  if (!vfsroot) host_vfs_cleanup();
+  _exit(failed ? 1 : 0);
+  }
@@ -0,0 +1,146 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#ifndef __HOSTTEST_H__
+#define __HOSTTEST_H__
+
+#include <stdint.h>
+#include <string>
+#include <sstream>
+
+/**
+ * Host build unit test & micro benchmark framework
+ *
+ * Tests:
+ *    HOST_TEST(group, name)
+ *      {
+ *      HOST_CHECK(expr);
+ *      HOST_CHECK_EQUAL(actual, expected);
+ *      }
+ *
+ * Benchmarks: the body is called with increasing iteration counts
+ * (bench.n) until the measurement takes at least the minimum time.
+ * Setup done before the loop can be excluded by bench.ResetTimer().
+ *    HOST_BENCH(group, name)
+ *      {
+ *      <setup>
+ *      bench.ResetTimer();
+ *      for (uint64_t i = 0; i < bench.n; i++)
+ *        <operation>
+ *      }
+ *
+ * Run by: ovms_host test|bench|list [<filter>...] (see hosttest.cpp)
+ */
+
+class HostTest
+  {
+  public:
+    HostTest(const char* group, const char* name);
+
+  public:
+    bool Check(bool ok, const char* file, int line, const char* expr);
+    bool Fail(const char* file, int line, const std::string& msg);
+
+  public:
+    std::string m_group;
+    std::string m_name;
+    int m_checks;
+    int m_failures;
+  };
+
+class HostBench
+  {
+  public:
+    HostBench(const char* group, const char* name, uint64_t n);
+
+  public:
+    void ResetTimer();
+    void SetBytes(uint64_t bytes) { m_bytes = bytes; }   // bytes processed per iteration
+
+  public:
+    std::string m_group;
+    std::string m_name;
+    const uint64_t n;
+    int64_t m_start;
+    uint64_t m_bytes;
+  };
+
+typedef void (*HostTestFunction)(HostTest& test);
+typedef void (*HostBenchFunction)(HostBench& bench);
+
+class HostTestRegistration
+  {
+  public:
+    HostTestRegistration(const char* group, const char* name, HostTestFunction fn);
+    HostTestRegistration(const char* group, const char* name, HostBenchFunction fn);
+  };
+
+#define HOST_TEST(group, name) \
+  static void host_test_##group##_##name(HostTest& test); \
+  static HostTestRegistration host_test_reg_##group##_##name(#group, #name, host_test_##group##_##name); \
+  static void host_test_##group##_##name(HostTest& test)
+
+#define HOST_BENCH(group, name) \
+  static void host_bench_##group##_##name(HostBench& bench); \
+  static HostTestRegistration host_bench_reg_##group##_##name(#group, #name, host_bench_##group##_##name); \
+  static void host_bench_##group##_##name(HostBench& bench)
+
+#define HOST_CHECK(expr) \
+  test.Check((expr), __FILE__, __LINE__, #expr)
+
+#define HOST_CHECK_EQUAL(actual, expected) \
+  do { \
+    auto _a = (actual); auto _e = (expected); \
+    if (!(_a == _e)) { \
+      std::ostringstream _msg; \
+      _msg << #actual << " == " << #expected << ": got [" << _a << "], expected [" << _e << "]"; \
+      test.Fail(__FILE__, __LINE__, _msg.str()); \
+      } \
+    else test.Check(true, __FILE__, __LINE__, #actual); \
+    } while (0)
+
+#define HOST_CHECK_NEAR(actual, expected, tolerance) \
+  do { \
+    double _a = (actual), _e = (expected); \
+    if (!(_a >= _e - (tolerance) && _a <= _e + (tolerance))) { \
+      std::ostringstream _msg; \
+      _msg << #actual << " ~ " << #expected << ": got [" << _a << "], expected [" << _e << "]"; \
+      test.Fail(__FILE__, __LINE__, _msg.str()); \
+      } \
+    else test.Check(true, __FILE__, __LINE__, #actual); \
+    } while (0)
+
+// Keep the optimizer from removing benchmarked computations:
+template <typename T> inline void HostBenchKeep(T const& value)
+  {
+  asm volatile("" : : "g"(&value) : "memory");
+  }
+
+#endif //#ifndef __HOSTTEST_H__
@@ -0,0 +1,35 @@
+/*
+ * Host build configuration
+ *
+ * Replaces the ESP-IDF generated sdkconfig.h for the host build.
+ * Only the platform independent core is enabled, hardware drivers,
+ * networking and scripting components are left out.
+ * Values follow support/sdkconfig.default.hw31.
+ */
+
+#ifndef __HOST_SDKCONFIG_H__
+#define __HOST_SDKCONFIG_H__
+
+#define CONFIG_OVMS_HOST_BUILD 1
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_FREERTOS_UNICORE 1
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+
+#define CONFIG_OVMS 1
+#define CONFIG_OVMS_HW_EVENT_QUEUE_SIZE 20
+#define CONFIG_OVMS_HW_NOTIFY_QUEUE_SIZE 20
+#define CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE 60
+#define CONFIG_OVMS_HW_CAN_TX_QUEUE_SIZE 20
+#define CONFIG_OVMS_SYS_COMMAND_STACK_SIZE 6144
+#define CONFIG_OVMS_SYS_COMMAND_WORKERS 3
+#define CONFIG_OVMS_LOGFILE_QUEUE_SIZE 100
+#define CONFIG_OVMS_LOGFILE_TASK_PRIORITY 2
+#define CONFIG_OVMS_SYS_VFS_STREAM_BUFSIZE 8192
+#define CONFIG_OVMS_VEHICLE_RXTASK_STACK 8192
+#define CONFIG_OVMS_VEHICLE_CAN_RX_QUEUE_SIZE 60
+
+#define CONFIG_OVMS_COMP_OBD2ECU 1
+#define CONFIG_OVMS_DEV_TRACER 1
+
+#endif //#ifndef __HOST_SDKCONFIG_H__
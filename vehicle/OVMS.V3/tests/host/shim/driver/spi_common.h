@@ -0,0 +1,20 @@
+/*
+ * ESP-IDF host shim: SPI bus (types only)
+ */
+
+#ifndef __HOST_DRIVER_SPI_COMMON_H__
+#define __HOST_DRIVER_SPI_COMMON_H__
+
+typedef enum { SPI_HOST = 0, HSPI_HOST = 1, VSPI_HOST = 2 } spi_host_device_t;
+
+typedef struct
+  {
+  int mosi_io_num;
+  int miso_io_num;
+  int sclk_io_num;
+  int quadwp_io_num;
+  int quadhd_io_num;
+  int max_transfer_sz;
+  } spi_bus_config_t;
+
+#endif //#ifndef __HOST_DRIVER_SPI_COMMON_H__
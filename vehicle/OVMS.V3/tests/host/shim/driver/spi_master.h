@@ -0,0 +1,10 @@
+/*
+ * ESP-IDF host shim: SPI master (types only)
+ */
+
+#ifndef __HOST_DRIVER_SPI_MASTER_H__
+#define __HOST_DRIVER_SPI_MASTER_H__
+
+#include "driver/spi_common.h"
+
+#endif //#ifndef __HOST_DRIVER_SPI_MASTER_H__
@@ -0,0 +1,21 @@
+/*
+ * ESP-IDF host shim: system event loop
+ */
+
+#ifndef __HOST_ESP_EVENT_LOOP_H__
+#define __HOST_ESP_EVENT_LOOP_H__
+
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void* ctx);
+system_event_cb_t esp_event_loop_set_cb(system_event_cb_t cb, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //#ifndef __HOST_ESP_EVENT_LOOP_H__
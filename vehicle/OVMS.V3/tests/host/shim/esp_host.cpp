@@ -0,0 +1,308 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// ESP-IDF system functions for the host build: logging, time base,
+// heap, error names, reset reasons & the newlib extensions.
+// Logging & timers are used by static constructors of the firmware,
+// so the state is constant initialized or function local.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_event_loop.h"
+#include "rom/rtc.h"
+#include "host_platform.h"
+
+////////////////////////////////////////////////////////////////////////
+// Logging
+
+static esp_log_level_t host_log_default = ESP_LOG_WARN;
+static std::map<std::string, esp_log_level_t>& host_log_tags()
+  {
+  static std::map<std::string, esp_log_level_t> tags;
+  return tags;
+  }
+static pthread_mutex_t host_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int host_log_stderr(const char* fmt, va_list args)
+  {
+  return vfprintf(stderr, fmt, args);
+  }
+
+static vprintf_like_t host_log_vprintf = host_log_stderr;
+
+void host_log_level(esp_log_level_t level)
+  {
+  pthread_mutex_lock(&host_log_lock);
+  host_log_default = level;
+  host_log_tags().clear();
+  pthread_mutex_unlock(&host_log_lock);
+  }
+
+void esp_log_level_set(const char* tag, esp_log_level_t level)
+  {
+  pthread_mutex_lock(&host_log_lock);
+  if (strcmp(tag, "*") == 0)
+    {
+    host_log_default = level;
+    host_log_tags().clear();
+    }
+  else
+    host_log_tags()[tag] = level;
+  pthread_mutex_unlock(&host_log_lock);
+  }
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+  {
+  pthread_mutex_lock(&host_log_lock);
+  vprintf_like_t prev = host_log_vprintf;
+  host_log_vprintf = func;
+  pthread_mutex_unlock(&host_log_lock);
+  return prev;
+  }
+
+uint32_t esp_log_timestamp(void)
+  {
+  return (uint32_t)(esp_timer_get_time() / 1000);
+  }
+
+uint32_t esp_log_early_timestamp(void)
+  {
+  return esp_log_timestamp();
+  }
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+  {
+  pthread_mutex_lock(&host_log_lock);
+  auto it = host_log_tags().find(tag);
+  esp_log_level_t limit = (it != host_log_tags().end()) ? it->second : host_log_default;
+  vprintf_like_t func = host_log_vprintf;
+  pthread_mutex_unlock(&host_log_lock);
+  if (level > limit) return;
+  va_list args;
+  va_start(args, format);
+  func(format, args);
+  va_end(args);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Time base
+
+static int64_t host_timer_base()
+  {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+  }
+
+// Virtual time (simulations): esp_timer_get_time() only advances by
+// host_timer_advance(), starting from the real time of the switch.
+static volatile bool host_timer_isvirtual = false;
+static volatile int64_t host_timer_now = 0;
+
+int64_t host_timer_real()
+  {
+  static int64_t start = host_timer_base();
+  return host_timer_base() - start;
+  }
+
+int64_t esp_timer_get_time(void)
+  {
+  if (host_timer_isvirtual) return host_timer_now;
+  return host_timer_real();
+  }
+
+void host_timer_virtual(bool enable)
+  {
+  if (enable && !host_timer_isvirtual)
+    host_timer_now = esp_timer_get_time();
+  host_timer_isvirtual = enable;
+  }
+
+void host_timer_advance(int64_t us)
+  {
+  if (host_timer_isvirtual && us > 0)
+    host_timer_now = host_timer_now + us;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Heap
+
+void* heap_caps_malloc(size_t size, uint32_t caps)
+  {
+  return malloc(size);
+  }
+
+void* heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+  {
+  return calloc(n, size);
+  }
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps)
+  {
+  return realloc(ptr, size);
+  }
+
+void heap_caps_free(void* ptr)
+  {
+  free(ptr);
+  }
+
+size_t heap_caps_get_free_size(uint32_t caps)
+  {
+  return 4*1024*1024;
+  }
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+  {
+  return 4*1024*1024;
+  }
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+  {
+  return 4*1024*1024;
+  }
+
+bool heap_caps_check_integrity_all(bool print_errors)
+  {
+  return true;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// System
+
+const char* esp_err_to_name(esp_err_t code)
+  {
+  switch (code)
+    {
+    case ESP_OK:                    return "ESP_OK";
+    case ESP_FAIL:                  return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_INVALID_MAC:       return "ESP_ERR_INVALID_MAC";
+    default:                        return "UNKNOWN ERROR";
+    }
+  }
+
+void esp_restart(void)
+  {
+  fprintf(stderr, "esp_restart() called, exiting\n");
+  exit(1);
+  }
+
+esp_reset_reason_t esp_reset_reason(void)
+  {
+  return ESP_RST_POWERON;
+  }
+
+RESET_REASON rtc_get_reset_reason(int cpu_no)
+  {
+  return POWERON_RESET;
+  }
+
+uint32_t esp_random(void)
+  {
+  return (uint32_t)random() ^ ((uint32_t)random() << 16);
+  }
+
+uint32_t esp_get_free_heap_size(void)
+  {
+  return heap_caps_get_free_size(0);
+  }
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type)
+  {
+  static const uint8_t host_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+  memcpy(mac, host_mac, 6);
+  mac[5] += type;
+  return ESP_OK;
+  }
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void* ctx)
+  {
+  return ESP_OK;
+  }
+
+system_event_cb_t esp_event_loop_set_cb(system_event_cb_t cb, void* ctx)
+  {
+  return NULL;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// newlib extensions
+
+char* utoa(unsigned int value, char* str, int base)
+  {
+  static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+  char buf[sizeof(unsigned int)*8+1];
+  int len = 0;
+  if (base < 2 || base > 36)
+    {
+    *str = 0;
+    return str;
+    }
+  do
+    {
+    buf[len++] = digits[value % base];
+    value /= base;
+    } while (value);
+  for (int i = 0; i < len; i++)
+    str[i] = buf[len-1-i];
+  str[len] = 0;
+  return str;
+  }
+
+char* itoa(int value, char* str, int base)
+  {
+  if (value < 0 && base == 10)
+    {
+    *str = '-';
+    utoa(-(unsigned int)value, str+1, base);
+    return str;
+    }
+  return utoa((unsigned int)value, str, base);
+  }
@@ -0,0 +1,10 @@
+/*
+ * ESP-IDF host shim: legacy interrupt header
+ */
+
+#ifndef __HOST_ESP_INTR_H__
+#define __HOST_ESP_INTR_H__
+
+#include "esp_intr_alloc.h"
+
+#endif //#ifndef __HOST_ESP_INTR_H__
@@ -0,0 +1,11 @@
+/*
+ * ESP-IDF host shim: interrupt allocation (types only)
+ */
+
+#ifndef __HOST_ESP_INTR_ALLOC_H__
+#define __HOST_ESP_INTR_ALLOC_H__
+
+typedef struct intr_handle_data_t* intr_handle_t;
+typedef void (*intr_handler_t)(void* arg);
+
+#endif //#ifndef __HOST_ESP_INTR_ALLOC_H__
@@ -0,0 +1,55 @@
+/*
+ * ESP-IDF host shim: system functions
+ */
+
+#ifndef __HOST_ESP_SYSTEM_H__
+#define __HOST_ESP_SYSTEM_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+  {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO,
+  } esp_reset_reason_t;
+
+typedef enum
+  {
+  ESP_MAC_WIFI_STA,
+  ESP_MAC_WIFI_SOFTAP,
+  ESP_MAC_BT,
+  ESP_MAC_ETH,
+  } esp_mac_type_t;
+
+typedef struct
+  {
+  uint32_t exit, pc, ps;
+  uint32_t a0, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15;
+  uint32_t sar, exccause, excvaddr, lbeg, lend, lcount;
+  } XtExcFrame;
+
+void esp_restart(void) __attribute__ ((noreturn));
+esp_reset_reason_t esp_reset_reason(void);
+uint32_t esp_random(void);
+uint32_t esp_get_free_heap_size(void);
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //#ifndef __HOST_ESP_SYSTEM_H__
@@ -0,0 +1,17 @@
+/*
+ * ESP-IDF host shim: task watchdog (no-op)
+ */
+
+#ifndef __HOST_ESP_TASK_WDT_H__
+#define __HOST_ESP_TASK_WDT_H__
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+
+static inline esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic) { return ESP_OK; }
+static inline esp_err_t esp_task_wdt_add(TaskHandle_t task) { return ESP_OK; }
+static inline esp_err_t esp_task_wdt_delete(TaskHandle_t task) { return ESP_OK; }
+static inline esp_err_t esp_task_wdt_reset(void) { return ESP_OK; }
+
+#endif //#ifndef __HOST_ESP_TASK_WDT_H__
@@ -0,0 +1,39 @@
+/*
+ * ESP-IDF host shim: FAT VFS
+ *
+ * The host VFS is the native file system, the /store and /sd
+ * mount points are mapped to a temporary directory by the
+ * runner (see hosttest.cpp).
+ */
+
+#ifndef __HOST_ESP_VFS_FAT_H__
+#define __HOST_ESP_VFS_FAT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "wear_levelling.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+  {
+  bool format_if_mount_failed;
+  int max_files;
+  size_t allocation_unit_size;
+  } esp_vfs_fat_mount_config_t;
+
+typedef esp_vfs_fat_mount_config_t esp_vfs_fat_sdmmc_mount_config_t;
+
+esp_err_t esp_vfs_fat_spiflash_mount(const char* base_path, const char* partition_label,
+  const esp_vfs_fat_mount_config_t* mount_config, wl_handle_t* wl_handle);
+esp_err_t esp_vfs_fat_spiflash_unmount(const char* base_path, wl_handle_t wl_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //#ifndef __HOST_ESP_VFS_FAT_H__
@@ -0,0 +1,81 @@
+/*
+ * FreeRTOS host shim: basic types & port definitions
+ *
+ * Tasks, queues, semaphores and timers are mapped to POSIX threads
+ * by freertos_host.cpp. Tick rate follows CONFIG_FREERTOS_HZ.
+ */
+
+#ifndef __HOST_FREERTOS_H__
+#define __HOST_FREERTOS_H__
+
+#include "sdkconfig.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t StackType_t;
+
+typedef struct host_queue* QueueHandle_t;
+typedef struct host_queue* SemaphoreHandle_t;
+typedef struct host_task* TaskHandle_t;
+typedef struct host_timer* TimerHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+
+#define configTICK_RATE_HZ          CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES        25
+#define configMINIMAL_STACK_SIZE    768
+#define configMAX_TASK_NAME_LEN     16
+#define portNUM_PROCESSORS          2
+#define portMAX_DELAY               ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS          ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS            portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define portTickType                TickType_t
+
+#define pdFALSE                     ((BaseType_t)0)
+#define pdTRUE                      ((BaseType_t)1)
+#define pdPASS                      pdTRUE
+#define pdFAIL                      pdFALSE
+#define errQUEUE_EMPTY              ((BaseType_t)0)
+#define errQUEUE_FULL               ((BaseType_t)0)
+#define tskNO_AFFINITY              0x7FFFFFFF
+#define tskIDLE_PRIORITY            ((UBaseType_t)0U)
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+// Critical sections: one global recursive lock (the mux is evaluated only
+//  to keep it referenced, as on the target)
+typedef struct { uint32_t owner; uint32_t count; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+void host_enter_critical(void);
+void host_exit_critical(void);
+#define portENTER_CRITICAL(mux)       ((void)(mux), host_enter_critical())
+#define portEXIT_CRITICAL(mux)        ((void)(mux), host_exit_critical())
+#define portENTER_CRITICAL_ISR(mux)   ((void)(mux), host_enter_critical())
+#define portEXIT_CRITICAL_ISR(mux)    ((void)(mux), host_exit_critical())
+#define portENTER_CRITICAL_SAFE(mux)  ((void)(mux), host_enter_critical())
+#define portEXIT_CRITICAL_SAFE(mux)   ((void)(mux), host_exit_critical())
+#define taskENTER_CRITICAL(mux)       ((void)(mux), host_enter_critical())
+#define taskEXIT_CRITICAL(mux)        ((void)(mux), host_exit_critical())
+#define vPortCPUInitializeMutex(mux)  do {} while (0)
+
+void host_yield(void);
+#define portYIELD()                   host_yield()
+#define portYIELD_FROM_ISR()          do {} while (0)
+#define xPortGetCoreID()              0
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //#ifndef __HOST_FREERTOS_H__
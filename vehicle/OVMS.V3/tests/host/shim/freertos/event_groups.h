@@ -0,0 +1,13 @@
+/*
+ * FreeRTOS host shim: event groups (type only)
+ */
+
+#ifndef __HOST_FREERTOS_EVENT_GROUPS_H__
+#define __HOST_FREERTOS_EVENT_GROUPS_H__
+
+#include "FreeRTOS.h"
+
+typedef void* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#endif //#ifndef __HOST_FREERTOS_EVENT_GROUPS_H__
@@ -0,0 +1,41 @@
+/*
+ * FreeRTOS host shim: queues
+ */
+
+#ifndef __HOST_FREERTOS_QUEUE_H__
+#define __HOST_FREERTOS_QUEUE_H__
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define queueSEND_TO_BACK   0
+#define queueSEND_TO_FRONT  1
+#define queueOVERWRITE      2
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+void vQueueDelete(QueueHandle_t xQueue);
+BaseType_t xQueueGenericSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait);
+BaseType_t xQueueReset(QueueHandle_t xQueue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue);
+
+#define xQueueSend(q, item, ticks)                xQueueGenericSend(q, item, ticks, queueSEND_TO_BACK)
+#define xQueueSendToBack(q, item, ticks)          xQueueGenericSend(q, item, ticks, queueSEND_TO_BACK)
+#define xQueueSendToFront(q, item, ticks)         xQueueGenericSend(q, item, ticks, queueSEND_TO_FRONT)
+#define xQueueOverwrite(q, item)                  xQueueGenericSend(q, item, 0, queueOVERWRITE)
+#define xQueueSendFromISR(q, item, woken)         xQueueGenericSend(q, item, 0, queueSEND_TO_BACK)
+#define xQueueSendToBackFromISR(q, item, woken)   xQueueGenericSend(q, item, 0, queueSEND_TO_BACK)
+#define xQueueSendToFrontFromISR(q, item, woken)  xQueueGenericSend(q, item, 0, queueSEND_TO_FRONT)
+#define xQueueReceiveFromISR(q, buf, woken)       xQueueReceive(q, buf, 0)
+#define uxQueueMessagesWaitingFromISR(q)          uxQueueMessagesWaiting(q)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //#ifndef __HOST_FREERTOS_QUEUE_H__
@@ -0,0 +1,867 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// FreeRTOS API mapped to POSIX threads:
+//  - tasks are detached pthreads, priorities & core affinity are ignored
+//  - queues, semaphores & mutexes share one implementation (host_queue)
+//    based on a pthread mutex and two condition variables
+//  - software timers are run by a single timer service thread
+//  - critical sections & scheduler suspension use one global recursive lock
+// Blocking times are converted from ticks using CONFIG_FREERTOS_HZ.
+// Note: the firmware creates tasks, queues & timers from static constructors
+// with init_priority, so the shim state must not depend on static init order
+// (function local statics or constant initialization only).
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+////////////////////////////////////////////////////////////////////////
+// Time base
+
+static uint64_t host_now_us()
+  {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+  }
+
+static uint64_t host_start_us()
+  {
+  static uint64_t start = host_now_us();
+  return start;
+  }
+
+static void host_deadline(struct timespec* ts, TickType_t ticks)
+  {
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  uint64_t ns = (uint64_t)ticks * (1000000000ULL / configTICK_RATE_HZ);
+  ts->tv_sec += ns / 1000000000ULL;
+  ts->tv_nsec += ns % 1000000000ULL;
+  if (ts->tv_nsec >= 1000000000L)
+    {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+    }
+  }
+
+static void host_cond_init(pthread_cond_t* cond)
+  {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+  }
+
+// Wait on cond until pred is true or the block time expired.
+// Returns the final predicate result. Caller holds mutex, which is
+// released if the task gets deleted (cancelled) while waiting.
+static void host_cond_cleanup(void* mutex)
+  {
+  pthread_mutex_unlock((pthread_mutex_t*)mutex);
+  }
+
+template <typename Pred>
+static bool host_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, TickType_t ticks, Pred pred)
+  {
+  if (pred()) return true;
+  if (ticks == 0) return false;
+  bool result = true;
+  pthread_cleanup_push(host_cond_cleanup, mutex);
+  if (ticks == portMAX_DELAY)
+    {
+    while (!pred())
+      pthread_cond_wait(cond, mutex);
+    }
+  else
+    {
+    struct timespec deadline;
+    host_deadline(&deadline, ticks);
+    while (!pred())
+      {
+      if (pthread_cond_timedwait(cond, mutex, &deadline) == ETIMEDOUT)
+        {
+        result = pred();
+        break;
+        }
+      }
+    }
+  pthread_cleanup_pop(0);
+  return result;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Critical sections
+
+static pthread_mutex_t host_critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void host_enter_critical(void)
+  {
+  pthread_mutex_lock(&host_critical_lock);
+  }
+
+void host_exit_critical(void)
+  {
+  pthread_mutex_unlock(&host_critical_lock);
+  }
+
+void host_yield(void)
+  {
+  sched_yield();
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Tasks
+
+struct host_task
+  {
+  pthread_t thread;
+  char name[configMAX_TASK_NAME_LEN];
+  TaskFunction_t code;
+  void* param;
+  UBaseType_t priority;
+  UBaseType_t number;
+  uint32_t stacksize;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint32_t notify;
+  bool deleted;
+  };
+
+static pthread_mutex_t host_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::list<host_task*>& host_tasks()
+  {
+  static std::list<host_task*> tasks;
+  return tasks;
+  }
+static UBaseType_t host_task_number = 0;
+static __thread host_task* host_current_task = NULL;
+
+static host_task* host_task_new(const char* name, UBaseType_t priority, uint32_t stacksize)
+  {
+  host_task* task = new host_task;
+  memset(task->name, 0, sizeof(task->name));
+  strncpy(task->name, name ? name : "", sizeof(task->name)-1);
+  task->code = NULL;
+  task->param = NULL;
+  task->priority = priority;
+  task->stacksize = stacksize;
+  pthread_mutex_init(&task->mutex, NULL);
+  host_cond_init(&task->cond);
+  task->notify = 0;
+  task->deleted = false;
+  pthread_mutex_lock(&host_tasks_lock);
+  task->number = ++host_task_number;
+  host_tasks().push_back(task);
+  pthread_mutex_unlock(&host_tasks_lock);
+  return task;
+  }
+
+static void host_task_remove(host_task* task)
+  {
+  pthread_mutex_lock(&host_tasks_lock);
+  host_tasks().remove(task);
+  pthread_mutex_unlock(&host_tasks_lock);
+  }
+
+static host_task* host_task_self()
+  {
+  if (!host_current_task)
+    {
+    // Thread not created by xTaskCreate (i.e. main): adopt it
+    host_current_task = host_task_new("main", 1, 0);
+    host_current_task->thread = pthread_self();
+    }
+  return host_current_task;
+  }
+
+static void* host_task_entry(void* arg)
+  {
+  host_task* task = (host_task*)arg;
+  host_current_task = task;
+  task->code(task->param);
+  // FreeRTOS tasks must not return, but be tolerant:
+  task->deleted = true;
+  host_task_remove(task);
+  pthread_detach(pthread_self());
+  return NULL;
+  }
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+  void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask, BaseType_t xCoreID)
+  {
+  host_task* task = host_task_new(pcName, uxPriority, usStackDepth);
+  task->code = pvTaskCode;
+  task->param = pvParameters;
+  if (pvCreatedTask) *pvCreatedTask = task;
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  // Joinable, so vTaskDelete() can wait for the cancellation to complete,
+  // tasks ending themselves detach:
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  // Host stacks need more headroom than the ESP32 (64 bit, libc buffers):
+  size_t stacksize = std::max<size_t>(usStackDepth * 4, 256*1024);
+  pthread_attr_setstacksize(&attr, stacksize);
+  int err = pthread_create(&task->thread, &attr, host_task_entry, task);
+  pthread_attr_destroy(&attr);
+  if (err != 0)
+    {
+    host_task_remove(task);
+    if (pvCreatedTask) *pvCreatedTask = NULL;
+    return pdFAIL;
+    }
+  return pdPASS;
+  }
+
+void vTaskDelete(TaskHandle_t xTask)
+  {
+  host_task* self = host_task_self();
+  host_task* task = xTask ? xTask : self;
+  task->deleted = true;
+  host_task_remove(task);
+  if (task == self)
+    {
+    pthread_detach(pthread_self());
+    pthread_exit(NULL);
+    }
+  else
+    {
+    // wait for the task to release its locks, so the caller can
+    // free the resources the task used:
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    }
+  }
+
+void vTaskDelay(TickType_t xTicksToDelay)
+  {
+  if (xTicksToDelay == 0)
+    {
+    sched_yield();
+    return;
+    }
+  uint64_t us = (uint64_t)xTicksToDelay * (1000000ULL / configTICK_RATE_HZ);
+  struct timespec ts;
+  ts.tv_sec = us / 1000000ULL;
+  ts.tv_nsec = (us % 1000000ULL) * 1000;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+  }
+
+void vTaskDelayUntil(TickType_t* pxPreviousWakeTime, TickType_t xTimeIncrement)
+  {
+  TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+  TickType_t now = xTaskGetTickCount();
+  if ((int32_t)(wake - now) > 0)
+    vTaskDelay(wake - now);
+  *pxPreviousWakeTime = wake;
+  }
+
+void vTaskSuspend(TaskHandle_t xTask)
+  {
+  // Only self suspension is supported: wait for a resume notification
+  host_task* task = host_task_self();
+  if (xTask && xTask != task) return;
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+
+void vTaskResume(TaskHandle_t xTask)
+  {
+  if (xTask) xTaskNotifyGive(xTask);
+  }
+
+TickType_t xTaskGetTickCount(void)
+  {
+  return (TickType_t)((host_now_us() - host_start_us()) / (1000000ULL / configTICK_RATE_HZ));
+  }
+
+TickType_t xTaskGetTickCountFromISR(void)
+  {
+  return xTaskGetTickCount();
+  }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+  {
+  return host_task_self();
+  }
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t cpuid)
+  {
+  return host_task_self();
+  }
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t cpuid)
+  {
+  return NULL;
+  }
+
+char* pcTaskGetTaskName(TaskHandle_t xTask)
+  {
+  host_task* task = xTask ? xTask : host_task_self();
+  return task->name;
+  }
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+  {
+  host_task* task = xTask ? xTask : host_task_self();
+  return task->stacksize;
+  }
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t xTask)
+  {
+  host_task* task = xTask ? xTask : host_task_self();
+  return task->priority;
+  }
+
+void vTaskPrioritySet(TaskHandle_t xTask, UBaseType_t uxNewPriority)
+  {
+  host_task* task = xTask ? xTask : host_task_self();
+  task->priority = uxNewPriority;
+  }
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+  {
+  pthread_mutex_lock(&host_tasks_lock);
+  UBaseType_t cnt = host_tasks().size();
+  pthread_mutex_unlock(&host_tasks_lock);
+  return cnt;
+  }
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* pxTaskStatusArray, UBaseType_t uxArraySize, uint32_t* pulTotalRunTime)
+  {
+  UBaseType_t cnt = 0;
+  pthread_mutex_lock(&host_tasks_lock);
+  for (host_task* task : host_tasks())
+    {
+    if (cnt == uxArraySize) break;
+    TaskStatus_t* st = &pxTaskStatusArray[cnt++];
+    memset(st, 0, sizeof(*st));
+    st->xHandle = task;
+    st->pcTaskName = task->name;
+    st->xTaskNumber = task->number;
+    st->eCurrentState = eBlocked;
+    st->uxCurrentPriority = st->uxBasePriority = task->priority;
+    st->usStackHighWaterMark = task->stacksize;
+    st->xCoreID = tskNO_AFFINITY;
+    // run time: thread CPU time in us (the task is alive while listed)
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(task->thread, &clock) == 0 && clock_gettime(clock, &ts) == 0)
+      st->ulRunTimeCounter = (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+    }
+  pthread_mutex_unlock(&host_tasks_lock);
+  if (pulTotalRunTime) *pulTotalRunTime = (uint32_t)(host_now_us() - host_start_us());
+  return cnt;
+  }
+
+UBaseType_t uxTaskGetTaskNumber(TaskHandle_t xTask)
+  {
+  return xTask ? xTask->number : 0;
+  }
+
+eTaskState eTaskGetState(TaskHandle_t xTask)
+  {
+  if (!xTask) return eRunning;
+  eTaskState state = eDeleted;
+  pthread_mutex_lock(&host_tasks_lock);
+  if (std::find(host_tasks().begin(), host_tasks().end(), xTask) != host_tasks().end())
+    state = (xTask == host_current_task) ? eRunning : eBlocked;
+  pthread_mutex_unlock(&host_tasks_lock);
+  return state;
+  }
+
+void vTaskSuspendAll(void)
+  {
+  host_enter_critical();
+  }
+
+BaseType_t xTaskResumeAll(void)
+  {
+  host_exit_critical();
+  return pdFALSE;
+  }
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+  {
+  host_task* task = xTaskToNotify;
+  pthread_mutex_lock(&task->mutex);
+  task->notify++;
+  pthread_cond_signal(&task->cond);
+  pthread_mutex_unlock(&task->mutex);
+  return pdPASS;
+  }
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken)
+  {
+  xTaskNotifyGive(xTaskToNotify);
+  if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdFALSE;
+  }
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+  {
+  host_task* task = host_task_self();
+  pthread_mutex_lock(&task->mutex);
+  host_cond_wait(&task->cond, &task->mutex, xTicksToWait, [task]{ return task->notify != 0; });
+  uint32_t value = task->notify;
+  if (value)
+    task->notify = xClearCountOnExit ? 0 : value-1;
+  pthread_mutex_unlock(&task->mutex);
+  return value;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Queues, semaphores & mutexes
+
+enum host_queue_type { HQ_Queue, HQ_Mutex, HQ_RecursiveMutex, HQ_Semaphore };
+
+struct host_queue
+  {
+  host_queue_type type;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond_send;
+  pthread_cond_t cond_recv;
+  UBaseType_t length;         // queue length / semaphore max count
+  UBaseType_t itemsize;
+  UBaseType_t count;          // items queued / semaphore count
+  UBaseType_t head;
+  uint8_t* data;
+  host_task* holder;          // mutex owner
+  UBaseType_t recursion;
+  };
+
+static host_queue* host_queue_new(host_queue_type type, UBaseType_t length, UBaseType_t itemsize)
+  {
+  host_queue* q = new host_queue;
+  q->type = type;
+  pthread_mutex_init(&q->mutex, NULL);
+  host_cond_init(&q->cond_send);
+  host_cond_init(&q->cond_recv);
+  q->length = length;
+  q->itemsize = itemsize;
+  q->count = 0;
+  q->head = 0;
+  q->data = (itemsize && length) ? new uint8_t[length * itemsize] : NULL;
+  q->holder = NULL;
+  q->recursion = 0;
+  return q;
+  }
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+  {
+  return host_queue_new(HQ_Queue, uxQueueLength, uxItemSize);
+  }
+
+void vQueueDelete(QueueHandle_t xQueue)
+  {
+  if (!xQueue) return;
+  pthread_mutex_destroy(&xQueue->mutex);
+  pthread_cond_destroy(&xQueue->cond_send);
+  pthread_cond_destroy(&xQueue->cond_recv);
+  delete [] xQueue->data;
+  delete xQueue;
+  }
+
+BaseType_t xQueueGenericSend(QueueHandle_t q, const void* pvItemToQueue, TickType_t xTicksToWait, BaseType_t xCopyPosition)
+  {
+  pthread_mutex_lock(&q->mutex);
+  if (xCopyPosition == queueOVERWRITE && q->count == q->length)
+    {
+    // Overwrite is only defined for length 1 queues: replace the item
+    memcpy(q->data + q->head * q->itemsize, pvItemToQueue, q->itemsize);
+    pthread_mutex_unlock(&q->mutex);
+    return pdPASS;
+    }
+  if (!host_cond_wait(&q->cond_send, &q->mutex, xTicksToWait, [q]{ return q->count < q->length; }))
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return errQUEUE_FULL;
+    }
+  if (xCopyPosition == queueSEND_TO_FRONT)
+    {
+    q->head = (q->head + q->length - 1) % q->length;
+    memcpy(q->data + q->head * q->itemsize, pvItemToQueue, q->itemsize);
+    }
+  else
+    {
+    UBaseType_t tail = (q->head + q->count) % q->length;
+    memcpy(q->data + tail * q->itemsize, pvItemToQueue, q->itemsize);
+    }
+  q->count++;
+  pthread_cond_signal(&q->cond_recv);
+  pthread_mutex_unlock(&q->mutex);
+  return pdPASS;
+  }
+
+static BaseType_t host_queue_receive(QueueHandle_t q, void* pvBuffer, TickType_t xTicksToWait, bool peek)
+  {
+  pthread_mutex_lock(&q->mutex);
+  if (!host_cond_wait(&q->cond_recv, &q->mutex, xTicksToWait, [q]{ return q->count > 0; }))
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return errQUEUE_EMPTY;
+    }
+  memcpy(pvBuffer, q->data + q->head * q->itemsize, q->itemsize);
+  if (!peek)
+    {
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    pthread_cond_signal(&q->cond_send);
+    }
+  pthread_mutex_unlock(&q->mutex);
+  return pdPASS;
+  }
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait)
+  {
+  return host_queue_receive(xQueue, pvBuffer, xTicksToWait, false);
+  }
+
+BaseType_t xQueuePeek(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait)
+  {
+  return host_queue_receive(xQueue, pvBuffer, xTicksToWait, true);
+  }
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+  {
+  pthread_mutex_lock(&xQueue->mutex);
+  xQueue->count = 0;
+  xQueue->head = 0;
+  pthread_cond_broadcast(&xQueue->cond_send);
+  pthread_mutex_unlock(&xQueue->mutex);
+  return pdPASS;
+  }
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+  {
+  pthread_mutex_lock(&xQueue->mutex);
+  UBaseType_t cnt = xQueue->count;
+  pthread_mutex_unlock(&xQueue->mutex);
+  return cnt;
+  }
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t xQueue)
+  {
+  pthread_mutex_lock(&xQueue->mutex);
+  UBaseType_t cnt = xQueue->length - xQueue->count;
+  pthread_mutex_unlock(&xQueue->mutex);
+  return cnt;
+  }
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+  {
+  host_queue* q = host_queue_new(HQ_Mutex, 1, 0);
+  q->count = 1;
+  return q;
+  }
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+  {
+  host_queue* q = host_queue_new(HQ_RecursiveMutex, 1, 0);
+  q->count = 1;
+  return q;
+  }
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+  {
+  return host_queue_new(HQ_Semaphore, 1, 0);
+  }
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+  {
+  host_queue* q = host_queue_new(HQ_Semaphore, uxMaxCount, 0);
+  q->count = uxInitialCount;
+  return q;
+  }
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore)
+  {
+  vQueueDelete(xSemaphore);
+  }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t q, TickType_t xBlockTime)
+  {
+  pthread_mutex_lock(&q->mutex);
+  if (!host_cond_wait(&q->cond_recv, &q->mutex, xBlockTime, [q]{ return q->count > 0; }))
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return pdFALSE;
+    }
+  q->count--;
+  if (q->type == HQ_Mutex || q->type == HQ_RecursiveMutex)
+    {
+    q->holder = host_task_self();
+    q->recursion = 1;
+    }
+  pthread_mutex_unlock(&q->mutex);
+  return pdTRUE;
+  }
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t q)
+  {
+  pthread_mutex_lock(&q->mutex);
+  if (q->count >= q->length)
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return pdFALSE;
+    }
+  q->count++;
+  q->holder = NULL;
+  q->recursion = 0;
+  pthread_cond_signal(&q->cond_recv);
+  pthread_mutex_unlock(&q->mutex);
+  return pdTRUE;
+  }
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t q, TickType_t xBlockTime)
+  {
+  host_task* self = host_task_self();
+  pthread_mutex_lock(&q->mutex);
+  if (q->holder == self)
+    {
+    q->recursion++;
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+    }
+  pthread_mutex_unlock(&q->mutex);
+  return xSemaphoreTake(q, xBlockTime);
+  }
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t q)
+  {
+  pthread_mutex_lock(&q->mutex);
+  if (q->holder != host_task_self())
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return pdFALSE;
+    }
+  if (--q->recursion > 0)
+    {
+    pthread_mutex_unlock(&q->mutex);
+    return pdTRUE;
+    }
+  pthread_mutex_unlock(&q->mutex);
+  return xSemaphoreGive(q);
+  }
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t xMutex)
+  {
+  pthread_mutex_lock(&xMutex->mutex);
+  TaskHandle_t holder = xMutex->holder;
+  pthread_mutex_unlock(&xMutex->mutex);
+  return holder;
+  }
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t xSemaphore)
+  {
+  return uxQueueMessagesWaiting(xSemaphore);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Software timers
+
+struct host_timer
+  {
+  char name[configMAX_TASK_NAME_LEN];
+  TickType_t period;
+  bool autoreload;
+  void* id;
+  TimerCallbackFunction_t callback;
+  bool active;
+  uint64_t expiry;            // µs
+  bool deleted;
+  };
+
+static pthread_mutex_t host_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t host_timer_cond;
+static std::vector<host_timer*>& host_timers()
+  {
+  static std::vector<host_timer*> timers;
+  return timers;
+  }
+static pthread_t host_timer_thread;
+static bool host_timer_running = false;
+
+static uint64_t host_timer_period_us(TickType_t period)
+  {
+  return (uint64_t)period * (1000000ULL / configTICK_RATE_HZ);
+  }
+
+static void* host_timer_task(void* arg)
+  {
+  host_current_task = host_task_new("Tmr Svc", configMAX_PRIORITIES-1, 0);
+  host_current_task->thread = pthread_self();
+  pthread_mutex_lock(&host_timer_lock);
+  while (true)
+    {
+    // Find next expiry:
+    host_timer* next = NULL;
+    for (host_timer* t : host_timers())
+      {
+      if (t->active && !t->deleted && (!next || t->expiry < next->expiry))
+        next = t;
+      }
+    if (!next)
+      {
+      pthread_cond_wait(&host_timer_cond, &host_timer_lock);
+      continue;
+      }
+    uint64_t now = host_now_us();
+    if (next->expiry > now)
+      {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      uint64_t wait = next->expiry - now;
+      ts.tv_sec += wait / 1000000ULL;
+      ts.tv_nsec += (wait % 1000000ULL) * 1000;
+      if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+      pthread_cond_timedwait(&host_timer_cond, &host_timer_lock, &ts);
+      continue;
+      }
+    // Expired: reschedule & run callback unlocked
+    if (next->autoreload)
+      next->expiry += host_timer_period_us(next->period);
+    else
+      next->active = false;
+    TimerCallbackFunction_t callback = next->callback;
+    pthread_mutex_unlock(&host_timer_lock);
+    callback(next);
+    pthread_mutex_lock(&host_timer_lock);
+    // Purge deleted timers:
+    for (auto it = host_timers().begin(); it != host_timers().end(); )
+      {
+      if ((*it)->deleted) { delete *it; it = host_timers().erase(it); }
+      else ++it;
+      }
+    }
+  return NULL;
+  }
+
+TimerHandle_t xTimerCreate(const char* pcTimerName, TickType_t xTimerPeriod, UBaseType_t uxAutoReload,
+  void* pvTimerID, TimerCallbackFunction_t pxCallbackFunction)
+  {
+  host_timer* t = new host_timer;
+  memset(t->name, 0, sizeof(t->name));
+  strncpy(t->name, pcTimerName ? pcTimerName : "", sizeof(t->name)-1);
+  t->period = xTimerPeriod ? xTimerPeriod : 1;
+  t->autoreload = uxAutoReload;
+  t->id = pvTimerID;
+  t->callback = pxCallbackFunction;
+  t->active = false;
+  t->expiry = 0;
+  t->deleted = false;
+  pthread_mutex_lock(&host_timer_lock);
+  if (!host_timer_running)
+    {
+    host_cond_init(&host_timer_cond);
+    pthread_create(&host_timer_thread, NULL, host_timer_task, NULL);
+    pthread_detach(host_timer_thread);
+    host_timer_running = true;
+    }
+  host_timers().push_back(t);
+  pthread_mutex_unlock(&host_timer_lock);
+  return t;
+  }
+
+static BaseType_t host_timer_update(TimerHandle_t xTimer, bool active, TickType_t period, bool remove)
+  {
+  pthread_mutex_lock(&host_timer_lock);
+  if (period) xTimer->period = period;
+  xTimer->active = active;
+  if (active)
+    xTimer->expiry = host_now_us() + host_timer_period_us(xTimer->period);
+  if (remove)
+    xTimer->deleted = true;
+  pthread_cond_signal(&host_timer_cond);
+  pthread_mutex_unlock(&host_timer_lock);
+  return pdPASS;
+  }
+
+BaseType_t xTimerStart(TimerHandle_t xTimer, TickType_t xTicksToWait)
+  {
+  return host_timer_update(xTimer, true, 0, false);
+  }
+
+BaseType_t xTimerStop(TimerHandle_t xTimer, TickType_t xTicksToWait)
+  {
+  return host_timer_update(xTimer, false, 0, false);
+  }
+
+BaseType_t xTimerReset(TimerHandle_t xTimer, TickType_t xTicksToWait)
+  {
+  return host_timer_update(xTimer, true, 0, false);
+  }
+
+BaseType_t xTimerDelete(TimerHandle_t xTimer, TickType_t xTicksToWait)
+  {
+  // Freed by the timer service thread
+  return host_timer_update(xTimer, false, 0, true);
+  }
+
+BaseType_t xTimerChangePeriod(TimerHandle_t xTimer, TickType_t xNewPeriod, TickType_t xTicksToWait)
+  {
+  return host_timer_update(xTimer, true, xNewPeriod ? xNewPeriod : 1, false);
+  }
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+  {
+  pthread_mutex_lock(&host_timer_lock);
+  BaseType_t active = xTimer->active;
+  pthread_mutex_unlock(&host_timer_lock);
+  return active;
+  }
+
+void* pvTimerGetTimerID(TimerHandle_t xTimer)
+  {
+  return xTimer->id;
+  }
+
+void vTimerSetTimerID(TimerHandle_t xTimer, void* pvNewID)
+  {
+  xTimer->id = pvNewID;
+  }
+
+const char* pcTimerGetTimerName(TimerHandle_t xTimer)
+  {
+  return xTimer->name;
+  }
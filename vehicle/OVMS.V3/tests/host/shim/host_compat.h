@@ -0,0 +1,24 @@
+/*
+ * Host build compatibility
+ *
+ * Force included into all host build sources (see Makefile):
+ * provides the newlib extensions the firmware relies on.
+ */
+
+#ifndef __HOST_COMPAT_H__
+#define __HOST_COMPAT_H__
+
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char* itoa(int value, char* str, int base);
+char* utoa(unsigned int value, char* str, int base);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //#ifndef __HOST_COMPAT_H__
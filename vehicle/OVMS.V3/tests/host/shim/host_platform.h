@@ -0,0 +1,32 @@
+/*
+ * Host build runtime API
+ *
+ * Functions of the host shims used by the test runner.
+ */
+
+#ifndef __HOST_PLATFORM_H__
+#define __HOST_PLATFORM_H__
+
+#include <stdint.h>
+#include <string>
+#include "esp_log.h"
+
+// VFS: "/store" and "/sd" are mapped to subdirectories of the host root
+// directory. host_vfs_init() creates the directories, NULL = new temp dir.
+bool host_vfs_init(const char* root = NULL);
+const char* host_vfs_root();
+std::string host_vfs_path(const char* path);
+void host_vfs_cleanup();
+
+// Logging: default level for all tags (ESP_LOG_NONE = silent)
+void host_log_level(esp_log_level_t level);
+
+// Time base: switch esp_timer_get_time() to virtual time, which only
+// advances by host_timer_advance() (deterministic simulations). Note:
+// FreeRTOS ticks & delays are not affected, host_timer_real() always
+// returns the real time [us] (benchmark timing).
+void host_timer_virtual(bool enable);
+void host_timer_advance(int64_t us);
+int64_t host_timer_real();
+
+#endif //#ifndef __HOST_PLATFORM_H__
@@ -0,0 +1,17 @@
+/*
+ * ESP-IDF host shim: DMA descriptors (type only)
+ */
+
+#ifndef __HOST_ROM_LLDESC_H__
+#define __HOST_ROM_LLDESC_H__
+
+#include <stdint.h>
+
+typedef struct lldesc_s
+  {
+  volatile uint32_t size:12, length:12, offset:5, sosf:1, eof:1, owner:1;
+  volatile uint8_t* buf;
+  struct lldesc_s* next;
+  } lldesc_t;
+
+#endif //#ifndef __HOST_ROM_LLDESC_H__
@@ -0,0 +1,12 @@
+/*
+ * ESP-IDF host shim: SPI registers (type only)
+ */
+
+#ifndef __HOST_SOC_SPI_STRUCT_H__
+#define __HOST_SOC_SPI_STRUCT_H__
+
+#include <stdint.h>
+
+typedef struct { volatile uint32_t reg[64]; } spi_dev_t;
+
+#endif //#ifndef __HOST_SOC_SPI_STRUCT_H__
@@ -0,0 +1,196 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+// Host VFS: the firmware mount points "/store" and "/sd" are mapped to
+// subdirectories of a host directory (by default a new temporary directory).
+// The file system calls of the firmware objects are redirected by the linker
+// (-Wl,--wrap, see Makefile), other code (libc, libstdc++) is not affected.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string>
+#include "esp_vfs_fat.h"
+#include "host_platform.h"
+
+static std::string host_vfs_rootdir;
+static bool host_vfs_tempdir = false;
+static const char* const host_vfs_mounts[] = { "/store", "/sd", NULL };
+
+bool host_vfs_init(const char* root)
+  {
+  if (root)
+    {
+    host_vfs_rootdir = root;
+    host_vfs_tempdir = false;
+    mkdir(root, 0755);
+    }
+  else
+    {
+    const char* tmp = getenv("TMPDIR");
+    std::string templ = std::string(tmp ? tmp : "/tmp") + "/ovms_host.XXXXXX";
+    char* dir = mkdtemp(&templ[0]);
+    if (!dir) return false;
+    host_vfs_rootdir = dir;
+    host_vfs_tempdir = true;
+    }
+  for (int i = 0; host_vfs_mounts[i]; i++)
+    mkdir((host_vfs_rootdir + host_vfs_mounts[i]).c_str(), 0755);
+  return true;
+  }
+
+const char* host_vfs_root()
+  {
+  return host_vfs_rootdir.c_str();
+  }
+
+std::string host_vfs_path(const char* path)
+  {
+  if (!path || host_vfs_rootdir.empty() || path[0] != '/')
+    return path ? path : "";
+  for (int i = 0; host_vfs_mounts[i]; i++)
+    {
+    size_t len = strlen(host_vfs_mounts[i]);
+    if (strncmp(path, host_vfs_mounts[i], len) == 0 && (path[len] == 0 || path[len] == '/'))
+      return host_vfs_rootdir + path;
+    }
+  return path;
+  }
+
+void host_vfs_cleanup()
+  {
+  if (host_vfs_tempdir && !host_vfs_rootdir.empty())
+    {
+    std::string cmd = "rm -rf '" + host_vfs_rootdir + "'";
+    if (system(cmd.c_str()) != 0)
+      fprintf(stderr, "host_vfs_cleanup: failed to remove %s\n", host_vfs_rootdir.c_str());
+    }
+  host_vfs_rootdir.clear();
+  }
+
+esp_err_t esp_vfs_fat_spiflash_mount(const char* base_path, const char* partition_label,
+  const esp_vfs_fat_mount_config_t* mount_config, wl_handle_t* wl_handle)
+  {
+  if (host_vfs_rootdir.empty() && !host_vfs_init())
+    return ESP_FAIL;
+  mkdir(host_vfs_path(base_path).c_str(), 0755);
+  if (wl_handle) *wl_handle = 0;
+  return ESP_OK;
+  }
+
+esp_err_t esp_vfs_fat_spiflash_unmount(const char* base_path, wl_handle_t wl_handle)
+  {
+  return ESP_OK;
+  }
+
+extern "C"
+  {
+  FILE* __real_fopen(const char* path, const char* mode);
+  int __real_open(const char* path, int flags, ...);
+  int __real_stat(const char* path, struct stat* buf);
+  int __real_mkdir(const char* path, mode_t mode);
+  int __real_rmdir(const char* path);
+  DIR* __real_opendir(const char* path);
+  int __real_unlink(const char* path);
+  int __real_remove(const char* path);
+  int __real_rename(const char* oldpath, const char* newpath);
+  int __real_truncate(const char* path, off_t length);
+  int __real_access(const char* path, int mode);
+
+  FILE* __wrap_fopen(const char* path, const char* mode)
+    {
+    return __real_fopen(host_vfs_path(path).c_str(), mode);
+    }
+
+  int __wrap_open(const char* path, int flags, ...)
+    {
+    mode_t mode = 0;
+    if (flags & O_CREAT)
+      {
+      va_list args;
+      va_start(args, flags);
+      mode = va_arg(args, int);
+      va_end(args);
+      }
+    return __real_open(host_vfs_path(path).c_str(), flags, mode);
+    }
+
+  int __wrap_stat(const char* path, struct stat* buf)
+    {
+    return __real_stat(host_vfs_path(path).c_str(), buf);
+    }
+
+  int __wrap_mkdir(const char* path, mode_t mode)
+    {
+    // The firmware passes mode 0 (FATFS ignores it)
+    return __real_mkdir(host_vfs_path(path).c_str(), mode ? mode : 0755);
+    }
+
+  int __wrap_rmdir(const char* path)
+    {
+    return __real_rmdir(host_vfs_path(path).c_str());
+    }
+
+  DIR* __wrap_opendir(const char* path)
+    {
+    return __real_opendir(host_vfs_path(path).c_str());
+    }
+
+  int __wrap_unlink(const char* path)
+    {
+    return __real_unlink(host_vfs_path(path).c_str());
+    }
+
+  int __wrap_remove(const char* path)
+    {
+    return __real_remove(host_vfs_path(path).c_str());
+    }
+
+  int __wrap_rename(const char* oldpath, const char* newpath)
+    {
+    return __real_rename(host_vfs_path(oldpath).c_str(), host_vfs_path(newpath).c_str());
+    }
+
+  int __wrap_truncate(const char* path, off_t length)
+    {
+    return __real_truncate(host_vfs_path(path).c_str(), length);
+    }
+
+  int __wrap_access(const char* path, int mode)
+    {
+    return __real_access(host_vfs_path(path).c_str(), mode);
+    }
+  }
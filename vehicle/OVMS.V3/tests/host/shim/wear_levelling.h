@@ -0,0 +1,13 @@
+/*
+ * ESP-IDF host shim: wear levelling (type only)
+ */
+
+#ifndef __HOST_WEAR_LEVELLING_H__
+#define __HOST_WEAR_LEVELLING_H__
+
+#include <stdint.h>
+
+typedef int32_t wl_handle_t;
+#define WL_INVALID_HANDLE -1
+
+#endif //#ifndef __HOST_WEAR_LEVELLING_H__
@@ -0,0 +1,202 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: BMS cell history
+
+#include <stdio.h>
+#include <unistd.h>
+#include "vehicle_bmshistory.h"
+#include "string_writer.h"
+#include "hosttest.h"
+
+HOST_TEST(bmshistory, aggregate)
+  {
+  OvmsBmsHistory h("voltage", "V", 0.001, 0, 3);
+  HOST_CHECK(h.Configure(3, "60:10,600:5"));
+  HOST_CHECK_EQUAL(h.GetTierCount(), 2);
+
+  float v1[3] = { 3.900, 3.950, 4.000 };
+  float v2[3] = { 3.800, 3.960, 4.100 };
+  h.Add(v1, 10);
+  h.Add(v2, 50);
+
+  // open bucket is read from the accumulator:
+  float min, avg, max;
+  HOST_CHECK(h.Get(0, 0, 1, &min, &avg, &max));
+  HOST_CHECK_NEAR(avg, 3.955, 1e-5);
+
+  // next bucket closes & quantises bucket 0:
+  h.Add(v1, 65);
+  HOST_CHECK(h.Get(0, 0, 0, &min, &avg, &max));
+  HOST_CHECK_NEAR(min, 3.800, 0.0005);
+  HOST_CHECK_NEAR(avg, 3.850, 0.0005);
+  HOST_CHECK_NEAR(max, 3.900, 0.0005);
+  HOST_CHECK(h.Get(0, 0, 2, &min, &avg, &max));
+  HOST_CHECK_NEAR(max, 4.100, 0.0005);
+  HOST_CHECK(h.Get(0, 1, 0, NULL, &avg, NULL));
+  HOST_CHECK_NEAR(avg, 3.900, 1e-5);
+  HOST_CHECK(!h.Get(0, 2, 0, NULL, &avg, NULL));
+  HOST_CHECK(!h.Get(0, 0, 3, NULL, &avg, NULL));
+
+  // second tier still accumulating all three readings:
+  HOST_CHECK(h.Get(1, 0, 0, &min, &avg, &max));
+  HOST_CHECK_NEAR(min, 3.800, 1e-5);
+  HOST_CHECK_NEAR(avg, (3.900 + 3.800 + 3.900) / 3, 1e-5);
+  }
+
+HOST_TEST(bmshistory, gaps)
+  {
+  OvmsBmsHistory h("temperature", "°C", 0.01, -100, 1);
+  HOST_CHECK(h.Configure(2, "60:4"));
+  float t[2] = { 20.0, -5.5 };
+  h.Add(t, 0);
+  h.Add(t, 100);                      // bucket 1
+  h.Add(t, 400);                      // bucket 6, 2…5 missing
+  float avg;
+  HOST_CHECK(h.Get(0, 1, 1, NULL, &avg, NULL));
+  HOST_CHECK_NEAR(avg, -5.5, 0.005);
+  HOST_CHECK(h.Get(0, 0, 0, NULL, &avg, NULL));
+  HOST_CHECK_NEAR(avg, 20.0, 0.005);
+  for (uint32_t b = 2; b < 6; b++)
+    HOST_CHECK(!h.Get(0, b, 0, NULL, &avg, NULL));
+
+  // ring rollover: closing bucket 6 drops buckets 0…2 from the ring:
+  h.Add(t, 430);
+  h.Tick(480);
+  HOST_CHECK(h.Get(0, 6, 0, NULL, &avg, NULL));
+  HOST_CHECK_NEAR(avg, 20.0, 0.005);
+  HOST_CHECK(!h.Get(0, 0, 0, NULL, &avg, NULL));
+  HOST_CHECK(!h.Get(0, 1, 0, NULL, &avg, NULL));
+
+  h.Clear();
+  HOST_CHECK(!h.Get(0, 6, 0, NULL, &avg, NULL));
+  }
+
+HOST_TEST(bmshistory, report)
+  {
+  OvmsBmsHistory h("voltage", "V", 0.001, 0, 3);
+  HOST_CHECK(h.Configure(3, "60:10"));
+  float v[3] = { 4.000, 3.950, 4.010 };
+  for (uint32_t now = 0; now < 300; now += 10)
+    h.Add(v, now);
+
+  StringWriter buf;
+  h.Report(COMMAND_RESULT_NORMAL, &buf, 300);
+  HOST_CHECK(buf.find("last 5 buckets (5 with data)") != std::string::npos);
+  HOST_CHECK(buf.find("Max deviation: cell 2 (-0.037 V)") != std::string::npos);
+
+  buf.clear();
+  h.Report(COMMAND_RESULT_NORMAL, &buf, 300, 0, 2, -1, true, true);
+  HOST_CHECK(buf.find("\"cells\":3,\"buckets\":2,\"avg\":[[4.000,3.950,4.010],[4.000,3.950,4.010]]}") != std::string::npos);
+  HOST_CHECK(buf.find("\"min\"") == std::string::npos);
+
+  buf.clear();
+  h.Report(COMMAND_RESULT_NORMAL, &buf, 300, 0, 0, 1);
+  HOST_CHECK(buf.find("BMS voltage cell 2") != std::string::npos);
+  HOST_CHECK(buf.find("-0.037") != std::string::npos);
+
+  buf.clear();
+  h.Report(COMMAND_RESULT_NORMAL, &buf, 300, 1);
+  HOST_CHECK(buf.find("Invalid tier") != std::string::npos);
+  }
+
+HOST_TEST(bmshistory, config)
+  {
+  OvmsBmsHistory h("voltage", "V", 0.001, 0, 3);
+  float v[2] = { 4.0, 4.0 };
+  h.Add(v, 0);                        // unconfigured: ignored
+  StringWriter buf;
+  h.Report(COMMAND_RESULT_NORMAL, &buf, 0);
+  HOST_CHECK(buf.find("disabled") != std::string::npos);
+
+  HOST_CHECK(!h.Configure(2, "60"));
+  HOST_CHECK(!h.Configure(2, "60:10;3600:5"));
+  HOST_CHECK(!h.Configure(2, "1:1,2:2,3:3,4:4,5:5"));
+  HOST_CHECK_EQUAL(h.GetTierCount(), 0);
+  HOST_CHECK(h.Configure(2, "1:1,2:2,3:3,4:4"));
+  HOST_CHECK_EQUAL(h.GetTierCount(), 4);
+
+  // unchanged configuration keeps the data:
+  h.Add(v, 0);
+  h.Add(v, 10);
+  HOST_CHECK(h.Configure(2, "1:1,2:2,3:3,4:4"));
+  HOST_CHECK(h.Get(3, 2, 0, NULL, NULL, NULL));
+  HOST_CHECK(h.Configure(0, "1:1,2:2,3:3,4:4"));
+  HOST_CHECK_EQUAL(h.GetTierCount(), 0);
+  }
+
+HOST_TEST(bmshistory, spill)
+  {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/ovms_bmshist_%d.csv", (int)getpid());
+  unlink(path);
+  OvmsBmsHistory h("voltage", "V", 0.001, 0, 3);
+  HOST_CHECK(h.Configure(2, "10:6,60:4"));
+  h.SetSpill(path);
+  float v[2] = { 3.5, 3.6 };
+  for (uint32_t now = 0; now < 130; now += 5)
+    h.Add(v, now);
+  h.Tick(130);
+  h.Tick(180);
+
+  FILE* f = fopen(path, "r");
+  HOST_CHECK(f != NULL);
+  if (!f) return;
+  char line[200];
+  int lines = 0;
+  bool header = false, data = true;
+  while (fgets(line, sizeof(line), f))
+    {
+    if (line[0] == '#')
+      header = true;
+    else
+      {
+      lines++;
+      data = data && (strstr(line, ",60,3.500,3.500,3.500,3.600,3.600,3.600\n") != NULL);
+      }
+    }
+  fclose(f);
+  unlink(path);
+  HOST_CHECK(header);
+  HOST_CHECK_EQUAL(lines, 3);
+  HOST_CHECK(data);
+  }
+
+HOST_BENCH(bmshistory, add)
+  {
+  // Cost of adding a complete set of 96 cell voltages to the default tiers:
+  OvmsBmsHistory h("voltage", "V", 0.001, 0, 3);
+  h.Configure(96, BMS_HISTORY_DEFTIERS);
+  float v[96];
+  for (int i = 0; i < 96; i++)
+    v[i] = 3.9 + 0.001 * i;
+  bench.ResetTimer();
+  for (uint64_t n = 0; n < bench.n; n++)
+    h.Add(v, (uint32_t)(n / 4));
+  }
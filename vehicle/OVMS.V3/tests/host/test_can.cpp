@@ -0,0 +1,199 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: CAN log formats & DBC decoding
+
+#include <string.h>
+#include "can.h"
+#include "canformat.h"
+#include "dbc.h"
+#include "hosttest.h"
+
+static void crtd_frame(CAN_log_message_t* msg, uint32_t id, int dlc)
+  {
+  memset(msg, 0, sizeof(*msg));
+  msg->type = CAN_LogFrame_RX;
+  msg->timestamp.tv_sec = 1524311386;
+  msg->timestamp.tv_usec = 811100;
+  msg->frame.FIR.B.FF = CAN_frame_std;
+  msg->frame.FIR.B.DLC = dlc;
+  msg->frame.MsgID = id;
+  for (int k=0; k<dlc; k++)
+    msg->frame.data.u8[k] = 0x11 * (k+1);
+  }
+
+HOST_TEST(can, crtd_get)
+  {
+  canformat* fmt = MyCanFormatFactory.NewFormat("crtd");
+  HOST_CHECK(fmt != NULL);
+  if (!fmt) return;
+  CAN_log_message_t msg;
+  crtd_frame(&msg, 0x100, 3);
+  HOST_CHECK_EQUAL(fmt->get(&msg), std::string("1524311386.811100 1R11 100 11 22 33\n"));
+  delete fmt;
+  }
+
+HOST_TEST(can, crtd_roundtrip)
+  {
+  canformat* fmt = MyCanFormatFactory.NewFormat("crtd");
+  if (!fmt) { HOST_CHECK(fmt != NULL); return; }
+  fmt->SetServeMode(canformat::Simulate);
+  CAN_log_message_t in, out;
+  crtd_frame(&in, 0x7e8, 8);
+  std::string line = fmt->get(&in);
+  memset(&out, 0, sizeof(out));
+  size_t used = fmt->put(&out, (uint8_t*)line.data(), line.size());
+  HOST_CHECK_EQUAL(used, line.size());
+  HOST_CHECK_EQUAL(out.type, CAN_LogFrame_RX);
+  HOST_CHECK_EQUAL(out.timestamp.tv_sec, in.timestamp.tv_sec);
+  HOST_CHECK_EQUAL(out.timestamp.tv_usec, in.timestamp.tv_usec);
+  HOST_CHECK_EQUAL(out.frame.MsgID, 0x7e8u);
+  HOST_CHECK_EQUAL((int)out.frame.FIR.B.DLC, 8);
+  HOST_CHECK(memcmp(out.frame.data.u8, in.frame.data.u8, 8) == 0);
+  delete fmt;
+  }
+
+HOST_TEST(can, gvret_binary_roundtrip)
+  {
+  canformat* fmt = MyCanFormatFactory.NewFormat("gvret-b");
+  if (!fmt) { HOST_CHECK(fmt != NULL); return; }
+  fmt->SetServeMode(canformat::Simulate);
+  CAN_log_message_t in1, in2, out;
+  crtd_frame(&in1, 0x7e8, 8);
+  crtd_frame(&in2, 0x18daf110, 3);
+  in2.frame.FIR.B.FF = CAN_frame_ext;
+  in2.timestamp.tv_usec += 2500;
+  std::string data = fmt->get(&in1) + fmt->get(&in2);
+  HOST_CHECK_EQUAL(data.size(), (size_t)(12+8 + 12+3));
+  uint32_t us = (uint32_t)in1.timestamp.tv_sec * 1000000 + (uint32_t)in1.timestamp.tv_usec;
+
+  // both records arrive in one buffer, the second is parsed from the backlog:
+  memset(&out, 0, sizeof(out));
+  size_t used = fmt->put(&out, (uint8_t*)data.data(), data.size());
+  HOST_CHECK_EQUAL(used, data.size());
+  HOST_CHECK_EQUAL(out.type, CAN_LogFrame_RX);
+  HOST_CHECK_EQUAL((uint32_t)out.timestamp.tv_sec, us / 1000000);
+  HOST_CHECK_EQUAL((uint32_t)out.timestamp.tv_usec, us % 1000000);
+  HOST_CHECK_EQUAL(out.frame.MsgID, 0x7e8u);
+  HOST_CHECK_EQUAL((int)out.frame.FIR.B.FF, (int)CAN_frame_std);
+  HOST_CHECK_EQUAL((int)out.frame.FIR.B.DLC, 8);
+  HOST_CHECK(memcmp(out.frame.data.u8, in1.frame.data.u8, 8) == 0);
+
+  memset(&out, 0, sizeof(out));
+  HOST_CHECK_EQUAL(fmt->put(&out, NULL, 0), (size_t)0);
+  HOST_CHECK_EQUAL(out.type, CAN_LogFrame_RX);
+  HOST_CHECK_EQUAL((uint32_t)out.timestamp.tv_usec, (us + 2500) % 1000000);
+  HOST_CHECK_EQUAL(out.frame.MsgID, 0x18daf110u);
+  HOST_CHECK_EQUAL((int)out.frame.FIR.B.FF, (int)CAN_frame_ext);
+  HOST_CHECK_EQUAL((int)out.frame.FIR.B.DLC, 3);
+  HOST_CHECK(memcmp(out.frame.data.u8, in2.frame.data.u8, 3) == 0);
+  HOST_CHECK_EQUAL(fmt->GetPutBufferUsed(), (size_t)0);
+  delete fmt;
+  }
+
+static const char test_dbc[] =
+  "VERSION \"host\"\n"
+  "BO_ 256 Battery: 8 Vector__XXX\n"
+  " SG_ Voltage : 0|16@1+ (0.1,0) [0|6553.5] \"V\" Vector__XXX\n"
+  " SG_ Current : 16|16@1- (0.1,0) [-3276.8|3276.7] \"A\" Vector__XXX\n"
+  " SG_ SOC : 39|8@0+ (0.5,0) [0|100] \"%\" Vector__XXX\n";
+
+HOST_TEST(dbc, decode)
+  {
+  dbcfile dbc;
+  HOST_CHECK(dbc.LoadString("host", test_dbc, strlen(test_dbc)));
+  dbcMessage* m = dbc.m_messages.FindMessage(256);
+  HOST_CHECK(m != NULL);
+  if (!m) return;
+  dbcSignal* voltage = m->FindSignal("Voltage");
+  dbcSignal* current = m->FindSignal("Current");
+  dbcSignal* soc = m->FindSignal("SOC");
+  HOST_CHECK(voltage && current && soc);
+  if (!voltage || !current || !soc) return;
+
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.MsgID = 256;
+  frame.FIR.B.DLC = 8;
+  frame.data.u8[0] = 0x1c;  // 3612 → 361.2 V
+  frame.data.u8[1] = 0x0e;
+  frame.data.u8[2] = 0x0c;  // -500 → -50.0 A
+  frame.data.u8[3] = 0xfe;
+  frame.data.u8[4] = 0x9b;  // 155 → 77.5 %
+  HOST_CHECK_NEAR(voltage->Decode(&frame).GetDouble(), 361.2, 0.001);
+  HOST_CHECK_NEAR(current->Decode(&frame).GetDouble(), -50.0, 0.001);
+  HOST_CHECK_NEAR(soc->Decode(&frame).GetDouble(), 77.5, 0.001);
+  }
+
+HOST_BENCH(can, crtd_get)
+  {
+  canformat* fmt = MyCanFormatFactory.NewFormat("crtd");
+  CAN_log_message_t msg;
+  crtd_frame(&msg, 0x100, 8);
+  bench.SetBytes(fmt->get(&msg).size());
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(fmt->get(&msg));
+  delete fmt;
+  }
+
+HOST_BENCH(can, crtd_put)
+  {
+  canformat* fmt = MyCanFormatFactory.NewFormat("crtd");
+  fmt->SetServeMode(canformat::Simulate);
+  CAN_log_message_t msg;
+  crtd_frame(&msg, 0x100, 8);
+  std::string line = fmt->get(&msg);
+  bench.SetBytes(line.size());
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    memset(&msg, 0, sizeof(msg));
+    fmt->put(&msg, (uint8_t*)line.data(), line.size());
+    }
+  delete fmt;
+  }
+
+HOST_BENCH(dbc, decode)
+  {
+  dbcfile dbc;
+  dbc.LoadString("host", test_dbc, strlen(test_dbc));
+  dbcMessage* m = dbc.m_messages.FindMessage(256);
+  dbcSignal* voltage = m ? m->FindSignal("Voltage") : NULL;
+  if (!voltage) return;
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.FIR.B.DLC = 8;
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    frame.data.u8[0] = (uint8_t)i;
+    HostBenchKeep(voltage->Decode(&frame));
+    }
+  }
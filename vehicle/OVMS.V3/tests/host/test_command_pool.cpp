@@ -0,0 +1,80 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests: command worker pool
+
+#include <string.h>
+#include <atomic>
+#include "command_pool.h"
+#include "buffered_shell.h"
+#include "ovms_command.h"
+#include "ovms_semaphore.h"
+#include "hosttest.h"
+
+static std::atomic_bool xhpool_hold(false);
+static std::atomic_int xhpool_running(0);
+
+static void xhpool_slow(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  xhpool_running++;
+  while (xhpool_hold)
+    vTaskDelay(1);
+  xhpool_running--;
+  writer->puts("slow");
+  }
+
+static void xhpool_quick(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  writer->puts("quick");
+  }
+
+HOST_TEST(command_pool, source_limit)
+  {
+  // long running commands of one source must not occupy all workers:
+  MyCommandApp.RegisterCommand("xhslow", "Host test", xhpool_slow);
+  MyCommandApp.RegisterCommand("xhquick", "Host test", xhpool_quick);
+  OvmsSemaphore slowdone(12), quickdone;
+  auto slow = [&](OvmsShell* shell) { delete shell; slowdone.Give(); };
+  auto quick = [&](OvmsShell* shell) { delete shell; quickdone.Give(); };
+
+  // jobs beyond the source limit wait queued:
+  xhpool_hold = true;
+  for (int i = 0; i < 12; i++)
+    HOST_CHECK(MyCommandPool.Submit(new BufferedShell(false, COMMAND_RESULT_NORMAL), "xhslow", slow, "xh.a"));
+  for (int k=0; k<200 && xhpool_running < COMMAND_POOL_SOURCE_MAX; k++)
+    vTaskDelay(pdMS_TO_TICKS(5));
+  HOST_CHECK(MyCommandPool.Submit(new BufferedShell(false, COMMAND_RESULT_NORMAL), "xhquick", quick, "xh.b"));
+  HOST_CHECK(quickdone.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK_EQUAL((int)xhpool_running, COMMAND_POOL_SOURCE_MAX);
+
+  xhpool_hold = false;
+  for (int i = 0; i < 12; i++)
+    HOST_CHECK(slowdone.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK_EQUAL((int)xhpool_running, 0);
+  }
@@ -0,0 +1,85 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: configuration store
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include "ovms_config.h"
+#include "host_platform.h"
+#include "hosttest.h"
+
+HOST_TEST(config, values)
+  {
+  MyConfig.RegisterParam("xh.test", "Host test", true, true);
+  MyConfig.SetParamValue("xh.test", "string", "hello");
+  MyConfig.SetParamValueInt("xh.test", "int", 42);
+  MyConfig.SetParamValueFloat("xh.test", "float", 1.5);
+  MyConfig.SetParamValueBool("xh.test", "bool", true);
+  HOST_CHECK_EQUAL(MyConfig.GetParamValue("xh.test", "string"), std::string("hello"));
+  HOST_CHECK_EQUAL(MyConfig.GetParamValueInt("xh.test", "int"), 42);
+  HOST_CHECK_NEAR(MyConfig.GetParamValueFloat("xh.test", "float"), 1.5, 0.0001);
+  HOST_CHECK(MyConfig.GetParamValueBool("xh.test", "bool"));
+  HOST_CHECK_EQUAL(MyConfig.GetParamValue("xh.test", "missing", "def"), std::string("def"));
+  MyConfig.DeleteInstance("xh.test", "string");
+  HOST_CHECK(!MyConfig.IsDefined("xh.test", "string"));
+  }
+
+HOST_TEST(config, persisted)
+  {
+  MyConfig.RegisterParam("xh.persist", "Host test", true, true);
+  MyConfig.SetParamValue("xh.persist", "key", "value");
+  struct stat st;
+  std::string path = host_vfs_path("/store/ovms_config/xh.persist");
+  HOST_CHECK(stat(path.c_str(), &st) == 0);
+  FILE* f = fopen("/store/ovms_config/xh.persist", "r");
+  HOST_CHECK(f != NULL);
+  if (f)
+    {
+    char buf[64] = "";
+    while (fgets(buf, sizeof(buf), f) && buf[0] == '#') {}
+    fclose(f);
+    HOST_CHECK_EQUAL(std::string(buf), std::string("key\tvalue\n"));
+    }
+  }
+
+HOST_BENCH(config, get_value)
+  {
+  MyConfig.RegisterParam("xh.bench", "Host bench", true, true);
+  MyConfig.SetParamValue("xh.bench", "key", "value");
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(MyConfig.GetParamValue("xh.bench", "key"));
+  }
+
+HOST_BENCH(config, get_value_int)
+  {
+  MyConfig.SetParamValueInt("xh.bench", "int", 12345);
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(MyConfig.GetParamValueInt("xh.bench", "int"));
+  }
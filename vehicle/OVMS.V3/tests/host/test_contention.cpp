@@ -0,0 +1,275 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: mutex & queue contention statistics
+//  (tests need the profiling build: make CONTENTION=1 BUILD=build-contention)
+
+#include <string.h>
+#include <atomic>
+#include "ovms_mutex.h"
+#include "ovms_contention.h"
+#include "string_writer.h"
+#include "can.h"
+#include "hosttest.h"
+
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+
+class HostStatsMutex : public OvmsMutex
+  {
+  public:
+    OvmsContentionStats& Stats() { return m_stats; }
+  };
+
+class HostStatsRecMutex : public OvmsRecMutex
+  {
+  public:
+    OvmsContentionStats& Stats() { return m_stats; }
+  };
+
+/**
+ * HostHolder: holds a mutex for some time on a second task
+ */
+class HostHolder
+  {
+  public:
+    HostHolder(OvmsMutex* mutex, int ms) : m_mutex(mutex), m_ms(ms), m_locked(false), m_done(false)
+      {
+      xTaskCreate(Task, "xh holder", 4096, this, 5, NULL);
+      while (!m_locked)
+        vTaskDelay(1);
+      }
+    ~HostHolder()
+      {
+      while (!m_done)
+        vTaskDelay(1);
+      }
+    static void Task(void* param)
+      {
+      HostHolder* me = (HostHolder*)param;
+      me->m_mutex->Lock();
+      me->m_locked = true;
+      vTaskDelay(pdMS_TO_TICKS(me->m_ms));
+      me->m_mutex->Unlock();
+      me->m_done = true;
+      vTaskDelete(NULL);
+      }
+
+  public:
+    OvmsMutex* m_mutex;
+    int m_ms;
+    std::atomic_bool m_locked, m_done;
+  };
+
+HOST_TEST(contention, mutex)
+  {
+  HostStatsMutex m;
+  m.SetName("xh.c.mutex");
+  OvmsContentionStats& s = m.Stats();
+  HOST_CHECK_EQUAL(std::string(s.m_type), std::string("mutex"));
+  HOST_CHECK(s.m_owner != NULL);
+  for (int i = 0; i < 3; i++)
+    {
+    OvmsMutexLock lock(&m);
+    HOST_CHECK(lock.IsLocked());
+    }
+  HOST_CHECK_EQUAL(s.m_count, 3u);
+  HOST_CHECK_EQUAL(s.m_contended, 0u);
+  HOST_CHECK_EQUAL(s.m_drops, 0u);
+
+  // Contended lock: wait time is recorded
+  {
+  HostHolder holder(&m, 30);
+  OvmsMutexLock lock(&m);
+  HOST_CHECK(lock.IsLocked());
+  }
+  HOST_CHECK_EQUAL(s.m_count, 5u);      // holder + contender
+  HOST_CHECK_EQUAL(s.m_contended, 1u);
+  HOST_CHECK(s.m_maxwait >= 10000);
+  HOST_CHECK(s.m_waittime >= s.m_maxwait);
+
+  // Timeouts count as drops, the holder's hold time is recorded
+  {
+  HostHolder holder(&m, 50);
+  HOST_CHECK(!m.Lock(0));
+  HOST_CHECK(!m.Lock(pdMS_TO_TICKS(5)));
+  }
+  HOST_CHECK_EQUAL(s.m_drops, 2u);
+  HOST_CHECK_EQUAL(s.m_count, 6u);
+  HOST_CHECK(s.m_maxhold >= 30000);
+
+  s.Reset();
+  HOST_CHECK_EQUAL(s.m_count, 0u);
+  HOST_CHECK_EQUAL(s.m_maxhold, 0u);
+  }
+
+HOST_TEST(contention, recmutex)
+  {
+  HostStatsRecMutex m;
+  OvmsContentionStats& s = m.Stats();
+  HOST_CHECK_EQUAL(std::string(s.m_type), std::string("recmutex"));
+  {
+  OvmsRecMutexLock outer(&m);
+  OvmsRecMutexLock inner(&m);
+  HOST_CHECK(inner.IsLocked());
+  }
+  // Only the outermost lock counts:
+  HOST_CHECK_EQUAL(s.m_count, 1u);
+  OvmsRecMutexLock again(&m);
+  HOST_CHECK_EQUAL(s.m_count, 2u);
+  }
+
+HOST_TEST(contention, queue)
+  {
+  QueueHandle_t queue = xQueueCreate(2, sizeof(int));
+  OvmsContentionStats* s = OvmsContention::RegisterQueue(queue, "xh.c.queue");
+  HOST_CHECK_EQUAL(s->m_size, 2u);
+  for (int i = 0; i < 3; i++)
+    OVMS_QUEUE_SEND(s, queue, &i, 0);
+  HOST_CHECK_EQUAL(s->m_count, 3u);
+  HOST_CHECK_EQUAL(s->m_drops, 1u);
+  HOST_CHECK_EQUAL(s->m_highwater, 2u);
+  HOST_CHECK_EQUAL(s->m_contended, 0u);
+
+  // Blocking send: waits for the receiver
+  int item;
+  TaskHandle_t task;
+  xTaskCreate([](void* param)
+    {
+    int v;
+    vTaskDelay(pdMS_TO_TICKS(20));
+    xQueueReceive((QueueHandle_t)param, &v, portMAX_DELAY);
+    vTaskDelete(NULL);
+    }, "xh receiver", 4096, queue, 5, &task);
+  item = 3;
+  HOST_CHECK(OVMS_QUEUE_SEND(s, queue, &item, pdMS_TO_TICKS(1000)) == pdTRUE);
+  HOST_CHECK_EQUAL(s->m_contended, 1u);
+  HOST_CHECK(s->m_maxwait >= 5000);
+
+  // Receiver side accounting:
+  OvmsContentionStats* r = OvmsContention::RegisterQueue(queue, "xh.c.queue.rx");
+  xQueueReceive(queue, &item, 0);
+  OVMS_QUEUE_RECEIVED(r, queue);
+  HOST_CHECK_EQUAL(r->m_count, 1u);
+  HOST_CHECK_EQUAL(r->m_highwater, 2u);
+
+  OvmsContention::DeregisterQueue(r);
+  OvmsContention::DeregisterQueue(s);
+  vQueueDelete(queue);
+  }
+
+HOST_TEST(contention, report)
+  {
+  QueueHandle_t queue = xQueueCreate(1, sizeof(int));
+  OvmsContentionStats* s = OvmsContention::RegisterQueue(queue, "xh.c.report.queue");
+  HostStatsMutex m;
+  m.SetName("xh.c.report.mutex");
+  int item = 0;
+  OVMS_QUEUE_SEND(s, queue, &item, 0);
+  OVMS_QUEUE_SEND(s, queue, &item, 0);
+  for (int i = 0; i < 5; i++)
+    {
+    OvmsMutexLock lock(&m);
+    }
+
+  StringWriter w;
+  OvmsContention::Report(&w, "count", 0, "xh.c.report");
+  size_t pm = w.find("xh.c.report.mutex"), pq = w.find("xh.c.report.queue");
+  HOST_CHECK(pm != std::string::npos && pq != std::string::npos);
+  HOST_CHECK(pm < pq);
+  HOST_CHECK(w.find("1/1") != std::string::npos);   // queue fill level
+
+  w.clear();
+  OvmsContention::Report(&w, "drops", 1, "xh.c.report");
+  HOST_CHECK(w.find("xh.c.report.queue") != std::string::npos);
+  HOST_CHECK(w.find("xh.c.report.mutex") == std::string::npos);
+  HOST_CHECK(w.find("(1 more)") != std::string::npos);
+
+  // Unused & deregistered objects are not listed:
+  OvmsContention::DeregisterQueue(s);
+  vQueueDelete(queue);
+  m.Stats().Reset();
+  w.clear();
+  OvmsContention::Report(&w, "wait", 0, "xh.c.report");
+  HOST_CHECK(w.find("xh.c.report") == std::string::npos);
+  HOST_CHECK(w.find("No contention data") != std::string::npos);
+  }
+
+HOST_TEST(contention, can_listener)
+  {
+  QueueHandle_t queue = xQueueCreate(4, sizeof(CAN_frame_t));
+  MyCan.RegisterListener(queue, false, "xh.c.listener");
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.MsgID = 0x123;
+  for (int i = 0; i < 6; i++)
+    MyCan.NotifyListeners(&frame, false);
+  MyCan.NotifyListeners(&frame, true);    // no txfeedback
+  StringWriter w;
+  OvmsContention::Report(&w, "drops", 0, "xh.c.listener");
+  HOST_CHECK(w.find("xh.c.listener") != std::string::npos);
+  HOST_CHECK(w.find("4/4") != std::string::npos);
+  MyCan.DeregisterListener(queue);
+  vQueueDelete(queue);
+  w.clear();
+  OvmsContention::Report(&w, "drops", 0, "xh.c.listener");
+  HOST_CHECK(w.find("xh.c.listener") == std::string::npos);
+  }
+
+#endif // CONFIG_OVMS_DEV_CONTENTION_STATS
+
+// Lock overhead, compare with the profiling build:
+HOST_BENCH(contention, mutex_lock)
+  {
+  OvmsMutex m;
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    m.Lock();
+    m.Unlock();
+    }
+  }
+
+HOST_BENCH(contention, queue_send)
+  {
+  QueueHandle_t queue = xQueueCreate(1, sizeof(int));
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  OvmsContentionStats* s = OvmsContention::RegisterQueue(queue, "xh.b.queue");
+#endif
+  int item = 0;
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    OVMS_QUEUE_SEND(s, queue, &item, 0);
+    xQueueReceive(queue, &item, 0);
+    }
+#ifdef CONFIG_OVMS_DEV_CONTENTION_STATS
+  OvmsContention::DeregisterQueue(s);
+#endif
+  vQueueDelete(queue);
+  }
@@ -0,0 +1,104 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: event framework
+
+#include <string.h>
+#include "ovms_events.h"
+#include "ovms_semaphore.h"
+#include "hosttest.h"
+
+HOST_TEST(events, signal)
+  {
+  OvmsSemaphore done;
+  std::string got_event;
+  void* got_data = NULL;
+  int calls = 0;
+  MyEvents.RegisterEvent("hosttest", "xh.test.signal", [&](std::string event, void* data)
+    {
+    got_event = event;
+    got_data = data;
+    calls++;
+    done.Give();
+    });
+  MyEvents.SignalEvent("xh.test.signal", (void*)&calls);
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK_EQUAL(got_event, std::string("xh.test.signal"));
+  HOST_CHECK(got_data == (void*)&calls);
+  HOST_CHECK_EQUAL(calls, 1);
+  MyEvents.DeregisterEvent("hosttest");
+  }
+
+HOST_TEST(events, data_copy)
+  {
+  OvmsSemaphore done;
+  std::string got;
+  MyEvents.RegisterEvent("hosttest", "xh.test.copy", [&](std::string event, void* data)
+    {
+    got = (const char*)data;
+    done.Give();
+    });
+  char text[] = "payload";
+  MyEvents.SignalEvent("xh.test.copy", text, sizeof(text));
+  strcpy(text, "changed");
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK_EQUAL(got, std::string("payload"));
+  MyEvents.DeregisterEvent("hosttest");
+  }
+
+// Keep the number of events in flight below the event queue size:
+#define BENCH_EVENTS_INFLIGHT (CONFIG_OVMS_HW_EVENT_QUEUE_SIZE/2)
+
+static OvmsSemaphore* bench_credits;
+
+static void bench_signal_done(const char* event, void* data)
+  {
+  bench_credits->Give();
+  }
+
+HOST_BENCH(events, signal_roundtrip)
+  {
+  OvmsSemaphore credits(BENCH_EVENTS_INFLIGHT, BENCH_EVENTS_INFLIGHT);
+  uint64_t calls = 0;
+  MyEvents.RegisterEvent("hostbench", "xh.bench.signal", [&](std::string event, void* data)
+    {
+    calls++;
+    });
+  bench_credits = &credits;
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    credits.Take();
+    MyEvents.SignalEvent("xh.bench.signal", NULL, bench_signal_done);
+    }
+  for (int i = 0; i < BENCH_EVENTS_INFLIGHT; i++)
+    credits.Take();
+  MyEvents.DeregisterEvent("hostbench");
+  HostBenchKeep(calls);
+  }
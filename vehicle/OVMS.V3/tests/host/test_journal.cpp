@@ -0,0 +1,204 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: server v3 store-and-forward journal
+
+#include <stdio.h>
+#include <vector>
+#include "ovms_server_v3_journal.h"
+#include "hosttest.h"
+
+struct JournalRecord
+  {
+  std::string topic;
+  std::string payload;
+  };
+
+static int journal_drain(OvmsServerV3Journal& journal, std::vector<JournalRecord>& out, int maxcount, int accept = -1)
+  {
+  return journal.Drain(maxcount, [&](const char* topic, const extram::string& payload) -> bool
+    {
+    if (accept == 0) return false;
+    if (accept > 0) accept--;
+    out.push_back({ topic, std::string(payload.data(), payload.size()) });
+    return true;
+    });
+  }
+
+static extram::string xs(const std::string& s)
+  {
+  return extram::string(s.data(), s.size());
+  }
+
+HOST_TEST(journal, roundtrip)
+  {
+  OvmsServerV3Journal journal;
+  HOST_CHECK(!journal.Add("notify/info/x", xs("disabled")));
+  journal.Configure("/store/xh_journal_rt", 64);
+  HOST_CHECK(journal.IsEnabled());
+  HOST_CHECK(journal.Add("notify/info/test", xs("line 1\nline 2\\end\r")));
+  HOST_CHECK(journal.Add("history/metrics", xs("{\"time\":1,\"metrics\":{\"v.b.soc\":50}}")));
+  HOST_CHECK_EQUAL(journal.GetDepth(), 2);
+
+  std::vector<JournalRecord> out;
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 10), 2);
+  HOST_CHECK_EQUAL(journal.GetDepth(), 0);
+  HOST_CHECK_EQUAL(out.size(), (size_t)2);
+  if (out.size() == 2)
+    {
+    HOST_CHECK_EQUAL(out[0].topic, std::string("notify/info/test"));
+    HOST_CHECK_EQUAL(out[0].payload, std::string("line 1\nline 2\\end\r"));
+    HOST_CHECK_EQUAL(out[1].topic, std::string("history/metrics"));
+    }
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 10), 0);
+  }
+
+HOST_TEST(journal, dedup)
+  {
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_dedup", 64);
+  journal.Add("notify/alert/a", xs("same"));
+  journal.Add("notify/alert/a", xs("same"));
+  journal.Add("notify/alert/b", xs("same"));
+  journal.Add("notify/alert/a", xs("same"));
+  HOST_CHECK_EQUAL(journal.GetDepth(), 3);
+  }
+
+HOST_TEST(journal, dedup_window)
+  {
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_dedupw", 64);
+  time_t t = 1700000000;
+  journal.Add("notify/alert/a", xs("same"), t);
+  journal.Add("notify/alert/a", xs("same"), t + 10);
+  journal.Add("notify/alert/a", xs("same"), t + 3*3600);
+  HOST_CHECK_EQUAL(journal.GetDepth(), 2);
+
+  // replay also keeps repeats hours apart:
+  std::vector<JournalRecord> out;
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 10), 2);
+  HOST_CHECK_EQUAL(out.size(), (size_t)2);
+  }
+
+HOST_TEST(journal, backpressure)
+  {
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_bp", 64);
+  for (int i = 0; i < 5; i++)
+    journal.Add("notify/info/n", xs(std::to_string(i)));
+
+  std::vector<JournalRecord> out;
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 10, 2), 2);
+  HOST_CHECK_EQUAL(journal.GetDepth(), 3);
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 2), 2);
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 10), 1);
+  HOST_CHECK_EQUAL(out.size(), (size_t)5);
+  for (size_t i = 0; i < out.size(); i++)
+    HOST_CHECK_EQUAL(out[i].payload, std::to_string(i));
+  }
+
+HOST_TEST(journal, resume)
+  {
+  std::vector<JournalRecord> out;
+    {
+    OvmsServerV3Journal journal;
+    journal.Configure("/store/xh_journal_resume", 64);
+    for (int i = 0; i < 5; i++)
+      journal.Add("notify/info/n", xs(std::to_string(i)));
+    HOST_CHECK_EQUAL(journal_drain(journal, out, 2), 2);
+    }
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_resume", 64);
+  HOST_CHECK_EQUAL(journal.GetDepth(), 3);
+  HOST_CHECK_EQUAL(journal_drain(journal, out, 10), 3);
+  HOST_CHECK_EQUAL(out.size(), (size_t)5);
+  if (out.size() == 5)
+    HOST_CHECK_EQUAL(out[2].payload, std::string("2"));
+  }
+
+HOST_TEST(journal, rotate)
+  {
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_rotate", 8);
+  const int count = 200;
+  std::string pad(80, 'x');
+  for (int i = 0; i < count; i++)
+    journal.Add("history/metrics", xs(std::to_string(i) + pad));
+  int depth = journal.GetDepth();
+  HOST_CHECK(depth > 0 && depth < count);
+
+  std::vector<JournalRecord> out;
+  HOST_CHECK_EQUAL(journal_drain(journal, out, count), depth);
+  HOST_CHECK_EQUAL(journal.GetDepth(), 0);
+  if (!out.empty())
+    {
+    // the oldest records have been dropped, the newest are retained in order:
+    HOST_CHECK_EQUAL(out.back().payload, std::to_string(count-1) + pad);
+    HOST_CHECK_EQUAL(out.front().payload, std::to_string(count-depth) + pad);
+    }
+  }
+
+HOST_BENCH(journal, add)
+  {
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_bench", 256);
+  extram::string payload = xs("{\"time\":1600000000,\"metrics\":{\"v.b.soc\":55.5,\"v.p.odometer\":12345.6}}");
+  bench.SetBytes(payload.size());
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    payload[8] = '0' + (i % 10);
+    journal.Add("history/metrics", payload);
+    }
+  journal.Clear();
+  }
+
+HOST_BENCH(journal, add_drain)
+  {
+  // Record & replay in blocks of 100 records (time per record):
+  OvmsServerV3Journal journal;
+  journal.Configure("/store/xh_journal_bench", 256);
+  extram::string payload = xs("{\"time\":1600000000,\"metrics\":{\"v.b.soc\":55.5,\"v.p.odometer\":12345.6}}");
+  size_t bytes = 0;
+  bench.SetBytes(payload.size());
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    payload[8] = '0' + (i % 10);
+    journal.Add("history/metrics", payload);
+    if ((i % 100) == 99 || i == bench.n-1)
+      {
+      journal.Drain(100, [&](const char* topic, const extram::string& payload) -> bool
+        {
+        bytes += payload.size();
+        return true;
+        });
+      }
+    }
+  HostBenchKeep(bytes);
+  }
@@ -0,0 +1,860 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: metrics framework
+
+#include "ovms_log.h"
+static const char *TAG = "hostmetrics";
+
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "ovms_metrics.h"
+#include "metrics_standard.h"
+#include "ovms_config.h"
+#include "ovms_events.h"
+#include "ovms_semaphore.h"
+#include "buffered_shell.h"
+#include "host_platform.h"
+#include "hosttest.h"
+
+HOST_TEST(metrics, int)
+  {
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.int", 0, 42);
+  HOST_CHECK(m != NULL);
+  HOST_CHECK_EQUAL(m->AsInt(), 42);
+  HOST_CHECK(MyMetrics.Find("xh.t.int") == m);
+  HOST_CHECK(MyMetrics.InitInt("xh.t.int", 0, 7) == m);
+  HOST_CHECK_EQUAL(m->AsInt(), 7);
+  m->SetValue(-17);
+  HOST_CHECK_EQUAL(m->AsInt(), -17);
+  HOST_CHECK_EQUAL(m->AsString(), std::string("-17"));
+  m->SetValue(std::string("123"));
+  HOST_CHECK_EQUAL(m->AsInt(), 123);
+  HOST_CHECK(m->IsDefined());
+  }
+
+HOST_TEST(metrics, float_units)
+  {
+  OvmsMetricFloat* m = MyMetrics.InitFloat("xh.t.float", 0, 0, Kilometers);
+  m->SetValue(100.0f);
+  HOST_CHECK_NEAR(m->AsFloat(), 100.0, 0.001);
+  HOST_CHECK_NEAR(m->AsFloat(0, Miles), 62.137, 0.01);
+  m->SetValue(50.0f, Miles);
+  HOST_CHECK_NEAR(m->AsFloat(), 80.467, 0.01);
+  HOST_CHECK_EQUAL(m->AsString("", Kilometers, 1), std::string("80.5"));
+
+  OvmsMetricFloat* t = MyMetrics.InitFloat("xh.t.temp", 0, 20, Celcius);
+  HOST_CHECK_NEAR(t->AsFloat(0, Fahrenheit), 68.0, 0.001);
+  }
+
+HOST_TEST(metrics, string_bool)
+  {
+  OvmsMetricString* s = MyMetrics.InitString("xh.t.string", 0, "hello");
+  HOST_CHECK_EQUAL(s->AsString(), std::string("hello"));
+  s->SetValue(std::string("world"));
+  HOST_CHECK_EQUAL(s->AsString(), std::string("world"));
+
+  OvmsMetricBool* b = MyMetrics.InitBool("xh.t.bool", 0, false);
+  HOST_CHECK(!b->AsBool());
+  b->SetValue(std::string("yes"));
+  HOST_CHECK(b->AsBool());
+  HOST_CHECK_EQUAL(b->AsString(), std::string("yes"));
+  }
+
+HOST_TEST(metrics, modified)
+  {
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.modified", 0, 1);
+  size_t modifier = MyMetrics.RegisterModifier();
+  m->IsModifiedAndClear(modifier);
+  m->SetValue(1);
+  HOST_CHECK(!m->IsModified(modifier));
+  m->SetValue(2);
+  HOST_CHECK(m->IsModifiedAndClear(modifier));
+  HOST_CHECK(!m->IsModified(modifier));
+  }
+
+HOST_TEST(metrics, standard)
+  {
+  HOST_CHECK(StandardMetrics.ms_v_bat_soc != NULL);
+  HOST_CHECK(MyMetrics.Find("v.b.soc") == StandardMetrics.ms_v_bat_soc);
+  StandardMetrics.ms_v_bat_soc->SetValue(55.5f);
+  HOST_CHECK_NEAR(MyMetrics.Find("v.b.soc")->AsFloat(), 55.5, 0.001);
+  }
+
+HOST_TEST(metrics, vector)
+  {
+  OvmsMetricVector<float>* v = MyMetrics.InitVector<float>("xh.t.vector", 0, NULL, Volts);
+  size_t modifier = MyMetrics.RegisterModifier();
+  v->SetElemValue(2, 3.5f);
+  HOST_CHECK(v->IsModifiedAndClear(modifier));
+  HOST_CHECK_EQUAL(v->GetSize(), 3u);
+  HOST_CHECK_EQUAL(v->AsString(), std::string("0,0,3.5"));
+  v->SetElemValue(2, 3.5f);
+  HOST_CHECK(!v->IsModifiedAndClear(modifier));
+  float vals[3] = { 1, 2, 3 };
+  v->SetElemValues(1, 3, vals);
+  HOST_CHECK(v->IsModifiedAndClear(modifier));
+  HOST_CHECK_EQUAL(v->AsString(), std::string("0,1,2,3"));
+  HOST_CHECK_NEAR(v->GetElemValue(3), 3.0, 0.001);
+  HOST_CHECK_NEAR(v->GetElemValue(9), 0.0, 0.001);
+  v->SetValue(std::string("4,5"));
+  HOST_CHECK_EQUAL((int)v->AsVector().size(), 2);
+  v->ClearValue();
+  HOST_CHECK_EQUAL(v->GetSize(), 0u);
+  HOST_CHECK(v->IsModifiedAndClear(modifier));
+  }
+
+HOST_TEST(metrics, set_bitset)
+  {
+  OvmsMetricSet<int>* s = MyMetrics.InitSet<int>("xh.t.set", 0, "3,1,2");
+  HOST_CHECK_EQUAL(s->AsString(), std::string("1,2,3"));
+  HOST_CHECK_EQUAL((int)s->AsSet().count(2), 1);
+
+  OvmsMetricBitset<16>* b = MyMetrics.InitBitset<16>("xh.t.bitset", 0, "1,5");
+  HOST_CHECK_EQUAL(b->AsString(), std::string("1,5"));
+  HOST_CHECK_EQUAL(b->AsJSON(), std::string("[1,5]"));
+  std::bitset<16> bits = b->AsBitset();
+  HOST_CHECK(bits[0] && bits[4] && !bits[1]);
+  size_t modifier = MyMetrics.RegisterModifier();
+  b->IsModifiedAndClear(modifier);
+  b->SetValue(bits);
+  HOST_CHECK(!b->IsModified(modifier));
+  }
+
+/**
+ * HostContender: runs a function in a loop on a second task while in scope
+ */
+class HostContender
+  {
+  public:
+    HostContender(std::function<void()> fn) : m_fn(fn), m_stop(false), m_done(false), m_loops(0)
+      {
+      xTaskCreate(Task, "xh contender", 4096, this, 5, NULL);
+      }
+    ~HostContender()
+      {
+      m_stop = true;
+      while (!m_done)
+        vTaskDelay(1);
+      }
+    static void Task(void* param)
+      {
+      HostContender* me = (HostContender*)param;
+      while (!me->m_stop)
+        {
+        me->m_fn();
+        me->m_loops++;
+        }
+      me->m_done = true;
+      vTaskDelete(NULL);
+      }
+
+  public:
+    std::function<void()> m_fn;
+    std::atomic_bool m_stop, m_done;
+    std::atomic_ulong m_loops;
+  };
+
+HOST_TEST(metrics, contention)
+  {
+  // Writers always fill the vector & string with one value, readers must
+  //  never see a mix (torn read):
+  OvmsMetricVector<int>* v = MyMetrics.InitVector<int>("xh.t.contention");
+  OvmsMetricString* s = MyMetrics.InitString("xh.t.contention.s");
+  OvmsMetricBitset<64>* b = MyMetrics.InitBitset<64>("xh.t.contention.b");
+  std::atomic_int torn(0);
+  int reads = 0;
+  {
+  int k = 0;
+  HostContender writer([&]()
+    {
+    k++;
+    std::vector<int> value(16 + (k & 15), k);
+    v->SetValue(value);
+    s->SetValue(std::string(20 + (k & 31), 'a' + (k % 26)));
+    b->SetValue((k & 1) ? std::bitset<64>().set() : std::bitset<64>());
+    });
+  int64_t end = host_timer_real() + 200000;
+  while (host_timer_real() < end)
+    {
+    std::vector<int> value = v->AsVector();
+    for (size_t i = 1; i < value.size(); i++)
+      if (value[i] != value[0]) torn++;
+    std::string str = s->AsString();
+    if (str.find_first_not_of(str.substr(0, 1)) != std::string::npos) torn++;
+    std::bitset<64> bits = b->AsBitset();
+    if (!bits.all() && !bits.none()) torn++;
+    reads++;
+    }
+  HOST_CHECK(writer.m_loops > 0);
+  }
+  HOST_CHECK(reads > 0);
+  HOST_CHECK_EQUAL((int)torn, 0);
+  }
+
+HOST_TEST(metrics, rcu_reader_blocked)
+  {
+  // a reader still on a former value never holds off writes, the former
+  //  values are reclaimed once the reader has left:
+  OvmsRcuValue<std::string> rv;
+  rv.Write("a");
+  std::atomic_bool reading(false), release(false);
+  std::string seen;
+  std::thread reader([&]()
+    {
+    rv.Read([&](const std::string& v)
+      {
+      reading = true;
+      while (!release)
+        vTaskDelay(1);
+      seen = v;
+      });
+    });
+  while (!reading)
+    vTaskDelay(1);
+  HOST_CHECK(rv.Write("b"));
+  HOST_CHECK(rv.Write("c"));
+  HOST_CHECK(!rv.Write("c"));
+  HOST_CHECK_EQUAL(rv.Get(), std::string("c"));
+  size_t held = rv.GetStorage([](const std::string&) { return 0; });
+  release = true;
+  reader.join();
+  HOST_CHECK_EQUAL(seen, std::string("a"));
+  rv.Synchronize();
+  HOST_CHECK(rv.Write("d"));
+  HOST_CHECK_EQUAL(rv.Get(), std::string("d"));
+  // current value plus one spare node remain:
+  HOST_CHECK(rv.GetStorage([](const std::string&) { return 0; }) < held);
+  }
+
+HOST_TEST(metrics, memory)
+  {
+  // a vehicle with 96 cells:
+  for (int i=0; i<96; i++)
+    {
+    StandardMetrics.ms_v_bat_cell_voltage->SetElemValue(i, 3.9f);
+    StandardMetrics.ms_v_bat_cell_vmin->SetElemValue(i, 3.8f);
+    StandardMetrics.ms_v_bat_cell_vmax->SetElemValue(i, 4.0f);
+    }
+  for (int i=0; i<32; i++)
+    StandardMetrics.ms_v_bat_cell_temp->SetElemValue(i, 21.5f);
+  StandardMetrics.ms_v_vin->SetValue("VF1ABCDEF01234567");
+
+  BufferedShell* bs = new BufferedShell(false, COMMAND_RESULT_NORMAL);
+  bs->SetSecure(true);
+  std::string command("metrics memory v.b.c.voltage v.vin"), output;
+  bs->ProcessChars(command.data(), command.size());
+  bs->ProcessChar('\n');
+  bs->Dump(output);
+  delete bs;
+  ESP_LOGI(TAG, "%s", output.c_str());
+
+  HOST_CHECK(output.find("v.b.c.voltage") != std::string::npos);
+  HOST_CHECK(output.find("vector") != std::string::npos);
+  HOST_CHECK(output.find("Total") != std::string::npos);
+  OvmsMetric* m = StandardMetrics.ms_v_bat_cell_voltage;
+  HOST_CHECK(m->GetMemoryUsage() >= 96 * sizeof(float));
+  HOST_CHECK(output.find("Arena:") != std::string::npos);
+  }
+
+HOST_TEST(metrics, arena)
+  {
+  OvmsMetricArena arena;
+  // freed blocks are recycled per size class:
+  void* a = arena.Alloc(20);
+  void* b = arena.Alloc(24);
+  HOST_CHECK(a != NULL && b != NULL && a != b);
+  HOST_CHECK_EQUAL((char*)b - (char*)a, 24);
+  arena.Free(a, 20);
+  HOST_CHECK(arena.Alloc(17) == a);
+  arena.Free(b, 24);
+  arena.Free(a, 17);
+
+  // large blocks are allocated directly:
+  void* c = arena.Alloc(METRICS_ARENA_MAXBLOCK + 1);
+  HOST_CHECK(c != NULL);
+  memset(c, 0, METRICS_ARENA_MAXBLOCK + 1);
+  arena.Free(c, METRICS_ARENA_MAXBLOCK + 1);
+  HOST_CHECK_EQUAL(OvmsMetricArena::BlockSize(20), 24u);
+  HOST_CHECK(OvmsMetricArena::BlockSize(METRICS_ARENA_MAXBLOCK + 1) > METRICS_ARENA_MAXBLOCK + 8);
+
+  // vector metrics keep their interface:
+  OvmsMetricVector<short>* v = new OvmsMetricVector<short>("xh.t.arena", 0, Other);
+  std::vector<short> value = { 1, 2, 3 };
+  v->SetValue(value);
+  HOST_CHECK(v->AsVector() == value);
+  HOST_CHECK_EQUAL(v->AsString(), std::string("1,2,3"));
+  v->SetValue(value);
+  HOST_CHECK_EQUAL(v->GetElemValue(2), (short)3);
+  MyMetrics.DeregisterMetric(v);   // deletes the metric
+  }
+
+HOST_TEST(metrics, listeners)
+  {
+  static const char* caller = "xh.t.listeners";
+  int named = 0, wildcard = 0;
+
+  // listeners registered by name attach to metrics created later:
+  MyMetrics.RegisterListener(caller, "xh.t.listen", [&](OvmsMetric* m) { named++; });
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.listen", 0, 1);
+  HOST_CHECK(m->m_modified & METRICS_LISTENED);
+  HOST_CHECK_EQUAL(named, 1);
+  m->SetValue(2);
+  m->SetValue(2);         // unchanged: no notification
+  HOST_CHECK_EQUAL(named, 2);
+
+  MyMetrics.RegisterListener(caller, "*", [&](OvmsMetric* m) { wildcard++; });
+  m->SetValue(3);
+  HOST_CHECK_EQUAL(named, 3);
+  HOST_CHECK_EQUAL(wildcard, 1);
+
+  MyMetrics.DeregisterListener(caller);
+  HOST_CHECK(!(m->m_modified & METRICS_LISTENED));
+  m->SetValue(4);
+  HOST_CHECK_EQUAL(named, 3);
+  HOST_CHECK_EQUAL(wildcard, 1);
+  }
+
+HOST_TEST(metrics, listeners_unlocked)
+  {
+  // listeners run unlocked: they may wait for other tasks setting metrics or
+  //  registering listeners, deregistration waits for calls in progress:
+  static const char* caller = "xh.t.unlocked";
+  OvmsMetricInt* a = MyMetrics.InitInt("xh.t.unlocked.a", 0, 0);
+  OvmsMetricInt* b = MyMetrics.InitInt("xh.t.unlocked.b", 0, 0);
+  std::atomic_int bcalls(0);
+  std::atomic_bool other(false), running(false), finished(false);
+  MyMetrics.RegisterListener("xh.t.unlocked.b", "xh.t.unlocked.b", [&](OvmsMetric* m) { bcalls++; });
+  MyMetrics.RegisterListener(caller, "xh.t.unlocked.a", [&](OvmsMetric* m)
+    {
+    running = true;
+    std::thread t([&]()
+      {
+      b->SetValue(b->AsInt() + 1);
+      MyMetrics.RegisterListener("xh.t.unlocked2", "xh.t.unlocked.b", [](OvmsMetric* m) {});
+      MyMetrics.DeregisterListener("xh.t.unlocked2");
+      other = true;
+      });
+    for (int k=0; k<100 && !other; k++)
+      vTaskDelay(pdMS_TO_TICKS(10));
+    if (other) t.join(); else t.detach();
+    vTaskDelay(pdMS_TO_TICKS(20));
+    finished = true;
+    });
+  std::thread setter([&]() { a->SetValue(1); });
+  for (int k=0; k<100 && !running; k++)
+    vTaskDelay(pdMS_TO_TICKS(1));
+  MyMetrics.DeregisterListener(caller);
+  HOST_CHECK(finished);
+  setter.join();
+  HOST_CHECK(other);
+  MyMetrics.DeregisterListener("xh.t.unlocked.b");
+  HOST_CHECK_EQUAL((int)bcalls, 1);
+  }
+
+HOST_TEST(metrics, listeners_deregister)
+  {
+  // deregistration waits for slow calls on other tasks without a time
+  //  limit, a listener may deregister itself:
+  static const char* caller = "xh.t.dereg";
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.dereg", 0, 0);
+  std::atomic_bool running(false), finished(false);
+  MyMetrics.RegisterListener(caller, "xh.t.dereg", [&](OvmsMetric* metric)
+    {
+    running = true;
+    vTaskDelay(pdMS_TO_TICKS(1200));
+    finished = true;
+    });
+  std::thread setter([&]() { m->SetValue(1); });
+  for (int k=0; k<100 && !running; k++)
+    vTaskDelay(pdMS_TO_TICKS(1));
+  HOST_CHECK(running);
+  MyMetrics.DeregisterListener(caller);
+  HOST_CHECK(finished);
+  setter.join();
+
+  int calls = 0;
+  MyMetrics.RegisterListener(caller, "xh.t.dereg", [&](OvmsMetric* metric)
+    {
+    calls++;
+    MyMetrics.DeregisterListener(caller);
+    });
+  m->SetValue(2);
+  m->SetValue(3);
+  HOST_CHECK_EQUAL(calls, 1);
+  }
+
+HOST_TEST(metrics, restore)
+  {
+  // snapshot values are not notified as live data:
+  static const char* caller = "xh.t.restore";
+  OvmsMetricFloat* m = new OvmsMetricFloat("xh.t.restore", 0, Volts);
+  int calls = 0;
+  MyMetrics.RegisterListener(caller, "xh.t.restore", [&](OvmsMetric* metric) { calls++; });
+  m->RestoreValue("12.5", 30);
+  HOST_CHECK_EQUAL(calls, 0);
+  HOST_CHECK_NEAR(m->AsFloat(), 12.5, 0.001);
+  HOST_CHECK(m->IsDefined());
+  HOST_CHECK(m->IsStale());
+  HOST_CHECK_EQUAL((int)m->m_restored, METRICS_RESTORED);
+  HOST_CHECK_EQUAL(m->Age(), (uint32_t)30);
+  m->SetValue(12.5);
+  HOST_CHECK_EQUAL(calls, 1);
+  HOST_CHECK(!m->IsStale());
+  HOST_CHECK_EQUAL((int)m->m_restored, 0);
+  HOST_CHECK_EQUAL(m->Age(), (uint32_t)0);
+  MyMetrics.DeregisterListener(caller);
+
+  // the restoring state is per metric, concurrent restores stay silent:
+  OvmsMetricInt* a = MyMetrics.InitInt("xh.t.restore.a");
+  OvmsMetricInt* b = MyMetrics.InitInt("xh.t.restore.b");
+  std::atomic_int rcalls(0);
+  MyMetrics.RegisterListener(caller, "xh.t.restore.a", [&](OvmsMetric* metric) { rcalls++; });
+  MyMetrics.RegisterListener(caller, "xh.t.restore.b", [&](OvmsMetric* metric) { rcalls++; });
+  std::thread other([b]()
+    {
+    for (int i=0; i<1000; i++)
+      b->RestoreValue(std::to_string(i), 10);
+    });
+  for (int i=0; i<1000; i++)
+    a->RestoreValue(std::to_string(i), 10);
+  other.join();
+  HOST_CHECK_EQUAL((int)rcalls, 0);
+  MyMetrics.DeregisterListener(caller);
+  MyMetrics.DeregisterMetric(a);
+  MyMetrics.DeregisterMetric(b);
+
+  uint32_t deletes = MyMetrics.m_deletecount;
+  MyMetrics.DeregisterMetric(m);   // deletes the metric
+  HOST_CHECK_EQUAL((uint32_t)MyMetrics.m_deletecount, deletes + 1);
+  }
+
+HOST_TEST(metrics, listeners_deferred)
+  {
+  static const char* caller = "xh.t.deferred";
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.deferred", 0, 0);
+  std::atomic_int calls(0), last(-1);
+  TaskHandle_t caller_task = xTaskGetCurrentTaskHandle();
+  std::atomic_bool same_task(false);
+  MyMetrics.RegisterListener(caller, "xh.t.deferred", [&](OvmsMetric* metric)
+    {
+    if (xTaskGetCurrentTaskHandle() == caller_task) same_task = true;
+    last = ((OvmsMetricInt*)metric)->AsInt();
+    calls++;
+    }, true);
+
+  // bursts are coalesced, the last value is always delivered:
+  uint32_t coalesced = MyMetrics.m_notifycoalesced;
+  for (int i=1; i<=1000; i++)
+    m->SetValue(i);
+  for (int k=0; k<100 && last != 1000; k++)
+    vTaskDelay(pdMS_TO_TICKS(10));
+  HOST_CHECK_EQUAL((int)last, 1000);
+  HOST_CHECK(calls >= 1 && calls < 1000);
+  HOST_CHECK(MyMetrics.m_notifycoalesced > coalesced);
+  HOST_CHECK(!same_task);
+
+  // no more calls after deregistration:
+  MyMetrics.DeregisterListener(caller);
+  int count = calls;
+  m->SetValue(0);
+  vTaskDelay(pdMS_TO_TICKS(50));
+  HOST_CHECK_EQUAL((int)calls, count);
+  }
+
+HOST_TEST(metrics, listeners_deferred_delete)
+  {
+  // deleting a metric waits for a running deferred dispatch:
+  static const char* caller = "xh.t.deferdel";
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.deferdel", 0, 0);
+  std::atomic_bool running(false), done(false);
+  MyMetrics.RegisterListener(caller, "xh.t.deferdel", [&](OvmsMetric* metric)
+    {
+    running = true;
+    vTaskDelay(pdMS_TO_TICKS(50));
+    done = (((OvmsMetricInt*)metric)->AsInt() == 1);
+    }, true);
+  m->SetValue(1);
+  for (int k=0; k<100 && !running; k++)
+    vTaskDelay(pdMS_TO_TICKS(1));
+  HOST_CHECK(running);
+  MyMetrics.DeregisterMetric(m);   // deletes the metric
+  HOST_CHECK(done);
+  MyMetrics.DeregisterListener(caller);
+
+  // deleting directly unregisters in the derived destructor, the running
+  //  listener still reads the intact value:
+  OvmsMetricString* s = MyMetrics.InitString("xh.t.deferdel", 0, "");
+  running = done = false;
+  MyMetrics.RegisterListener(caller, "xh.t.deferdel", [&](OvmsMetric* metric)
+    {
+    running = true;
+    vTaskDelay(pdMS_TO_TICKS(50));
+    done = (metric->AsString() == "a long string value, stored on the heap");
+    }, true);
+  s->SetValue("a long string value, stored on the heap");
+  for (int k=0; k<100 && !running; k++)
+    vTaskDelay(pdMS_TO_TICKS(1));
+  uint32_t deletes = MyMetrics.m_deletecount;
+  delete s;
+  HOST_CHECK(done);
+  HOST_CHECK_EQUAL((uint32_t)MyMetrics.m_deletecount, deletes + 1);
+  HOST_CHECK(MyMetrics.Find("xh.t.deferdel") == NULL);
+  MyMetrics.DeregisterListener(caller);
+  }
+
+// Advance the monotonic clock like the housekeeping ticker, run the stale
+//  ticker like the events task on "ticker.1":
+static void StaleTick(int seconds=1)
+  {
+  for (int i=0; i<seconds; i++)
+    {
+    monotonictime++;
+    MyMetrics.StaleTicker();
+    }
+  }
+
+HOST_TEST(metrics, stale_expiry)
+  {
+  static const char* caller = "xh.t.stale";
+  StaleTick();
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.stale", 10);
+  int calls = 0, expiries = 0;
+  MyMetrics.RegisterListener(caller, "xh.t.stale", [&](OvmsMetric* metric) { calls++; });
+  MyMetrics.RegisterListener(caller, "xh.t.stale", [&](OvmsMetric* metric)
+    {
+    if (metric->IsStale()) expiries++;
+    }, false, true);
+  size_t modifier = MyMetrics.RegisterModifier();
+
+  // stale listeners are called exactly when expiring, value listeners and
+  //  modification flags are not touched:
+  m->SetValue(1);
+  m->ClearModified(modifier);
+  HOST_CHECK_EQUAL(calls, 1);
+  StaleTick(10);
+  HOST_CHECK(!m->IsStale());
+  HOST_CHECK_EQUAL(expiries, 0);
+  StaleTick();
+  HOST_CHECK(m->IsStale());
+  HOST_CHECK_EQUAL(expiries, 1);
+  HOST_CHECK_EQUAL(calls, 1);
+  HOST_CHECK(!m->IsModified(modifier));
+  StaleTick(100);
+  HOST_CHECK_EQUAL(expiries, 1);
+
+  // an unchanged value clears staleness silently:
+  m->SetValue(1);
+  HOST_CHECK(!m->IsStale());
+  HOST_CHECK_EQUAL(calls, 1);
+  HOST_CHECK(!m->IsModified(modifier));
+  m->SetValue(2);
+  HOST_CHECK_EQUAL(calls, 2);
+
+  // updates keep the metric fresh:
+  for (int i=0; i<20; i++)
+    {
+    StaleTick(5);
+    m->SetValue(2);
+    }
+  HOST_CHECK_EQUAL(expiries, 1);
+  StaleTick(11);
+  HOST_CHECK_EQUAL(expiries, 2);
+
+  // long periods are cascaded down the wheel levels:
+  m->SetAutoStale(5000);
+  m->SetValue(3);
+  StaleTick(5000);
+  HOST_CHECK_EQUAL(expiries, 2);
+  StaleTick();
+  HOST_CHECK_EQUAL(expiries, 3);
+
+  // changing the period reschedules:
+  m->SetValue(4);
+  m->SetAutoStale(3);
+  StaleTick(3);
+  HOST_CHECK_EQUAL(expiries, 3);
+  StaleTick();
+  HOST_CHECK_EQUAL(expiries, 4);
+  m->SetValue(5);
+  m->SetAutoStale(0);
+  StaleTick(100);
+  HOST_CHECK_EQUAL(expiries, 4);
+  HOST_CHECK(!m->IsStale());
+  HOST_CHECK_EQUAL(calls, 5);
+
+  MyMetrics.DeregisterListener(caller);
+  }
+
+HOST_TEST(metrics, stale_listener)
+  {
+  // expiry listeners run without the wheel lock, other tasks can schedule:
+  static const char* caller = "xh.t.stalelock";
+  StaleTick();
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.t.stalelock", 2);
+  OvmsMetricInt* other = MyMetrics.InitInt("xh.t.stalelock2", 60);
+  std::atomic_bool scheduled(false);
+  bool waited = false;
+  MyMetrics.RegisterListener(caller, "xh.t.stalelock", [&](OvmsMetric* metric)
+    {
+    if (!metric->IsStale()) return;
+    std::thread t([&]() { other->SetValue(other->AsInt() + 1); scheduled = true; });
+    for (int k=0; k<100 && !scheduled; k++)
+      vTaskDelay(pdMS_TO_TICKS(10));
+    waited = true;
+    if (scheduled) t.join(); else t.detach();
+    }, false, true);
+  m->SetValue(1);
+  StaleTick(3);
+  HOST_CHECK(waited);
+  HOST_CHECK(scheduled);
+  MyMetrics.DeregisterListener(caller);
+  }
+
+HOST_TEST(metrics, stale_random)
+  {
+  // Random updates & periods: every metric is notified exactly on the tick
+  //  IsStale() turns true, and never else.
+  static const char* caller = "xh.t.stalerandom";
+  const int count = 50;
+  static char names[count][20];
+  OvmsMetricInt* m[count];
+  int expired[count], expected[count];
+  uint32_t seed = 4711;
+  auto random = [&seed](uint32_t range) { seed = seed * 1103515245 + 12345; return (seed >> 8) % range; };
+  static const int periods[] = { 1, 2, 10, 63, 64, 65, 200, 4095, 4096, 4097, 9000 };
+
+  StaleTick();
+  for (int k=0; k<count; k++)
+    {
+    snprintf(names[k], sizeof(names[k]), "xh.t.stale.%02d", k);
+    m[k] = MyMetrics.InitInt(names[k], periods[random(sizeof(periods)/sizeof(int))]);
+    m[k]->SetValue(0);
+    expired[k] = expected[k] = 0;
+    }
+  MyMetrics.RegisterListener(caller, "*", [&](OvmsMetric* metric)
+    {
+    for (int k=0; k<count; k++)
+      if (metric == m[k] && metric->IsStale()) expired[k]++;
+    }, false, true);
+
+  bool stale[count] = { false };
+  for (int t=0; t<30000; t++)
+    {
+    int k = random(count * 20);
+    if (k < count)
+      {
+      m[k]->SetValue((int)random(2));
+      stale[k] = false;
+      }
+    StaleTick();
+    for (k=0; k<count; k++)
+      {
+      if (m[k]->IsStale() && !stale[k])
+        expected[k]++;
+      stale[k] = m[k]->IsStale();
+      }
+    }
+
+  int mismatches = 0, total = 0;
+  for (int k=0; k<count; k++)
+    {
+    if (expired[k] != expected[k]) mismatches++;
+    total += expired[k];
+    }
+  HOST_CHECK_EQUAL(mismatches, 0);
+  HOST_CHECK(total > count);
+
+  MyMetrics.DeregisterListener(caller);
+  for (int k=0; k<count; k++)
+    MyMetrics.DeregisterMetric(m[k]); // deletes the metric
+  }
+
+HOST_TEST(metrics, stale_event)
+  {
+  OvmsSemaphore done;
+  std::string got;
+  MyEvents.RegisterEvent("hosttest", "metric.stale", [&](std::string event, void* data)
+    {
+    if (strcmp((const char*)data, "xh.t.staleevent") == 0)
+      {
+      got = (const char*)data;
+      done.Give();
+      }
+    });
+  MyConfig.SetParamValueBool("metrics", "stale.events", true);
+  for (int k=0; k<100 && !MyMetrics.m_staleevents; k++)
+    vTaskDelay(pdMS_TO_TICKS(10));
+  HOST_CHECK(MyMetrics.m_staleevents);
+
+  OvmsMetricFloat* m = MyMetrics.InitFloat("xh.t.staleevent", 2, 1.5);
+  StaleTick(3);
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK_EQUAL(got, std::string("xh.t.staleevent"));
+
+  // barrier: let the event task finish the metric.stale handler loop
+  OvmsSemaphore idle;
+  MyEvents.SignalEvent("xh.t.sync", &idle, [](const char* event, void* data)
+    { ((OvmsSemaphore*)data)->Give(); });
+  HOST_CHECK(idle.Take(pdMS_TO_TICKS(2000)));
+  MyEvents.DeregisterEvent("hosttest");
+  MyConfig.DeleteInstance("metrics", "stale.events");
+  MyMetrics.DeregisterMetric(m); // deletes the metric
+  }
+
+HOST_BENCH(metrics, set_int)
+  {
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.b.int");
+  for (uint64_t i = 0; i < bench.n; i++)
+    m->SetValue((int)i);
+  }
+
+HOST_BENCH(metrics, set_float_units)
+  {
+  OvmsMetricFloat* m = MyMetrics.InitFloat("xh.b.float", 0, 0, Kilometers);
+  for (uint64_t i = 0; i < bench.n; i++)
+    m->SetValue((float)(i & 1023), Miles);
+  }
+
+HOST_BENCH(metrics, find)
+  {
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(MyMetrics.Find("v.b.soc"));
+  }
+
+HOST_BENCH(metrics, as_string)
+  {
+  OvmsMetricFloat* m = MyMetrics.InitFloat("xh.b.string", 0, 12.345f, Kilometers);
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(m->AsString("", Miles, 2));
+  }
+
+// SetValue() cost with listeners on the metric, synchronous vs. deferred:
+static void BenchListeners(HostBench& bench, const char* name, int count, bool deferred)
+  {
+  static const char* caller = "xh.b.listeners";
+  static volatile int calls;
+  OvmsMetricInt* m = MyMetrics.InitInt(name);
+  for (int k=0; k<count; k++)
+    MyMetrics.RegisterListener(caller, name, [](OvmsMetric* m) { calls++; }, deferred);
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    m->SetValue((int)i);
+  MyMetrics.DeregisterListener(caller);
+  }
+
+HOST_BENCH(metrics, set_int_listeners0)
+  {
+  BenchListeners(bench, "xh.b.listeners0", 0, false);
+  }
+
+HOST_BENCH(metrics, set_int_listeners5)
+  {
+  BenchListeners(bench, "xh.b.listeners5", 5, false);
+  }
+
+HOST_BENCH(metrics, set_int_listeners20)
+  {
+  BenchListeners(bench, "xh.b.listeners20", 20, false);
+  }
+
+HOST_BENCH(metrics, set_int_deferred20)
+  {
+  BenchListeners(bench, "xh.b.deferred20", 20, true);
+  }
+
+HOST_BENCH(metrics, set_int_autostale)
+  {
+  OvmsMetricInt* m = MyMetrics.InitInt("xh.b.autostale", 60);
+  for (uint64_t i = 0; i < bench.n; i++)
+    m->SetValue((int)i);
+  }
+
+// Stale ticker cost per second with 1000 metrics updated every 2 seconds:
+HOST_BENCH(metrics, stale_ticker)
+  {
+  const int count = 1000;
+  static char names[count][20];
+  static OvmsMetricInt* m[count];
+  for (int k=0; k<count; k++)
+    {
+    snprintf(names[k], sizeof(names[k]), "xh.b.stale.%03d", k);
+    m[k] = MyMetrics.InitInt(names[k], 10 + k % 100, 0);
+    }
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    for (int k=(i&1); k<count; k+=2)
+      m[k]->SetValue((int)i);
+    monotonictime++;
+    MyMetrics.StaleTicker();
+    }
+  }
+
+// Lock free stores, read & write throughput with a contending task:
+HOST_BENCH(metrics, vector_read_contended)
+  {
+  OvmsMetricVector<float>* v = MyMetrics.InitVector<float>("xh.b.vector.r");
+  int k = 0;
+  HostContender writer([&]() { k++; v->SetElemValue(k % 96, k); });
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(v->GetElemValue(i % 96));
+  }
+
+HOST_BENCH(metrics, vector_write_contended)
+  {
+  OvmsMetricVector<float>* v = MyMetrics.InitVector<float>("xh.b.vector.w");
+  HostContender reader([&]() { HostBenchKeep(v->GetElemValue(7)); });
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    v->SetElemValue(i % 96, i);
+  }
+
+HOST_BENCH(metrics, string_read_contended)
+  {
+  OvmsMetricString* s = MyMetrics.InitString("xh.b.string.r");
+  int k = 0;
+  HostContender writer([&]() { s->SetValue((k++ & 1) ? "a longer string value beyond SSO" : "short"); });
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(s->AsString());
+  }
+
+HOST_BENCH(metrics, bitset_read_contended)
+  {
+  OvmsMetricBitset<64>* b = MyMetrics.InitBitset<64>("xh.b.bitset.r");
+  int k = 0;
+  HostContender writer([&]() { b->SetValue(std::bitset<64>(k++)); });
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(b->AsBitset().count());
+  }
@@ -0,0 +1,228 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: notification framework
+
+#include <string.h>
+#include <atomic>
+#include <map>
+#include "ovms_notify.h"
+#include "ovms_command.h"
+#include "ovms_config.h"
+#include "ovms_semaphore.h"
+#include "hosttest.h"
+
+static bool xhtest_filter(OvmsNotifyType* type, const char* subtype)
+  {
+  return strcmp(type->m_name, "xhtest") == 0;
+  }
+
+static OvmsNotifyType* xhtest_type()
+  {
+  MyNotify.RegisterType("xhtest");
+  return MyNotify.GetType("xhtest");
+  }
+
+HOST_TEST(notify, async_delivery)
+  {
+  OvmsNotifyType* mt = xhtest_type();
+  OvmsSemaphore done;
+  TaskHandle_t reader_task = NULL;
+  std::string got;
+  size_t reader = MyNotify.RegisterReader("xhtest", COMMAND_RESULT_NORMAL,
+    [&](OvmsNotifyType* type, OvmsNotifyEntry* entry)
+      {
+      got = entry->GetValue().c_str();
+      reader_task = xTaskGetCurrentTaskHandle();
+      done.Give();
+      return true;
+      }, false, xhtest_filter);
+
+  uint32_t id = MyNotify.NotifyString("xhtest", "async", "hello");
+  HOST_CHECK(id != 0);
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK_EQUAL(got, std::string("hello"));
+  // readers are called by the notification task:
+  HOST_CHECK(reader_task != xTaskGetCurrentTaskHandle());
+  // the entry is cleaned up after the hand-off, i.e. once the reader returned:
+  for (int k=0; k<100; k++)
+    {
+      {
+      OvmsRecMutexLock lock(&mt->m_mutex);
+      if (mt->FindEntry(id) == NULL) break;
+      }
+    vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    {
+    OvmsRecMutexLock lock(&mt->m_mutex);
+    HOST_CHECK(mt->FindEntry(id) == NULL);
+    HOST_CHECK_EQUAL(mt->m_queuedbytes, (size_t)0);
+    HOST_CHECK(mt->m_delivered >= 1);
+    }
+  MyNotify.ClearReader(reader);
+  }
+
+HOST_TEST(notify, byte_cap)
+  {
+  OvmsNotifyType* mt = xhtest_type();
+  MyConfig.SetParamValueInt("notify", "cap.xhtest", 1);
+  MyNotify.ReadConfig();
+  HOST_CHECK_EQUAL(mt->m_cap, (size_t)1024);
+  // data records are not capped by default:
+  HOST_CHECK_EQUAL(MyNotify.GetType("data")->m_cap, (size_t)0);
+
+  // reader keeps all entries queued, like a disconnected server:
+  size_t reader = MyNotify.RegisterReader("xhtest", COMMAND_RESULT_NORMAL,
+    [](OvmsNotifyType* type, OvmsNotifyEntry* entry) { return false; }, false, xhtest_filter);
+
+  std::string payload(200, 'x');
+  uint32_t dropped = mt->m_dropped;
+  int queued = 0;
+  for (int i = 0; i < 8; i++)
+    {
+    if (MyNotify.NotifyString("xhtest", "cap", payload.c_str()) != 0)
+      queued++;
+    }
+  HOST_CHECK_EQUAL(queued, 5);
+  HOST_CHECK_EQUAL(mt->m_dropped - dropped, (uint32_t)3);
+  HOST_CHECK_EQUAL(mt->m_queuedbytes, (size_t)1000);
+
+  // reading the backlog releases the bytes:
+  OvmsNotifyEntry* e;
+  while ((e = mt->FirstUnreadEntry(reader, 0)) != NULL)
+    mt->MarkRead(reader, e);
+  HOST_CHECK_EQUAL(mt->m_queuedbytes, (size_t)0);
+  HOST_CHECK(MyNotify.NotifyString("xhtest", "cap", payload.c_str()) != 0);
+
+  MyNotify.ClearReader(reader);
+  HOST_CHECK_EQUAL(mt->m_queuedbytes, (size_t)0);
+  MyConfig.DeleteInstance("notify", "cap.xhtest");
+  MyNotify.ReadConfig();
+  }
+
+HOST_TEST(notify, reader_unlocked)
+  {
+  xhtest_type();
+  OvmsSemaphore entered, release, done;
+  std::atomic_bool cleared(false);
+  bool cleared_during_call = false;
+  size_t reader = MyNotify.RegisterReader("xhtest", COMMAND_RESULT_NORMAL,
+    [&](OvmsNotifyType* type, OvmsNotifyEntry* entry)
+      {
+      entered.Give();
+      release.Take(pdMS_TO_TICKS(2000));
+      cleared_during_call = cleared;
+      done.Give();
+      return true;
+      }, false, xhtest_filter);
+
+  HOST_CHECK(MyNotify.NotifyString("xhtest", "unlocked", "hello") != 0);
+  HOST_CHECK(entered.Take(pdMS_TO_TICKS(2000)));
+  // the reader is called without the notify mutex, so it can be cleared
+  //  while the call is in progress:
+  MyNotify.ClearReader(reader);
+  cleared = true;
+  release.Give();
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(4000)));
+  HOST_CHECK(cleared_during_call);
+  }
+
+static TaskHandle_t xhnotify_task;
+static std::atomic_bool xhnotify_hold(false);
+
+static void xhnotify_cmd(int verbosity, OvmsWriter* writer, OvmsCommand* cmd, int argc, const char* const* argv)
+  {
+  xhnotify_task = xTaskGetCurrentTaskHandle();
+  while (xhnotify_hold)
+    vTaskDelay(1);
+  writer->puts("command output");
+  }
+
+HOST_TEST(notify, command_worker)
+  {
+  xhtest_type();
+  MyCommandApp.RegisterCommand("xhnotify", "Host test", xhnotify_cmd);
+  OvmsSemaphore done;
+  std::map<std::string, uint32_t> ids;
+  size_t reader = MyNotify.RegisterReader("xhtest", COMMAND_RESULT_NORMAL,
+    [&](OvmsNotifyType* type, OvmsNotifyEntry* entry)
+      {
+      std::string value = entry->GetValue().c_str();
+      ids[value] = entry->m_id;
+      if (value == "command output\n")
+        done.Give();
+      return true;
+      }, false, xhtest_filter);
+
+  // entries raised while the command runs are queued first, the IDs must
+  //  follow the queue order (readers resume after the last ID seen):
+  xhnotify_task = NULL;
+  xhnotify_hold = true;
+  HOST_CHECK(MyNotify.NotifyCommand("xhtest", "cmd", "xhnotify") != 0);
+  for (int k=0; k<200 && !xhnotify_task; k++)
+    vTaskDelay(pdMS_TO_TICKS(10));
+  HOST_CHECK(MyNotify.NotifyString("xhtest", "string", "meanwhile") != 0);
+  xhnotify_hold = false;
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(2000)));
+  HOST_CHECK(ids["meanwhile"] != 0);
+  HOST_CHECK(ids["command output\n"] > ids["meanwhile"]);
+  // the command has been executed by the notification task:
+  HOST_CHECK(xhnotify_task != NULL);
+  HOST_CHECK(xhnotify_task != xTaskGetCurrentTaskHandle());
+  MyNotify.ClearReader(reader);
+  }
+
+// Keep the number of notifications in flight low, so the byte cap isn't hit:
+#define BENCH_NOTIFY_INFLIGHT 8
+
+static bool xhbench_filter(OvmsNotifyType* type, const char* subtype)
+  {
+  return strcmp(subtype, "xhbench") == 0;
+  }
+
+// Type "stream" doesn't signal events, so the event queue doesn't limit the rate:
+HOST_BENCH(notify, stream_roundtrip)
+  {
+  OvmsSemaphore credits(BENCH_NOTIFY_INFLIGHT, BENCH_NOTIFY_INFLIGHT);
+  size_t reader = MyNotify.RegisterReader("xhbench", COMMAND_RESULT_NORMAL,
+    [&](OvmsNotifyType* type, OvmsNotifyEntry* entry)
+      {
+      credits.Give();
+      return true;
+      }, false, xhbench_filter);
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    credits.Take();
+    MyNotify.NotifyString("stream", "xhbench", "bench payload");
+    }
+  for (int i = 0; i < BENCH_NOTIFY_INFLIGHT; i++)
+    credits.Take();
+  MyNotify.ClearReader(reader);
+  }
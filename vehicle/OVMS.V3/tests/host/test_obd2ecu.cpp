@@ -0,0 +1,332 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: OBDII ECU PID expressions & request handling
+
+#include <string.h>
+#include <math.h>
+#include "ovms_config.h"
+#include "ovms_metrics.h"
+#include "metrics_standard.h"
+#include "obd2ecu.h"
+#include "obd2expr.h"
+#include "hosttest.h"
+
+static float xo_eval(const char* source)
+  {
+  obd2expr expr;
+  std::string error;
+  if (!expr.Compile(source, error))
+    return NAN;
+  return expr.Evaluate();
+  }
+
+static std::string xo_error(const char* source)
+  {
+  obd2expr expr;
+  std::string error;
+  expr.Compile(source, error);
+  return error;
+  }
+
+/**
+ * HostObdBus: canbus collecting the ECU responses
+ */
+class HostObdBus : public canbus
+  {
+  public:
+    HostObdBus() : canbus("hobd1")
+      {
+      m_frames = 0;
+      memset(&m_last, 0, sizeof(m_last));
+      }
+
+  public:
+    esp_err_t Start(CAN_mode_t mode, CAN_speed_t speed)
+      {
+      m_mode = mode;
+      m_speed = speed;
+      return ESP_OK;
+      }
+    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0)
+      {
+      m_status.packets_tx++;
+      m_frames++;
+      m_last = *p_frame;
+      return ESP_OK;
+      }
+
+  public:
+    int m_frames;
+    CAN_frame_t m_last;
+  };
+
+static obd2ecu& hostobd_ecu(HostObdBus** busp=NULL)
+  {
+  // canbus & ecu instances register with the framework, so keep one for all tests:
+  static HostObdBus* bus = new HostObdBus();
+  static obd2ecu* ecu = new obd2ecu("xo_ecu", bus);
+  if (busp) *busp = bus;
+  return *ecu;
+  }
+
+static CAN_frame_t hostobd_request(uint8_t pid)
+  {
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.FIR.B.FF = CAN_frame_std;
+  frame.FIR.B.DLC = 8;
+  frame.MsgID = REQUEST_PID;
+  frame.data.u8[0] = 2;
+  frame.data.u8[1] = 1;
+  frame.data.u8[2] = pid;
+  return frame;
+  }
+
+HOST_TEST(obd2ecu, expr_arithmetic)
+  {
+  HOST_CHECK_EQUAL(xo_eval("1 + 2 * 3"), 7.0f);
+  HOST_CHECK_EQUAL(xo_eval("(1 + 2) * 3"), 9.0f);
+  HOST_CHECK_EQUAL(xo_eval("10 - 4 - 3"), 3.0f);
+  HOST_CHECK_EQUAL(xo_eval("-2 * -3"), 6.0f);
+  HOST_CHECK_EQUAL(xo_eval("7 % 4"), 3.0f);
+  HOST_CHECK_EQUAL(xo_eval("1.5e2 / 3"), 50.0f);
+  HOST_CHECK_EQUAL(xo_eval("5 / 0"), 0.0f);
+  HOST_CHECK_EQUAL(xo_eval("1 < 2 && 3 >= 3"), 1.0f);
+  HOST_CHECK_EQUAL(xo_eval("0 || 42"), 42.0f);
+  HOST_CHECK_EQUAL(xo_eval("!0 + !5"), 1.0f);
+  HOST_CHECK_EQUAL(xo_eval("2 > 1 ? 10 : 20"), 10.0f);
+  HOST_CHECK_EQUAL(xo_eval("0 ? 1 : 0 ? 2 : 3"), 3.0f);
+  HOST_CHECK_EQUAL(xo_eval("max(1, 7, 3) + min(4, 2)"), 9.0f);
+  HOST_CHECK_EQUAL(xo_eval("Math.round(2.5) + floor(-1.5) + ceil(0.2)"), 2.0f);
+  HOST_CHECK_EQUAL(xo_eval("abs(-3) * sqrt(16)"), 12.0f);
+  HOST_CHECK(fabsf(xo_eval("Math.PI") - 3.14159265f) < 1e-6);
+  HOST_CHECK_EQUAL(xo_eval("true + true; // comment"), 2.0f);
+  }
+
+HOST_TEST(obd2ecu, expr_constant_folding)
+  {
+  obd2expr expr;
+  std::string error;
+  HOST_CHECK(expr.Compile("(1 + 2) * max(3, 4) - 2", error));
+  HOST_CHECK_EQUAL(expr.GetSize(), (size_t)1);
+  HOST_CHECK_EQUAL(expr.Evaluate(), 10.0f);
+  }
+
+HOST_TEST(obd2ecu, expr_metrics)
+  {
+  StandardMetrics.ms_v_pos_speed->SetValue(100, Kph);
+  StandardMetrics.ms_v_bat_soc->SetValue(80);
+  StandardMetrics.ms_v_bat_temp->SetValue(20);
+
+  HOST_CHECK_EQUAL(xo_eval("v.p.speed"), 100.0f);
+  HOST_CHECK(fabsf(xo_eval("v.p.speed[mph]") - 62.137f) < 0.01);
+  HOST_CHECK_EQUAL(xo_eval("v.b.temp[f]"), 68.0f);
+  HOST_CHECK_EQUAL(xo_eval("v.b.soc / 2 + 10"), 50.0f);
+  HOST_CHECK_EQUAL(xo_eval("OvmsMetrics.AsFloat(\"v.b.soc\")"), 80.0f);
+  HOST_CHECK_EQUAL(xo_eval("OvmsMetrics.Value('v.b.soc') * 1"), 80.0f);
+  HOST_CHECK_EQUAL(xo_eval("OvmsMetricFloat(\"v.b.soc\")"), 80.0f);
+
+  // metrics are read on evaluation:
+  obd2expr expr;
+  std::string error;
+  HOST_CHECK(expr.Compile("v.b.soc > 50 ? v.b.soc : 0", error));
+  HOST_CHECK_EQUAL(expr.Evaluate(), 80.0f);
+  StandardMetrics.ms_v_bat_soc->SetValue(40);
+  HOST_CHECK_EQUAL(expr.Evaluate(), 0.0f);
+
+  // metrics created after compilation are looked up late:
+  HOST_CHECK(expr.Compile("xo.late.metric + 1", error));
+  HOST_CHECK_EQUAL(expr.Evaluate(), 1.0f);
+  OvmsMetric* late = MyMetrics.InitFloat("xo.late.metric", SM_STALE_NONE, 5);
+  HOST_CHECK_EQUAL(expr.Evaluate(), 6.0f);
+
+  // deleted metrics are looked up again:
+  MyMetrics.DeregisterMetric(late);
+  HOST_CHECK_EQUAL(expr.Evaluate(), 1.0f);
+  MyMetrics.InitFloat("xo.late.metric", SM_STALE_NONE, 7);
+  HOST_CHECK_EQUAL(expr.Evaluate(), 8.0f);
+  }
+
+HOST_TEST(obd2ecu, expr_errors)
+  {
+  HOST_CHECK(!xo_error("").empty());
+  HOST_CHECK(!xo_error("1 +").empty());
+  HOST_CHECK(!xo_error("(1 + 2").empty());
+  HOST_CHECK(!xo_error("speed").empty());
+  HOST_CHECK(!xo_error("v.p.speed[furlongs]").empty());
+  HOST_CHECK(!xo_error("foo(1)").empty());
+  HOST_CHECK(!xo_error("var x = 1; x").empty());
+  HOST_CHECK(!xo_error("1 ? 2").empty());
+  HOST_CHECK_EQUAL(xo_error("1 + x * 2"), std::string("unknown identifier at position 4"));
+  HOST_CHECK_EQUAL(xo_error("1 + # 2"), std::string("syntax error at position 4"));
+  // stack depth limit:
+  std::string deep;
+  for (int i=0; i<OBD2EXPR_MAXSTACK+2; i++)
+    deep += "v.b.soc + (";
+  deep += "1";
+  for (int i=0; i<OBD2EXPR_MAXSTACK+2; i++)
+    deep += ")";
+  HOST_CHECK(!xo_error(deep.c_str()).empty());
+  }
+
+HOST_TEST(obd2ecu, script_pid)
+  {
+  StandardMetrics.ms_v_bat_soc->SetValue(75);
+
+  // simple scripts compile:
+  FILE* f = fopen("/sd/xo_pid.js", "w");
+  fputs("// SOC as fuel level\nOvmsMetrics.AsFloat(\"v.b.soc\") * 1.0;\n", f);
+  fclose(f);
+  obd2pid pid(0x2f, obd2pid::Script);
+  pid.LoadScript("/sd/xo_pid.js");
+  HOST_CHECK(pid.IsCompiled());
+  HOST_CHECK_EQUAL(pid.Execute(), 75.0f);
+
+  // others are left to Duktape:
+  f = fopen("/sd/xo_pid.js", "w");
+  fputs("var soc = OvmsMetrics.AsFloat(\"v.b.soc\");\nsoc;\n", f);
+  fclose(f);
+  pid.LoadScript("/sd/xo_pid.js");
+  HOST_CHECK(!pid.IsCompiled());
+  HOST_CHECK(strstr(pid.GetSource(), "var soc") != NULL);
+  remove("/sd/xo_pid.js");
+
+  // expression PIDs keep their source:
+  obd2pid expr(0x2f, obd2pid::Expression);
+  std::string error;
+  HOST_CHECK(expr.SetExpression("v.b.soc - 5", error));
+  HOST_CHECK_EQUAL(std::string(expr.GetSource()), std::string("v.b.soc - 5"));
+  HOST_CHECK_EQUAL(expr.Execute(), 70.0f);
+  }
+
+HOST_TEST(obd2ecu, map_expression)
+  {
+  HostObdBus* bus;
+  obd2ecu& ecu = hostobd_ecu(&bus);
+  MyConfig.SetParamValue("obd2ecu.map", "47", "v.b.soc");
+  MyConfig.SetParamValue("obd2ecu.map", "5", "v.b.temp[f] - 32");
+  MyConfig.SetParamValue("obd2ecu.map", "17", "no such thing");
+  ecu.LoadMap();
+
+  HOST_CHECK_EQUAL((int)ecu.m_pidmap[47]->GetType(), (int)obd2pid::Metric);
+  HOST_CHECK_EQUAL((int)ecu.m_pidmap[5]->GetType(), (int)obd2pid::Expression);
+  HOST_CHECK(ecu.m_pidmap.find(17) == ecu.m_pidmap.end());
+
+  // coolant temperature (A-40) from the expression:
+  StandardMetrics.ms_v_bat_temp->SetValue(30);
+  CAN_frame_t req = hostobd_request(0x05);
+  int frames = bus->m_frames;
+  ecu.IncomingFrame(&req);
+  HOST_CHECK_EQUAL(bus->m_frames, frames + 1);
+  HOST_CHECK_EQUAL(bus->m_last.MsgID, (uint32_t)RESPONSE_PID);
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[1], 0x41);
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[2], 0x05);
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[3], 54 + 40);
+
+  MyConfig.DeleteInstance("obd2ecu.map", "47");
+  MyConfig.DeleteInstance("obd2ecu.map", "5");
+  MyConfig.DeleteInstance("obd2ecu.map", "17");
+  ecu.LoadMap();
+  HOST_CHECK_EQUAL((int)ecu.m_pidmap[5]->GetType(), (int)obd2pid::Internal);
+  }
+
+HOST_TEST(obd2ecu, requests)
+  {
+  HostObdBus* bus;
+  obd2ecu& ecu = hostobd_ecu(&bus);
+  ecu.LoadMap();
+  StandardMetrics.ms_v_pos_speed->SetValue(88, Kph);
+  StandardMetrics.ms_v_mot_rpm->SetValue(4000);
+
+  // supported PIDs:
+  CAN_frame_t req = hostobd_request(0x00);
+  ecu.IncomingFrame(&req);
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[2], 0x00);
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[3], 0x18);    // 04 05
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[4], 0x19);    // 0c 0d 10
+
+  // speed (A):
+  req = hostobd_request(0x0d);
+  ecu.IncomingFrame(&req);
+  HOST_CHECK_EQUAL((int)bus->m_last.data.u8[3], 88);
+
+  // rpm ((256A+B)/4) with jitter:
+  req = hostobd_request(0x0c);
+  ecu.IncomingFrame(&req);
+  int rpm = (bus->m_last.data.u8[3] * 256 + bus->m_last.data.u8[4]) / 4;
+  HOST_CHECK(rpm >= 4000 && rpm < 4016);
+
+  // extended frames are answered like for like:
+  req = hostobd_request(0x0d);
+  req.FIR.B.FF = CAN_frame_ext;
+  req.MsgID = REQUEST_EXT_PID;
+  ecu.IncomingFrame(&req);
+  HOST_CHECK_EQUAL(bus->m_last.MsgID, (uint32_t)RESPONSE_EXT_PID);
+  }
+
+HOST_BENCH(obd2ecu, expr_eval)
+  {
+  obd2expr expr;
+  std::string error;
+  expr.Compile("v.b.soc > 20 ? max(v.p.speed[mph], 0) * 1.5 : v.b.temp[f] - 32", error);
+  bench.ResetTimer();
+  float sum = 0;
+  for (uint64_t i = 0; i < bench.n; i++)
+    sum += expr.Evaluate();
+  (void)sum;
+  }
+
+/**
+ * HUD PID set: a typical head-up display polling RPM, speed, coolant,
+ * load & MAF, plus a mapped expression & a compiled script PID.
+ * Reports requests per second.
+ */
+HOST_BENCH(obd2ecu, hud_requests)
+  {
+  HostObdBus* bus;
+  obd2ecu& ecu = hostobd_ecu(&bus);
+  ecu.LoadMap();
+  std::string error;
+  obd2pid* fuel = new obd2pid(0x2f, obd2pid::Expression);
+  fuel->SetExpression("v.b.soc", error);
+  obd2pid* baro = new obd2pid(0x33, obd2pid::Script);
+  baro->SetExpression("OvmsMetrics.AsFloat(\"v.b.12v.voltage\") * 10;", error);
+  ecu.m_pidmap[0x2f] = fuel;
+  ecu.m_pidmap[0x33] = baro;
+
+  static const uint8_t hud[] = { 0x0c, 0x0d, 0x05, 0x04, 0x10, 0x2f, 0x33 };
+  CAN_frame_t req[sizeof(hud)];
+  for (size_t k = 0; k < sizeof(hud); k++)
+    req[k] = hostobd_request(hud[k]);
+
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    ecu.IncomingFrame(&req[i % sizeof(hud)]);
+  }
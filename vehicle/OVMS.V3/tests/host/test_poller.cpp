@@ -0,0 +1,168 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: vehicle poll scheduler
+
+#include "vehicle_poller.h"
+#include "string_writer.h"
+#include "hosttest.h"
+
+static const vehicle_poll_pid_t xh_polls[] =
+  {
+  { 0x7e4, 0x7ec, 0x22, 0x0101, { 0, 4, 8, 0 } },
+  { 0x7e4, 0x7ec, 0x22, 0x0102, { 0, 4, 8, 0 } },
+  { 0x7e4, 0x7ec, 0x22, 0x0103, { 0, 4, 8, 0 } },
+  { 0x7e4, 0x7ec, 0x22, 0x0104, { 0, 4, 0, 0 } },
+  { 0, 0, 0, 0, { 0, 0, 0, 0 } }
+  };
+
+// Run one tick, answering every request immediately with the hash
+// returned by <reply> (0 = no reply), return number of requests sent:
+template <typename F> static int xh_tick(OvmsPollScheduler& s, uint32_t now, F reply, int busload=0)
+  {
+  int64_t t = (int64_t)now * 1000000;
+  int sent = 0, i;
+  s.Tick(now, t, busload);
+  while ((i = s.Next(now)) >= 0)
+    {
+    s.Sent(i, now, t);
+    sent++;
+    uint32_t hash = reply(i);
+    if (!hash) break;
+    s.Reply(hash, t + 20000);
+    }
+  return sent;
+  }
+
+HOST_TEST(poller, spread)
+  {
+  OvmsPollScheduler s;
+  s.Configure(1, 0, false);
+  s.SetList(xh_polls, 1, 0);
+  HOST_CHECK_EQUAL(s.m_entries.size(), (size_t)4);
+  // 4 entries every 4 s at 1 request/s: exactly one request per tick
+  int polls[4] = {};
+  for (uint32_t now = 1; now <= 40; now++)
+    {
+    HOST_CHECK_EQUAL(xh_tick(s, now, [&](int i) { polls[i]++; return 1; }), 1);
+    }
+  for (int i = 0; i < 4; i++)
+    HOST_CHECK_EQUAL(polls[i], 10);
+  // state 2: entry 3 is off, others every 8 s
+  s.SetState(2, 40);
+  int total = 0;
+  for (uint32_t now = 41; now <= 80; now++)
+    total += xh_tick(s, now, [&](int i) { HOST_CHECK(i != 3); return 1; });
+  HOST_CHECK_EQUAL(total, 15);
+  }
+
+HOST_TEST(poller, adaptive)
+  {
+  OvmsPollScheduler s;
+  s.Configure(4, 0, true);
+  s.SetList(xh_polls, 1, 0);
+  uint32_t n = 0;
+  for (uint32_t now = 1; now <= 200; now++)
+    {
+    xh_tick(s, now, [&](int i) -> uint32_t
+      {
+      // entry 0 changes on every reply, 1 never changes, 2 doesn't answer
+      if (i == 0) return ++n;
+      if (i == 1) return 42;
+      if (i == 2) return 0;
+      return 7;
+      });
+    }
+  HOST_CHECK_EQUAL(s.m_entries[0].interval, 1);
+  HOST_CHECK_EQUAL(s.m_entries[1].interval, 16);
+  HOST_CHECK_EQUAL(s.m_entries[2].interval, 16);
+  HOST_CHECK(s.m_entries[0].polls > 150);
+  HOST_CHECK(s.m_entries[1].polls < 20);
+  HOST_CHECK(s.m_entries[2].timeouts > 0);
+  HOST_CHECK_EQUAL(s.m_entries[2].replies, (uint32_t)0);
+  HOST_CHECK_EQUAL(s.m_entries[1].changes, (uint32_t)0);
+
+  // a change resets a backed off entry to nominal:
+  s.m_entries[1].due = 200;
+  xh_tick(s, 201, [&](int i) -> uint32_t { return (i == 1) ? 43 : 0; });
+  HOST_CHECK_EQUAL(s.m_entries[1].interval, 4);
+  HOST_CHECK_EQUAL(s.m_entries[1].changes, (uint32_t)1);
+  }
+
+HOST_TEST(poller, budget)
+  {
+  OvmsPollScheduler s;
+  s.Configure(2, 50, false);
+  s.SetList(xh_polls, 1, 0);
+  // bus load above limit: defer
+  HOST_CHECK_EQUAL(xh_tick(s, 1, [](int i) { return 1; }, 80), 0);
+  HOST_CHECK_EQUAL(s.m_deferred, (uint32_t)1);
+  // rate limit:
+  HOST_CHECK_EQUAL(xh_tick(s, 2, [](int i) { return 1; }, 20), 2);
+  HOST_CHECK_EQUAL(xh_tick(s, 3, [](int i) { return 1; }, 20), 2);
+  HOST_CHECK_EQUAL(xh_tick(s, 4, [](int i) { return 1; }, 20), 0);
+  // outstanding request blocks further requests:
+  HOST_CHECK_EQUAL(xh_tick(s, 6, [](int i) { return 0; }), 1);
+  HOST_CHECK(s.IsWaiting());
+  s.Receiving(6500000);
+  s.Tick(7, 7000000, 0);
+  HOST_CHECK(s.IsWaiting());
+  s.Tick(8, 8000000, 0);
+  HOST_CHECK(!s.IsWaiting());
+
+  StringWriter buf;
+  s.Status(COMMAND_RESULT_NORMAL, &buf, 8);
+  HOST_CHECK(buf.find("7e4  7ec  22   0101") != std::string::npos);
+  }
+
+HOST_BENCH(poller, next)
+  {
+  // Scheduler overhead per request for a 50 entry list:
+  vehicle_poll_pid_t list[51] = {};
+  for (int i = 0; i < 50; i++)
+    list[i] = { 0x7e4, 0x7ec, 0x22, (uint16_t)i, { 10, 10, 10, 10 } };
+  OvmsPollScheduler s;
+  s.Configure(1000, 0, true);
+  s.SetList(list, 0, 0);
+  uint8_t data[7] = { 1, 2, 3, 4, 5, 6, 7 };
+  uint32_t now = 0;
+  bench.ResetTimer();
+  for (uint64_t n = 0; n < bench.n; n++)
+    {
+    int i;
+    while ((i = s.Next(now)) < 0)
+      {
+      now++;
+      s.Tick(now, (int64_t)now * 1000000, 0);
+      }
+    s.Sent(i, now, (int64_t)now * 1000000);
+    data[0] = n & 0x0f;
+    s.Reply(OvmsPollScheduler::Hash(0, data, sizeof(data)), (int64_t)now * 1000000 + 10000);
+    }
+  }
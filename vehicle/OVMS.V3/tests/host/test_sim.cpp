@@ -0,0 +1,508 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: ECU simulator & vehicle poller simulation
+//
+// The simulation runs the OvmsVehicle poller against the ECU scenarios in
+// tests/sim on virtual time: frames written by the poller are processed by
+// the simulator, the responses are delivered at their simulated bus time.
+
+#include "ovms_log.h"
+static const char *TAG = "hostsim";
+
+#include <string.h>
+#include <map>
+#include <vector>
+#include "esp_timer.h"
+#include "cansim.h"
+#include "vehicle.h"
+#include "string_writer.h"
+#include "host_platform.h"
+#include "hosttest.h"
+
+#ifndef HOST_SIM_DIR
+#define HOST_SIM_DIR "../sim"
+#endif
+
+/**
+ * HostSimBus: canbus feeding written frames into a cansim, collecting the
+ *  responses in a time ordered queue
+ */
+class HostSimBus : public canbus
+  {
+  public:
+    HostSimBus() : canbus("hsim1")
+      {
+      m_sim = NULL;
+      m_speed = CAN_SPEED_500KBPS;
+      }
+
+  public:
+    esp_err_t Write(const CAN_frame_t* p_frame, TickType_t maxqueuewait=0)
+      {
+      m_status.packets_tx++;
+      if (m_sim)
+        {
+        m_sim->Process(p_frame, esp_timer_get_time(), [this](const CAN_frame_t& frame, int64_t time_us)
+          {
+          m_queue.insert(std::make_pair(time_us, frame));
+          });
+        }
+      return ESP_OK;
+      }
+
+  public:
+    cansim* m_sim;
+    std::multimap<int64_t, CAN_frame_t> m_queue;
+  };
+
+static HostSimBus& hostsim_bus()
+  {
+  // canbus instances register with the framework, so keep one for all tests:
+  static HostSimBus* bus = new HostSimBus();
+  return *bus;
+  }
+
+/**
+ * HostSimVehicle: drives the OvmsVehicle poller synchronously
+ */
+class HostSimVehicle : public OvmsVehicle
+  {
+  public:
+    HostSimVehicle()
+      {
+      m_replies = m_frames = m_bytes = 0;
+      }
+
+  public:
+    void Start(canbus* bus, const poll_pid_t* plist, uint8_t state, int rate)
+      {
+      m_poll_sched.Configure(rate, 0, true);
+      PollSetPidList(bus, plist);
+      PollSetState(state);
+      }
+    void Tick()
+      {
+      PollerSend();
+      }
+    void Receive(CAN_frame_t* frame)
+      {
+      // filter like the vehicle RX task:
+      if (frame->origin == m_poll_bus && m_poll_plist &&
+          frame->MsgID >= m_poll_moduleid_low && frame->MsgID <= m_poll_moduleid_high)
+        PollerReceive(frame);
+      }
+    OvmsPollScheduler& Scheduler()
+      {
+      return m_poll_sched;
+      }
+
+  protected:
+    void IncomingPollReply(canbus* bus, uint16_t type, uint16_t pid, uint8_t* data, uint8_t length, uint16_t mlremain)
+      {
+      std::string& buf = m_rx[(uint32_t)type << 16 | pid];
+      if (m_frames == 0) buf.clear();
+      buf.append((const char*)data, length);
+      m_frames++;
+      m_bytes += length;
+      if (mlremain == 0)
+        {
+        m_data[(uint32_t)type << 16 | pid] = buf;
+        m_replies++;
+        m_frames = 0;
+        }
+      }
+
+  public:
+    uint32_t m_replies;
+    uint32_t m_frames;
+    uint64_t m_bytes;
+    std::map<uint32_t, std::string> m_rx;       // reply being received
+    std::map<uint32_t, std::string> m_data;     // last complete reply
+  };
+
+/**
+ * HostSimulation: scenario, poll list & virtual time event loop
+ */
+struct HostSimulation
+  {
+  cansim sim;
+  std::vector<vehicle_poll_pid_t> plist;
+  int64_t time;
+
+  bool Load(const char* name)
+    {
+    std::string path = std::string(HOST_SIM_DIR "/") + name + ".sim";
+    if (!sim.Load(path.c_str())) return false;
+    plist.clear();
+    for (const cansim::ecu_t& ecu : sim.GetECUs())
+      {
+      for (const cansim::simpid_t& p : ecu.pids)
+        {
+        if (!p.poll[0] && !p.poll[1] && !p.poll[2] && !p.poll[3]) continue;
+        plist.push_back({ ecu.txid, ecu.rxid, p.type, p.pid, { p.poll[0], p.poll[1], p.poll[2], p.poll[3] } });
+        }
+      }
+    plist.push_back({ 0, 0, 0, 0, { 0, 0, 0, 0 } });
+    return true;
+    }
+
+  // Run the poller for <seconds> of virtual time:
+  void Run(HostSimVehicle& vehicle, int seconds)
+    {
+    HostSimBus& bus = hostsim_bus();
+    for (int s = 0; s < seconds; s++)
+      {
+      int64_t end = time + 1000000;
+      vehicle.Tick();
+      while (!bus.m_queue.empty() && bus.m_queue.begin()->first < end)
+        {
+        auto it = bus.m_queue.begin();
+        int64_t at = it->first;
+        CAN_frame_t frame = it->second;
+        bus.m_queue.erase(it);
+        if (at > time)
+          {
+          host_timer_advance(at - time);
+          time = at;
+          }
+        bus.m_status.packets_rx++;
+        vehicle.Receive(&frame);
+        }
+      host_timer_advance(end - time);
+      time = end;
+      }
+    }
+
+  void Start(HostSimVehicle& vehicle, uint8_t state, int rate)
+    {
+    HostSimBus& bus = hostsim_bus();
+    host_timer_virtual(true);
+    time = esp_timer_get_time();
+    bus.m_queue.clear();
+    bus.m_sim = &sim;
+    sim.Start(time);
+    vehicle.Start(&bus, plist.data(), state, rate);
+    }
+
+  void Stop(HostSimVehicle& vehicle)
+    {
+    HostSimBus& bus = hostsim_bus();
+    vehicle.Start(NULL, NULL, 0, 1);
+    bus.m_sim = NULL;
+    bus.m_queue.clear();
+    host_timer_virtual(false);
+    }
+  };
+
+static const char xs_scenario[] =
+  "latency 10 0\n"
+  "separation 1\n"
+  "ecu 7e4 7ec 10\n"
+  "pid 22 0101 size 20 11 22      # 10 × 1122\n"
+  "pid 22 0102 0a0b\n"
+  "set 60 22 0102 1 ff\n"
+  "pid 21 01 size 10 aa\n"
+  "ramp 21 01 2 2 1000 2000 0 100\n"
+  "ecu 7e0 7e8 5\n"
+  "pid 01 0d 32                    # speed 50 kph\n"
+  "ecu 7e1 7e9 5\n"
+  "pid 01 0d 33\n";
+
+static CAN_frame_t xs_request(uint32_t id, uint8_t type, uint16_t pid)
+  {
+  CAN_frame_t f;
+  memset(&f, 0, sizeof(f));
+  f.FIR.B.DLC = 8;
+  f.MsgID = id;
+  if (type == 0x22)
+    {
+    f.data.u8[0] = 3;
+    f.data.u8[1] = type;
+    f.data.u8[2] = pid >> 8;
+    f.data.u8[3] = pid & 0xff;
+    }
+  else
+    {
+    f.data.u8[0] = 2;
+    f.data.u8[1] = type;
+    f.data.u8[2] = pid;
+    }
+  return f;
+  }
+
+typedef std::vector<std::pair<int64_t, CAN_frame_t> > xs_frames_t;
+
+static cansim::emit_fn xs_collect(xs_frames_t& out)
+  {
+  return [&out](const CAN_frame_t& frame, int64_t time_us) { out.push_back(std::make_pair(time_us, frame)); };
+  }
+
+HOST_TEST(sim, isotp)
+  {
+  cansim sim;
+  HOST_CHECK(sim.LoadString("xs", xs_scenario, strlen(xs_scenario)));
+  sim.Start(0);
+
+  // single frame:
+  xs_frames_t rx;
+  CAN_frame_t req = xs_request(0x7e4, 0x22, 0x0102);
+  sim.Process(&req, 1000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)1);
+  if (rx.size() != 1) return;
+  HOST_CHECK_EQUAL(rx[0].first, (int64_t)11000);
+  HOST_CHECK_EQUAL(rx[0].second.MsgID, 0x7ecu);
+  const uint8_t sf[6] = { 0x05, 0x62, 0x01, 0x02, 0x0a, 0x0b };
+  HOST_CHECK(memcmp(rx[0].second.data.u8, sf, 6) == 0);
+
+  // multi frame: 23 bytes = FF + 3 CF, flow control with block size 2, STmin 5 ms
+  rx.clear();
+  req = xs_request(0x7e4, 0x22, 0x0101);
+  sim.Process(&req, 100000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)1);
+  if (rx.size() != 1) return;
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[0], 0x10);
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[1], 23);
+  CAN_frame_t fc;
+  memset(&fc, 0, sizeof(fc));
+  fc.FIR.B.DLC = 8;
+  fc.MsgID = 0x7e4;
+  fc.data.u8[0] = 0x30;
+  fc.data.u8[1] = 2;
+  fc.data.u8[2] = 5;
+  sim.Process(&fc, 120000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)3);
+  sim.Process(&fc, 140000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)4);
+  if (rx.size() != 4) return;
+  HOST_CHECK_EQUAL(rx[1].first, (int64_t)125000);
+  HOST_CHECK_EQUAL(rx[2].first, (int64_t)130000);
+  HOST_CHECK_EQUAL(rx[3].first, (int64_t)145000);
+  std::string data((const char*)&rx[0].second.data.u8[2], 6);
+  for (int i = 1; i < 4; i++)
+    {
+    HOST_CHECK_EQUAL(rx[i].second.data.u8[0], 0x20 + i);
+    data.append((const char*)&rx[i].second.data.u8[1], 7);
+    }
+  data.resize(23);
+  HOST_CHECK_EQUAL(data.substr(0, 3), std::string("\x62\x01\x01"));
+  HOST_CHECK_EQUAL(data.substr(3, 4), std::string("\x11\x22\x11\x22"));
+  HOST_CHECK_EQUAL(data.substr(21, 2), std::string("\x11\x22"));
+
+  // unexpected flow control is ignored:
+  sim.Process(&fc, 160000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)4);
+  HOST_CHECK_EQUAL(sim.m_ignored, (uint32_t)1);
+  }
+
+HOST_TEST(sim, scenario)
+  {
+  cansim sim;
+  HOST_CHECK(sim.LoadString("xs", xs_scenario, strlen(xs_scenario)));
+  sim.Start(0);
+  xs_frames_t rx;
+
+  // negative response for unknown PIDs:
+  CAN_frame_t req = xs_request(0x7e4, 0x22, 0x0199);
+  sim.Process(&req, 0, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)1);
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[1], 0x7f);
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[3], 0x31);
+  HOST_CHECK_EQUAL(sim.m_negative, (uint32_t)1);
+
+  // broadcast answered by all standard ECUs knowing the PID:
+  rx.clear();
+  req = xs_request(0x7df, 0x01, 0x0d);
+  sim.Process(&req, 0, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)2);
+  if (rx.size() != 2) return;
+  HOST_CHECK_EQUAL(rx[0].second.MsgID, 0x7e8u);
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[3], 0x32);
+  HOST_CHECK_EQUAL(rx[1].second.MsgID, 0x7e9u);
+
+  // patch from 60 s:
+  rx.clear();
+  req = xs_request(0x7e4, 0x22, 0x0102);
+  sim.Process(&req, 59000000, xs_collect(rx));
+  sim.Process(&req, 61000000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)2);
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[5], 0x0b);
+  HOST_CHECK_EQUAL(rx[1].second.data.u8[5], 0xff);
+
+  // ramp 1000 → 2000 over 100 s, at 25 s:
+  rx.clear();
+  req = xs_request(0x7e4, 0x21, 0x01);
+  sim.Process(&req, 25000000, xs_collect(rx));
+  HOST_CHECK_EQUAL(rx.size(), (size_t)1);
+  HOST_CHECK_EQUAL(rx[0].second.data.u8[6] << 8 | rx[0].second.data.u8[7], 1250);
+
+  // errors:
+  cansim bad;
+  HOST_CHECK(!bad.LoadString("bad", "pid 22 0101 00\n", 15));
+  HOST_CHECK(bad.GetError().find("pid without ecu") != std::string::npos);
+  HOST_CHECK(!bad.LoadString("bad", "ecu 7e4 7ec\nfoo\n", 16));
+  HOST_CHECK(bad.GetError().find(":2:") != std::string::npos);
+  }
+
+HOST_TEST(sim, trace)
+  {
+  // learn a polling session from a crtd log:
+  FILE* f = fopen("/sd/xs_trace.crtd", "w");
+  HOST_CHECK(f != NULL);
+  if (!f) return;
+  fputs("1.000000 1T11 7e4 03 22 01 05 00 00 00 00\n"
+        "1.010000 1R11 7ec 10 0a 62 01 05 01 02 03\n"
+        "1.011000 1T11 7e4 30 00 19 00 00 00 00 00\n"
+        "1.036000 1R11 7ec 21 04 05 06 07 00 00 00\n"
+        "1.100000 1T11 7e2 02 21 01 00 00 00 00 00\n"
+        "1.110000 1R11 7ea 05 61 01 aa bb cc 00 00\n", f);
+  fclose(f);
+  const char scenario[] = "ecu 7e4 7ec\npid 22 0101 00\ntrace /sd/xs_trace.crtd\n";
+  cansim sim;
+  HOST_CHECK(sim.LoadString("xs", scenario, strlen(scenario)));
+  HOST_CHECK_EQUAL(sim.m_learned, (uint32_t)2);
+  HOST_CHECK_EQUAL(sim.GetECUs().size(), (size_t)2);
+  if (sim.GetECUs().size() != 2) return;
+  HOST_CHECK_EQUAL(sim.GetECUs()[0].pids.size(), (size_t)2);
+  HOST_CHECK_EQUAL(sim.GetECUs()[0].pids[1].data, std::string("\x01\x02\x03\x04\x05\x06\x07"));
+  HOST_CHECK_EQUAL(sim.GetECUs()[1].rxid, 0x7eau);
+  HOST_CHECK_EQUAL(sim.GetECUs()[1].pids[0].data, std::string("\xaa\xbb\xcc"));
+  }
+
+// Shipped scenarios: the poller gets complete replies for all poll list
+// entries without timeouts, multi frame replies included.
+static void xs_vehicle(HostTest& test, const char* name, int minutes)
+  {
+  HostSimulation hs;
+  HOST_CHECK(hs.Load(name));
+  if (hs.plist.size() < 2) return;
+  HostSimVehicle vehicle;
+  hs.Start(vehicle, 1, 4);
+  hs.Run(vehicle, minutes * 60);
+  OvmsPollScheduler& sched = vehicle.Scheduler();
+  uint32_t polls = 0, replies = 0, timeouts = 0;
+  for (size_t i = 0; i < sched.m_entries.size(); i++)
+    {
+    const OvmsPollScheduler::entry_t& e = sched.m_entries[i];
+    if (!hs.plist[i].polltime[1]) continue;
+    if (!test.Check(e.polls > 0 && e.replies + 1 >= e.polls, __FILE__, __LINE__, "replies"))
+      printf("  %s: %03x %02x %04x: %u polls, %u replies, %u timeouts\n", name,
+        hs.plist[i].txmoduleid, hs.plist[i].type, hs.plist[i].pid, e.polls, e.replies, e.timeouts);
+    polls += e.polls;
+    replies += e.replies;
+    timeouts += e.timeouts;
+    }
+  HOST_CHECK_EQUAL(timeouts, (uint32_t)0);
+  HOST_CHECK_EQUAL(vehicle.m_replies, replies);
+  HOST_CHECK(replies > 0);
+
+  // poller statistics (run with -v):
+  StringWriter buf;
+  vehicle.PollerStatus(COMMAND_RESULT_VERBOSE, &buf);
+  ESP_LOGI(TAG, "%s: %d minutes, %u requests, %u replies, %llu bytes, sim %s\n%s", name, minutes,
+    polls, replies, (unsigned long long)vehicle.m_bytes, hs.sim.GetStats().c_str(), buf.c_str());
+  hs.Stop(vehicle);
+  }
+
+HOST_TEST(sim, voltampera) { xs_vehicle(test, "voltampera", 5); }
+HOST_TEST(sim, kiasoulev) { xs_vehicle(test, "kiasoulev", 5); }
+HOST_TEST(sim, kianiroev) { xs_vehicle(test, "kianiroev", 5); }
+HOST_TEST(sim, nissanleaf) { xs_vehicle(test, "nissanleaf", 5); }
+HOST_TEST(sim, smarted) { xs_vehicle(test, "smarted", 5); }
+HOST_TEST(sim, renaulttwizy) { xs_vehicle(test, "renaulttwizy", 5); }
+HOST_TEST(sim, renaultzoe) { xs_vehicle(test, "renaultzoe", 5); }
+
+HOST_TEST(sim, reassembly)
+  {
+  // ISO-TP reassembly of the poller: the reply data of 0x22 PIDs starts with
+  // the PID low byte, replies complete with the last consecutive frame.
+  HostSimulation hs;
+  HOST_CHECK(hs.Load("smarted"));
+    {
+    HostSimVehicle vehicle;
+    hs.Start(vehicle, 1, 4);
+    hs.Run(vehicle, 60);
+    const std::string& f111 = vehicle.m_data[0x22f111];
+    HOST_CHECK_EQUAL(f111.size(), (size_t)79);
+    const std::string& volts = vehicle.m_data[0x220208];
+    HOST_CHECK_EQUAL(volts.size(), (size_t)205);
+    HOST_CHECK_EQUAL(volts.substr(0, 3), std::string("\x08\x0e\xd8"));
+    hs.Stop(vehicle);
+    }
+
+  // data ramps arrive at the vehicle: Volt/Ampera SOC raw 80 → 240 in 3600 s
+  HOST_CHECK(hs.Load("voltampera"));
+    {
+    HostSimVehicle vehicle;
+    hs.Start(vehicle, 1, 4);
+    hs.Run(vehicle, 1800);
+    const std::string& soc = vehicle.m_data[0x228334];
+    HOST_CHECK_EQUAL(soc.size(), (size_t)4);
+    if (soc.size() == 4)
+      HOST_CHECK_NEAR((uint8_t)soc[0], 160, 1);
+    hs.Stop(vehicle);
+    }
+  }
+
+HOST_BENCH(sim, kianiroev_minute)
+  {
+  // Host CPU time per simulated minute of Kia Niro polling (~30 requests
+  // per minute with adaptive rates, ~150 frames):
+  HostSimulation hs;
+  hs.Load("kianiroev");
+  HostSimVehicle vehicle;
+  hs.Start(vehicle, 1, 4);
+  bench.ResetTimer();
+  for (uint64_t n = 0; n < bench.n; n++)
+    hs.Run(vehicle, 60);
+  hs.Stop(vehicle);
+  }
+
+HOST_BENCH(sim, process)
+  {
+  // Simulator overhead per 0x22 multi frame exchange (request, FF, FC, 8 CF):
+  HostSimulation hs;
+  hs.Load("kianiroev");
+  hs.sim.Start(0);
+  CAN_frame_t req = xs_request(0x7e4, 0x22, 0x0101);
+  CAN_frame_t fc;
+  memset(&fc, 0, sizeof(fc));
+  fc.FIR.B.DLC = 8;
+  fc.MsgID = 0x7e4;
+  fc.data.u8[0] = 0x30;
+  uint32_t frames = 0;
+  cansim::emit_fn emit = [&frames](const CAN_frame_t& frame, int64_t time_us) { frames++; };
+  bench.ResetTimer();
+  for (uint64_t n = 0; n < bench.n; n++)
+    {
+    hs.sim.Process(&req, n * 1000000, emit);
+    hs.sim.Process(&fc, n * 1000000 + 20000, emit);
+    }
+  HostBenchKeep(frames);
+  }
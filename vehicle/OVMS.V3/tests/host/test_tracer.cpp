@@ -0,0 +1,251 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: task, event & ISR tracer
+
+#include <string.h>
+#include <atomic>
+#include <map>
+#include "ovms_tracer.h"
+#include "ovms_events.h"
+#include "ovms_semaphore.h"
+#include "ovms_utils.h"
+#include "esp_timer.h"
+#include "hosttest.h"
+
+/**
+ * HostTraceFile: trace file reader
+ */
+class HostTraceFile
+  {
+  public:
+    HostTraceFile(const char* path) : m_ok(false)
+      {
+      FILE* f = fopen(path, "r");
+      if (!f) return;
+      ovms_trace_record_t rec;
+      m_ok = (fread(&m_header, sizeof(m_header), 1, f) == 1);
+      while (m_ok && fread(&rec, sizeof(rec), 1, f) == 1)
+        {
+        if (rec.type == TRACE_Name)
+          {
+          std::string name(rec.value, '\0');
+          fread(&name[0], 1, rec.value, f);
+          fseek(f, (sizeof(rec) - rec.value % sizeof(rec)) % sizeof(rec), SEEK_CUR);
+          m_names[rec.id] = name;
+          }
+        else
+          m_records.push_back(rec);
+        }
+      fclose(f);
+      }
+    int Count(ovms_trace_type_t type, const char* name=NULL)
+      {
+      int cnt = 0;
+      for (auto& rec : m_records)
+        if (rec.type == type && (!name || m_names[rec.id] == name)) cnt++;
+      return cnt;
+      }
+
+  public:
+    bool m_ok;
+    ovms_trace_header_t m_header;
+    std::map<uint16_t, std::string> m_names;
+    std::vector<ovms_trace_record_t> m_records;
+  };
+
+static void host_trace_work()
+  {
+  OVMS_TRACE_SPAN("xh.trace.span");
+  OVMS_TRACE_MARK("xh.trace.mark", 42);
+  }
+
+static std::string host_read_file(const char* path)
+  {
+  std::string text;
+  FILE* f = fopen(path, "r");
+  if (!f) return text;
+  char buf[512];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    text.append(buf, n);
+  fclose(f);
+  return text;
+  }
+
+HOST_TEST(tracer, record)
+  {
+  std::string error;
+  HOST_CHECK(!MyTracer.IsRunning());
+  HOST_CHECK(MyTracer.Start("/sd/xh_trace.otr", 256, 20, error));
+  HOST_CHECK(!MyTracer.Start("/sd/xh_trace2.otr", 256, 20, error));
+  HOST_CHECK(MyTracer.IsRunning());
+
+  // Spans & marks:
+  for (int i = 0; i < 3; i++)
+    host_trace_work();
+
+  // ISR entries:
+  uint16_t isr = MyTracer.Intern("isr.xh");
+  OVMS_TRACE_ISR(isr, 7);
+
+  // Event dispatch:
+  OvmsSemaphore done;
+  MyEvents.RegisterEvent("hosttest", "xh.trace.event", [&](std::string event, void* data)
+    {
+    done.Give();
+    });
+  MyEvents.SignalEvent("xh.trace.event", NULL);
+  HOST_CHECK(done.Take(pdMS_TO_TICKS(2000)));
+  // barrier: let the event task finish the handler loop & record the end
+  OvmsSemaphore idle;
+  MyEvents.SignalEvent("xh.trace.sync", &idle, [](const char* event, void* data)
+    { ((OvmsSemaphore*)data)->Give(); });
+  HOST_CHECK(idle.Take(pdMS_TO_TICKS(2000)));
+  MyEvents.DeregisterEvent("hosttest");
+
+  // Task CPU usage:
+  std::atomic_bool busy_done(false);
+  xTaskCreate([](void* param)
+    {
+    int64_t end = esp_timer_get_time() + 60000;
+    volatile uint32_t x = 0;
+    while (esp_timer_get_time() < end) x++;
+    *(std::atomic_bool*)param = true;
+    vTaskDelete(NULL);
+    }, "xh busy", 4096, &busy_done, 5, NULL);
+  while (!busy_done) vTaskDelay(1);
+  vTaskDelay(pdMS_TO_TICKS(50));
+
+  MyTracer.Stop();
+  HOST_CHECK(!MyTracer.IsRunning());
+  host_trace_work();    // not recorded
+
+  HostTraceFile trace("/sd/xh_trace.otr");
+  HOST_CHECK(trace.m_ok);
+  HOST_CHECK(memcmp(trace.m_header.magic, OVMS_TRACE_MAGIC, 8) == 0);
+  HOST_CHECK_EQUAL(trace.m_header.recordsize, (uint32_t)sizeof(ovms_trace_record_t));
+  HOST_CHECK_EQUAL(trace.m_header.period, 20u);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Begin, "xh.trace.span"), 3);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_End, "xh.trace.span"), 3);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Mark, "xh.trace.mark"), 3);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Isr, "isr.xh"), 1);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Begin, "xh.trace.event"), 1);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_End, "xh.trace.event"), 1);
+  HOST_CHECK(trace.Count(TRACE_TaskRun, "xh busy") >= 1);
+  HOST_CHECK(trace.Count(TRACE_TaskTotal) >= 2);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Drop), 0);
+
+  // Record details: ISR has no task, times are ordered
+  bool ordered = true;
+  uint32_t last = (uint32_t)trace.m_header.starttime;
+  for (auto& rec : trace.m_records)
+    {
+    if (rec.type == TRACE_Isr)
+      {
+      HOST_CHECK_EQUAL(rec.task, (uint16_t)OVMS_TRACE_NOTASK);
+      HOST_CHECK_EQUAL(rec.value, 7u);
+      }
+    if ((int32_t)(rec.time - last) < 0) ordered = false;
+    last = rec.time;
+    }
+  HOST_CHECK(ordered);
+  }
+
+HOST_TEST(tracer, export)
+  {
+  std::string error;
+  HOST_CHECK(MyTracer.Start("/sd/xh_trace_export.otr", 256, 20, error));
+  host_trace_work();
+  xTaskCreate([](void* param)
+    {
+    int64_t end = esp_timer_get_time() + 60000;
+    volatile uint32_t x = 0;
+    while (esp_timer_get_time() < end) x++;
+    vTaskDelete(NULL);
+    }, "xh export busy", 4096, NULL, 5, NULL);
+  vTaskDelay(pdMS_TO_TICKS(100));
+  MyTracer.Stop();
+
+  HOST_CHECK(OvmsTracer::Export("/sd/xh_trace_export.otr", "/sd/xh_trace_export.json", error));
+  std::string json = host_read_file("/sd/xh_trace_export.json");
+  HOST_CHECK(json.compare(0, 40, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n") == 0);
+  HOST_CHECK(json.find("{\"name\":\"xh.trace.span\",\"ph\":\"B\"") != std::string::npos);
+  HOST_CHECK(json.find("{\"name\":\"xh.trace.span\",\"ph\":\"E\"") != std::string::npos);
+  HOST_CHECK(json.find("{\"name\":\"xh.trace.mark\",\"ph\":\"i\"") != std::string::npos);
+  HOST_CHECK(json.find("\"args\":{\"name\":\"xh export busy\"}") != std::string::npos);
+  HOST_CHECK(json.find("{\"name\":\"cpu xh export busy\",\"ph\":\"C\"") != std::string::npos);
+  HOST_CHECK(json.compare(json.size() - 4, 4, "\n]}\n") == 0);
+
+  // Errors:
+  HOST_CHECK(!OvmsTracer::Export("/sd/xh_trace_export.json", "/sd/xh_trace_bad.json", error));
+  HOST_CHECK(error.find("not an OVMS trace file") != std::string::npos);
+  HOST_CHECK(!OvmsTracer::Export("/sd/xh_no_such_trace.otr", "/sd/xh_trace_bad.json", error));
+  }
+
+HOST_TEST(tracer, overflow)
+  {
+  // The ring buffer overflows when the tracer task can't keep up:
+  std::string error;
+  HOST_CHECK(MyTracer.Start("/sd/xh_trace_overflow.otr", 10, 1000, error));
+  for (int i = 0; i < 200; i++)
+    host_trace_work();
+  MyTracer.Stop();
+  HostTraceFile trace("/sd/xh_trace_overflow.otr");
+  HOST_CHECK(trace.m_ok);
+  // Minimum ring size is 64 records:
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Begin) + trace.Count(TRACE_End) + trace.Count(TRACE_Mark), 64);
+  HOST_CHECK_EQUAL(trace.Count(TRACE_Drop), 1);
+  uint32_t dropped = 0;
+  for (auto& rec : trace.m_records)
+    if (rec.type == TRACE_Drop) dropped = rec.value;
+  HOST_CHECK(dropped >= 600 - 64);
+  }
+
+// Trace point cost while stopped (flag test) & running:
+HOST_BENCH(tracer, span_stopped)
+  {
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    OVMS_TRACE_SPAN("xh.bench.span");
+    }
+  }
+
+HOST_BENCH(tracer, span_running)
+  {
+  std::string error;
+  MyTracer.Start("/sd/xh_trace_bench.otr", 16384, 10, error);
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    {
+    OVMS_TRACE_SPAN("xh.bench.span");
+    }
+  MyTracer.Stop();
+  }
@@ -0,0 +1,328 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: virtual CAN bus
+//
+// These run in real time through the vcan scheduler & CAN tasks, timing
+// checks only use lower bounds & generous upper bounds.
+
+#include <string.h>
+#include <list>
+#include <vector>
+#include "vcan.h"
+#include "canplay_vfs.h"
+#include "host_platform.h"
+#include "hosttest.h"
+
+#ifndef HOST_SIM_DIR
+#define HOST_SIM_DIR "../sim"
+#endif
+
+// canbus instances register with the framework, so keep two for all tests:
+static vcan* hostvcan(int k)
+  {
+  static vcan* bus[2] = { new vcan("vcan7"), new vcan("vcan8") };
+  return bus[k];
+  }
+
+/**
+ * HostVCanTest: two cross-connected virtual buses and a listener queue
+ */
+class HostVCanTest
+  {
+  public:
+    HostVCanTest(CAN_speed_t speed=CAN_SPEED_500KBPS)
+      {
+      a = hostvcan(0);
+      b = hostvcan(1);
+      for (vcan* bus : { a, b })
+        {
+        bus->m_bitrate = -1;
+        bus->m_latency = bus->m_jitter = 0;
+        bus->m_txerr = bus->m_rxerr = 0;
+        bus->m_loopback = false;
+        bus->DetachSimulator();
+        bus->Start(CAN_MODE_ACTIVE, speed);
+        }
+      a->Connect(b);
+      queue = xQueueCreate(200, sizeof(CAN_frame_t));
+      MyCan.RegisterListener(queue, true);
+      }
+    ~HostVCanTest()
+      {
+      MyCan.DeregisterListener(queue);
+      a->Disconnect();
+      a->Stop();
+      b->Stop();
+      vTaskDelay(pdMS_TO_TICKS(20));
+      vQueueDelete(queue);
+      }
+
+  public:
+    static CAN_frame_t Frame(uint32_t id, int k)
+      {
+      CAN_frame_t frame;
+      memset(&frame, 0, sizeof(frame));
+      frame.FIR.B.FF = CAN_frame_std;
+      frame.FIR.B.DLC = 8;
+      frame.MsgID = id;
+      for (int i=0; i<8; i++)
+        frame.data.u8[i] = k + i;
+      return frame;
+      }
+    // Wait for <count> frames from <origin>, keeping frames of other buses:
+    int Collect(canbus* origin, int count, std::vector<CAN_frame_t>* frames=NULL, int timeout_ms=2000)
+      {
+      int found = 0;
+      for (auto it = pending.begin(); found < count && it != pending.end();)
+        {
+        if (it->origin != origin) { ++it; continue; }
+        found++;
+        if (frames) frames->push_back(*it);
+        it = pending.erase(it);
+        }
+      CAN_frame_t frame;
+      while (found < count && xQueueReceive(queue, &frame, pdMS_TO_TICKS(timeout_ms)) == pdTRUE)
+        {
+        if (frame.origin != origin) { pending.push_back(frame); continue; }
+        found++;
+        if (frames) frames->push_back(frame);
+        }
+      return found;
+      }
+
+  public:
+    vcan* a;
+    vcan* b;
+    QueueHandle_t queue;
+    std::list<CAN_frame_t> pending;
+  };
+
+HOST_TEST(vcan, framebits)
+  {
+  // all zero standard frame without data: 34 stuffable bits → 6 stuff bits
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  HOST_CHECK_EQUAL(vcan::FrameBits(&frame), 44 + 3 + 6);
+  // 8 data bytes: 111 nominal bits, stuffing adds up to 24:
+  for (int k=0; k<256; k+=17)
+    {
+    frame = HostVCanTest::Frame(0x7e0 + k, k);
+    int bits = vcan::FrameBits(&frame);
+    HOST_CHECK(bits >= 111 && bits <= 111 + 24);
+    }
+  // extended frames have 20 more header bits:
+  frame.FIR.B.FF = CAN_frame_ext;
+  frame.MsgID = 0x18daf110;
+  HOST_CHECK(vcan::FrameBits(&frame) >= 131);
+  }
+
+HOST_TEST(vcan, crossconnect)
+  {
+  HostVCanTest t;
+  int64_t start = host_timer_real();
+  for (int k=0; k<50; k++)
+    {
+    CAN_frame_t frame = HostVCanTest::Frame(0x100 + k, k);
+    HOST_CHECK(t.a->Write(&frame, portMAX_DELAY) != ESP_FAIL);
+    }
+  std::vector<CAN_frame_t> rx;
+  HOST_CHECK_EQUAL(t.Collect(t.b, 50, &rx), 50);
+  int64_t elapsed = host_timer_real() - start;
+
+  // frames arrive in order at the peer, the sender gets TX feedback:
+  for (size_t k=0; k<rx.size(); k++)
+    {
+    HOST_CHECK_EQUAL(rx[k].MsgID, 0x100 + k);
+    HOST_CHECK_EQUAL((int)rx[k].data.u8[7], (int)(k + 7));
+    }
+  HOST_CHECK_EQUAL(t.a->m_status.packets_tx, 50u);
+  HOST_CHECK_EQUAL(t.b->m_status.packets_rx, 50u);
+  HOST_CHECK_EQUAL(t.a->m_status.packets_rx, 0u);
+
+  // 50 frames at 500 kbit/s need at least 50 × 222 us on the wire:
+  HOST_CHECK(elapsed >= 50 * 222);
+  }
+
+HOST_TEST(vcan, bitrate)
+  {
+  HostVCanTest t(CAN_SPEED_125KBPS);
+  CAN_frame_t frame = HostVCanTest::Frame(0x200, 0);
+  int64_t wire = 100 * (int64_t)vcan::FrameBits(&frame) * 8;   // 8 us per bit
+  int64_t start = host_timer_real();
+  for (int k=0; k<100; k++)
+    t.a->Write(&frame, portMAX_DELAY);
+  HOST_CHECK_EQUAL(t.Collect(t.b, 100), 100);
+  int64_t elapsed = host_timer_real() - start;
+  HOST_CHECK(elapsed >= wire);
+  HOST_CHECK(elapsed < 2 * wire + 100000);
+
+  // unlimited bandwidth: frames arrive in bursts, the RX queue may overflow
+  t.a->m_bitrate = 0;
+  for (int k=0; k<100; k++)
+    t.a->Write(&frame, portMAX_DELAY);
+  int received = t.Collect(t.b, 100, NULL, 200);
+  HOST_CHECK_EQUAL(received + t.b->m_status.rxbuf_overflow, 100);
+  HOST_CHECK(received >= CONFIG_OVMS_HW_CAN_RX_QUEUE_SIZE / 2);
+  }
+
+HOST_TEST(vcan, latency)
+  {
+  HostVCanTest t;
+  t.b->m_latency = 30000;
+  t.b->m_jitter = 5000;
+  CAN_frame_t frame = HostVCanTest::Frame(0x300, 0);
+  int64_t start = host_timer_real();
+  t.a->Write(&frame);
+  HOST_CHECK_EQUAL(t.Collect(t.b, 1), 1);
+  HOST_CHECK(host_timer_real() - start >= 30000);
+
+  // jitter does not reorder frames:
+  for (int k=0; k<20; k++)
+    {
+    frame = HostVCanTest::Frame(0x300 + k, k);
+    t.a->Write(&frame, portMAX_DELAY);
+    }
+  std::vector<CAN_frame_t> rx;
+  HOST_CHECK_EQUAL(t.Collect(t.b, 20, &rx), 20);
+  for (size_t k=1; k<rx.size(); k++)
+    HOST_CHECK(rx[k].MsgID > rx[k-1].MsgID);
+  }
+
+HOST_TEST(vcan, errors)
+  {
+  HostVCanTest t;
+  CAN_frame_t frame = HostVCanTest::Frame(0x400, 0);
+
+  // TX errors: failures are reported to the sender, nothing is received:
+  t.a->m_txerr = 1000;
+  for (int k=0; k<10; k++)
+    t.a->Write(&frame, portMAX_DELAY);
+  HOST_CHECK_EQUAL(t.Collect(t.b, 1, NULL, 200), 0);
+  HOST_CHECK_EQUAL((int)t.a->m_status.errors_tx, 10);
+  HOST_CHECK_EQUAL(t.a->m_status.packets_tx, 0u);
+
+  // RX losses:
+  t.a->m_txerr = 0;
+  t.b->m_rxerr = 500;
+  t.b->m_seed = 4711;
+  for (int k=0; k<100; k++)
+    t.a->Write(&frame, portMAX_DELAY);
+  HOST_CHECK_EQUAL(t.Collect(t.a, 100), 100);     // TX feedback
+  int received = t.Collect(t.b, 100, NULL, 200);
+  HOST_CHECK_EQUAL(received + t.b->m_status.errors_rx, 100);
+  HOST_CHECK(received > 20 && received < 80);
+  }
+
+HOST_TEST(vcan, loopback)
+  {
+  HostVCanTest t;
+  t.a->Disconnect();
+  t.a->m_loopback = true;
+  CAN_frame_t frame = HostVCanTest::Frame(0x500, 0);
+  for (int k=0; k<10; k++)
+    t.a->Write(&frame, portMAX_DELAY);
+  // TX feedback + loopback RX:
+  HOST_CHECK_EQUAL(t.Collect(t.a, 20), 20);
+  HOST_CHECK_EQUAL(t.a->m_status.packets_rx, 10u);
+  HOST_CHECK_EQUAL(t.b->m_status.packets_rx, 0u);
+  }
+
+HOST_TEST(vcan, simulator)
+  {
+  HostVCanTest t;
+  std::string error;
+  HOST_CHECK(t.b->AttachSimulator(HOST_SIM_DIR "/voltampera.sim", error));
+  HOST_CHECK_EQUAL(error, std::string(""));
+
+  // The ECU simulation on the peer answers requests sent on the wire:
+  CAN_frame_t frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.FIR.B.FF = CAN_frame_std;
+  frame.FIR.B.DLC = 8;
+  frame.MsgID = 0x7e4;
+  uint8_t req[8] = { 0x03, 0x22, 0x83, 0x34, 0, 0, 0, 0 };
+  memcpy(frame.data.u8, req, 8);
+  t.a->Write(&frame);
+
+  std::vector<CAN_frame_t> rx;
+  HOST_CHECK_EQUAL(t.Collect(t.a, 2, &rx), 2);    // TX feedback, response
+  if (rx.size() == 2)
+    {
+    HOST_CHECK_EQUAL(rx[1].MsgID, 0x7ecu);
+    HOST_CHECK_EQUAL((int)rx[1].data.u8[0], 0x04);
+    HOST_CHECK_EQUAL((int)rx[1].data.u8[1], 0x62);
+    HOST_CHECK_EQUAL((int)rx[1].data.u8[2], 0x83);
+    HOST_CHECK_EQUAL((int)rx[1].data.u8[3], 0x34);
+    }
+  // …and the peer receives both:
+  HOST_CHECK_EQUAL(t.Collect(t.b, 2), 2);
+  t.b->DetachSimulator();
+  }
+
+HOST_TEST(vcan, replay)
+  {
+  HostVCanTest t;
+  FILE* f = fopen("/sd/xs_vcan.crtd", "w");
+  HOST_CHECK(f != NULL);
+  if (!f) return;
+  for (int k=0; k<10; k++)
+    fprintf(f, "%d.%06d 5R11 %x 01 02 03 04\n", 1, k * 1000, 0x700 + k);
+  fclose(f);
+
+  // the log bus needs to exist (like on the module), frames logged on it
+  // are transmitted on the target bus:
+  static vcan* logbus = new vcan("can5");
+  HOST_CHECK(MyCan.GetBus(4) == logbus);
+  canplay_vfs* player = new canplay_vfs("/sd/xs_vcan.crtd", "crtd", canformat::Transmit);
+  player->SetTarget(t.a);
+  player->SetSpeed(0);
+  HOST_CHECK(player->Open());
+  player->Start();
+  std::vector<CAN_frame_t> rx;
+  HOST_CHECK_EQUAL(t.Collect(t.b, 10, &rx), 10);
+  for (size_t k=0; k<rx.size(); k++)
+    HOST_CHECK_EQUAL(rx[k].MsgID, 0x700 + k);
+  HOST_CHECK_EQUAL(t.a->m_status.packets_tx, 10u);
+  delete player;
+  remove("/sd/xs_vcan.crtd");
+  }
+
+HOST_BENCH(vcan, roundtrip)
+  {
+  HostVCanTest t;
+  t.a->m_bitrate = 0;
+  CAN_frame_t frame = HostVCanTest::Frame(0x600, 0);
+  bench.ResetTimer();
+  for (int k=0; k<bench.n; k++)
+    {
+    t.a->Write(&frame, portMAX_DELAY);
+    t.Collect(t.b, 1);
+    }
+  }
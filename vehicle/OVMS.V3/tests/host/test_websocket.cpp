@@ -0,0 +1,272 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          14th March 2017
+;
+;    Changes:
+;    1.0  Initial release
+;
+;    (C) 2011       Michael Stegen / Stegen Electronics
+;    (C) 2011-2017  Mark Webb-Johnson
+;    (C) 2011        Sonny Chen @ EPRO/DX
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+// Host tests & benchmarks: websocket metrics encoding
+
+#include "ovms_log.h"
+static const char *TAG = "hostwebsocket";
+
+#include <string.h>
+#include "ovms_metrics.h"
+#include "metrics_standard.h"
+#include "ovms_websocketcodec.h"
+#include "hosttest.h"
+
+static std::string ws_frame(WebSocketMetricsEncoder& enc, std::initializer_list<OvmsMetric*> metrics)
+  {
+  enc.Begin();
+  for (OvmsMetric* m : metrics)
+    enc.Add(m);
+  return std::string(enc.Finish().c_str());
+  }
+
+// Encode an update of <count> metrics taking every <step>th, return frame size:
+static size_t ws_update(WebSocketMetricsEncoder& enc, int count, int step=1)
+  {
+  size_t size = 0;
+  OvmsMetric* m = MyMetrics.m_first;
+  enc.Begin();
+  for (int i = 0; i < count*step && m; i++, m = m->m_next)
+    if ((i % step) == 0)
+      enc.Add(m);
+  if (enc.Count())
+    size = enc.Finish().size();
+  return size;
+  }
+
+#define WS_CHUNK_SIZE 1024    // = XFER_CHUNK_SIZE (ovms_webserver.h)
+
+// Encode a full update through the filter, return total frame bytes:
+static size_t ws_full_update(WebSocketMetricsEncoder& enc, const WebSocketMetricsFilter& filter)
+  {
+  size_t size = 0;
+  enc.Begin();
+  for (OvmsMetric* m = MyMetrics.m_first; m; m = m->m_next)
+    {
+    if (!filter.Match(m->m_name))
+      continue;
+    enc.Add(m);
+    if (enc.Size() >= WS_CHUNK_SIZE)
+      {
+      size += enc.Finish().size();
+      enc.Begin();
+      }
+    }
+  if (enc.Count())
+    size += enc.Finish().size();
+  return size;
+  }
+
+// Metrics used by the web UI dashboard & BMS cell monitor pages:
+static const char* ws_dashboard[] = {
+  "v.b.consumption", "v.b.energy.recd", "v.b.energy.used", "v.b.power", "v.b.range.est",
+  "v.b.range.ideal", "v.b.soc", "v.b.temp", "v.b.voltage", "v.c.temp", "v.i.temp",
+  "v.m.temp", "v.p.speed" };
+static const char* ws_cellmon[] = { "v.b.c.*", "v.b.p.*" };
+
+static void ws_subscribe(WebSocketMetricsFilter& filter, const char* const* patterns, size_t count)
+  {
+  for (size_t i = 0; i < count; i++)
+    filter.Subscribe(patterns[i]);
+  }
+
+HOST_TEST(websocket, json)
+  {
+  OvmsMetricInt* a = MyMetrics.InitInt("xh.ws.a", 0, 42);
+  OvmsMetricString* b = MyMetrics.InitString("xh.ws.b", 0, "x\"y");
+  WebSocketMetricsEncoder enc;
+  HOST_CHECK_EQUAL(ws_frame(enc, { a, b }),
+    std::string("{\"metrics\":{\"xh.ws.a\":42,\"xh.ws.b\":\"x\\\"y\"}}"));
+  HOST_CHECK_EQUAL(enc.GetDictSize(), (size_t)0);
+  }
+
+HOST_TEST(websocket, compact)
+  {
+  OvmsMetricInt* a = MyMetrics.InitInt("xh.ws.a", 0, 42);
+  OvmsMetricString* b = MyMetrics.InitString("xh.ws.b", 0, "x\"y");
+  OvmsMetricBool* c = MyMetrics.InitBool("xh.ws.c", 0, true);
+  WebSocketMetricsEncoder enc;
+  enc.SetCompact(true);
+
+  // new metrics are introduced by the dictionary part:
+  HOST_CHECK_EQUAL(ws_frame(enc, { a, b }),
+    std::string("{\"mdict\":[0,\"xh.ws.a\",\"xh.ws.b\"],\"mu\":[0,42,1,\"x\\\"y\"]}"));
+  // known metrics are sent by id only:
+  a->SetValue(7);
+  HOST_CHECK_EQUAL(ws_frame(enc, { b, a }), std::string("{\"mu\":[1,\"x\\\"y\",0,7]}"));
+  // dictionary extension starts at the next id:
+  HOST_CHECK_EQUAL(ws_frame(enc, { a, c }),
+    std::string("{\"mdict\":[2,\"xh.ws.c\"],\"mu\":[0,7,2,true]}"));
+  HOST_CHECK_EQUAL(enc.GetDictSize(), (size_t)3);
+
+  // switching the mode resets the dictionary:
+  enc.SetCompact(false);
+  enc.SetCompact(true);
+  HOST_CHECK_EQUAL(ws_frame(enc, { c }), std::string("{\"mdict\":[0,\"xh.ws.c\"],\"mu\":[0,true]}"));
+  }
+
+HOST_TEST(websocket, reduction)
+  {
+  // typical update of 20 metrics after the dictionary has been sent:
+  WebSocketMetricsEncoder json, compact;
+  compact.SetCompact(true);
+  ws_update(compact, 100);
+  size_t json_size = ws_update(json, 20);
+  size_t compact_size = ws_update(compact, 20);
+  HOST_CHECK(compact_size > 0);
+  HOST_CHECK(compact_size * 2 < json_size);
+  }
+
+HOST_BENCH(websocket, update_json)
+  {
+  WebSocketMetricsEncoder enc;
+  bench.SetBytes(ws_update(enc, 20));
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(ws_update(enc, 20));
+  }
+
+HOST_BENCH(websocket, update_compact)
+  {
+  WebSocketMetricsEncoder enc;
+  enc.SetCompact(true);
+  ws_update(enc, 100);
+  bench.SetBytes(ws_update(enc, 20));
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(ws_update(enc, 20));
+  }
+
+HOST_BENCH(websocket, update_compact_sparse)
+  {
+  // every 5th metric: no id sequence hits, dictionary lookup per metric
+  WebSocketMetricsEncoder enc;
+  enc.SetCompact(true);
+  ws_update(enc, 100);
+  bench.SetBytes(ws_update(enc, 20, 5));
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(ws_update(enc, 20, 5));
+  }
+
+HOST_TEST(websocket, filter)
+  {
+  WebSocketMetricsFilter f;
+  HOST_CHECK(f.IsAll());
+  HOST_CHECK(f.Match("v.b.soc"));
+
+  // first subscription switches to the match set:
+  HOST_CHECK(f.Subscribe("v.b.c.*"));
+  HOST_CHECK(!f.IsAll());
+  HOST_CHECK(f.Match("v.b.c.voltage"));
+  HOST_CHECK(!f.Match("v.b.soc"));
+  HOST_CHECK(f.Subscribe("v.b.soc"));
+  HOST_CHECK(f.Subscribe("v.p.speed"));
+  HOST_CHECK(f.Match("v.b.soc"));
+  HOST_CHECK(!f.Match("v.b.soc.x"));
+  HOST_CHECK(!f.Match("v.b.s"));
+  HOST_CHECK(!f.Match("v.b.c"));
+  HOST_CHECK(!f.Match("a"));
+  HOST_CHECK(!f.Match("z"));
+
+  // covered patterns are dropped / not added:
+  HOST_CHECK(!f.Subscribe("v.b.c.temp"));
+  HOST_CHECK_EQUAL(f.Size(), (size_t)3);
+  HOST_CHECK(f.Subscribe("v.b.*"));
+  HOST_CHECK_EQUAL(f.Size(), (size_t)2);
+  HOST_CHECK(f.Match("v.b.c.temp") && f.Match("v.b.power") && f.Match("v.p.speed"));
+
+  // unsubscribe removes covered patterns:
+  HOST_CHECK(!f.Unsubscribe("v.b.soc"));
+  HOST_CHECK(f.Unsubscribe("v.*"));
+  HOST_CHECK_EQUAL(f.Size(), (size_t)0);
+  HOST_CHECK(!f.IsAll());
+  HOST_CHECK(!f.Match("v.b.soc"));
+
+  // back to all, exclusions from all are not supported:
+  HOST_CHECK(f.Subscribe("*"));
+  HOST_CHECK(f.IsAll());
+  HOST_CHECK(!f.Unsubscribe("v.b.soc"));
+  HOST_CHECK(f.Unsubscribe("*"));
+  HOST_CHECK(!f.Match("v.b.soc"));
+  }
+
+HOST_TEST(websocket, subscriptions)
+  {
+  // full update bytes per client, all metrics vs. page subscriptions:
+  WebSocketMetricsFilter all, dashboard, cellmon;
+  ws_subscribe(dashboard, ws_dashboard, sizeof(ws_dashboard)/sizeof(ws_dashboard[0]));
+  ws_subscribe(cellmon, ws_cellmon, sizeof(ws_cellmon)/sizeof(ws_cellmon[0]));
+  for (int i = 0; i < 96; i++)
+    StandardMetrics.ms_v_bat_cell_voltage->SetElemValue(i, 3.9f + 0.001f * i);
+
+  for (bool compact : { false, true })
+    {
+    WebSocketMetricsEncoder e1, e2, e3;
+    e1.SetCompact(compact); e2.SetCompact(compact); e3.SetCompact(compact);
+    size_t b_all = ws_full_update(e1, all);
+    size_t b_dashboard = ws_full_update(e2, dashboard);
+    size_t b_cellmon = ws_full_update(e3, cellmon);
+    ESP_LOGI(TAG, "%s full update: all %u bytes, dashboard %u bytes, cellmon %u bytes",
+      compact ? "compact" : "JSON", (unsigned)b_all, (unsigned)b_dashboard, (unsigned)b_cellmon);
+    HOST_CHECK(b_dashboard > 0 && b_dashboard * 10 < b_all);
+    HOST_CHECK(b_cellmon > 0 && b_cellmon < b_all);
+    }
+  }
+
+static void ws_bench_update(HostBench& bench, WebSocketMetricsFilter& filter)
+  {
+  WebSocketMetricsEncoder enc;
+  enc.SetCompact(true);
+  ws_full_update(enc, filter);
+  bench.SetBytes(ws_full_update(enc, filter));
+  bench.ResetTimer();
+  for (uint64_t i = 0; i < bench.n; i++)
+    HostBenchKeep(ws_full_update(enc, filter));
+  }
+
+HOST_BENCH(websocket, full_all)
+  {
+  WebSocketMetricsFilter filter;
+  ws_bench_update(bench, filter);
+  }
+
+HOST_BENCH(websocket, full_dashboard)
+  {
+  WebSocketMetricsFilter filter;
+  ws_subscribe(filter, ws_dashboard, sizeof(ws_dashboard)/sizeof(ws_dashboard[0]));
+  ws_bench_update(bench, filter);
+  }
+
+HOST_BENCH(websocket, full_cellmon)
+  {
+  WebSocketMetricsFilter filter;
+  ws_subscribe(filter, ws_cellmon, sizeof(ws_cellmon)/sizeof(ws_cellmon[0]));
+  ws_bench_update(bench, filter);
+  }
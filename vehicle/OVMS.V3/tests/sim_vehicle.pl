@@ -0,0 +1,171 @@
+#!/usr/bin/perl
+#
+# Vehicle ECU simulator: answers OBD-II / UDS poll requests of an OVMS
+# module over a crtd CAN log/simulation connection, using the ECU
+# scenarios in tests/sim/*.sim (see components/can/src/cansim.h for the
+# scenario format; "trace" directives are not supported here).
+#
+# Usage: sim_vehicle.pl <scenario> [<host> [<port>]]
+#   e.g. sim_vehicle.pl sim/voltampera.sim devbench.local 3000
+#
+# On the module, start a tcpserver in crtd simulation mode, e.g.
+#   can log start tcpserver simulate crtd :3000
+#
+
+use strict;
+use IPC::Open2;
+use Time::HiRes qw(time sleep);
+
+my $scenario = shift @ARGV or die "Usage: $0 <scenario> [<host> [<port>]]\n";
+my $vehicle = shift @ARGV || 'devbench.local';
+my $port = shift @ARGV || 3000;
+
+# Load scenario:
+my (%ecu, $cur, $cycle, $separation);
+$separation = 0.001;
+open my $fh, '<', $scenario or die "Cannot open $scenario: $!\n";
+while (<$fh>)
+  {
+  s/#.*//;
+  my @t = split;
+  next unless @t;
+  my $cmd = shift @t;
+  if ($cmd eq 'ecu')
+    {
+    $cur = { txid => hex($t[0]), rxid => hex($t[1]), pids => {} };
+    $ecu{hex($t[0])} = $cur;
+    }
+  elsif ($cmd eq 'pid')
+    {
+    die "$scenario:$.: pid without ecu\n" unless $cur;
+    my ($type, $pid) = (hex(shift @t), hex(shift @t));
+    my ($size, $pattern) = (0, '');
+    while (@t)
+      {
+      my $a = shift @t;
+      if ($a eq 'poll') { shift @t; }
+      elsif ($a eq 'size') { $size = shift @t; }
+      else { $pattern .= pack('H*', $a); }
+      }
+    $size = length($pattern) unless $size;
+    $pattern = "\0" if ($pattern eq '');
+    my $data = substr($pattern x (int($size / length($pattern)) + 1), 0, $size);
+    $cur->{pids}{"$type:$pid"} = { data => $data, ramps => [], sets => [] };
+    }
+  elsif ($cmd eq 'ramp')
+    {
+    my $p = $cur->{pids}{hex($t[0]).':'.hex($t[1])} or die "$scenario:$.: unknown pid\n";
+    push @{$p->{ramps}}, [ @t[2..7] ];
+    }
+  elsif ($cmd eq 'set')
+    {
+    my $p = $cur->{pids}{hex($t[1]).':'.hex($t[2])} or die "$scenario:$.: unknown pid\n";
+    push @{$p->{sets}}, [ $t[0], $t[3], pack('H*', join('', @t[4..$#t])) ];
+    }
+  elsif ($cmd eq 'cycle') { $cycle = $t[0]; }
+  elsif ($cmd eq 'separation') { $separation = $t[0] / 1000; }
+  elsif ($cmd eq 'latency' || $cmd eq 'trace') { }
+  else { die "$scenario:$.: invalid directive '$cmd'\n"; }
+  }
+close $fh;
+
+my $start = time;
+
+sub payload
+  {
+  my ($p) = @_;
+  my $t = time - $start;
+  $t = $t - $cycle * int($t / $cycle) if ($cycle);
+  my $data = $p->{data};
+  foreach my $s (sort { $a->[0] <=> $b->[0] } @{$p->{sets}})
+    {
+    substr($data, $s->[1], length($s->[2])) = $s->[2] if ($s->[0] <= $t);
+    }
+  foreach my $r (@{$p->{ramps}})
+    {
+    my ($offset, $bytes, $from, $to, $t0, $t1) = @$r;
+    my $v = ($t <= $t0) ? $from : ($t >= $t1) ? $to : int($from + ($to - $from) * ($t - $t0) / ($t1 - $t0));
+    for (my $k = 0; $k < $bytes; $k++)
+      {
+      substr($data, $offset + $k, 1) = chr(($v >> (8 * ($bytes - 1 - $k))) & 0xff);
+      }
+    }
+  return $data;
+  }
+
+my($chld_out, $chld_in);
+my $pid = open2($chld_out, $chld_in, "nc $vehicle $port");
+
+select $chld_in; $| = 1;
+select STDOUT; $| = 1;
+
+sub send_frame
+  {
+  my ($id, @bytes) = @_;
+  push @bytes, 0 while (@bytes < 8);
+  my $frame = sprintf("0.0 1R11 %03x %s", $id, join(' ', map { sprintf("%02x", $_) } @bytes));
+  print "  < $frame\n";
+  print $chld_in $frame, "\n";
+  }
+
+print "Simulation of $scenario running with pid #$pid\n";
+while (<$chld_out>)
+  {
+  chop;
+  print "$_\n";
+  next unless (/^\d+\.\d+ .[RT]11 (\S+)\s*(.*)/);
+  my $id = hex($1);
+  my @b = map { hex($_) } split(/ /, $2);
+  my @ecus = ($id == 0x7df)
+    ? grep { $_->{rxid} >= 0x7e8 && $_->{rxid} <= 0x7ef } values %ecu
+    : grep { defined $_ } ($ecu{$id});
+  foreach my $e (@ecus)
+    {
+    if (($b[0] >> 4) == 3)
+      {
+      # Flow control: send the remaining consecutive frames
+      next unless defined $e->{tx};
+      my $stmin = ($b[2] <= 0x7f) ? $b[2] / 1000 : 0;
+      $stmin = $separation if ($stmin < $separation);
+      my $seq = 1;
+      my $tx = $e->{tx};
+      delete $e->{tx};
+      while (length($tx) > 0)
+        {
+        sleep($stmin);
+        send_frame($e->{rxid}, 0x20 | ($seq++ & 0x0f), unpack('C*', substr($tx, 0, 7, '')));
+        }
+      }
+    elsif (($b[0] >> 4) == 0)
+      {
+      # Request: type + 8 bit PID, type 0x22 with 16 bit PID
+      my $type = $b[1];
+      my $pid = ($type == 0x22) ? ($b[2] << 8) + $b[3] : $b[2];
+      my $p = $e->{pids}{"$type:$pid"};
+      my $resp;
+      if ($p)
+        {
+        $resp = chr(0x40 + $type) . (($type == 0x22) ? pack('n', $pid) : chr($pid)) . payload($p);
+        }
+      elsif ($id != 0x7df)
+        {
+        $resp = pack('C*', 0x7f, $type, 0x31);
+        }
+      else
+        {
+        next;
+        }
+      printf "Request %03x %02x/%x, response %d bytes\n", $id, $type, $pid, length($resp);
+      if (length($resp) <= 7)
+        {
+        send_frame($e->{rxid}, length($resp), unpack('C*', $resp));
+        }
+      else
+        {
+        my $len = length($resp);
+        send_frame($e->{rxid}, 0x10 | ($len >> 8), $len & 0xff, unpack('C*', substr($resp, 0, 6, '')));
+        $e->{tx} = $resp;
+        }
+      }
+    }
+  }